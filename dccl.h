@@ -26,6 +26,7 @@
 #define DCCL3COURTESY20091211H
 
 #include "dccl/codec.h"
+#include "dccl/stream_decoder.h"
 
 /// \defgroup dccl_api API class for using the DCCL Codec
 /// \defgroup dccl_field_api API classes for defining new custom field encoders/decoders
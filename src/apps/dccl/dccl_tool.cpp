@@ -37,6 +37,7 @@
 #include <boost/algorithm/string.hpp>
 
 #include "dccl/codec.h"
+#include "dccl/stream_decoder.h"
 #include "dccl/cli_option.h"
 #include "dccl/binary.h"
 
@@ -47,8 +48,11 @@
 #include <limits.h>
 #include <stdlib.h>
 
+// for read
+#include <unistd.h>
 
-enum Action { NO_ACTION, ENCODE, DECODE, ANALYZE, DISP_PROTO };
+
+enum Action { NO_ACTION, ENCODE, DECODE, ANALYZE, DISP_PROTO, TRACE_DUMP };
 enum Format { BINARY, TEXTFORMAT, HEX, BASE64 };
 
 namespace dccl
@@ -63,7 +67,8 @@ namespace dccl
                   format(BINARY),
                   id_codec(dccl::Codec::default_id_codec_name()),
                   verbose(false),
-                  omit_prefix(false)
+                  omit_prefix(false),
+                  stats(false)
                 { }
     
             Action action;
@@ -75,6 +80,12 @@ namespace dccl
             std::string id_codec;
             bool verbose;
             bool omit_prefix;
+            // --trace: binary trace to write after encoding or decoding
+            std::string trace_file;
+            // --trace-dump: binary trace to display
+            std::string trace_dump_file;
+            // --stats: display Codec::stats() after encoding or decoding
+            bool stats;
         };
     }
 }
@@ -84,6 +95,7 @@ void analyze(dccl::Codec& dccl, const dccl::tool::Config& cfg);
 void encode(dccl::Codec& dccl, dccl::tool::Config& cfg);
 void decode(dccl::Codec& dccl, const dccl::tool::Config& cfg);
 void disp_proto(dccl::Codec& dccl, const dccl::tool::Config& cfg);
+void trace_dump(dccl::Codec& dccl, const dccl::tool::Config& cfg);
 
         
 void load_desc(dccl::Codec* dccl,  const google::protobuf::Descriptor* desc, const std::string& name);
@@ -158,17 +170,40 @@ int main(int argc, char* argv[])
             load_desc(&dccl, desc, *it);
         }
 
+        if(!cfg.trace_file.empty())
+            dccl.enable_trace(1 << 16);
+        
         switch(cfg.action)
         {
             case ENCODE: encode(dccl, cfg); break;
             case DECODE: decode(dccl, cfg); break;
             case ANALYZE: analyze(dccl, cfg); break;
             case DISP_PROTO: disp_proto(dccl, cfg); break;
+            case TRACE_DUMP: trace_dump(dccl, cfg); break;
             default:
                 std::cerr << "No action specified (e.g. analyze, decode, encode). Try --help." << std::endl;
                 exit(EXIT_SUCCESS);
         
         }
+
+        if(!cfg.trace_file.empty())
+        {
+            std::ofstream fout(cfg.trace_file.c_str(), std::ios::binary);
+            if(!fout.is_open())
+            {
+                std::cerr << "Failed to open trace file: " << cfg.trace_file << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            dccl.trace()->write(&fout);
+        }
+
+        // STDOUT holds the encoded or decoded messages
+        if(cfg.stats)
+        {
+            std::map<dccl::int32, dccl::MessageStats> stats = dccl.stats();
+            for(std::map<dccl::int32, dccl::MessageStats>::const_iterator it = stats.begin(), end = stats.end(); it != end; ++it)
+                std::cerr << "[" << it->first << "] " << it->second;
+        }
     }    
 }
 
@@ -297,15 +332,32 @@ void encode(dccl::Codec& dccl, dccl::tool::Config& cfg)
     }    
 }
 
+void print_decoded(dccl::StreamDecoder& decoder, const dccl::tool::Config& cfg)
+{
+    while(!decoder.empty())
+    {
+        boost::shared_ptr<google::protobuf::Message> msg = decoder.pop();
+        if(!cfg.omit_prefix)
+            std::cout << "|" << msg->GetDescriptor()->full_name() << "| ";
+        std::cout << msg->ShortDebugString() << std::endl;
+    }
+}
+
 void decode(dccl::Codec& dccl, const dccl::tool::Config& cfg)
 {
-    std::string input;
+    // decode messages as they arrive, rather than waiting for all of STDIN
+    // messages are released after printing, so reuse them
+    dccl::MessagePool pool;
+    dccl::StreamDecoder decoder(&dccl, &pool);
     if(cfg.format == BINARY)
     {
-        std::ifstream fin("/dev/stdin", std::ios::binary);
-        std::ostringstream ostrm;
-        ostrm << fin.rdbuf();
-        input = ostrm.str();
+        char buf[1024];
+        ssize_t n;
+        while((n = read(STDIN_FILENO, buf, sizeof(buf))) > 0)
+        {
+            decoder.push(buf, n);
+            print_decoded(decoder, cfg);
+        }
     }
     else
     {
@@ -327,14 +379,13 @@ void decode(dccl::Codec& dccl, const dccl::tool::Config& cfg)
                 {
                     boost::trim_if(line, boost::is_any_of("\""));
                     
-                    
                     dccl::tool::protobuf::ByteString s;
                     google::protobuf::TextFormat::ParseFieldValueFromString("\"" + line + "\"", s.GetDescriptor()->FindFieldByNumber(1), &s);
-                    input += s.b();
+                    decoder.push(s.b());
                     break;
                 }
                 case HEX:
-                    input += dccl::hex_decode(line);
+                    decoder.push(dccl::hex_decode(line));
                     break;
                 case BASE64:
 #if DCCL_HAS_B64
@@ -342,23 +393,19 @@ void decode(dccl::Codec& dccl, const dccl::tool::Config& cfg)
                     std::stringstream outstream;
                     ::base64::decoder D;
                     D.decode(instream, outstream);
-                    input += outstream.str();
+                    decoder.push(outstream.str());
                     break;
 #else
                     std::cerr << "dccl was not compiled with libb64-dev, so no Base64 functionality is available." << std::endl;
                     exit(EXIT_FAILURE);
 #endif
             }
+            print_decoded(decoder, cfg);
         }
     }
 
-    while(!input.empty())
-    {
-        boost::shared_ptr<google::protobuf::Message> msg = dccl.decode<boost::shared_ptr<google::protobuf::Message> >(&input);
-        if(!cfg.omit_prefix)
-            std::cout << "|" << msg->GetDescriptor()->full_name() << "| ";
-        std::cout << msg->ShortDebugString() << std::endl;
-    }
+    decoder.flush();
+    print_decoded(decoder, cfg);
 }
 
 void disp_proto(dccl::Codec& dccl, const dccl::tool::Config& cfg)
@@ -375,6 +422,24 @@ void disp_proto(dccl::Codec& dccl, const dccl::tool::Config& cfg)
     }
 }
 
+void trace_dump(dccl::Codec& dccl, const dccl::tool::Config& cfg)
+{
+    std::ifstream fin(cfg.trace_dump_file.c_str(), std::ios::binary);
+    if(!fin.is_open())
+    {
+        std::cerr << "Failed to open trace file: " << cfg.trace_dump_file << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    dccl::TraceBuffer trace(1);
+    try { trace.read(&fin); }
+    catch(std::exception& e)
+    {
+        std::cerr << "Failed to read trace file: " << cfg.trace_dump_file << "\nWhy: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    dccl.trace_dump(trace, &std::cout);
+}
 
 void load_desc(dccl::Codec* dccl,  const google::protobuf::Descriptor* desc, const std::string& name)
 {
@@ -410,6 +475,9 @@ void parse_options(int argc, char* argv[], dccl::tool::Config* cfg)
     options.push_back(dccl::Option('o', "omit_prefix", no_argument, "Omit the DCCL type name prefix from the output of decode."));
     options.push_back(dccl::Option('i', "id_codec", required_argument, "(Advanced) name for a nonstandard DCCL ID codec to use"));
     options.push_back(dccl::Option('V', "version", no_argument, "DCCL Version"));
+    options.push_back(dccl::Option(0, "trace", required_argument, "Write a binary trace of the fields encoded or decoded (with --encode or --decode) to this file. Display it with --trace-dump."));
+    options.push_back(dccl::Option(0, "stats", no_argument, "After encoding or decoding (e.g. replaying a stream with --decode), display the number of messages, bytes, padding bits, failures and latencies for each DCCL type to STDERR."));
+    options.push_back(dccl::Option(0, "trace-dump", required_argument, "Display the binary trace in this file (written by --trace or dccl::TraceBuffer::write). Load the traced messages (e.g. with -f) to see the field names."));
     
     std::vector<option> long_options; 
     std::string opt_string;
@@ -445,6 +513,19 @@ void parse_options(int argc, char* argv[], dccl::tool::Config* cfg)
                         exit(EXIT_FAILURE);
                     }
                 }
+                else if(!strcmp(long_options[option_index].name, "trace"))
+                {
+                    cfg->trace_file = optarg;
+                }
+                else if(!strcmp(long_options[option_index].name, "stats"))
+                {
+                    cfg->stats = true;
+                }
+                else if(!strcmp(long_options[option_index].name, "trace-dump"))
+                {
+                    cfg->action = TRACE_DUMP;
+                    cfg->trace_dump_file = optarg;
+                }
                 else
                 {
                     std::cerr << "Try --help for valid options." << std::endl;
@@ -0,0 +1,580 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// Trains arithmetic coder models (dccl.arith.protobuf.ArithmeticModel) from a corpus of messages
+
+#include <fstream>
+#include <cmath>
+#include <numeric>
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/text_format.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include "dccl/codec.h"
+#include "dccl/stream_decoder.h"
+#include "dccl/cli_option.h"
+#include "dccl/binary.h"
+#include "dccl/arithmetic/field_codec_arithmetic.h"
+
+// for realpath
+#include <limits.h>
+#include <stdlib.h>
+
+// for read
+#include <unistd.h>
+
+enum Format { BINARY, TEXTFORMAT, HEX };
+
+namespace dccl
+{
+    namespace tool
+    {
+        struct TrainConfig
+        {
+            TrainConfig()
+                : format(TEXTFORMAT),
+                  max_symbols(256),
+                  out_of_range_frequency(0),
+                  verbose(false)
+                { }
+            
+            std::set<std::string> include;
+            std::set<std::string> message;
+            std::set<std::string> proto_file;
+            std::vector<std::string> model_file;
+            Format format;
+            int max_symbols;
+            unsigned out_of_range_frequency;
+            bool verbose;
+        };
+
+        /// \brief What the training corpus holds for the fields that use one model
+        struct Histogram
+        {
+            Histogram() : eof(0), needs_eof(false) { }
+            
+            std::map<double, dccl::uint64> values;
+            // number of fields shorter than max_repeat, each of which codes an EOF
+            dccl::uint64 eof;
+            // some field using this model is repeated or optional, so it may code an EOF
+            bool needs_eof;
+            std::set<std::string> fields;
+        };
+    }
+}
+
+void parse_options(int argc, char* argv[], dccl::tool::TrainConfig* cfg);
+void read_corpus(dccl::Codec& codec, const dccl::tool::TrainConfig& cfg,
+                 std::map<std::string, dccl::tool::Histogram>* histograms,
+                 std::set<const google::protobuf::Descriptor*>* descriptors);
+void add_message(const google::protobuf::Message& msg,
+                 std::map<std::string, dccl::tool::Histogram>* histograms);
+dccl::arith::protobuf::ArithmeticModel make_model(const std::string& name,
+                                                  const dccl::tool::Histogram& histogram,
+                                                  const dccl::tool::TrainConfig& cfg,
+                                                  double floor_fraction);
+std::string fit(const std::map<std::string, dccl::tool::Histogram>& histograms,
+                const std::set<const google::protobuf::Descriptor*>& descriptors,
+                const dccl::tool::TrainConfig& cfg,
+                double floor_fraction,
+                std::map<std::string, dccl::arith::protobuf::ArithmeticModel>* models);
+double expected_bits(const dccl::arith::protobuf::ArithmeticModel& model,
+                     const dccl::tool::Histogram& histogram);
+
+
+int main(int argc, char* argv[])
+{
+    dccl::tool::TrainConfig cfg;
+    parse_options(argc, argv, &cfg);
+
+    dccl::dlog.connect(cfg.verbose ? dccl::logger::DEBUG1_PLUS : dccl::logger::WARN_PLUS, &std::cerr);
+    
+    dccl::DynamicProtobufManager::enable_compilation();
+    for(std::set<std::string>::const_iterator it = cfg.include.begin(),
+            end = cfg.include.end(); it != end; ++it)
+        dccl::DynamicProtobufManager::add_include_path(*it);
+
+    // the models the corpus was encoded with (needed to decode it)
+    for(std::vector<std::string>::const_iterator it = cfg.model_file.begin(),
+            end = cfg.model_file.end(); it != end; ++it)
+    {
+        std::ifstream fin(it->c_str());
+        std::string text((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+        dccl::arith::protobuf::ArithmeticModel model;
+        if(!fin.is_open() || !google::protobuf::TextFormat::ParseFromString(text, &model))
+        {
+            std::cerr << "Failed to read model from: " << *it << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        dccl::arith::ModelManager::set_model(model);
+    }
+    
+    dccl::Codec codec;
+    dccl_arithmetic_load(&codec);
+
+    bool no_messages_specified = cfg.message.empty();
+    for(std::set<std::string>::const_iterator it = cfg.proto_file.begin(),
+            end = cfg.proto_file.end(); it != end; ++it)
+    {
+        const google::protobuf::FileDescriptor* file_desc =
+            dccl::DynamicProtobufManager::load_from_proto_file(*it);
+        if(!file_desc)
+        {
+            std::cerr << "failed to read in: " << *it << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if(no_messages_specified)
+        {
+            for(int i = 0, n = file_desc->message_type_count(); i < n; ++i)
+                cfg.message.insert(file_desc->message_type(i)->full_name());
+        }
+    }
+
+    std::map<std::string, dccl::tool::Histogram> histograms;
+    std::set<const google::protobuf::Descriptor*> descriptors;
+    read_corpus(codec, cfg, &histograms, &descriptors);
+    
+    if(histograms.empty())
+    {
+        std::cerr << "No arithmetic coded fields found in the input." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // the frequencies of the corpus minimize the expected size. If that makes a message's
+    // maximum size larger than its max_bytes, raise the frequency of the rarest symbols to
+    // the smallest fraction of the total that fits
+    std::map<std::string, dccl::arith::protobuf::ArithmeticModel> models;
+    if(!fit(histograms, descriptors, cfg, 0, &models).empty())
+    {
+        std::string why = fit(histograms, descriptors, cfg, 1, &models);
+        if(!why.empty())
+        {
+            std::cerr << "No model fits the messages: " << why << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        
+        double low = 0, high = 1;
+        for(int i = 0; i < 30; ++i)
+        {
+            double mid = (low + high) / 2;
+            if(fit(histograms, descriptors, cfg, mid, &models).empty())
+                high = mid;
+            else
+                low = mid;
+        }
+        fit(histograms, descriptors, cfg, high, &models);
+    }
+
+    for(std::map<std::string, dccl::arith::protobuf::ArithmeticModel>::const_iterator it = models.begin(),
+            end = models.end(); it != end; ++it)
+    {
+        const dccl::tool::Histogram& histogram = histograms[it->first];
+        dccl::uint64 values = 0;
+        for(std::map<double, dccl::uint64>::const_iterator v_it = histogram.values.begin(),
+                v_end = histogram.values.end(); v_it != v_end; ++v_it)
+            values += v_it->second;
+
+        std::string text;
+        google::protobuf::TextFormat::PrintToString(it->second, &text);
+        std::cout << "# " << it->first << ": " << values << " values from " << boost::algorithm::join(histogram.fields, ", ")
+                  << "; " << it->second.frequency_size() << " symbols, " << expected_bits(it->second, histogram) / (values + histogram.eof) << " bits/symbol expected\n"
+                  << text << std::endl;
+    }
+}
+
+void read_corpus(dccl::Codec& codec, const dccl::tool::TrainConfig& cfg,
+                 std::map<std::string, dccl::tool::Histogram>* histograms,
+                 std::set<const google::protobuf::Descriptor*>* descriptors)
+{
+    if(cfg.format == TEXTFORMAT)
+    {
+        // as the input of 'dccl --encode': "|Name| field: value ...", or just the fields if there is one message (-m)
+        std::string default_name = (cfg.message.size() == 1) ? *cfg.message.begin() : "";
+        while(!std::cin.eof())
+        {
+            std::string input;
+            std::getline(std::cin, input);
+            boost::trim(input);
+            if(input.empty() || input[0] == '#')
+                continue;
+            
+            std::string name = default_name;
+            if(input[0] == '|')
+            {
+                std::string::size_type close_bracket_pos = input.find('|', 1);
+                if(close_bracket_pos == std::string::npos)
+                {
+                    std::cerr << "Incorrectly formatted input: expected '|'" << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                name = input.substr(1, close_bracket_pos - 1);
+                input.erase(0, close_bracket_pos + 1);
+            }
+
+            const google::protobuf::Descriptor* desc = dccl::DynamicProtobufManager::find_descriptor(name);
+            if(desc == 0)
+            {
+                std::cerr << "No descriptor with name \"" << name << "\" found! Give the message with -m or as '|Name| field: value' in the input." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            
+            boost::shared_ptr<google::protobuf::Message> msg = dccl::DynamicProtobufManager::new_protobuf_message(desc);
+            if(!google::protobuf::TextFormat::ParseFromString(input, msg.get()))
+            {
+                std::cerr << "Failed to parse: " << input << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            add_message(*msg, histograms);
+            descriptors->insert(desc);
+        }
+    }
+    else
+    {
+        for(std::set<std::string>::const_iterator it = cfg.message.begin(),
+                end = cfg.message.end(); it != end; ++it)
+        {
+            const google::protobuf::Descriptor* desc = dccl::DynamicProtobufManager::find_descriptor(*it);
+            if(!desc)
+            {
+                std::cerr << "No descriptor with name " << *it << " found!" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            try { codec.load(desc); }
+            catch(std::exception& e)
+            {
+                std::cerr << "Not a valid DCCL message: " << desc->full_name() << "\nWhy: " << e.what() << "\n(Give the models the messages were encoded with using --model.)" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        
+        dccl::StreamDecoder decoder(&codec);
+        if(cfg.format == BINARY)
+        {
+            char buf[1024];
+            ssize_t n;
+            while((n = read(STDIN_FILENO, buf, sizeof(buf))) > 0)
+                decoder.push(buf, n);
+        }
+        else
+        {
+            while(!std::cin.eof())
+            {
+                std::string line;
+                std::getline(std::cin, line);
+                boost::trim(line);
+                if(!line.empty())
+                    decoder.push(dccl::hex_decode(line));
+            }
+        }
+        decoder.flush();
+        
+        while(!decoder.empty())
+        {
+            boost::shared_ptr<google::protobuf::Message> msg = decoder.pop();
+            add_message(*msg, histograms);
+            descriptors->insert(msg->GetDescriptor());
+        }
+    }
+}
+
+void add_message(const google::protobuf::Message& msg,
+                 std::map<std::string, dccl::tool::Histogram>* histograms)
+{
+    using google::protobuf::FieldDescriptor;
+    const google::protobuf::Descriptor* desc = msg.GetDescriptor();
+    const google::protobuf::Reflection* refl = msg.GetReflection();
+    
+    for(int i = 0, n = desc->field_count(); i < n; ++i)
+    {
+        const FieldDescriptor* field = desc->field(i);
+        const dccl::DCCLFieldOptions& options = field->options().GetExtension(dccl::field);
+
+        if(field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE)
+        {
+            if(field->is_repeated())
+            {
+                for(int j = 0, m = refl->FieldSize(msg, field); j < m; ++j)
+                    add_message(refl->GetRepeatedMessage(msg, field, j), histograms);
+            }
+            else if(refl->HasField(msg, field))
+            {
+                add_message(refl->GetMessage(msg, field), histograms);
+            }
+            continue;
+        }
+        
+        if(!options.HasExtension(::arithmetic) ||
+           (options.codec() != "_arithmetic" && options.codec() != "dccl.arithmetic" && options.codec() != "dccl.rans"))
+            continue;
+
+        dccl::tool::Histogram& histogram = (*histograms)[options.GetExtension(::arithmetic).model()];
+        histogram.fields.insert(field->full_name());
+        if(!field->is_required())
+            histogram.needs_eof = true;
+        
+        int size = field->is_repeated() ? refl->FieldSize(msg, field) : refl->HasField(msg, field);
+        int max_repeat = field->is_repeated() ? options.max_repeat() : 1;
+        if(size < max_repeat)
+            ++histogram.eof;
+        
+        for(int j = 0; j < size; ++j)
+        {
+            double value = 0;
+            switch(field->cpp_type())
+            {
+                case FieldDescriptor::CPPTYPE_INT32: value = field->is_repeated() ? refl->GetRepeatedInt32(msg, field, j) : refl->GetInt32(msg, field); break;
+                case FieldDescriptor::CPPTYPE_INT64: value = field->is_repeated() ? refl->GetRepeatedInt64(msg, field, j) : refl->GetInt64(msg, field); break;
+                case FieldDescriptor::CPPTYPE_UINT32: value = field->is_repeated() ? refl->GetRepeatedUInt32(msg, field, j) : refl->GetUInt32(msg, field); break;
+                case FieldDescriptor::CPPTYPE_UINT64: value = field->is_repeated() ? refl->GetRepeatedUInt64(msg, field, j) : refl->GetUInt64(msg, field); break;
+                case FieldDescriptor::CPPTYPE_DOUBLE: value = field->is_repeated() ? refl->GetRepeatedDouble(msg, field, j) : refl->GetDouble(msg, field); break;
+                case FieldDescriptor::CPPTYPE_FLOAT: value = field->is_repeated() ? refl->GetRepeatedFloat(msg, field, j) : refl->GetFloat(msg, field); break;
+                case FieldDescriptor::CPPTYPE_BOOL: value = field->is_repeated() ? refl->GetRepeatedBool(msg, field, j) : refl->GetBool(msg, field); break;
+                case FieldDescriptor::CPPTYPE_ENUM: value = (field->is_repeated() ? refl->GetRepeatedEnum(msg, field, j) : refl->GetEnum(msg, field))->number(); break;
+                default: continue;
+            }
+            ++histogram.values[value];
+        }
+    }
+}
+
+dccl::arith::protobuf::ArithmeticModel make_model(const std::string& name,
+                                                  const dccl::tool::Histogram& histogram,
+                                                  const dccl::tool::TrainConfig& cfg,
+                                                  double floor_fraction)
+{
+    // value_bound(i) is the value that symbol i decodes to, so each distinct value gets its own
+    // symbol if there are few enough. Otherwise the range is split into max_symbols equal widths,
+    // each decoding to the smallest value seen within it.
+    std::vector<double> bounds;
+    std::vector<dccl::uint64> counts;
+    double width = 0;
+    const double low = histogram.values.begin()->first, high = histogram.values.rbegin()->first;
+    if(static_cast<int>(histogram.values.size()) <= cfg.max_symbols)
+    {
+        for(std::map<double, dccl::uint64>::const_iterator it = histogram.values.begin(),
+                end = histogram.values.end(); it != end; ++it)
+        {
+            if(!bounds.empty() && (width == 0 || it->first - bounds.back() < width))
+                width = it->first - bounds.back();
+            bounds.push_back(it->first);
+            counts.push_back(it->second);
+        }
+    }
+    else
+    {
+        width = (high - low) / cfg.max_symbols;
+        int last_bin = -1;
+        for(std::map<double, dccl::uint64>::const_iterator it = histogram.values.begin(),
+                end = histogram.values.end(); it != end; ++it)
+        {
+            int bin = std::min(cfg.max_symbols - 1, static_cast<int>((it->first - low) / width));
+            if(bin != last_bin)
+            {
+                bounds.push_back(it->first);
+                counts.push_back(0);
+                last_bin = bin;
+            }
+            counts.back() += it->second;
+        }
+    }
+    if(width == 0)
+        width = 1;
+    
+    dccl::uint64 eof = histogram.needs_eof ? std::max<dccl::uint64>(histogram.eof, 1) : 0;
+    
+    // keep the total well within the coder's precision
+    dccl::uint64 total = std::accumulate(counts.begin(), counts.end(), eof) + cfg.out_of_range_frequency;
+    dccl::uint64 divisor = 1;
+    while(total / divisor > dccl::arith::Model::MAX_FREQUENCY / 4)
+        divisor *= 2;
+    dccl::uint64 min_freq = std::max<dccl::uint64>(1, std::ceil(floor_fraction * (total / divisor)));
+    
+    dccl::arith::protobuf::ArithmeticModel model;
+    model.set_name(name);
+    for(std::size_t i = 0, n = counts.size(); i < n; ++i)
+    {
+        model.add_value_bound(bounds[i]);
+        model.add_frequency(std::max(min_freq, counts[i] / divisor));
+    }
+    model.add_value_bound(bounds.back() + width);
+    model.set_eof_frequency(eof ? std::max(min_freq, eof / divisor) : 0);
+    model.set_out_of_range_frequency(cfg.out_of_range_frequency);
+    return model;
+}
+
+// sets the models for the histograms with frequencies of at least floor_fraction of their total, returning why they do not fit the messages (empty if they do)
+std::string fit(const std::map<std::string, dccl::tool::Histogram>& histograms,
+                const std::set<const google::protobuf::Descriptor*>& descriptors,
+                const dccl::tool::TrainConfig& cfg,
+                double floor_fraction,
+                std::map<std::string, dccl::arith::protobuf::ArithmeticModel>* models)
+{
+    for(std::map<std::string, dccl::tool::Histogram>::const_iterator it = histograms.begin(),
+            end = histograms.end(); it != end; ++it)
+    {
+        (*models)[it->first] = make_model(it->first, it->second, cfg, floor_fraction);
+        dccl::arith::ModelManager::set_model((*models)[it->first]);
+    }
+
+    dccl::Codec check;
+    for(std::set<const google::protobuf::Descriptor*>::const_iterator it = descriptors.begin(),
+            end = descriptors.end(); it != end; ++it)
+    {
+        try { check.load(*it); }
+        catch(dccl::Exception& e)
+        {
+            return (*it)->full_name() + ": " + e.what();
+        }
+    }
+    return std::string();
+}
+
+double expected_bits(const dccl::arith::protobuf::ArithmeticModel& model,
+                     const dccl::tool::Histogram& histogram)
+{
+    double total = model.eof_frequency() + model.out_of_range_frequency();
+    for(int i = 0, n = model.frequency_size(); i < n; ++i)
+        total += model.frequency(i);
+
+    double bits = 0;
+    int symbol = 0;
+    for(std::map<double, dccl::uint64>::const_iterator it = histogram.values.begin(),
+            end = histogram.values.end(); it != end; ++it)
+    {
+        while(symbol + 1 < model.frequency_size() && it->first >= model.value_bound(symbol + 1))
+            ++symbol;
+        bits += it->second * -std::log(model.frequency(symbol) / total) / std::log(2.0);
+    }
+    if(histogram.eof)
+        bits += histogram.eof * -std::log(model.eof_frequency() / total) / std::log(2.0);
+    return bits;
+}
+
+void parse_options(int argc, char* argv[], dccl::tool::TrainConfig* cfg)
+{
+    std::vector<dccl::Option> options;
+    options.push_back(dccl::Option('h', "help", no_argument, "Gives help on the usage of 'dccl_arithmetic_train'"));
+    options.push_back(dccl::Option('I', "proto_path", required_argument, "Add another search directory for .proto files"));
+    options.push_back(dccl::Option('m', "message", required_argument, "Message name in the input (if not given as '|Name|' in TextFormat input). All messages in the .proto files are used if none are given."));
+    options.push_back(dccl::Option('f', "proto_file", required_argument, ".proto file to load."));
+    options.push_back(dccl::Option(0, "format", required_argument, "Format of the messages on STDIN: 'textformat' (default) is one Google Protobuf TextFormat message per line (as the input of 'dccl --encode'), 'hex' and 'bin' are DCCL encoded messages (as the input of 'dccl --decode')."));
+    options.push_back(dccl::Option(0, "model", required_argument, "TextFormat dccl.arith.protobuf.ArithmeticModel that the messages were encoded with (needed to decode 'hex' or 'bin' input). May be given more than once."));
+    options.push_back(dccl::Option(0, "max_symbols", required_argument, "Most symbols (value_bound buckets) in each model (default 256). With more distinct values than this, values are merged into equal width buckets."));
+    options.push_back(dccl::Option(0, "out_of_range_frequency", required_argument, "out_of_range_frequency of each model (default 0, which ends a field at an out of range value)."));
+    options.push_back(dccl::Option('v', "verbose", no_argument, "Display extra debugging information."));
+    
+    std::vector<option> long_options; 
+    std::string opt_string;
+    dccl::Option::convert_vector(options, &long_options, &opt_string);
+    
+    while (1) {
+        int option_index = 0;
+
+        int c = getopt_long(argc, argv, opt_string.c_str(),
+                            &long_options[0], &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+            case 0:
+                if(!strcmp(long_options[option_index].name, "format"))
+                {
+                    if(!strcmp(optarg, "textformat"))
+                        cfg->format = TEXTFORMAT;
+                    else if(!strcmp(optarg, "hex"))
+                        cfg->format = HEX;
+                    else if(!strcmp(optarg, "bin"))
+                        cfg->format = BINARY;
+                    else
+                    {
+                        std::cerr << "Invalid format '" << optarg << "'" << std::endl;
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                else if(!strcmp(long_options[option_index].name, "model"))
+                {
+                    cfg->model_file.push_back(optarg);
+                }
+                else if(!strcmp(long_options[option_index].name, "max_symbols"))
+                {
+                    cfg->max_symbols = atoi(optarg);
+                    if(cfg->max_symbols < 1)
+                    {
+                        std::cerr << "--max_symbols must be at least 1" << std::endl;
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                else if(!strcmp(long_options[option_index].name, "out_of_range_frequency"))
+                {
+                    cfg->out_of_range_frequency = atoi(optarg);
+                }
+                else
+                {
+                    std::cerr << "Try --help for valid options." << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                break;
+                
+            case 'I': cfg->include.insert(optarg); break;
+            case 'm': cfg->message.insert(optarg); break;
+            case 'f':
+            {
+                char* proto_file_canonical_path = realpath(optarg, 0);
+                if(proto_file_canonical_path)
+                {
+                    cfg->proto_file.insert(proto_file_canonical_path);
+                    free(proto_file_canonical_path);
+                }
+                else
+                {
+                    std::cerr << "Invalid proto file path: '" << optarg << "'" << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            }
+            case 'v': cfg->verbose = true; break;                
+                
+            case 'h':
+                std::cout << "Usage of 'dccl_arithmetic_train', which writes the arithmetic coder models (dccl.arith.protobuf.ArithmeticModel) that minimize the expected size of the messages on STDIN, subject to their max_bytes: " << std::endl;
+                for(int i = 0, n = options.size(); i < n; ++i)
+                    std::cout << "  " << options[i].usage() << std::endl;
+                exit(EXIT_SUCCESS);
+                break;
+
+            case '?':
+                std::cerr << "Try --help for valid options." << std::endl;
+                exit(EXIT_FAILURE);
+            default: exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind < argc)
+    {
+        std::cerr << "Unknown arguments: \n";
+        while (optind < argc)
+            std::cerr << argv[optind++];
+        std::cerr << std::endl;
+        std::cerr << "Try --help for valid options." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
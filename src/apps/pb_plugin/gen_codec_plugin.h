@@ -0,0 +1,329 @@
+// Copyright 2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef GenCodecPlugin20171026H
+#define GenCodecPlugin20171026H
+
+#include <cmath>
+#include <cctype>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/descriptor.h>
+
+#include "option_extensions.pb.h"
+
+///////////////////////////////////////////////////////////////////////////////////
+// Generation of encoders and decoders specialized to a message's DCCL options
+// (registered with dccl::GeneratedCodecs, see dccl/generated_codec.h)
+///////////////////////////////////////////////////////////////////////////////////
+
+namespace dccl
+{
+  namespace gen
+  {
+    // same as dccl::ceil_log2 (dccl/binary.h), so the sizes match what the DCCL codecs compute
+    inline unsigned ceil_log2(unsigned long long v)
+    {
+      unsigned r = ((v & (v - 1)) == 0) ? 0 : 1;
+      while (v >>= 1)
+        r++;
+      return r;
+    }
+
+    inline unsigned ceil_log2(double d)
+    { return ceil_log2(static_cast<unsigned long long>(std::ceil(d))); }
+
+    // one field, as encoded by the default DCCL v3 codecs
+    struct GeneratedField
+    {
+      const google::protobuf::FieldDescriptor* field;
+      bool required;
+      // C++ DCCL wire type (numeric and enum fields)
+      std::string wire_type;
+      double min, max, precision;
+      unsigned width;
+    };
+    
+    // as protoc's (C++) field name: lower case, with an underscore appended to C++ keywords
+    inline std::string cpp_field_name(const google::protobuf::FieldDescriptor* field)
+    {
+      static const char* const keywords[] = {
+        "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break",
+        "case", "catch", "char", "char8_t", "char16_t", "char32_t", "class", "compl", "concept",
+        "const", "consteval", "constexpr", "constinit", "const_cast", "continue", "co_await",
+        "co_return", "co_yield", "decltype", "default", "delete", "do", "double", "dynamic_cast",
+        "else", "enum", "explicit", "export", "extern", "false", "float", "for", "friend", "goto",
+        "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq",
+        "nullptr", "operator", "or", "or_eq", "private", "protected", "public", "register",
+        "reinterpret_cast", "requires", "return", "short", "signed", "sizeof", "static",
+        "static_assert", "static_cast", "struct", "switch", "template", "this", "thread_local",
+        "throw", "true", "try", "typedef", "typeid", "typename", "union", "unsigned", "using",
+        "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq" };
+      
+      std::string name = field->name();
+      for(std::string::iterator it = name.begin(), end = name.end(); it != end; ++it)
+        *it = std::tolower(*it);
+      for(unsigned i = 0, n = sizeof(keywords) / sizeof(keywords[0]); i < n; ++i)
+      {
+        if(name == keywords[i])
+        {
+          name += "_";
+          break;
+        }
+      }
+      return name;
+    }
+
+    // Foo.Bar -> Foo_Bar (the name protoc gives the class of a nested message)
+    inline std::string cpp_class_name(const google::protobuf::Descriptor* desc)
+    {
+      std::string name = desc->full_name();
+      const std::string& package = desc->file()->package();
+      if(!package.empty())
+        name = name.substr(package.size() + 1);
+      for(std::string::iterator it = name.begin(), end = name.end(); it != end; ++it)
+        if(*it == '.') *it = '_';
+      return name;
+    }
+    
+    // the generated code assumes the DCCL v3 default codecs (see Codec::generated_codec())
+    inline bool is_default_codec(const std::string& codec)
+    { return codec == "dccl.default3"; }
+
+    // returns false if this field cannot be encoded by generated code
+    inline bool make_generated_field(const google::protobuf::FieldDescriptor* field, GeneratedField* generated)
+    {
+      using google::protobuf::FieldDescriptor;
+      const dccl::DCCLFieldOptions& options = field->options().GetExtension(dccl::field);
+      if(field->is_repeated() || options.has_codec())
+        return false;
+#if GOOGLE_PROTOBUF_VERSION >= 2006000
+      if(field->containing_oneof())
+        return false;
+#endif
+      
+      generated->field = field;
+      generated->required = field->is_required();
+      generated->min = options.min();
+      generated->max = options.max();
+      generated->precision = options.precision();
+      
+      switch(field->cpp_type())
+      {
+        case FieldDescriptor::CPPTYPE_INT32: generated->wire_type = "::dccl::int32"; break;
+        case FieldDescriptor::CPPTYPE_INT64: generated->wire_type = "::dccl::int64"; break;
+        case FieldDescriptor::CPPTYPE_UINT32: generated->wire_type = "::dccl::uint32"; break;
+        case FieldDescriptor::CPPTYPE_UINT64: generated->wire_type = "::dccl::uint64"; break;
+        case FieldDescriptor::CPPTYPE_DOUBLE: generated->wire_type = "double"; break;
+        case FieldDescriptor::CPPTYPE_FLOAT: generated->wire_type = "float"; break;
+        case FieldDescriptor::CPPTYPE_ENUM:
+          generated->wire_type = "::dccl::int32";
+          generated->min = 0;
+          generated->max = field->enum_type()->value_count() - 1;
+          generated->precision = 0;
+          break;
+        case FieldDescriptor::CPPTYPE_BOOL:
+          // true and false, and the null value if optional
+          generated->width = ceil_log2(2.0 + (generated->required ? 0 : 1));
+          return true;
+        default:
+          return false;
+      }
+
+      if(field->cpp_type() != FieldDescriptor::CPPTYPE_ENUM && (!options.has_min() || !options.has_max()))
+        return false;
+      
+      // as v2::DefaultNumericFieldCodec::make_quantization
+      const double num_values = (generated->max - generated->min) * std::pow(10.0, generated->precision) + 1;
+      generated->width = ceil_log2(generated->required ? num_values : num_values + 1);
+      return true;
+    }
+
+    // writes the encoding of one field to `os`
+    inline void construct_field_encoder(const GeneratedField& f, std::ostream& os)
+    {
+      using google::protobuf::FieldDescriptor;
+      const std::string name = cpp_field_name(f.field);
+      const std::string required = f.required ? "true" : "false";
+      // optional fields that are not set are encoded as zero (the null value)
+      const std::string has = f.required ? "" : ("msg.has_" + name + "() ? ");
+      const std::string otherwise = f.required ? "" : " : 0";
+      
+      os << "    // " << name << ": " << f.width << " bits\n";
+      if(f.field->cpp_type() == FieldDescriptor::CPPTYPE_BOOL)
+      {
+        os << "    bits.write(" << has << "msg." << name << "()" << (f.required ? "" : " + 1") << otherwise << ", " << f.width << ");\n";
+        return;
+      }
+      
+      os << "    {\n"
+         << "      typedef ::dccl::v2::DefaultNumericFieldCodec< " << f.wire_type << " > Numeric;\n"
+         << "      static const Numeric::Quantization q = Numeric::make_quantization(" << f.min << ", " << f.max << ", " << f.precision << ");\n";
+      if(f.field->cpp_type() == FieldDescriptor::CPPTYPE_ENUM)
+      {
+        // value number to index (the first value of each number, as EnumDescriptor::FindValueByNumber)
+        const google::protobuf::EnumDescriptor* e = f.field->enum_type();
+        os << "      ::dccl::int32 index = 0;\n"
+           << "      switch(msg." << name << "())\n"
+           << "      {\n";
+        std::map<int, int> number_to_index;
+        for(int i = 0, n = e->value_count(); i < n; ++i)
+          number_to_index.insert(std::make_pair(e->value(i)->number(), i));
+        for(std::map<int, int>::const_iterator it = number_to_index.begin(), end = number_to_index.end(); it != end; ++it)
+          os << "        case " << it->first << ": index = " << it->second << "; break;\n";
+        os << "        default: break;\n"
+           << "      }\n"
+           << "      bits.write(" << has << "Numeric::quantize(index, q, " << required << ")" << otherwise << ", " << f.width << ");\n";
+      }
+      else
+      {
+        os << "      bits.write(" << has << "Numeric::quantize(msg." << name << "(), q, " << required << ")" << otherwise << ", " << f.width << ");\n";
+      }
+      os << "    }\n";
+    }
+
+    // writes the decoding of one field to `os`
+    inline void construct_field_decoder(const GeneratedField& f, const std::string& class_name, std::ostream& os)
+    {
+      using google::protobuf::FieldDescriptor;
+      const std::string name = cpp_field_name(f.field);
+      const std::string required = f.required ? "true" : "false";
+
+      os << "    // " << name << ": " << f.width << " bits\n";
+      if(f.field->cpp_type() == FieldDescriptor::CPPTYPE_BOOL)
+      {
+        os << "    {\n"
+           << "      ::dccl::uint64 value = bits.read(" << f.width << ");\n";
+        if(f.required)
+          os << "      msg->set_" << name << "(value != 0);\n";
+        else
+          os << "      if(value) msg->set_" << name << "(value - 1 != 0);\n";
+        os << "    }\n";
+        return;
+      }
+      
+      os << "    {\n"
+         << "      typedef ::dccl::v2::DefaultNumericFieldCodec< " << f.wire_type << " > Numeric;\n"
+         << "      static const Numeric::Quantization q = Numeric::make_quantization(" << f.min << ", " << f.max << ", " << f.precision << ");\n"
+         << "      " << f.wire_type << " value;\n";
+      if(f.field->cpp_type() == FieldDescriptor::CPPTYPE_ENUM)
+      {
+        const google::protobuf::EnumDescriptor* e = f.field->enum_type();
+        os << "      static const int numbers[] = { ";
+        for(int i = 0, n = e->value_count(); i < n; ++i)
+          os << (i ? ", " : "") << e->value(i)->number();
+        os << " };\n"
+           << "      if(Numeric::dequantize(bits.read(" << f.width << "), q, " << required << ", &value) && value >= 0 && value < " << e->value_count() << ")\n"
+           << "        ::dccl::generated::set_enum(msg, &" << class_name << "::set_" << name << ", numbers[value]);\n";
+      }
+      else
+      {
+        os << "      if(Numeric::dequantize(bits.read(" << f.width << "), q, " << required << ", &value))\n"
+           << "        msg->set_" << name << "(value);\n";
+      }
+      os << "    }\n";
+    }
+
+    /// \brief Writes the specialized encoder and decoder for a message to `class_scope` (the inside of the generated message class) and the code to register them with dccl::GeneratedCodecs to `namespace_scope`, if all the fields of the message use the default DCCL v3 numeric, enumeration or boolean codecs.
+    /// \return false if no code was generated because the message does not qualify
+    inline bool construct_codec_plugin(const google::protobuf::Descriptor* desc, std::ostream& class_scope, std::ostream& namespace_scope)
+    {
+      const dccl::DCCLMessageOptions& msg_options = desc->options().GetExtension(dccl::msg);
+      if(!msg_options.has_id() || msg_options.codec_version() != 3 ||
+         (msg_options.has_codec() && !is_default_codec(msg_options.codec())) ||
+         (msg_options.has_codec_group() && !is_default_codec(msg_options.codec_group())))
+        return false;
+
+      const unsigned id = msg_options.id();
+      // DefaultIdentifierCodec: one byte for ids up to 127 (LSB 0), otherwise two bytes (LSB 1)
+      if(id > (1 << 15) - 1)
+        return false;
+      const bool short_id = id <= (1 << 7) - 1;
+      const unsigned id_width = short_id ? 8 : 16;
+      const unsigned id_value = short_id ? (id << 1) : ((id << 1) | 1);
+
+      std::vector<GeneratedField> head, body;
+      for(int i = 0, n = desc->field_count(); i < n; ++i)
+      {
+        const google::protobuf::FieldDescriptor* field = desc->field(i);
+        const dccl::DCCLFieldOptions& options = field->options().GetExtension(dccl::field);
+        if(options.omit())
+          continue;
+        
+        GeneratedField f;
+        if(!make_generated_field(field, &f))
+          return false;
+        (options.in_head() ? head : body).push_back(f);
+      }
+
+      unsigned head_bits = id_width, body_bits = 0;
+      for(std::vector<GeneratedField>::const_iterator it = head.begin(), end = head.end(); it != end; ++it)
+        head_bits += it->width;
+      for(std::vector<GeneratedField>::const_iterator it = body.begin(), end = body.end(); it != end; ++it)
+        body_bits += it->width;
+      const unsigned size = (head_bits + 7) / 8 + (body_bits + 7) / 8;
+
+      const std::string class_name = cpp_class_name(desc);
+      std::ostringstream os;
+      os.precision(17);
+      
+      // typed functions: GeneratedCodecs::add<>() registers shims that do the cast from google::protobuf::Message
+      os << "  // DCCL encoder and decoder generated by protoc-gen-dccl (see dccl::GeneratedCodecs)\n"
+         << "  typedef " << class_name << " DCCLGeneratedMessage;\n"
+         << "  enum DCCLGeneratedId { DCCL_GENERATED_ID = " << id << " };\n"
+         << "  enum DCCLGeneratedSize { DCCL_GENERATED_SIZE = " << size << " };\n\n"
+         << "  static size_t dccl_encode(const " << class_name << "& msg, char* dccl_bytes, size_t dccl_max_len)\n"
+         << "  {\n"
+         << "    ::dccl::generated::BitWriter bits(dccl_bytes, dccl_max_len);\n"
+         << "    // dccl.id: " << id << "\n"
+         << "    bits.write(" << id_value << ", " << id_width << ");\n";
+      for(std::vector<GeneratedField>::const_iterator it = head.begin(), end = head.end(); it != end; ++it)
+        construct_field_encoder(*it, os);
+      os << "    bits.pad_to_byte();\n";
+      for(std::vector<GeneratedField>::const_iterator it = body.begin(), end = body.end(); it != end; ++it)
+        construct_field_encoder(*it, os);
+      os << "    return bits.byte_size();\n"
+         << "  }\n\n";
+
+      os << "  static size_t dccl_decode(const char* dccl_bytes, size_t dccl_len, " << class_name << "* msg)\n"
+         << "  {\n"
+         << "    ::dccl::generated::BitReader bits(dccl_bytes, dccl_len);\n"
+         << "    if(bits.read(" << id_width << ") != " << id_value << ") return 0;\n";
+      for(std::vector<GeneratedField>::const_iterator it = head.begin(), end = head.end(); it != end; ++it)
+        construct_field_decoder(*it, class_name, os);
+      os << "    bits.pad_to_byte();\n";
+      for(std::vector<GeneratedField>::const_iterator it = body.begin(), end = body.end(); it != end; ++it)
+        construct_field_decoder(*it, class_name, os);
+      os << "    return bits.byte_size();\n"
+         << "  }\n";
+      class_scope << os.str();
+
+      namespace_scope << "namespace { const bool dccl_generated_" << class_name << "_registered = ::dccl::GeneratedCodecs::add< "
+                      << class_name << " >(); }\n";
+      return true;
+    }
+  }
+}
+
+#endif
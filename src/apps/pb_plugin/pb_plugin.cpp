@@ -30,10 +30,15 @@
 #include <google/protobuf/io/zero_copy_stream.h>
 #include "option_extensions.pb.h"
 #include "gen_units_class_plugin.h"
+#include "gen_codec_plugin.h"
 
 std::set<std::string> systems_to_include_;
 std::set<std::string> base_units_to_include_;
 std::string filename_h_;
+std::string filename_cc_;
+// generate specialized encoders/decoders (protoc --dccl_out=dccl_codecs:...)
+bool generate_codecs_ = false;
+bool codecs_generated_ = false;
 
 
 class DCCLGenerator : public google::protobuf::compiler::CodeGenerator {
@@ -87,7 +92,8 @@ bool DCCLGenerator::Generate(const google::protobuf::FileDescriptor* file,
     {
         const std::string& filename = file->name();
         filename_h_ = filename.substr(0, filename.find(".proto")) + ".pb.h";
-//        std::string filename_cc = filename.substr(0, filename.find(".proto")) + ".pb.cc";
+        filename_cc_ = filename.substr(0, filename.find(".proto")) + ".pb.cc";
+        generate_codecs_ = parameter.find("dccl_codecs") != std::string::npos;
         
         for(int message_i = 0, message_n = file->message_type_count(); message_i < message_n; ++message_i)
         {
@@ -119,6 +125,11 @@ bool DCCLGenerator::Generate(const google::protobuf::FileDescriptor* file,
         {
             include_base_unit_headers(*it, includes_ss);
         }
+        if(codecs_generated_)
+        {
+            includes_ss << "#include \"dccl/generated_codec.h\"" << std::endl;
+            includes_ss << "#include \"dccl/codecs2/field_codec_default.h\"" << std::endl;
+        }
         include_printer.Print(includes_ss.str().c_str());
         
         return true;
@@ -165,6 +176,21 @@ void DCCLGenerator::generate_message(const google::protobuf::Descriptor* desc, g
             generate_field(desc->field(field_i), &printer, message_unit_system);
         }
 
+        if(generate_codecs_)
+        {
+            std::stringstream codec_methods, codec_registration;
+            if(dccl::gen::construct_codec_plugin(desc, codec_methods, codec_registration))
+            {
+                printer.Print(codec_methods.str().c_str());
+
+                boost::shared_ptr<google::protobuf::io::ZeroCopyOutputStream> namespace_output(
+                    generator_context->OpenForInsert(filename_cc_, "namespace_scope"));
+                google::protobuf::io::Printer namespace_printer(namespace_output.get(), '$');
+                namespace_printer.Print(codec_registration.str().c_str());
+                codecs_generated_ = true;
+            }
+        }
+
         for(int nested_type_i = 0, nested_type_n = desc->nested_type_count(); nested_type_i < nested_type_n; ++nested_type_i)
             generate_message(desc->nested_type(nested_type_i), generator_context, message_unit_system);
     }
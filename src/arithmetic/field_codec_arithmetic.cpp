@@ -20,12 +20,15 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
 #include "field_codec_arithmetic.h"
+#include "field_codec_rans.h"
 #include "dccl/field_codec_manager.h"
 
 using dccl::dlog;
 using namespace dccl::logger;
 
 std::map<std::string, dccl::arith::Model> dccl::arith::ModelManager::arithmetic_models_;
+unsigned dccl::arith::ModelManager::generation_ = 0;
+DCCL_THREAD_LOCAL dccl::arith::AdaptiveModelState* dccl::arith::ModelManager::bound_state_ = 0;
 const dccl::arith::Model::symbol_type dccl::arith::Model::OUT_OF_RANGE_SYMBOL;
 const dccl::arith::Model::symbol_type dccl::arith::Model::EOF_SYMBOL;
 const dccl::arith::Model::symbol_type dccl::arith::Model::MIN_SYMBOL;
@@ -65,6 +68,15 @@ extern "C"
         FieldCodecManager::add<ArithmeticFieldCodec<bool> >("dccl.arithmetic");
         FieldCodecManager::add<ArithmeticFieldCodec<const google::protobuf::EnumValueDescriptor*> >("dccl.arithmetic");
 
+        FieldCodecManager::add<RansFieldCodec<int32> >("dccl.rans");
+        FieldCodecManager::add<RansFieldCodec<int64> >("dccl.rans");
+        FieldCodecManager::add<RansFieldCodec<uint32> >("dccl.rans");
+        FieldCodecManager::add<RansFieldCodec<uint64> >("dccl.rans");
+        FieldCodecManager::add<RansFieldCodec<double> >("dccl.rans");
+        FieldCodecManager::add<RansFieldCodec<float> >("dccl.rans");
+        FieldCodecManager::add<RansFieldCodec<bool> >("dccl.rans");
+        FieldCodecManager::add<RansFieldCodec<const google::protobuf::EnumValueDescriptor*> >("dccl.rans");
+
     }
     void dccl3_unload(dccl::Codec* dccl)
     {
@@ -93,41 +105,72 @@ extern "C"
         FieldCodecManager::remove<ArithmeticFieldCodec<float> >("dccl.arithmetic");
         FieldCodecManager::remove<ArithmeticFieldCodec<bool> >("dccl.arithmetic");
         FieldCodecManager::remove<ArithmeticFieldCodec<const google::protobuf::EnumValueDescriptor*> >("dccl.arithmetic");
+
+        FieldCodecManager::remove<RansFieldCodec<int32> >("dccl.rans");
+        FieldCodecManager::remove<RansFieldCodec<int64> >("dccl.rans");
+        FieldCodecManager::remove<RansFieldCodec<uint32> >("dccl.rans");
+        FieldCodecManager::remove<RansFieldCodec<uint64> >("dccl.rans");
+        FieldCodecManager::remove<RansFieldCodec<double> >("dccl.rans");
+        FieldCodecManager::remove<RansFieldCodec<float> >("dccl.rans");
+        FieldCodecManager::remove<RansFieldCodec<bool> >("dccl.rans");
+        FieldCodecManager::remove<RansFieldCodec<const google::protobuf::EnumValueDescriptor*> >("dccl.rans");
         
     }
 }
 
 dccl::arith::Model::symbol_type dccl::arith::Model::value_to_symbol(value_type value) const
 {
-    if(value < *user_model_.value_bound().begin() || value > *(user_model_.value_bound().end()-1))
-        return Model::OUT_OF_RANGE_SYMBOL;
+    const google::protobuf::RepeatedField<double>& bounds = user_model_.value_bound();
     
+    // (also NaN)
+    if(!(value >= bounds.Get(0) && value <= bounds.Get(bounds.size() - 1)))
+        return Model::OUT_OF_RANGE_SYMBOL;
 
-    google::protobuf::RepeatedField<double>::const_iterator upper_it =
-        std::upper_bound(user_model_.value_bound().begin(),
-                         user_model_.value_bound().end(),
-                         value);
+    // equivalent to std::upper_bound(bounds.begin(), bounds.end(), value), starting from the lookup table's guess
+    std::size_t bucket = std::min(static_cast<std::size_t>((value - bounds.Get(0)) * value_lookup_scale_), value_lookup_.size() - 1);
+    int upper = value_lookup_[bucket];
+    while(upper > 0 && bounds.Get(upper - 1) > value)
+        --upper;
+    while(upper < bounds.size() && bounds.Get(upper) <= value)
+        ++upper;
 
+    // value equal to the last bound
+    if(upper == bounds.size())
+        return upper - 1;
+    
+    int lower = upper - 1;
         
-    google::protobuf::RepeatedField<double>::const_iterator lower_it = 
-        (upper_it == user_model_.value_bound().begin()) ? upper_it : upper_it - 1;
-        
-    double lower_diff = std::abs((*lower_it)*(*lower_it) - value*value);
-    double upper_diff = std::abs((*upper_it)*(*upper_it) - value*value);
+    double lower_diff = std::abs(bounds.Get(lower)*bounds.Get(lower) - value*value);
+    double upper_diff = std::abs(bounds.Get(upper)*bounds.Get(upper) - value*value);
 
-//    std::cout << "value: " << value << std::endl;
-//    std::cout << "lower_value: " << *lower_it << std::endl;
-//    std::cout << "upper_value: " << *upper_it << std::endl;
-    
-    symbol_type symbol = ((lower_diff < upper_diff) ? lower_it : upper_it)
-        - user_model_.value_bound().begin();
+    return (lower_diff < upper_diff) ? lower : upper;
+}
+              
+void dccl::arith::Model::build_value_lookup()
+{
+    const google::protobuf::RepeatedField<double>& bounds = user_model_.value_bound();
+
+    // two equal-width buckets per bound
+    const std::size_t num_buckets = std::min(2 * static_cast<std::size_t>(bounds.size()), static_cast<std::size_t>(1 << 16));
+    const value_type width = bounds.Get(bounds.size() - 1) - bounds.Get(0);
+    value_lookup_scale_ = num_buckets / width;
 
+    // a single bound, or bounds too far apart to divide: search from the start
+    if(!(value_lookup_scale_ > 0 && value_lookup_scale_ < std::numeric_limits<value_type>::infinity()))
+    {
+        value_lookup_scale_ = 0;
+        value_lookup_.assign(1, std::upper_bound(bounds.begin(), bounds.end(), bounds.Get(0)) - bounds.begin());
+        return;
+    }
     
-    return symbol;
-                          
+    value_lookup_.resize(num_buckets);
+    for(std::size_t b = 0; b < num_buckets; ++b)
+    {
+        value_type edge = bounds.Get(0) + b / value_lookup_scale_;
+        value_lookup_[b] = std::upper_bound(bounds.begin(), bounds.end(), edge) - bounds.begin();
+    }
 }
-              
-                  
+
 dccl::arith::Model::value_type dccl::arith::Model::symbol_to_value(symbol_type symbol) const
 {
 
@@ -144,33 +187,17 @@ dccl::arith::Model::value_type dccl::arith::Model::symbol_to_value(symbol_type s
 
 std::pair<dccl::arith::Model::freq_type, dccl::arith::Model::freq_type> dccl::arith::Model::symbol_to_cumulative_freq(symbol_type symbol, ModelState state) const
 {
-    const boost::bimap<symbol_type, freq_type>& c_freqs = (state == ENCODER) ?
-        encoder_cumulative_freqs_ :
-        decoder_cumulative_freqs_;
+    const CumulativeFrequencies& c_freqs = cumulative_freqs(state);
 
-    boost::bimap<symbol_type, freq_type>::left_map::const_iterator c_freq_it =
-        c_freqs.left.find(symbol);
     std::pair<freq_type, freq_type> c_freq_range;
-    c_freq_range.second = c_freq_it->second;
-    if(c_freq_it == c_freqs.left.begin())
-    {
-        c_freq_range.first  = 0;
-    }
-    else
-    {
-        c_freq_it--;
-        c_freq_range.first = c_freq_it->second;
-    }
+    c_freq_range.first = c_freqs.cumulative(index(symbol));
+    c_freq_range.second = c_freq_range.first + c_freqs.freq(index(symbol));
     return c_freq_range;
-                          
 }
 
 std::pair<dccl::arith::Model::symbol_type, dccl::arith::Model::symbol_type> dccl::arith::Model::cumulative_freq_to_symbol(std::pair<freq_type, freq_type> c_freq_pair,  ModelState state) const
 {
-
-    const boost::bimap<symbol_type, freq_type>& c_freqs = (state == ENCODER) ?
-        encoder_cumulative_freqs_ :
-        decoder_cumulative_freqs_;
+    const CumulativeFrequencies& c_freqs = cumulative_freqs(state);
     
     std::pair<symbol_type, symbol_type> symbol_pair;
     
@@ -181,17 +208,15 @@ std::pair<dccl::arith::Model::symbol_type, dccl::arith::Model::symbol_type> dccl
     // symbol: 2   freq: 10   c_freq: 35 [25 ... 35)
     // searching for c_freq of 30 should return symbol 2     
     // searching for c_freq of 10 should return symbol 1
-    symbol_pair.first = c_freqs.right.upper_bound(c_freq_pair.first)->second;
-    
+    std::size_t first = c_freqs.upper_bound(c_freq_pair.first);
+    symbol_pair.first = symbol(first);
     
-    if(symbol_pair.first == c_freqs.left.rbegin()->first)
+    if(symbol_pair.first == max_symbol())
         symbol_pair.second = symbol_pair.first; // last symbol can't be ambiguous on the low end
-    else if(c_freqs.left.find(symbol_pair.first)->second > c_freq_pair.second)
+    else if(c_freqs.cumulative(first) + c_freqs.freq(first) > c_freq_pair.second)
         symbol_pair.second = symbol_pair.first; // unambiguously this symbol
     else
         symbol_pair.second = symbol_pair.first + 1;
-
-
     
     return symbol_pair;
 }
@@ -202,43 +227,95 @@ void dccl::arith::Model::update_model(symbol_type symbol, ModelState state)
     if(!user_model_.is_adaptive())
         return;
 
-    boost::bimap<symbol_type, freq_type>& c_freqs = (state == ENCODER) ?
-        encoder_cumulative_freqs_ :
-        decoder_cumulative_freqs_;
+    CumulativeFrequencies& c_freqs = mutable_cumulative_freqs(state);
 
     if(dlog.is(DEBUG3))
     {
         dlog << "Model was: " << std::endl;
         for(symbol_type i = MIN_SYMBOL, n = max_symbol(); i <= n; ++i)
-        {
-            boost::bimap<symbol_type, freq_type>::left_iterator it =
-                c_freqs.left.find(i);
-            if(it != c_freqs.left.end())
-                dlog << "Symbol: " << it->first << ", c_freq: " << it->second << std::endl;
-        }
-    }
-    
-                
-    for(symbol_type i = max_symbol(), n = symbol; i >= n; --i)
-    {
-        boost::bimap<symbol_type, freq_type>::left_iterator it =
-            c_freqs.left.find(i);
-        if(it != c_freqs.left.end())
-            c_freqs.left.replace_data(it, it->second + 1);
+            dlog << "Symbol: " << i << ", c_freq: " << c_freqs.cumulative(index(i) + 1) << std::endl;
     }
 
+    c_freqs.increment(index(symbol));
+
     if(dlog.is(DEBUG3))
     {
         dlog << "Model is now: " << std::endl;
         for(symbol_type i = MIN_SYMBOL, n = max_symbol(); i <= n; ++i)
-        {
-            boost::bimap<symbol_type, freq_type>::left_iterator it =
-                c_freqs.left.find(i);
-            if(it != c_freqs.left.end())
-                dlog << "Symbol: " << it->first << ", c_freq: " << it->second << std::endl;
-        }
+            dlog << "Symbol: " << i << ", c_freq: " << c_freqs.cumulative(index(i) + 1) << std::endl;
     }
     
     dlog.is(DEBUG3) && dlog << "total freq: " << total_freq(state) << std::endl;
                 
 }
+
+const dccl::arith::CumulativeFrequencies& dccl::arith::Model::cumulative_freqs(ModelState state) const
+{
+    if(user_model_.is_adaptive() && ModelManager::bound_state())
+        return ModelManager::bound_state()->cumulative_freqs(*this, state);
+    
+    return (state == ENCODER) ? encoder_cumulative_freqs_ : decoder_cumulative_freqs_;
+}
+
+dccl::arith::CumulativeFrequencies& dccl::arith::Model::mutable_cumulative_freqs(ModelState state)
+{
+    if(user_model_.is_adaptive() && ModelManager::bound_state())
+        return ModelManager::bound_state()->cumulative_freqs(*this, state);
+    
+    return (state == ENCODER) ? encoder_cumulative_freqs_ : decoder_cumulative_freqs_;
+}
+
+dccl::arith::AdaptiveModelState::AdaptiveModelState()
+    : generation_(ModelManager::generation()),
+      last_model_(0),
+      last_frequencies_(0)
+{ }
+
+dccl::arith::AdaptiveModelState::AdaptiveModelState(const AdaptiveModelState& other)
+    : frequencies_(other.frequencies_),
+      generation_(other.generation_),
+      last_model_(0),
+      last_frequencies_(0)
+{ }
+
+dccl::arith::AdaptiveModelState& dccl::arith::AdaptiveModelState::operator=(const AdaptiveModelState& other)
+{
+    frequencies_ = other.frequencies_;
+    generation_ = other.generation_;
+    last_model_ = 0;
+    last_frequencies_ = 0;
+    return *this;
+}
+
+void dccl::arith::AdaptiveModelState::reset()
+{
+    frequencies_.clear();
+    last_model_ = 0;
+    last_frequencies_ = 0;
+}
+
+dccl::arith::CumulativeFrequencies& dccl::arith::AdaptiveModelState::cumulative_freqs(const Model& model, Model::ModelState state)
+{
+    if(generation_ != ModelManager::generation())
+    {
+        // the models (and so the keys) may have been replaced
+        reset();
+        generation_ = ModelManager::generation();
+    }
+    
+    if(last_model_ != &model)
+    {
+        std::map<const Model*, Frequencies>::iterator it = frequencies_.find(&model);
+        if(it == frequencies_.end())
+        {
+            Frequencies initial;
+            initial.encoder = model.initial_cumulative_freqs_;
+            initial.decoder = model.initial_cumulative_freqs_;
+            it = frequencies_.insert(std::make_pair(&model, initial)).first;
+        }
+        last_model_ = &model;
+        last_frequencies_ = &it->second;
+    }
+    
+    return (state == Model::ENCODER) ? last_frequencies_->encoder : last_frequencies_->decoder;
+}
@@ -27,8 +27,8 @@
 
 #include <limits>
 #include <algorithm>
+#include <vector>
 
-#include <boost/bimap.hpp>
 #include <boost/lexical_cast.hpp>
 
 #include "dccl/field_codec_typed.h"
@@ -53,6 +53,178 @@ namespace dccl
     /// DCCL Arithmetic Encoder Library namespace 
     namespace arith
     {
+        /// \brief Frequencies of the symbols 0 ... size()-1 of a model, kept in a Fenwick (binary indexed) tree so that cumulative frequencies can be found and updated in O(log n) time
+        class CumulativeFrequencies
+        {
+          public:
+            typedef uint32 freq_type;
+            
+            CumulativeFrequencies() : total_(0), lookup_shift_(0) { }
+            
+            /// \brief Set the frequencies of all the symbols
+            void assign(const std::vector<freq_type>& freqs)
+            {
+                freqs_ = freqs;
+                tree_.assign(freqs.size() + 1, 0);
+                total_ = 0;
+                for(std::size_t i = 0, n = freqs.size(); i < n; ++i)
+                {
+                    // O(n) construction: each node passes its sum up to its parent
+                    tree_[i + 1] += freqs[i];
+                    std::size_t parent = (i + 1) + ((i + 1) & -(i + 1));
+                    if(parent <= n)
+                        tree_[parent] += tree_[i + 1];
+                    total_ += freqs[i];
+                }
+                prefix_.clear();
+                lookup_.clear();
+            }
+
+            /// \brief For frequencies that no longer change (static models), precompute flat tables that make cumulative() O(1) and upper_bound() a direct table lookup. increment() discards the tables.
+            void build_lookup()
+            {
+                const std::size_t n = freqs_.size();
+                std::vector<freq_type> prefix(n + 1, 0);
+                for(std::size_t i = 0; i < n; ++i)
+                    prefix[i + 1] = prefix[i] + freqs_[i];
+
+                // about four table entries per symbol, from 2^8 to 2^16 entries
+                unsigned table_bits = 8;
+                while(table_bits < 16 && (static_cast<std::size_t>(1) << table_bits) < 4 * n)
+                    ++table_bits;
+                unsigned total_bits = 0;
+                while(total_bits < 32 && (static_cast<uint64>(1) << total_bits) < total_)
+                    ++total_bits;
+                const unsigned shift = (total_bits > table_bits) ? total_bits - table_bits : 0;
+
+                // lookup[b] is the symbol containing the lowest cumulative frequency of bucket b
+                std::vector<uint32> lookup(total_ ? ((total_ - 1) >> shift) + 1 : 0);
+                for(std::size_t b = 0, m = lookup.size(); b < m; ++b)
+                    lookup[b] = upper_bound(static_cast<freq_type>(b << shift));
+
+                prefix_.swap(prefix);
+                lookup_.swap(lookup);
+                lookup_shift_ = shift;
+            }
+
+            /// \brief Number of symbols
+            std::size_t size() const { return freqs_.size(); }
+            
+            /// \brief Frequency of symbol i
+            freq_type freq(std::size_t i) const { return freqs_[i]; }
+
+            /// \brief Sum of the frequencies of all the symbols
+            freq_type total() const { return total_; }
+            
+            /// \brief Sum of the frequencies of the symbols before symbol i (0 ... i-1)
+            freq_type cumulative(std::size_t i) const
+            {
+                if(!prefix_.empty())
+                    return prefix_[i];
+                
+                freq_type sum = 0;
+                for(; i > 0; i &= i - 1)
+                    sum += tree_[i];
+                return sum;
+            }
+
+            /// \brief Add one to the frequency of symbol i
+            void increment(std::size_t i)
+            {
+                if(!prefix_.empty())
+                {
+                    prefix_.clear();
+                    lookup_.clear();
+                }
+                
+                ++freqs_[i];
+                ++total_;
+                for(std::size_t n = freqs_.size(), j = i + 1; j <= n; j += j & -j)
+                    ++tree_[j];
+            }
+
+            /// \brief First symbol i for which cumulative(i+1) > c_freq (size() if none). Symbols with zero frequency are never returned unless they are the last.
+            std::size_t upper_bound(freq_type c_freq) const
+            {
+                if(!lookup_.empty() && c_freq < total_)
+                {
+                    // the bucket gives the first candidate; the symbols it spans are scanned
+                    std::size_t i = lookup_[c_freq >> lookup_shift_];
+                    while(prefix_[i + 1] <= c_freq)
+                        ++i;
+                    return i;
+                }
+                
+                std::size_t n = freqs_.size();
+                std::size_t step = 1;
+                while(step <= n / 2)
+                    step <<= 1;
+
+                // descend the tree to the last position whose cumulative frequency is <= c_freq
+                std::size_t pos = 0;
+                for(; step > 0; step >>= 1)
+                {
+                    if(pos + step <= n && tree_[pos + step] <= c_freq)
+                    {
+                        pos += step;
+                        c_freq -= tree_[pos];
+                    }
+                }
+                return pos;
+            }
+            
+          private:
+            std::vector<freq_type> freqs_;
+            // 1-based: tree_[j] is the sum of the frequencies of the (j & -j) symbols ending at symbol j-1
+            std::vector<freq_type> tree_;
+            freq_type total_;
+            
+            // set by build_lookup(): prefix_[i] == cumulative(i), and lookup_[c_freq >> lookup_shift_] is the first symbol to check for upper_bound(c_freq)
+            std::vector<freq_type> prefix_;
+            std::vector<uint32> lookup_;
+            unsigned lookup_shift_;
+        };
+        
+        /// \brief Output of the arithmetic coder kept as runs of a bit followed by some number of copies of its complement (the "follow" bits). Used to count the encoded bits without building a Bitset.
+        class BitRuns
+        {
+          public:
+            BitRuns() : size_(0) { }
+            
+            void clear()
+            {
+                runs_.clear();
+                size_ = 0;
+            }
+            
+            /// \brief Add `bit` followed by `follow` copies of !bit
+            void push_back(bool bit, int follow)
+            {
+                runs_.push_back(std::make_pair(bit, follow));
+                size_ += 1 + follow;
+            }
+
+            /// \brief Number of bits
+            unsigned size() const { return size_; }
+
+            /// \brief Append the bits to a Bitset
+            void append_to(Bitset* bits) const
+            {
+                for(std::vector<std::pair<bool, int> >::const_iterator it = runs_.begin(), end = runs_.end(); it != end; ++it)
+                {
+                    bits->push_back(it->first);
+                    for(int i = 0; i < it->second; ++i)
+                        bits->push_back(!it->first);
+                }
+            }
+            
+          private:
+            std::vector<std::pair<bool, int> > runs_;
+            unsigned size_;
+        };
+        
+        class AdaptiveModelState;
+        
         class Model
         {
           public:
@@ -75,7 +247,8 @@ namespace dccl
 
             
           Model(const protobuf::ArithmeticModel& user)
-              : user_model_(user)
+              : user_model_(user),
+                value_lookup_scale_(0)
             { }
 
             enum ModelState
@@ -93,14 +266,7 @@ namespace dccl
             symbol_type max_symbol() const { return user_model_.frequency_size() - 1; }
             
             freq_type total_freq(ModelState state) const
-            {
-                
-                const boost::bimap<symbol_type, freq_type>& c_freqs = (state == ENCODER) ?
-                    encoder_cumulative_freqs_ :
-                    decoder_cumulative_freqs_;
-
-                return c_freqs.left.at(max_symbol());
-            }
+            { return cumulative_freqs(state).total(); }
 
             void update_model(symbol_type symbol, ModelState state);
             
@@ -109,10 +275,31 @@ namespace dccl
             std::pair<symbol_type, symbol_type> cumulative_freq_to_symbol(std::pair<freq_type, freq_type> c_freq_pair,  ModelState state) const;
 
             friend class ModelManager;
+            friend class AdaptiveModelState;
+          private:
+            // the frequencies in use: those of the bound AdaptiveModelState for adaptive models, if there is one
+            const CumulativeFrequencies& cumulative_freqs(ModelState state) const;
+            CumulativeFrequencies& mutable_cumulative_freqs(ModelState state);
+
+            // index of a symbol in the CumulativeFrequencies
+            static std::size_t index(symbol_type symbol)
+            { return symbol - MIN_SYMBOL; }
+            static symbol_type symbol(std::size_t index)
+            { return static_cast<symbol_type>(index) + MIN_SYMBOL; }
+            
+          private:
+            void build_value_lookup();
+            
           private:
             protobuf::ArithmeticModel user_model_;
-            boost::bimap<symbol_type, freq_type> encoder_cumulative_freqs_;
-            boost::bimap<symbol_type, freq_type> decoder_cumulative_freqs_;
+            // the frequencies the model starts from, and the (shared) frequencies adapted when no AdaptiveModelState is bound
+            CumulativeFrequencies initial_cumulative_freqs_;
+            CumulativeFrequencies encoder_cumulative_freqs_;
+            CumulativeFrequencies decoder_cumulative_freqs_;
+
+            // value_to_symbol() starts its search of `value_bound` from value_lookup_[(value - value_bound(0)) * value_lookup_scale_]
+            std::vector<symbol_type> value_lookup_;
+            value_type value_lookup_scale_;
         };
 
         class ModelManager
@@ -125,6 +312,7 @@ namespace dccl
                 if(arithmetic_models_.count(model.name()))
                     arithmetic_models_.erase(model.name());
                 arithmetic_models_.insert(std::make_pair(model.name(), new_model));
+                ++generation_;
             }
 
             static void create_and_validate_model(Model* model)
@@ -136,6 +324,7 @@ namespace dccl
                                     "Missing fields: " + model->user_model_.InitializationErrorString()));
                 }
 
+                std::vector<Model::freq_type> freqs;
                 Model::freq_type cumulative_freq = 0;
                 for(Model::symbol_type symbol = Model::MIN_SYMBOL, n = model->user_model_.frequency_size(); symbol < n; ++symbol)
                 {
@@ -154,12 +343,16 @@ namespace dccl
                                         "All frequencies must be nonzero."));
                     }                      
                     cumulative_freq += freq;
-                    model->encoder_cumulative_freqs_.left.insert(std::make_pair(symbol, cumulative_freq));
-                    
+                    freqs.push_back(freq);
                 }
+                model->encoder_cumulative_freqs_.assign(freqs);
+                if(!model->user_model_.is_adaptive())
+                    model->encoder_cumulative_freqs_.build_lookup();
 
                 // must have separate models for adaptive encoding.
                 model->decoder_cumulative_freqs_ = model->encoder_cumulative_freqs_;
+                if(model->user_model_.is_adaptive())
+                    model->initial_cumulative_freqs_ = model->encoder_cumulative_freqs_;
                 
                 if(model->total_freq(Model::ENCODER) > Model::MAX_FREQUENCY)
                 {
@@ -187,6 +380,8 @@ namespace dccl
                                     model->user_model_.DebugString() +
                                     "`value_bound` must be monotonically increasing."));
                 }
+
+                model->build_value_lookup();
             }
             
 
@@ -199,8 +394,75 @@ namespace dccl
                     return it->second;
             }
 
+            /// \brief Incremented by every set_model(), which invalidates references returned by find()
+            static unsigned generation() { return generation_; }
+
+            /// \brief Use `state` (which may be null, for the frequencies shared by every user of the models) for the adaptive models on the calling thread until the next bind_state() on this thread. Usually set with a ScopedAdaptiveModelState.
+            static void bind_state(AdaptiveModelState* state) { bound_state_ = state; }
+
+            /// \brief The AdaptiveModelState in use on the calling thread, or null
+            static AdaptiveModelState* bound_state() { return bound_state_; }
+            
           private:
             static std::map<std::string, Model> arithmetic_models_;
+            static unsigned generation_;
+            // one binding per thread, so that each thread can encode or decode for its own link
+            static DCCL_THREAD_LOCAL AdaptiveModelState* bound_state_;
+        };
+
+        /// \brief The frequencies of the adaptive models as adapted by one link or stream, so that each link adapts to its own statistics.
+        ///
+        /// Bind a state (with ScopedAdaptiveModelState) around each Codec::encode() or Codec::decode() for its link (the binding is per thread); the encoder
+        /// and decoder of a link each keep their own state. A model starts from its initial frequencies the first time it is used with a state.
+        /// Copying a state takes a snapshot (which may be assigned back to roll back), and reset() returns every model to its initial frequencies.
+        /// Replacing any model (ModelManager::set_model()) resets the state. Without a bound state the adaptive models use frequencies shared by every link.
+        class AdaptiveModelState
+        {
+          public:
+            AdaptiveModelState();
+            AdaptiveModelState(const AdaptiveModelState& other);
+            AdaptiveModelState& operator=(const AdaptiveModelState& other);
+
+            /// \brief Return every model to its initial frequencies
+            void reset();
+
+            /// \brief Number of models adapted with this state
+            std::size_t size() const { return frequencies_.size(); }
+            
+          private:
+            friend class Model;
+            CumulativeFrequencies& cumulative_freqs(const Model& model, Model::ModelState state);
+            
+          private:
+            struct Frequencies
+            {
+                CumulativeFrequencies encoder;
+                CumulativeFrequencies decoder;
+            };
+            std::map<const Model*, Frequencies> frequencies_;
+            unsigned generation_;
+
+            // the last model used, to skip the map lookup for successive symbols
+            const Model* last_model_;
+            Frequencies* last_frequencies_;
+        };
+
+        /// \brief Binds an AdaptiveModelState (ModelManager::bind_state()) on the calling thread for its lifetime, then restores the previous one
+        class ScopedAdaptiveModelState
+        {
+          public:
+          explicit ScopedAdaptiveModelState(AdaptiveModelState* state)
+              : previous_(ModelManager::bound_state())
+            { ModelManager::bind_state(state); }
+            
+            ~ScopedAdaptiveModelState()
+            { ModelManager::bind_state(previous_); }
+            
+          private:
+            ScopedAdaptiveModelState(const ScopedAdaptiveModelState&);
+            ScopedAdaptiveModelState& operator=(const ScopedAdaptiveModelState&);
+            
+            AdaptiveModelState* previous_;
         };
         
         
@@ -208,6 +470,13 @@ namespace dccl
             class ArithmeticFieldCodecBase : public RepeatedTypedFieldCodec<Model::value_type, FieldType>
             {   
               public:              
+              ArithmeticFieldCodecBase()
+                  : models_generation_(ModelManager::generation()),
+                  fields_generation_(FieldCodecBase::cache_generation()),
+                  sized_field_(0),
+                  sized_model_(0),
+                  sized_generation_(0)
+                  { }
             
               static const uint64 TOP_VALUE = (static_cast<uint64>(1) << Model::CODE_VALUE_BITS) - 1; // 11111111...
               static const uint64 HALF = (static_cast<uint64>(1) << (Model::CODE_VALUE_BITS-1));      // 10000000...
@@ -221,6 +490,27 @@ namespace dccl
               
               Bitset encode_repeated(const std::vector<Model::value_type>& wire_value,
                                      bool update_model)
+              {
+                  Bitset bits;
+                  if(update_model && sized_encoding_matches(wire_value))
+                      sized_runs_.append_to(&bits);
+                  else
+                      encode_symbols(wire_value, update_model, &bits);
+                  sized_field_ = 0;
+                  
+                  if(FieldCodecBase::dccl_field_options().GetExtension(arithmetic).debug_assert())
+                  {
+                      // bit of a hack so I can get at the exact bit field sizes
+                      Model::last_bits_map[FieldCodecBase::this_descriptor()->full_name()][FieldCodecBase::this_field()->name()] = bits;
+                  }
+                  
+                  return bits;
+              }
+
+              /// \brief Runs the arithmetic coder over the values, writing the bits to `bits` (a Bitset, or BitRuns to only count them)
+              template<typename Output>
+                  void encode_symbols(const std::vector<Model::value_type>& wire_value,
+                                      bool update_model, Output* bits)
               {
                   using dccl::dlog;
                   using namespace dccl::logger;
@@ -230,7 +520,6 @@ namespace dccl
                   uint64 low = 0; // lowest code value (0.0 in decimal version)
                   uint64 high = TOP_VALUE; // highest code value (1.0 in decimal version)
                   int bits_to_follow = 0; // bits to follow with after expanding around half
-                  Bitset bits;
 
                   
                   for(unsigned value_index = 0, n = max_repeat(); value_index < n; ++value_index)
@@ -309,12 +598,12 @@ namespace dccl
                       {
                           if(high<HALF)
                           {
-                              bit_plus_follow(&bits, &bits_to_follow, 0);
+                              bit_plus_follow(bits, &bits_to_follow, 0);
                               dlog.is(DEBUG3) && dlog << "(ArithmeticFieldCodec): completely in [0, 0.5): EXPAND" << std::endl;
                           }
                           else if(low>=HALF)
                           {
-                              bit_plus_follow(&bits, &bits_to_follow, 1);
+                              bit_plus_follow(bits, &bits_to_follow, 1);
                               low -= HALF;
                               high -= HALF;
                               dlog.is(DEBUG3) && dlog << "(ArithmeticFieldCodec): completely in [0.5, 1): EXPAND" << std::endl;
@@ -354,13 +643,13 @@ namespace dccl
                   if(low == 0) // high must be greater than half
                   {
                       if(high != TOP_VALUE || bits_to_follow > 0)
-                          bit_plus_follow(&bits, &bits_to_follow, 0);
+                          bit_plus_follow(bits, &bits_to_follow, 0);
                   }
                   // 0    .     .     .     1
                   //       |                | -- output a single 1
                   else if(high == TOP_VALUE) // 0 < low < half
                   {
-                      bit_plus_follow(&bits, &bits_to_follow, 1);
+                      bit_plus_follow(bits, &bits_to_follow, 1);
                   }
                   // 0    .     .     .     1
                   //     |           |        -- output 01
@@ -368,17 +657,8 @@ namespace dccl
                   else 
                   {
                       bits_to_follow += 1;
-                      bit_plus_follow(&bits, &bits_to_follow, (low < FIRST_QTR) ? 0 : 1);
+                      bit_plus_follow(bits, &bits_to_follow, (low < FIRST_QTR) ? 0 : 1);
                   }
-                  
-                  if(FieldCodecBase::dccl_field_options().GetExtension(arithmetic).debug_assert())
-                  {
-                      // bit of a hack so I can get at the exact bit field sizes
-                      Model::last_bits_map[FieldCodecBase::this_descriptor()->full_name()][FieldCodecBase::this_field()->name()] = bits;
-                  }
-
-                  
-                  return bits;
               }
 
               
@@ -395,6 +675,12 @@ namespace dccl
                       (*bits_to_follow) -= 1;
                   }
               }
+
+              void bit_plus_follow(BitRuns* runs, int* bits_to_follow, bool bit)
+              {
+                  runs->push_back(bit, *bits_to_follow);
+                  *bits_to_follow = 0;
+              }
               
               std::vector<Model::value_type> decode_repeated(Bitset* bits)
               {
@@ -499,8 +785,35 @@ namespace dccl
 
               unsigned size_repeated(const std::vector<Model::value_type>& wire_values)
               {
-                  // we should really cache this for efficiency
-                  return encode_repeated(wire_values, false).size();
+                  // only the runs are kept, and their storage is reused, so sizing allocates nothing once warmed up
+                  sized_runs_.clear();
+                  encode_symbols(wire_values, false, &sized_runs_);
+
+                  // for static models, an encode of the same values (e.g. Codec::size() then Codec::encode()) reuses the runs
+                  Model& model = current_model();
+                  if(model.user_model().is_adaptive())
+                  {
+                      sized_field_ = 0;
+                  }
+                  else
+                  {
+                      sized_field_ = FieldCodecBase::this_field();
+                      sized_model_ = &model;
+                      sized_generation_ = ModelManager::generation();
+                      sized_values_ = wire_values;
+                  }
+                  
+                  return sized_runs_.size();
+              }
+
+              // true if the last size_repeated() encoded these values for this field with the same model
+              bool sized_encoding_matches(const std::vector<Model::value_type>& wire_values)
+              {
+                  return sized_field_ &&
+                      sized_field_ == FieldCodecBase::this_field() &&
+                      sized_generation_ == ModelManager::generation() &&
+                      sized_model_ == &current_model() &&
+                      sized_values_ == wire_values;
               }
             
 
@@ -646,13 +959,39 @@ namespace dccl
 
               Model& current_model()
               {
+                  if(models_generation_ != ModelManager::generation() ||
+                     fields_generation_ != FieldCodecBase::cache_generation())
+                  {
+                      models_.clear();
+                      models_generation_ = ModelManager::generation();
+                      fields_generation_ = FieldCodecBase::cache_generation();
+                  }
+                  
+                  const google::protobuf::FieldDescriptor* field = FieldCodecBase::this_field();
+                  typename std::map<const google::protobuf::FieldDescriptor*, Model*>::const_iterator it = models_.find(field);
+                  if(it != models_.end())
+                      return *it->second;
+
                   std::string name = FieldCodecBase::dccl_field_options().GetExtension(arithmetic).model();
-                  return ModelManager::find(name);
+                  Model& model = ModelManager::find(name);
+                  models_.insert(std::make_pair(field, &model));
+                  return model;
               }
-              
-              
-              
-              
+
+            private:
+              // the model for each field, so that the model name is only looked up (by string) once
+              std::map<const google::protobuf::FieldDescriptor*, Model*> models_;
+              // ModelManager::generation() when models_ was filled
+              unsigned models_generation_;
+              // FieldCodecBase::cache_generation() when models_ was filled
+              unsigned fields_generation_;
+
+              // output of the last size_repeated(), and what it encoded (sized_field_ is null unless it may be reused by encode_repeated())
+              BitRuns sized_runs_;
+              const google::protobuf::FieldDescriptor* sized_field_;
+              const Model* sized_model_;
+              unsigned sized_generation_;
+              std::vector<Model::value_type> sized_values_;
             };
 
         // constant integer definitions
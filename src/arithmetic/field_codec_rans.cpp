@@ -0,0 +1,128 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <numeric>
+
+#include "field_codec_rans.h"
+
+const unsigned dccl::arith::RansModel::MIN_SCALE_BITS;
+const unsigned dccl::arith::RansModel::MAX_SCALE_BITS;
+
+namespace
+{
+    unsigned floor_log2(dccl::uint64 x)
+    {
+        unsigned n = 0;
+        while(x >>= 1)
+            ++n;
+        return n;
+    }
+
+    // orders symbol indices by decreasing remainder of their rescaled frequency
+    struct GreaterRemainder
+    {
+        GreaterRemainder(const std::vector<dccl::uint64>& remainders) : remainders_(remainders) { }
+        bool operator()(std::size_t a, std::size_t b) const
+        { return remainders_[a] > remainders_[b]; }
+        const std::vector<dccl::uint64>& remainders_;
+    };
+}
+
+dccl::arith::RansModel::RansModel(const Model& model)
+    : most_probable_index_(index(0)),
+      max_renorm_bits_(0)
+{
+    const protobuf::ArithmeticModel& user = model.user_model();
+    
+    std::vector<uint64> user_freqs;
+    user_freqs.push_back(user.eof_frequency());
+    user_freqs.push_back(user.out_of_range_frequency());
+    for(int i = 0, n = user.frequency_size(); i < n; ++i)
+    {
+        user_freqs.push_back(user.frequency(i));
+        if(user.frequency(i) > user.frequency(symbol(most_probable_index_)))
+            most_probable_index_ = index(i);
+    }
+
+    const std::size_t num_symbols = user_freqs.size();
+    const uint64 total = std::accumulate(user_freqs.begin(), user_freqs.end(), static_cast<uint64>(0));
+    std::size_t num_nonzero = 0;
+    for(std::size_t i = 0; i < num_symbols; ++i)
+        if(user_freqs[i])
+            ++num_nonzero;
+
+    // about 32 slots per symbol: enough to keep the rescaling loss small without making the decode table (or the flushed state) large
+    const unsigned needed_bits = floor_log2(num_nonzero) + ((num_nonzero & (num_nonzero - 1)) ? 1 : 0);
+    scale_bits_ = std::max(MIN_SCALE_BITS, std::min(MAX_SCALE_BITS, needed_bits + 5));
+    const uint64 scale = static_cast<uint64>(1) << scale_bits_;
+    if(num_nonzero == 0)
+        throw(Exception("Invalid model for dccl.rans: " + user.name() + " has no symbols"));
+    if(num_nonzero > scale)
+        throw(Exception("Invalid model for dccl.rans: " + user.name() + " has more than " + boost::lexical_cast<std::string>(scale) + " symbols"));
+
+    // rescale, rounding down (but keeping every symbol in use), then give the remaining slots to the largest remainders
+    // or take any excess from the largest frequencies
+    freqs_.assign(num_symbols, 0);
+    std::vector<uint64> remainders(num_symbols, 0);
+    uint64 sum = 0;
+    for(std::size_t i = 0; i < num_symbols; ++i)
+    {
+        if(!user_freqs[i])
+            continue;
+        const uint64 scaled = user_freqs[i] * scale;
+        freqs_[i] = std::max<uint64>(1, scaled / total);
+        remainders[i] = scaled % total;
+        sum += freqs_[i];
+    }
+
+    if(sum < scale)
+    {
+        std::vector<std::size_t> order;
+        for(std::size_t i = 0; i < num_symbols; ++i)
+            if(user_freqs[i])
+                order.push_back(i);
+        std::stable_sort(order.begin(), order.end(), GreaterRemainder(remainders));
+        for(std::size_t j = 0; sum < scale; ++sum, j = (j + 1) % order.size())
+            ++freqs_[order[j]];
+    }
+    while(sum > scale)
+    {
+        std::size_t largest = std::max_element(freqs_.begin(), freqs_.end()) - freqs_.begin();
+        --freqs_[largest];
+        --sum;
+    }
+
+    cumulative_.assign(num_symbols, 0);
+    renorm_bits_.assign(num_symbols, 0);
+    slot_index_.resize(scale);
+    Model::freq_type cumulative = 0;
+    for(std::size_t i = 0; i < num_symbols; ++i)
+    {
+        cumulative_[i] = cumulative;
+        if(!freqs_[i])
+            continue;
+        
+        renorm_bits_[i] = scale_bits_ - floor_log2(freqs_[i]);
+        max_renorm_bits_ = std::max(max_renorm_bits_, renorm_bits_[i]);
+        std::fill(slot_index_.begin() + cumulative, slot_index_.begin() + cumulative + freqs_[i], i);
+        cumulative += freqs_[i];
+    }
+}
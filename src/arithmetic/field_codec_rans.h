@@ -0,0 +1,353 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// This code implements the range variant of asymmetric numeral systems (rANS) described by J. Duda, "Asymmetric numeral systems: entropy coding combining speed of Huffman coding with compression rate of arithmetic coding," arXiv:1311.2540, 2013
+
+
+#ifndef DCCLFIELDCODECRANS20171016H
+#define DCCLFIELDCODECRANS20171016H
+
+#include <vector>
+#include <map>
+
+#include "dccl/arithmetic/field_codec_arithmetic.h"
+
+namespace dccl
+{
+    namespace arith
+    {
+        /// \brief The frequencies of a Model rescaled so that they sum to a power of two (2^scale_bits()), with the tables needed to code its symbols with rANS in constant time.
+        ///
+        /// The coder state x is kept in [2^scale_bits(), 2^(scale_bits()+1)) and renormalized one bit at a time, so encoding and decoding a symbol takes no division and no search.
+        class RansModel
+        {
+          public:
+            typedef uint32 state_type;
+            
+            static const unsigned MIN_SCALE_BITS = 6;
+            static const unsigned MAX_SCALE_BITS = 16;
+
+            /// \brief Rescale the frequencies of a (static) model
+            /// \throw Exception The model has more symbols than can be given a nonzero frequency out of 2^MAX_SCALE_BITS
+            explicit RansModel(const Model& model);
+
+            /// \brief log2 of the sum of the rescaled frequencies; the coder state (and the bits flushed at the end of each field) is this many bits
+            unsigned scale_bits() const { return scale_bits_; }
+
+            /// \brief Rescaled frequency of the symbol with index i (Model::symbol_type - Model::MIN_SYMBOL)
+            Model::freq_type freq(std::size_t i) const { return freqs_[i]; }
+
+            /// \brief Index of the symbol with the largest user frequency
+            std::size_t most_probable_index() const { return most_probable_index_; }
+
+            /// \brief Most bits written for any one symbol with a nonzero frequency
+            unsigned max_renorm_bits() const { return max_renorm_bits_; }
+
+            /// \brief Encode the symbol with index i onto state x
+            /// \param x Current state; the low *out_bits bits of x must be written out by the caller
+            /// \param i Symbol index (must have a nonzero frequency)
+            /// \param out_bits Set to the number of low bits of x that this symbol shifts out
+            /// \return New state
+            state_type encode(state_type x, std::size_t i, unsigned* out_bits) const
+            {
+                const unsigned b = renorm_bits_[i];
+                const unsigned shift = ((x >> b) >= freqs_[i]) ? b : b - 1;
+                *out_bits = shift;
+                return (static_cast<state_type>(1) << scale_bits_) + ((x >> shift) - freqs_[i]) + cumulative_[i];
+            }
+
+            /// \brief Decode one symbol from state x
+            /// \param x Current state, replaced by the state before the symbol was encoded, less the *in_bits low bits that the caller must shift in
+            /// \param in_bits Set to the number of bits to shift into x
+            /// \return Symbol index
+            std::size_t decode(state_type* x, unsigned* in_bits) const
+            {
+                const state_type slot = *x & ((static_cast<state_type>(1) << scale_bits_) - 1);
+                const std::size_t i = slot_index_[slot];
+                const state_type y = freqs_[i] + slot - cumulative_[i];
+                const unsigned b = renorm_bits_[i];
+                *in_bits = ((y << b) >> (scale_bits_ + 1)) ? b - 1 : b;
+                *x = y;
+                return i;
+            }
+            
+            static std::size_t index(Model::symbol_type symbol)
+            { return symbol - Model::MIN_SYMBOL; }
+            static Model::symbol_type symbol(std::size_t index)
+            { return static_cast<Model::symbol_type>(index) + Model::MIN_SYMBOL; }
+
+          private:
+            unsigned scale_bits_;
+            std::vector<Model::freq_type> freqs_;
+            std::vector<Model::freq_type> cumulative_;
+            // scale_bits_ - floor(log2(freqs_[i])): a symbol shifts out this many bits of the state, or one fewer
+            std::vector<unsigned> renorm_bits_;
+            // symbol index for each of the 2^scale_bits_ values of the low bits of the state
+            std::vector<uint32> slot_index_;
+            std::size_t most_probable_index_;
+            unsigned max_renorm_bits_;
+        };
+        
+        /// \brief Codes a field with the same models (ArithmeticModel) as ArithmeticFieldCodec, but using rANS, which is much faster than the bit-serial arithmetic coder at the cost of flushing RansModel::scale_bits() bits of state per field. Adaptive models are not supported.
+        ///
+        /// The encoder runs over the symbols in reverse, so the field is laid out as the final state followed by the bits shifted out for each symbol in the order they are decoded.
+        template<typename FieldType = Model::value_type>   
+            class RansFieldCodecBase : public RepeatedTypedFieldCodec<Model::value_type, FieldType>
+            {
+              public:
+              RansFieldCodecBase() : models_generation_(ModelManager::generation()),
+                  fields_generation_(FieldCodecBase::cache_generation())
+                  { }
+
+              Bitset encode_repeated(const std::vector<Model::value_type>& wire_values)
+              {
+                  const RansModel& rans = current_rans_model();
+                  const unsigned scale_bits = rans.scale_bits();
+                  to_symbols(wire_values);
+
+                  RansModel::state_type x = static_cast<RansModel::state_type>(1) << scale_bits;
+                  renorm_.clear();
+                  for(std::vector<std::size_t>::const_reverse_iterator it = symbols_.rbegin(), end = symbols_.rend(); it != end; ++it)
+                  {
+                      unsigned n;
+                      RansModel::state_type next = rans.encode(x, *it, &n);
+                      renorm_.push_back(std::make_pair(x & ((static_cast<RansModel::state_type>(1) << n) - 1), n));
+                      x = next;
+                  }
+
+                  // state (without its leading one), then what was shifted out in reverse, which is decode order
+                  Bitset bits(scale_bits, x - (static_cast<RansModel::state_type>(1) << scale_bits));
+                  for(std::vector<std::pair<RansModel::state_type, unsigned> >::const_reverse_iterator it = renorm_.rbegin(), end = renorm_.rend(); it != end; ++it)
+                  {
+                      for(unsigned j = 0; j < it->second; ++j)
+                          bits.push_back((it->first >> j) & 1);
+                  }
+                  return bits;
+              }
+
+              std::vector<Model::value_type> decode_repeated(Bitset* bits)
+              {
+                  const Model& model = current_model();
+                  const RansModel& rans = current_rans_model();
+                  const unsigned scale_bits = rans.scale_bits();
+                  
+                  // min_size_repeated() is exactly the state
+                  RansModel::state_type x = 1;
+                  for(unsigned j = scale_bits; j > 0; --j)
+                      x = (x << 1) | (*bits)[j - 1];
+
+                  std::vector<Model::value_type> values;
+                  for(unsigned value_index = 0, n = max_repeat(); value_index < n; ++value_index)
+                  {
+                      unsigned in_bits;
+                      const std::size_t i = rans.decode(&x, &in_bits);
+                      
+                      if(in_bits)
+                      {
+                          const std::size_t pos = bits->size();
+                          bits->get_more_bits(in_bits);
+                          RansModel::state_type chunk = 0;
+                          for(unsigned j = in_bits; j > 0; --j)
+                              chunk = (chunk << 1) | (*bits)[pos + j - 1];
+                          x = (x << in_bits) | chunk;
+                      }
+
+                      const Model::symbol_type symbol = RansModel::symbol(i);
+                      if(symbol == Model::EOF_SYMBOL)
+                          break;
+                      values.push_back(model.symbol_to_value(symbol));
+                  }
+                  return values;
+              }
+
+              unsigned size_repeated(const std::vector<Model::value_type>& wire_values)
+              {
+                  const RansModel& rans = current_rans_model();
+                  to_symbols(wire_values);
+                  
+                  RansModel::state_type x = static_cast<RansModel::state_type>(1) << rans.scale_bits();
+                  unsigned size = rans.scale_bits();
+                  for(std::vector<std::size_t>::const_reverse_iterator it = symbols_.rbegin(), end = symbols_.rend(); it != end; ++it)
+                  {
+                      unsigned n;
+                      x = rans.encode(x, *it, &n);
+                      size += n;
+                  }
+                  return size;
+              }
+
+              unsigned max_size_repeated()
+              {
+                  const RansModel& rans = current_rans_model();
+                  return rans.scale_bits() + max_repeat() * rans.max_renorm_bits();
+              }
+            
+              unsigned min_size_repeated()
+              {
+                  return current_rans_model().scale_bits();
+              }
+          
+              void validate()
+              {
+                  FieldCodecBase::require(FieldCodecBase::dccl_field_options().HasExtension(arithmetic),
+                                          "missing (dccl.field).arithmetic");
+
+                  std::string model_name = FieldCodecBase::dccl_field_options().GetExtension(arithmetic).model();
+                  try
+                  {
+                      ModelManager::find(model_name);
+                  }
+                  catch(Exception& e)
+                  {
+                      FieldCodecBase::require(false, "no such (dccl.field).arithmetic.model called \"" + model_name + "\" loaded.");
+                  }
+
+                  FieldCodecBase::require(!current_model().user_model().is_adaptive(),
+                                          "dccl.rans does not support adaptive models (model \"" + model_name + "\")");
+                  try
+                  {
+                      current_rans_model();
+                  }
+                  catch(Exception& e)
+                  {
+                      FieldCodecBase::require(false, e.what());
+                  }
+              }
+
+              // end inherited methods
+
+              dccl::int32 max_repeat()
+              {
+                  return FieldCodecBase::this_field()->is_repeated() ? FieldCodecBase::dccl_field_options().max_repeat() : 1;
+              }
+
+            private:
+              // fills symbols_ with the indices of the symbols to encode, in order
+              void to_symbols(const std::vector<Model::value_type>& wire_values)
+              {
+                  const Model& model = current_model();
+                  const RansModel& rans = current_rans_model();
+                  
+                  symbols_.clear();
+                  for(unsigned value_index = 0, n = max_repeat(); value_index < n; ++value_index)
+                  {
+                      Model::symbol_type symbol = Model::EOF_SYMBOL;
+                      if(value_index < wire_values.size())
+                          symbol = model.value_to_symbol(wire_values[value_index]);
+
+                      // as ArithmeticFieldCodec: if out-of-range is given no frequency, end encoding
+                      if(symbol == Model::OUT_OF_RANGE_SYMBOL &&
+                         model.user_model().out_of_range_frequency() == 0)
+                          symbol = Model::EOF_SYMBOL;
+
+                      // if EOF is given no frequency, fill with the most probable symbol
+                      if(symbol == Model::EOF_SYMBOL &&
+                         model.user_model().eof_frequency() == 0)
+                      {
+                          symbols_.push_back(rans.most_probable_index());
+                          continue;
+                      }
+
+                      symbols_.push_back(RansModel::index(symbol));
+                      if(symbol == Model::EOF_SYMBOL)
+                          break;
+                  }
+              }
+              
+              const Model& current_model()
+              {
+                  return *current_models().first;
+              }
+              
+              const RansModel& current_rans_model()
+              {
+                  return *current_models().second;
+              }
+
+              const std::pair<const Model*, const RansModel*>& current_models()
+              {
+                  if(models_generation_ != ModelManager::generation() ||
+                     fields_generation_ != FieldCodecBase::cache_generation())
+                  {
+                      models_.clear();
+                      rans_models_.clear();
+                      models_generation_ = ModelManager::generation();
+                      fields_generation_ = FieldCodecBase::cache_generation();
+                  }
+                  
+                  const google::protobuf::FieldDescriptor* field = FieldCodecBase::this_field();
+                  typename std::map<const google::protobuf::FieldDescriptor*, std::pair<const Model*, const RansModel*> >::const_iterator it = models_.find(field);
+                  if(it != models_.end())
+                      return it->second;
+
+                  const Model& model = ModelManager::find(FieldCodecBase::dccl_field_options().GetExtension(arithmetic).model());
+                  std::map<const Model*, RansModel>::iterator rans_it = rans_models_.find(&model);
+                  if(rans_it == rans_models_.end())
+                      rans_it = rans_models_.insert(std::make_pair(&model, RansModel(model))).first;
+                  
+                  return models_.insert(std::make_pair(field, std::make_pair(&model, &rans_it->second))).first->second;
+              }
+              
+            private:
+              // the models for each field, and the rescaled models (shared by all the fields using a model), both cleared when ModelManager::generation() changes
+              std::map<const google::protobuf::FieldDescriptor*, std::pair<const Model*, const RansModel*> > models_;
+              std::map<const Model*, RansModel> rans_models_;
+              unsigned models_generation_;
+              // FieldCodecBase::cache_generation() when models_ was filled
+              unsigned fields_generation_;
+              
+              // working storage reused between calls
+              std::vector<std::size_t> symbols_;
+              std::vector<std::pair<RansModel::state_type, unsigned> > renorm_;
+            };
+        
+        template<typename FieldType>   
+            class RansFieldCodec : public RansFieldCodecBase<FieldType>
+        {
+            Model::value_type pre_encode(const FieldType& field_value)
+            { return static_cast<Model::value_type>(field_value); }
+            
+            FieldType post_decode(const Model::value_type& wire_value)
+            { return static_cast<FieldType>(wire_value); }
+        };
+
+        template <>
+            class RansFieldCodec<const google::protobuf::EnumValueDescriptor*> : public RansFieldCodecBase<const google::protobuf::EnumValueDescriptor*>
+        {
+          public:
+            Model::value_type pre_encode(const google::protobuf::EnumValueDescriptor* const& field_value)
+            { return field_value->number(); }
+            
+            const google::protobuf::EnumValueDescriptor* post_decode(const Model::value_type& wire_value)
+            {
+                const google::protobuf::EnumDescriptor* e = FieldCodecBase::this_field()->enum_type();
+                const google::protobuf::EnumValueDescriptor* return_value = e->FindValueByNumber((int)wire_value);
+                
+                if(return_value)
+                    return return_value;
+                else
+                    throw NullValueException();
+            }
+        };   
+    }
+}
+
+#endif
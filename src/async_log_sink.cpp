@@ -0,0 +1,170 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <sstream>
+
+#include "dccl/async_log_sink.h"
+
+#if __cplusplus >= 201103L
+
+dccl::AsyncLogSink::AsyncLogSink(std::ostream* os, bool add_timestamp /* = true */, std::size_t capacity /* = 1024 */)
+    : os_(os),
+      add_timestamp_(add_timestamp),
+      enqueue_pos_(0),
+      dequeue_pos_(0),
+      dropped_(0),
+      dropped_reported_(0),
+      flushed_pos_(0),
+      stop_(false),
+      waiting_(false)
+{
+    std::size_t size = 2;
+    while(size < capacity)
+        size <<= 1;
+    
+    std::vector<Slot>(size).swap(slots_);
+    mask_ = size - 1;
+    for(std::size_t i = 0; i < size; ++i)
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+
+    thread_ = std::thread(&AsyncLogSink::run, this);
+}
+
+dccl::AsyncLogSink::~AsyncLogSink()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    queued_.notify_one();
+    thread_.join();
+}
+
+void dccl::AsyncLogSink::push(const std::string& msg, logger::Verbosity vrb, logger::Group grp)
+{
+    std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Slot* slot = 0;
+    for(;;)
+    {
+        slot = &slots_[pos & mask_];
+        std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+        if(diff == 0)
+        {
+            if(enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if(diff < 0)
+        {
+            // full: the background thread has not yet written the line queued one lap ago
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+
+    // reuses the capacity of the slot's string
+    slot->msg.assign(msg);
+    slot->vrb = vrb;
+    slot->grp = grp;
+    slot->time = add_timestamp_ ? std::time(0) : 0;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    // pairs with the fence in run(): either the background thread sees this line before waiting, or we see waiting_ and wake it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(waiting_.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_.notify_one();
+    }
+}
+
+void dccl::AsyncLogSink::flush()
+{
+    const std::size_t target = enqueue_pos_.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(mutex_);
+    queued_.notify_one();
+    while(static_cast<std::ptrdiff_t>(flushed_pos_ - target) < 0)
+        written_.wait(lock);
+}
+
+bool dccl::AsyncLogSink::write_one()
+{
+    const std::size_t pos = dequeue_pos_;
+    Slot& slot = slots_[pos & mask_];
+    if(slot.sequence.load(std::memory_order_acquire) != pos + 1)
+        return false;
+
+    to_ostream(slot.msg, slot.vrb, slot.grp, os_, add_timestamp_, slot.time);
+    
+    // free the slot for the producer one lap ahead
+    slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+    ++dequeue_pos_;
+    return true;
+}
+
+void dccl::AsyncLogSink::report_dropped()
+{
+    uint64 dropped = dropped_.load(std::memory_order_relaxed);
+    if(dropped != dropped_reported_)
+    {
+        std::stringstream ss;
+        ss << "AsyncLogSink: dropped " << (dropped - dropped_reported_) << " log message(s) (buffer full)";
+        to_ostream(ss.str(), logger::WARN, logger::GENERAL, os_, add_timestamp_, add_timestamp_ ? std::time(0) : 0);
+        dropped_reported_ = dropped;
+    }
+}
+
+void dccl::AsyncLogSink::run()
+{
+    for(;;)
+    {
+        while(write_one());
+        report_dropped();
+        *os_ << std::flush;
+        
+        std::unique_lock<std::mutex> lock(mutex_);
+        flushed_pos_ = dequeue_pos_;
+        written_.notify_all();
+        
+        if(stop_)
+        {
+            if(line_queued())
+                continue; // write lines queued since
+            return;
+        }
+
+        // producers only notify when we are waiting, so check for a line queued since the last write_one() after setting waiting_
+        waiting_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while(!stop_ && !line_queued())
+            queued_.wait(lock);
+        waiting_.store(false, std::memory_order_relaxed);
+    }
+}
+
+bool dccl::AsyncLogSink::line_queued() const
+{ return slots_[dequeue_pos_ & mask_].sequence.load(std::memory_order_acquire) == dequeue_pos_ + 1; }
+
+#endif
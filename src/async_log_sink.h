@@ -0,0 +1,122 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLASYNCLOGSINK20171027H
+#define DCCLASYNCLOGSINK20171027H
+
+// uses the C++11 thread support library
+#if __cplusplus >= 201103L
+
+#include <atomic>
+#include <condition_variable>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "dccl/common.h"
+#include "dccl/logger.h"
+
+namespace dccl
+{
+    /// \brief Asynchronous log sink: log lines are queued in a bounded ring buffer and written to a std::ostream (in the format of dccl::to_ostream) by a background thread.
+    ///
+    /// Queuing a line only copies it (and the current time) into a preallocated slot, so the logging thread never waits on the timestamp formatting or the stream. If the buffer is full the line is dropped and counted (see dropped()); the background thread reports the number of dropped lines to the stream when it catches up. push() may be called concurrently from any number of threads (the ring buffer is lock-free for producers).
+    ///
+    /// Typical usage:
+    /// \code
+    /// dccl::AsyncLogSink sink(&std::cerr);
+    /// dccl::dlog.connect(dccl::logger::DEBUG1_PLUS, &sink, &dccl::AsyncLogSink::push);
+    /// \endcode
+    /// The sink must be disconnected from dlog before it is destroyed. The destructor writes all the queued lines before returning.
+    ///
+    /// Only available when building as C++11 or newer.
+    class AsyncLogSink : boost::noncopyable
+    {
+      public:
+        /// \brief Starts the background thread
+        ///
+        /// \param os Stream to write to (only accessed by the background thread until destruction)
+        /// \param add_timestamp If true, prepend the time each line was queued
+        /// \param capacity Number of lines that can be queued (rounded up to a power of two)
+        AsyncLogSink(std::ostream* os, bool add_timestamp = true, std::size_t capacity = 1024);
+        ~AsyncLogSink();
+
+        /// \brief Queue one log line (slot compatible with Logger::connect). Never blocks; drops the line if the buffer is full.
+        void push(const std::string& msg, logger::Verbosity vrb, logger::Group grp);
+
+        /// \brief Blocks until all lines queued before this call have been written and the stream flushed.
+        void flush();
+
+        /// \brief Total number of lines dropped because the buffer was full.
+        uint64 dropped() const
+        { return dropped_.load(std::memory_order_relaxed); }
+        
+      private:
+        void run();
+        // writes the next queued line, if any; only called from the background thread
+        bool write_one();
+        // whether the next line is ready to be written; only called from the background thread
+        bool line_queued() const;
+        void report_dropped();
+        
+      private:
+        struct Slot
+        {
+            // (bounded queue of D. Vyukov) == position: free for the producer of that position; == position + 1: holds that position's line
+            std::atomic<std::size_t> sequence;
+            std::string msg;
+            logger::Verbosity vrb;
+            logger::Group grp;
+            std::time_t time;
+        };
+        
+        std::ostream* os_;
+        bool add_timestamp_;
+        std::vector<Slot> slots_;
+        std::size_t mask_;
+
+        std::atomic<std::size_t> enqueue_pos_;
+        // only accessed by the background thread
+        std::size_t dequeue_pos_;
+        std::atomic<uint64> dropped_;
+        uint64 dropped_reported_;
+        // lines written and flushed to os_ (guarded by mutex_)
+        std::size_t flushed_pos_;
+
+        std::atomic<bool> stop_;
+        // set while the background thread waits on queued_, so that push() only locks mutex_ to notify it then
+        std::atomic<bool> waiting_;
+        std::mutex mutex_;
+        // signals the background thread that lines are queued (or stop_ is set)
+        std::condition_variable queued_;
+        // signals flush() that flushed_pos_ advanced
+        std::condition_variable written_;
+        std::thread thread_;
+    };
+}
+
+#endif
+
+#endif
@@ -0,0 +1,215 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// benchmarks encoding and decoding with the models of the dccl_arithmetic test (static and adaptive), using the arithmetic coder and rANS
+
+#include <sys/time.h>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "dccl/codec.h"
+#include "dccl/arithmetic/field_codec_arithmetic.h"
+#include "bench.pb.h"
+
+using namespace dccl::bench;
+
+double now()
+{
+    timeval t;
+    gettimeofday(&t, 0);
+    return t.tv_sec + t.tv_usec / 1.0e6;
+}
+
+dccl::arith::protobuf::ArithmeticModel small_model()
+{
+    dccl::arith::protobuf::ArithmeticModel model;
+    model.set_name("small");
+    const double bounds[] = { 100.0, 100.1, 100.2, 100.3, 100.4, 100.5, 100.6, 100.7, 100.8 };
+    const int freqs[] = { 100, 100, 100, 100, 90, 125, 125, 125 };
+    for(int i = 0; i < 8; ++i)
+    {
+        model.add_value_bound(bounds[i]);
+        model.add_frequency(freqs[i]);
+    }
+    model.add_value_bound(bounds[8]);
+    model.set_eof_frequency(25);
+    model.set_out_of_range_frequency(10);
+    return model;
+}
+
+dccl::arith::protobuf::ArithmeticModel enum_model()
+{
+    dccl::arith::protobuf::ArithmeticModel model;
+    model.set_name("enum");
+    const int freqs[] = { 2, 1, 3, 1, 1 };
+    for(int i = 0; i < 5; ++i)
+    {
+        model.add_value_bound(i + 1);
+        model.add_frequency(freqs[i]);
+    }
+    model.add_value_bound(6);
+    model.set_eof_frequency(1);
+    model.set_out_of_range_frequency(0);
+    return model;
+}
+
+dccl::arith::protobuf::ArithmeticModel large_model(const std::string& name, int symbols)
+{
+    srand(1);
+    dccl::arith::protobuf::ArithmeticModel model;
+    model.set_name(name);
+    dccl::arith::Model::freq_type each_max_freq = dccl::arith::Model::MAX_FREQUENCY / (symbols + 2);
+    model.set_eof_frequency(rand() % each_max_freq + 1);
+    model.set_out_of_range_frequency(rand() % each_max_freq + 1);
+    for(int i = 0; i < symbols; ++i)
+    {
+        model.add_value_bound(i * 1000 + rand() % 1000);
+        model.add_frequency(rand() % each_max_freq + 1);
+    }
+    model.add_value_bound(symbols * 1000);
+    return model;
+}
+
+// fills `value` with `n` values drawn from the model's bounds
+template<typename Msg>
+std::vector<Msg> make_messages(const dccl::arith::protobuf::ArithmeticModel& model, int n, int values_per_message)
+{
+    srand(2);
+    std::vector<Msg> msgs(n);
+    for(int i = 0; i < n; ++i)
+    {
+        for(int j = 0; j < values_per_message; ++j)
+            msgs[i].add_value(model.value_bound(rand() % model.frequency_size()));
+    }
+    return msgs;
+}
+
+template<typename Msg>
+std::vector<Msg> make_enum_messages(int n)
+{
+    srand(3);
+    std::vector<Msg> msgs(n);
+    for(int i = 0; i < n; ++i)
+    {
+        for(int j = 0; j < 8; ++j)
+            msgs[i].add_value(static_cast<Letter>(rand() % 5 + 1));
+    }
+    return msgs;
+}
+
+template<typename Msg>
+void run(dccl::Codec& codec, const std::string& title, const dccl::arith::protobuf::ArithmeticModel& model, const std::vector<Msg>& msgs)
+{
+    // adaptive models start over from the same frequencies for the encoder and decoder
+    dccl::arith::ModelManager::set_model(model);
+    std::vector<std::string> encoded(msgs.size());
+    std::size_t values = 0, bytes = 0;
+    
+    double start = now();
+    for(std::size_t i = 0, n = msgs.size(); i < n; ++i)
+    {
+        codec.encode(&encoded[i], msgs[i]);
+        values += msgs[i].value_size();
+        bytes += encoded[i].size();
+    }
+    double encode_time = now() - start;
+
+    start = now();
+    for(std::size_t i = 0, n = msgs.size(); i < n; ++i)
+    {
+        // adaptive models have adapted to the messages since they were encoded
+        if(codec.size(msgs[i]) != encoded[i].size() && !model.is_adaptive())
+        {
+            std::cerr << title << ": size of message " << i << " does not match its encoding" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    double size_time = now() - start;
+
+    Msg msg;
+    start = now();
+    for(std::size_t i = 0, n = msgs.size(); i < n; ++i)
+    {
+        msg.Clear();
+        codec.decode(encoded[i], &msg);
+        if(msg.value_size() != msgs[i].value_size())
+        {
+            std::cerr << title << ": message " << i << " did not decode correctly" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    double decode_time = now() - start;
+
+    std::cout << title << "encode " << encode_time / values * 1e9 << " ns/value, size "
+              << size_time / values * 1e9 << " ns/value, decode "
+              << decode_time / values * 1e9 << " ns/value, "
+              << static_cast<double>(bytes) / msgs.size() << " bytes/message" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int num_messages = (argc > 1) ? atoi(argv[1]) : 2000;
+    
+    dccl::Codec codec;
+    dccl_arithmetic_load(&codec);
+
+    dccl::arith::protobuf::ArithmeticModel small = small_model(),
+        letters = enum_model(),
+        large = large_model("large", 1000),
+        large_adaptive = large_model("large_adaptive", 1000);
+    large_adaptive.set_is_adaptive(true);
+    
+    dccl::arith::ModelManager::set_model(small);
+    dccl::arith::ModelManager::set_model(letters);
+    dccl::arith::ModelManager::set_model(large);
+    dccl::arith::ModelManager::set_model(large_adaptive);
+    codec.load<ArithSmall>();
+    codec.load<ArithEnum>();
+    codec.load<ArithLarge>();
+    codec.load<ArithLargeAdaptive>();
+    codec.load<RansSmall>();
+    codec.load<RansEnum>();
+    codec.load<RansLarge>();
+
+    std::vector<ArithSmall> small_msgs = make_messages<ArithSmall>(small, num_messages, 4);
+    std::vector<ArithEnum> enum_msgs = make_enum_messages<ArithEnum>(num_messages);
+    std::vector<ArithLarge> large_msgs = make_messages<ArithLarge>(large, num_messages, 100);
+    std::vector<ArithLargeAdaptive> large_adaptive_msgs = make_messages<ArithLargeAdaptive>(large_adaptive, num_messages, 100);
+    std::vector<RansSmall> rans_small_msgs = make_messages<RansSmall>(small, num_messages, 4);
+    std::vector<RansEnum> rans_enum_msgs = make_enum_messages<RansEnum>(num_messages);
+    std::vector<RansLarge> rans_large_msgs = make_messages<RansLarge>(large, num_messages, 100);
+
+    std::cout << "Encoding and decoding " << num_messages << " messages per model" << std::endl;
+    
+    // warm up
+    run(codec, "(warm up) ", small, small_msgs);
+    
+    run(codec, "8 symbols, static:            ", small, small_msgs);
+    run(codec, "5 symbols, static:            ", letters, enum_msgs);
+    run(codec, "1000 symbols, static:         ", large, large_msgs);
+    run(codec, "1000 symbols, adaptive:       ", large_adaptive, large_adaptive_msgs);
+    run(codec, "8 symbols, static, rANS:      ", small, rans_small_msgs);
+    run(codec, "5 symbols, static, rANS:      ", letters, rans_enum_msgs);
+    run(codec, "1000 symbols, static, rANS:   ", large, rans_large_msgs);
+    
+    return 0;
+}
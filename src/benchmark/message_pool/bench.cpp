@@ -0,0 +1,196 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// benchmarks decoding a stream of mixed message types (as `dccl --decode` does) with and without dccl::MessagePool
+
+#include <sys/time.h>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "dccl/codec.h"
+#include "dccl/stream_decoder.h"
+#include "bench.pb.h"
+
+using namespace dccl::bench;
+
+double now()
+{
+    timeval t;
+    gettimeofday(&t, 0);
+    return t.tv_sec + t.tv_usec / 1.0e6;
+}
+
+// frames are grouped into reads of `frames_per_read` messages, as they would arrive from a pipe
+typedef std::vector<std::string> Stream;
+const int frames_per_read = 32;
+
+Stream make_stream(dccl::Codec& codec, int num_frames)
+{
+    Stream stream;
+    for(int i = 0; i < num_frames; ++i)
+    {
+        if(i % frames_per_read == 0)
+            stream.push_back(std::string());
+        std::string& bytes = stream.back();
+        
+        switch(i % 3)
+        {
+            case 0:
+            {
+                NavReport nav;
+                nav.set_time(now());
+                nav.set_lat(41.5 + i * 1e-5);
+                nav.set_lon(-70.7 - i * 1e-5);
+                nav.set_depth(i % 6000);
+                for(int j = 0, n = i % 16; j < n; ++j)
+                    nav.add_temperature(10 + j * 0.25);
+                codec.encode(&bytes, nav, false);
+                break;
+            }
+            case 1:
+            {
+                TextCommand cmd;
+                cmd.set_destination(i % 32);
+                cmd.set_command(std::string("goto waypoint ") + std::string(i % 80, 'x'));
+                codec.encode(&bytes, cmd, false);
+                break;
+            }
+            case 2:
+            {
+                LogChunk log;
+                log.set_sequence(i % 65536);
+                for(int j = 0, n = i % 8; j < n; ++j)
+                {
+                    LogChunk::Entry* entry = log.add_entry();
+                    entry->set_code(j);
+                    entry->set_note("entry");
+                }
+                log.set_payload(std::string(i % 64, static_cast<char>(i)));
+                codec.encode(&bytes, log, false);
+                break;
+            }
+        }
+    }
+    return stream;
+}
+
+template<typename Decoder>
+double run(const Stream& stream, int num_frames, Decoder& decode)
+{
+    double start = now();
+    int n = decode(stream);
+    double elapsed = now() - start;
+    if(n != num_frames)
+    {
+        std::cerr << "Decoded " << n << " messages, expected " << num_frames << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return elapsed / num_frames * 1e6;
+}
+
+struct NewMessageDecode
+{
+    NewMessageDecode(dccl::Codec& c) : codec(c) { }
+    int operator()(const Stream& stream)
+    {
+        int n = 0;
+        for(Stream::const_iterator it = stream.begin(), end = stream.end(); it != end; ++it)
+        {
+            std::string bytes = *it;
+            for(; !bytes.empty(); ++n)
+            {
+                boost::shared_ptr<google::protobuf::Message> msg =
+                    codec.decode<boost::shared_ptr<google::protobuf::Message> >(&bytes);
+            }
+        }
+        return n;
+    }
+    dccl::Codec& codec;
+};
+
+struct PoolDecode
+{
+    PoolDecode(dccl::Codec& c) : codec(c) { }
+    int operator()(const Stream& stream)
+    {
+        int n = 0;
+        for(Stream::const_iterator it = stream.begin(), end = stream.end(); it != end; ++it)
+        {
+            std::string bytes = *it;
+            for(; !bytes.empty(); ++n)
+                boost::shared_ptr<google::protobuf::Message> msg = codec.decode_from_pool(&bytes, &pool);
+        }
+        return n;
+    }
+    dccl::Codec& codec;
+    dccl::MessagePool pool;
+};
+
+struct StreamDecode
+{
+    StreamDecode(dccl::Codec& c, bool use_pool) : codec(c), use_pool(use_pool) { }
+    int operator()(const Stream& stream)
+    {
+        dccl::StreamDecoder decoder(&codec, use_pool ? &pool : 0);
+        int n = 0;
+        for(Stream::const_iterator it = stream.begin(), end = stream.end(); it != end; ++it)
+        {
+            decoder.push(it->data(), it->size());
+            for(; !decoder.empty(); ++n)
+                decoder.pop();
+        }
+        decoder.flush();
+        for(; !decoder.empty(); ++n)
+            decoder.pop();
+        return n;
+    }
+    dccl::Codec& codec;
+    bool use_pool;
+    dccl::MessagePool pool;
+};
+
+int main(int argc, char* argv[])
+{
+    int num_frames = (argc > 1) ? atoi(argv[1]) : 10000;
+    
+    dccl::Codec codec;
+    codec.load<NavReport>();
+    codec.load<TextCommand>();
+    codec.load<LogChunk>();
+
+    Stream stream = make_stream(codec, num_frames);
+    std::cout << "Decoding " << num_frames << " messages of three types" << std::endl;
+
+    NewMessageDecode new_message(codec);
+    PoolDecode pool(codec);
+    StreamDecode stream_new(codec, false), stream_pool(codec, true);
+
+    // warm up
+    run(stream, num_frames, pool);
+    
+    std::cout << "decode<shared_ptr>:        " << run(stream, num_frames, new_message) << " us/message" << std::endl;
+    std::cout << "decode with MessagePool:   " << run(stream, num_frames, pool) << " us/message" << std::endl;
+    std::cout << "StreamDecoder:             " << run(stream, num_frames, stream_new) << " us/message" << std::endl;
+    std::cout << "StreamDecoder, MessagePool: " << run(stream, num_frames, stream_pool) << " us/message" << std::endl;
+
+    return 0;
+}
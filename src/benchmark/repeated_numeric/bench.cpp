@@ -0,0 +1,122 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// benchmarks encoding and decoding long repeated numeric fields with the built-in (array) codecs and with per-value codecs
+
+#include <sys/time.h>
+#include <cstdlib>
+#include <iostream>
+
+#include "dccl/codec.h"
+#include "dccl/codecs2/field_codec_default.h"
+#include "bench.pb.h"
+
+using namespace dccl::bench;
+
+double now()
+{
+    timeval t;
+    gettimeofday(&t, 0);
+    return t.tv_sec + t.tv_usec / 1.0e6;
+}
+
+// not DCCL_FINAL, so each value is quantized and packed in turn
+template<typename T>
+class PerValueNumericCodec : public dccl::v2::DefaultNumericFieldCodec<T>
+{ };
+
+template<typename Msg>
+void fill(Msg* msg, int n)
+{
+    for(int i = 0; i < n; ++i)
+    {
+        msg->add_temperature(10 + (i % 100) * 0.25);
+        msg->add_salinity(30 + (i % 50) * 0.125);
+        msg->add_depth(i * 25);
+    }
+}
+
+// returns microseconds per message
+template<typename Msg>
+double run_encode(dccl::Codec& codec, const Msg& msg, int num_messages, std::string* bytes)
+{
+    double start = now();
+    for(int i = 0; i < num_messages; ++i)
+    {
+        bytes->clear();
+        codec.encode(bytes, msg);
+    }
+    return (now() - start) / num_messages * 1e6;
+}
+
+template<typename Msg>
+double run_decode(dccl::Codec& codec, const std::string& bytes, int num_messages)
+{
+    Msg msg;
+    double start = now();
+    for(int i = 0; i < num_messages; ++i)
+        codec.decode(bytes, &msg);
+    double elapsed = now() - start;
+    if(msg.temperature_size() != msg.depth_size())
+    {
+        std::cerr << "Decoded message is inconsistent" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return elapsed / num_messages * 1e6;
+}
+
+int main(int argc, char* argv[])
+{
+    int num_messages = (argc > 1) ? atoi(argv[1]) : 10000;
+    int num_values = (argc > 2) ? atoi(argv[2]) : 200;
+
+    dccl::FieldCodecManager::add<PerValueNumericCodec<float> >("per_value");
+    dccl::FieldCodecManager::add<PerValueNumericCodec<double> >("per_value");
+    dccl::FieldCodecManager::add<PerValueNumericCodec<dccl::int32> >("per_value");
+
+    dccl::Codec codec, per_value_codec;
+    codec.load<Profile>();
+    per_value_codec.load<PerValueProfile>();
+
+    Profile msg;
+    fill(&msg, num_values);
+    PerValueProfile per_value_msg;
+    fill(&per_value_msg, num_values);
+
+    std::cout << "Encoding and decoding " << num_messages << " messages with " << num_values << " values in each of three repeated fields" << std::endl;
+
+    std::string bytes, per_value_bytes;
+    // warm up
+    run_encode(codec, msg, num_messages / 10 + 1, &bytes);
+    run_encode(per_value_codec, per_value_msg, num_messages / 10 + 1, &per_value_bytes);
+    if(bytes != per_value_bytes)
+    {
+        std::cerr << "Encoded messages differ" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::cout << "encode, array:     " << run_encode(codec, msg, num_messages, &bytes) << " us/message" << std::endl;
+    std::cout << "encode, per value: " << run_encode(per_value_codec, per_value_msg, num_messages, &per_value_bytes) << " us/message" << std::endl;
+    std::cout << "decode, array:     " << run_decode<Profile>(codec, bytes, num_messages) << " us/message" << std::endl;
+    std::cout << "decode, per value: " << run_decode<PerValueProfile>(per_value_codec, per_value_bytes, num_messages) << " us/message" << std::endl;
+
+    return 0;
+}
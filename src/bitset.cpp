@@ -43,7 +43,7 @@ dccl::Bitset dccl::Bitset::relinquish_bits(size_type num_bits,
         for(size_type i = 0; i < num_bits; ++i)
         {
             if(this->empty())
-                throw(dccl::Exception("Cannot relinquish_bits - no more bits to give up! Check that all field codecs are always producing (encode) and consuming (decode) the exact same number of bits."));
+                throw(dccl::NotEnoughBitsException("Cannot relinquish_bits - no more bits to give up! Check that all field codecs are always producing (encode) and consuming (decode) the exact same number of bits.", num_bits - i));
             
             out.push_back(this->front());
             this->pop_front();
@@ -309,12 +309,25 @@ namespace dccl
         /// \return A string containing the value of the Bitset, with the least signficant byte in string[0] and the most significant byte in string[size()-1]
         std::string to_byte_string()
         {
-            // number of bytes needed is ceil(size() / 8)
-            std::string s(this->size()/8 + (this->size()%8 ? 1 : 0), 0);
-                
-            for(size_type i = 0, n = this->size(); i < n; ++i)
-                s[i/8] |= static_cast<char>((*this)[i] << (i%8));
-                
+            return to_byte_string(0);
+        }
+
+        /// \brief Returns the bits from position `pos` to the most significant end as a byte string. Equivalent to shifting a copy of the Bitset right by `pos`, resizing it to size()-pos and calling to_byte_string(), without the copy or shift.
+        ///
+        /// \param pos Index of the bit to put into the least significant bit of string[0]
+        /// \return A string containing the value of the bits, with the least signficant byte in string[0]
+        std::string to_byte_string(size_type pos) const
+        {
+            const size_type n = pos < this->size() ? this->size() - pos : 0;
+            // number of bytes needed is ceil(n / 8)
+            std::string s(n/8 + (n%8 ? 1 : 0), 0);
+
+            const_iterator it = this->begin() + (this->size() - n), end = this->end();
+            for(std::string::iterator byte = s.begin(), s_end = s.end(); byte != s_end; ++byte)
+            {
+                for(size_type j = 0; j < 8 && it != end; ++j, ++it)
+                    *byte |= static_cast<char>(*it << j);
+            }
             return s;
         }
 
@@ -357,13 +370,70 @@ namespace dccl
         template<typename CharIterator>
         void from_byte_stream(CharIterator begin, CharIterator end)
         {
-            this->resize(std::distance(begin, end) * 8);
-            int i = 0;
+            this->clear();
+            append_byte_stream(begin, end);
+        }
+
+        /// \brief Adds the contents of a byte string to the big end. Equivalent to append() of a Bitset set by from_byte_string(), without the temporary Bitset.
+        ///
+        /// \param s A string container the values where the least signficant byte in string[0] and the most significant byte in string[size()-1]
+        Bitset& append_byte_string(const std::string& s)
+        {
+            return append_byte_stream(s.begin(), s.end());
+        }
+
+        /// \brief Adds the contents of a byte stream to the big end (see append_byte_string())
+        /// \param begin Iterator pointing to the begining of the input buffer
+        /// \param end Iterator pointing to the end of the input bufer
+        template<typename CharIterator>
+        Bitset& append_byte_stream(CharIterator begin, CharIterator end)
+        {
+            const size_type pos = this->size();
+            this->resize(pos + std::distance(begin, end) * 8);
+            iterator bit = this->begin() + pos;
             for(CharIterator it = begin; it != end; ++it)
             {
-                for(size_type j = 0; j < 8; ++j)
-                    (*this)[i*8+j] = (*it) & (1 << j);
-                ++i;
+                const char c = *it;
+                for(size_type j = 0; j < 8; ++j, ++bit)
+                    *bit = c & (1 << j);
+            }
+            return *this;
+        }
+
+        /// \brief Adds `num_bits` bits to the big end from an array of unsigned integer words, starting with the lsb of words[0] (the bit order of from()). Values packed into words with shifts can be appended in one pass this way, rather than one (temporary) Bitset at a time.
+        ///
+        /// \param words Array of at least ceil(num_bits / std::numeric_limits<WordType>::digits) words
+        /// \param num_bits Number of bits to append
+        template<typename WordType>
+            Bitset& append_words(const WordType* words, size_type num_bits)
+        {
+            const int word_bits = std::numeric_limits<WordType>::digits;
+            const size_type pos = this->size();
+            this->resize(pos + num_bits);
+            iterator bit = this->begin() + pos;
+            for(size_type i = 0; i < num_bits; ++words)
+            {
+                const WordType word = *words;
+                for(int j = 0; j < word_bits && i < num_bits; ++j, ++i, ++bit)
+                    *bit = (word >> j) & 1;
+            }
+            return *this;
+        }
+
+        /// \brief Copies the bits into an array of unsigned integer words, starting with the lsb of words[0] (the inverse of append_words()). The unused high bits of the last word are zero.
+        ///
+        /// \param words Array of at least ceil(size() / std::numeric_limits<WordType>::digits) words
+        template<typename WordType>
+            void to_words(WordType* words) const
+        {
+            const int word_bits = std::numeric_limits<WordType>::digits;
+            const_iterator bit = this->begin(), end = this->end();
+            while(bit != end)
+            {
+                WordType word = 0;
+                for(int j = 0; j < word_bits && bit != end; ++j, ++bit)
+                    word |= static_cast<WordType>(*bit) << j;
+                *words++ = word;
             }
         }
 
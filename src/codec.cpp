@@ -20,6 +20,8 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
 #include <algorithm>
+#include <cstring>
+#include <typeinfo>
 
 #include <dlfcn.h> // for shared library loading
 
@@ -43,6 +45,7 @@
 #include "dccl/codecs3/field_codec_default.h"
 #include "dccl/codecs3/field_codec_var_bytes.h"
 #include "dccl/field_codec_id.h"
+#include "dccl/internal/schema_image.h"
 
 #include "dccl/option_extensions.pb.h"
 
@@ -65,7 +68,8 @@ const unsigned full_width = 60;
 //
 
 dccl::Codec::Codec(const std::string& dccl_id_codec, const std::string& library_path)
-    : id_codec_(dccl_id_codec)
+    : id_codec_(dccl_id_codec),
+      use_generated_codecs_(true)
 {
     set_default_codecs();
     FieldCodecManager::add<DefaultIdentifierCodec>(default_id_codec_name());
@@ -78,6 +82,10 @@ dccl::Codec::Codec(const std::string& dccl_id_codec, const std::string& library_
 
 dccl::Codec::~Codec()
 {
+    for(std::map<int32, const google::protobuf::Descriptor*>::const_iterator it = id2desc_.begin(),
+            end = id2desc_.end(); it != end; ++it)
+        FieldCodecManager::release(it->second);
+    
     for(std::vector<void *>::iterator it = dl_handles_.begin(),
             n = dl_handles_.end(); it != n; ++it)
     {
@@ -94,19 +102,20 @@ void dccl::Codec::set_default_codecs()
 
     if(!defaults_loaded)
     {
+        FieldCodecManager::ScopedBatch batch;
         using google::protobuf::FieldDescriptor;
         
         // version 2
-        FieldCodecManager::add<v2::DefaultNumericFieldCodec<double> >(default_codec_name());
-        FieldCodecManager::add<v2::DefaultNumericFieldCodec<float> >(default_codec_name());
-        FieldCodecManager::add<v2::DefaultBoolCodec>(default_codec_name());
-        FieldCodecManager::add<v2::DefaultNumericFieldCodec<int32> >(default_codec_name());
-        FieldCodecManager::add<v2::DefaultNumericFieldCodec<int64> >(default_codec_name());
-        FieldCodecManager::add<v2::DefaultNumericFieldCodec<uint32> >(default_codec_name());
-        FieldCodecManager::add<v2::DefaultNumericFieldCodec<uint64> >(default_codec_name());
-        FieldCodecManager::add<v2::DefaultStringCodec, FieldDescriptor::TYPE_STRING>(default_codec_name());
-        FieldCodecManager::add<v2::DefaultBytesCodec, FieldDescriptor::TYPE_BYTES>(default_codec_name());
-        FieldCodecManager::add<v2::DefaultEnumCodec >(default_codec_name());
+        FieldCodecManager::add<v2::BuiltinNumericFieldCodec<double> >(default_codec_name());
+        FieldCodecManager::add<v2::BuiltinNumericFieldCodec<float> >(default_codec_name());
+        FieldCodecManager::add<v2::BuiltinBoolCodec>(default_codec_name());
+        FieldCodecManager::add<v2::BuiltinNumericFieldCodec<int32> >(default_codec_name());
+        FieldCodecManager::add<v2::BuiltinNumericFieldCodec<int64> >(default_codec_name());
+        FieldCodecManager::add<v2::BuiltinNumericFieldCodec<uint32> >(default_codec_name());
+        FieldCodecManager::add<v2::BuiltinNumericFieldCodec<uint64> >(default_codec_name());
+        FieldCodecManager::add<v2::BuiltinStringCodec, FieldDescriptor::TYPE_STRING>(default_codec_name());
+        FieldCodecManager::add<v2::BuiltinBytesCodec, FieldDescriptor::TYPE_BYTES>(default_codec_name());
+        FieldCodecManager::add<v2::BuiltinEnumCodec>(default_codec_name());
         FieldCodecManager::add<v2::DefaultMessageCodec, FieldDescriptor::TYPE_MESSAGE>(default_codec_name());
 
         FieldCodecManager::add<v2::TimeCodec<uint64> >("dccl.time2");
@@ -122,20 +131,20 @@ void dccl::Codec::set_default_codecs()
         FieldCodecManager::add<v2::StaticCodec<uint64> >("dccl.static2");
 
         // version 3
-        FieldCodecManager::add<v3::DefaultNumericFieldCodec<double> >(default_codec_name(3));
-        FieldCodecManager::add<v3::DefaultNumericFieldCodec<float> >(default_codec_name(3));
-        FieldCodecManager::add<v3::DefaultBoolCodec>(default_codec_name(3));
-        FieldCodecManager::add<v3::DefaultNumericFieldCodec<int32> >(default_codec_name(3));
-        FieldCodecManager::add<v3::DefaultNumericFieldCodec<int64> >(default_codec_name(3));
-        FieldCodecManager::add<v3::DefaultNumericFieldCodec<uint32> >(default_codec_name(3));
-        FieldCodecManager::add<v3::DefaultNumericFieldCodec<uint64> >(default_codec_name(3));
-        FieldCodecManager::add<v3::DefaultStringCodec, FieldDescriptor::TYPE_STRING>(default_codec_name(3));
-        FieldCodecManager::add<v3::DefaultBytesCodec, FieldDescriptor::TYPE_BYTES>(default_codec_name(3));
-        FieldCodecManager::add<v3::DefaultEnumCodec >(default_codec_name(3));
+        FieldCodecManager::add<v3::BuiltinNumericFieldCodec<double> >(default_codec_name(3));
+        FieldCodecManager::add<v3::BuiltinNumericFieldCodec<float> >(default_codec_name(3));
+        FieldCodecManager::add<v3::BuiltinBoolCodec>(default_codec_name(3));
+        FieldCodecManager::add<v3::BuiltinNumericFieldCodec<int32> >(default_codec_name(3));
+        FieldCodecManager::add<v3::BuiltinNumericFieldCodec<int64> >(default_codec_name(3));
+        FieldCodecManager::add<v3::BuiltinNumericFieldCodec<uint32> >(default_codec_name(3));
+        FieldCodecManager::add<v3::BuiltinNumericFieldCodec<uint64> >(default_codec_name(3));
+        FieldCodecManager::add<v3::BuiltinStringCodec, FieldDescriptor::TYPE_STRING>(default_codec_name(3));
+        FieldCodecManager::add<v3::BuiltinBytesCodec, FieldDescriptor::TYPE_BYTES>(default_codec_name(3));
+        FieldCodecManager::add<v3::BuiltinEnumCodec>(default_codec_name(3));
         FieldCodecManager::add<v3::DefaultMessageCodec, FieldDescriptor::TYPE_MESSAGE>(default_codec_name(3));
 
         // alternative bytes codec that more efficiently encodes variable length bytes fields
-        FieldCodecManager::add<v3::VarBytesCodec, FieldDescriptor::TYPE_BYTES>("dccl.var_bytes");
+        FieldCodecManager::add<v3::BuiltinVarBytesCodec, FieldDescriptor::TYPE_BYTES>("dccl.var_bytes");
         
         // for backwards compatibility
         FieldCodecManager::add<v2::TimeCodec<uint64> >("_time");
@@ -155,7 +164,7 @@ void dccl::Codec::set_default_codecs()
     }
 }
 
-void dccl::Codec::encode_internal(const google::protobuf::Message& msg, bool header_only, Bitset& head_bits, Bitset& body_bits)
+unsigned dccl::Codec::encode_internal(const google::protobuf::Message& msg, bool header_only, Bitset& head_bits, Bitset& body_bits)
 {
     const Descriptor* desc = msg.GetDescriptor();
 
@@ -173,7 +182,9 @@ void dccl::Codec::encode_internal(const google::protobuf::Message& msg, bool hea
     
         
         
-        boost::shared_ptr<FieldCodecBase> codec = FieldCodecManager::find(desc);
+        FieldCodecManager::ScopedSnapshot snapshot;
+        FieldCodecBase::ScopedTrace trace(trace_.get(), id(desc));
+        FieldCodecBase* codec = FieldCodecManager::find(desc);
         boost::shared_ptr<internal::FromProtoCppTypeBase> helper = internal::TypeHelper::find(desc);
 
         if(codec)
@@ -184,6 +195,7 @@ void dccl::Codec::encode_internal(const google::protobuf::Message& msg, bool hea
             internal::MessageStack msg_stack;
             msg_stack.push(msg.GetDescriptor());
             codec->base_encode(&head_bits, msg, HEAD);
+            const unsigned head_bits_used = head_bits.size();
 
             // given header of not even byte size (e.g. 01011), make even byte size (e.g. 00001011)
             head_byte_size = ceil_bits2bytes(head_bits.size());
@@ -197,6 +209,7 @@ void dccl::Codec::encode_internal(const google::protobuf::Message& msg, bool hea
             {
                 codec->base_encode(&body_bits, msg, BODY);
             }
+            return head_bits_used + body_bits.size();
         }
         else
         {
@@ -206,6 +219,9 @@ void dccl::Codec::encode_internal(const google::protobuf::Message& msg, bool hea
     }
     catch(std::exception& e)
     {
+        if(internal::MessageCounters* counters = this->counters(id(desc)))
+            counters->encode_failed((header_only || msg.IsInitialized()) ? FAILURE_OTHER : FAILURE_UNINITIALIZED);
+        
         std::stringstream ss;
         
         ss << "Message " << desc->full_name() << " failed to encode. Reason: " << e.what();
@@ -215,16 +231,99 @@ void dccl::Codec::encode_internal(const google::protobuf::Message& msg, bool hea
     }
 }
 
+namespace
+{
+    // true if desc and all of its (encoded) fields resolve to the DCCL v3 built-in codecs that the code generated by protoc-gen-dccl assumes (see dccl::gen::make_generated_field())
+    bool has_builtin_field_codecs(const Descriptor* desc)
+    {
+        FieldCodecManager::ScopedSnapshot snapshot;
+        const FieldCodecBase* msg_codec = FieldCodecManager::find(desc);
+        if(!msg_codec || typeid(*msg_codec) != typeid(v3::DefaultMessageCodec))
+            return false;
+
+        const bool has_codec_group = desc->options().GetExtension(dccl::msg).has_codec_group() ||
+            desc->options().GetExtension(dccl::msg).has_codec_version();
+        const std::string codec_group = FieldCodecBase::codec_group(desc);
+        
+        for(int i = 0, n = desc->field_count(); i < n; ++i)
+        {
+            const FieldDescriptor* field_desc = desc->field(i);
+            const DCCLFieldOptions& options = field_desc->options().GetExtension(dccl::field);
+            if(options.omit())
+                continue;
+            if(options.has_codec() || field_desc->is_repeated())
+                return false;
+            
+            const FieldCodecBase* field_codec = FieldCodecManager::find(field_desc, has_codec_group, codec_group);
+            if(!field_codec)
+                return false;
+            
+            const std::type_info& type = typeid(*field_codec);
+            switch(field_desc->cpp_type())
+            {
+                case FieldDescriptor::CPPTYPE_INT32: if(type != typeid(v3::BuiltinNumericFieldCodec<int32>)) return false; break;
+                case FieldDescriptor::CPPTYPE_INT64: if(type != typeid(v3::BuiltinNumericFieldCodec<int64>)) return false; break;
+                case FieldDescriptor::CPPTYPE_UINT32: if(type != typeid(v3::BuiltinNumericFieldCodec<uint32>)) return false; break;
+                case FieldDescriptor::CPPTYPE_UINT64: if(type != typeid(v3::BuiltinNumericFieldCodec<uint64>)) return false; break;
+                case FieldDescriptor::CPPTYPE_DOUBLE: if(type != typeid(v3::BuiltinNumericFieldCodec<double>)) return false; break;
+                case FieldDescriptor::CPPTYPE_FLOAT: if(type != typeid(v3::BuiltinNumericFieldCodec<float>)) return false; break;
+                case FieldDescriptor::CPPTYPE_ENUM: if(type != typeid(v3::BuiltinEnumCodec)) return false; break;
+                case FieldDescriptor::CPPTYPE_BOOL: if(type != typeid(v3::BuiltinBoolCodec)) return false; break;
+                default: return false;
+            }
+        }
+        return true;
+    }
+}
+
+const dccl::GeneratedCodecs::Entry* dccl::Codec::generated_codec(const google::protobuf::Descriptor* desc) const
+{
+    // tracing records the individual fields, which the generated codecs do not visit
+    if(!use_generated_codecs_ || trace_)
+        return 0;
+    
+    const GeneratedCodecs::Entry* generated = GeneratedCodecs::find(desc);
+    if(!generated)
+        return 0;
+
+    // the generated code assumes the default identifier codec, and knows nothing of encryption
+    std::map<int32, const Descriptor*>::const_iterator it = id2desc_.find(generated->dccl_id);
+    if(it == id2desc_.end() || it->second != desc || !builtin_codec_descs_.count(desc) ||
+       id_codec_ != default_id_codec_name() ||
+       (!crypto_key_.empty() && !skip_crypto_ids_.count(generated->dccl_id)))
+        return 0;
+    
+    return generated;
+}
+
 size_t dccl::Codec::encode(char* bytes, size_t max_len, const google::protobuf::Message& msg, bool header_only /* = false */)
 {
     const Descriptor* desc = msg.GetDescriptor();
+    internal::MessageCounters* counters = this->counters(id(desc));
+    const uint64 start = internal::MessageCounters::now();
+
+    // the reflection path below reports uninitialized messages
+    const GeneratedCodecs::Entry* generated = header_only ? 0 : generated_codec(desc);
+    if(generated && msg.IsInitialized())
+    {
+        size_t generated_size = generated->encoder(msg, bytes, max_len);
+        if(generated_size)
+        {
+            if(counters)
+                counters->encoded(generated_size, counters->fixed_bits(), internal::MessageCounters::now() - start);
+            return generated_size;
+        }
+    }
+    
     Bitset head_bits;
     Bitset body_bits;
-    encode_internal(msg, header_only, head_bits, body_bits);
+    const unsigned bits_used = encode_internal(msg, header_only, head_bits, body_bits);
 
     size_t head_byte_size = ceil_bits2bytes(head_bits.size());
     if (max_len < head_byte_size)
     {
+        if(counters)
+            counters->encode_failed(FAILURE_BUFFER_TOO_SMALL);
         throw std::length_error("max_len must be >= head_byte_size");
     }
     head_bits.to_byte_string(bytes, head_byte_size);
@@ -239,6 +338,8 @@ size_t dccl::Codec::encode(char* bytes, size_t max_len, const google::protobuf::
         body_byte_size = ceil_bits2bytes(body_bits.size());
         if (max_len < (head_byte_size + body_byte_size))
         {
+            if(counters)
+                counters->encode_failed(FAILURE_BUFFER_TOO_SMALL);
             throw std::length_error("max_len must be >= (head_byte_size + body_byte_size)");
         }
         body_bits.to_byte_string(bytes+head_byte_size, max_len-head_byte_size);
@@ -259,6 +360,8 @@ size_t dccl::Codec::encode(char* bytes, size_t max_len, const google::protobuf::
 
     dlog.is(DEBUG1, ENCODE) && dlog << "Successfully encoded message of type: " << desc->full_name() << std::endl;
 
+    if(counters)
+        counters->encoded(head_byte_size + body_byte_size, bits_used, internal::MessageCounters::now() - start);
     return head_byte_size + body_byte_size;
 }
 
@@ -266,9 +369,26 @@ size_t dccl::Codec::encode(char* bytes, size_t max_len, const google::protobuf::
 void dccl::Codec::encode(std::string* bytes, const google::protobuf::Message& msg, bool header_only /* = false */)
 {
     const Descriptor* desc = msg.GetDescriptor();
+    internal::MessageCounters* counters = this->counters(id(desc));
+    const uint64 start = internal::MessageCounters::now();
+
+    const GeneratedCodecs::Entry* generated = header_only ? 0 : generated_codec(desc);
+    if(generated && msg.IsInitialized())
+    {
+        size_t offset = bytes->size();
+        bytes->resize(offset + generated->size);
+        if(generated->encoder(msg, &(*bytes)[offset], generated->size))
+        {
+            if(counters)
+                counters->encoded(generated->size, counters->fixed_bits(), internal::MessageCounters::now() - start);
+            return;
+        }
+        bytes->resize(offset);
+    }
+    
     Bitset head_bits;
     Bitset body_bits;
-    encode_internal(msg, header_only, head_bits, body_bits);
+    const unsigned bits_used = encode_internal(msg, header_only, head_bits, body_bits);
 
     std::string head_bytes = head_bits.to_byte_string();
 
@@ -293,6 +413,9 @@ void dccl::Codec::encode(std::string* bytes, const google::protobuf::Message& ms
 
     dlog.is(DEBUG1, ENCODE) && dlog << "Successfully encoded message of type: " << desc->full_name() << std::endl;
     *bytes += head_bytes + body_bytes;
+
+    if(counters)
+        counters->encoded(head_bytes.size() + body_bytes.size(), bits_used, internal::MessageCounters::now() - start);
 }
 
 unsigned dccl::Codec::id(const std::string& bytes)
@@ -301,18 +424,127 @@ unsigned dccl::Codec::id(const std::string& bytes)
 }
 
 
-void dccl::Codec::decode(std::string* bytes, google::protobuf::Message* msg)
+size_t dccl::Codec::decode_generated(const std::string& bytes, google::protobuf::Message* msg)
 {
-    decode(*bytes, msg);
-    unsigned last_size = size(*msg);
-    bytes->erase(0, last_size);
+    const GeneratedCodecs::Entry* generated = generated_codec(msg->GetDescriptor());
+    if(!generated)
+        return 0;
+
+    internal::MessageCounters* counters = this->counters(generated->dccl_id);
+    const uint64 start = internal::MessageCounters::now();
+    try
+    {
+        size_t consumed = generated->decoder(bytes.data(), bytes.size(), msg);
+        if(counters)
+            counters->decoded(consumed, internal::MessageCounters::now() - start);
+        return consumed;
+    }
+    catch(std::exception& e)
+    {
+        const NotEnoughBitsException* not_enough_bits = dynamic_cast<NotEnoughBitsException*>(&e);
+        if(counters)
+            counters->decode_failed(not_enough_bits ? FAILURE_TRUNCATED : FAILURE_OTHER);
+
+        std::stringstream ss;
+        ss << "Message " << hex_encode(bytes) <<  " failed to decode. Reason: " << e.what() << std::endl;
+        dlog.is(logger::DEBUG1, logger::DECODE) && dlog << ss.str() << std::endl;
+        if(not_enough_bits)
+            throw(NotEnoughBitsException(ss.str(), not_enough_bits->bits_short()));
+        else
+            throw(Exception(ss.str()));
+    }
 }
 
-void dccl::Codec::decode(const std::string& bytes, google::protobuf::Message* msg, bool header_only /* = false */)
+size_t dccl::Codec::decode(std::string* bytes, google::protobuf::Message* msg)
 {
-    decode(bytes.begin(), bytes.end(), msg, header_only);
+    size_t generated_size = decode_generated(*bytes, msg);
+    if(generated_size)
+    {
+        bytes->erase(0, generated_size);
+        return generated_size;
+    }
+    
+    // use the end of decoding rather than size(*msg), which would re-traverse the entire message
+    std::string::iterator new_begin = decode(bytes->begin(), bytes->end(), msg);
+    size_t consumed = new_begin - bytes->begin();
+    bytes->erase(bytes->begin(), new_begin);
+    return consumed;
 }
 
+size_t dccl::Codec::decode(const std::string& bytes, google::protobuf::Message* msg, bool header_only /* = false */)
+{
+    if(!header_only)
+    {
+        size_t generated_size = decode_generated(bytes, msg);
+        if(generated_size)
+            return generated_size;
+    }
+    
+    return decode(bytes.begin(), bytes.end(), msg, header_only) - bytes.begin();
+}
+
+boost::shared_ptr<google::protobuf::Message> dccl::Codec::decode_from_pool(const std::string& bytes, MessagePool* pool, bool header_only /* = false */, size_t* consumed /* = 0 */)
+{
+    if(!pool)
+        throw(Exception("decode_from_pool() called with NULL MessagePool"));
+    
+    unsigned this_id = id(bytes);
+
+    if(!id2desc_.count(this_id))
+        throw(Exception("Message id " + boost::lexical_cast<std::string>(this_id) + " has not been loaded. Call load() before decoding this type."));
+
+    boost::shared_ptr<google::protobuf::Message> msg = pool->get(id2desc_.find(this_id)->second);
+    size_t this_consumed = decode(bytes, msg.get(), header_only);
+    if(consumed)
+        *consumed = this_consumed;
+    return msg;
+}
+
+boost::shared_ptr<google::protobuf::Message> dccl::Codec::decode_from_pool(std::string* bytes, MessagePool* pool, size_t* consumed /* = 0 */)
+{
+    size_t this_consumed = 0;
+    boost::shared_ptr<google::protobuf::Message> msg = decode_from_pool(*bytes, pool, false, &this_consumed);
+    bytes->erase(0, this_consumed);
+    if(consumed)
+        *consumed = this_consumed;
+    return msg;
+}
+
+#if DCCL_HAS_PROTOBUF_ARENA
+google::protobuf::Message* dccl::Codec::decode_to_arena(const std::string& bytes, google::protobuf::Arena* arena, bool header_only /* = false */, size_t* consumed /* = 0 */)
+{
+    unsigned this_id = id(bytes);
+
+    if(!id2desc_.count(this_id))
+        throw(Exception("Message id " + boost::lexical_cast<std::string>(this_id) + " has not been loaded. Call load() before decoding this type."));
+
+    google::protobuf::Message* msg =
+        dccl::DynamicProtobufManager::new_protobuf_message(id2desc_.find(this_id)->second, arena);
+    try
+    {
+        size_t this_consumed = decode(bytes, msg, header_only);
+        if(consumed)
+            *consumed = this_consumed;
+    }
+    catch(...)
+    {
+        if(!arena) delete msg;
+        throw;
+    }
+    return msg;
+}
+
+google::protobuf::Message* dccl::Codec::decode_to_arena(std::string* bytes, google::protobuf::Arena* arena, size_t* consumed /* = 0 */)
+{
+    size_t this_consumed = 0;
+    google::protobuf::Message* msg = decode_to_arena(*bytes, arena, false, &this_consumed);
+    bytes->erase(0, this_consumed);
+    if(consumed)
+        *consumed = this_consumed;
+    return msg;
+}
+#endif
+
 // makes sure we can actual encode / decode a message of this descriptor given the loaded FieldCodecs
 // checks all bounds on the message
 void dccl::Codec::load(const google::protobuf::Descriptor* desc)
@@ -327,7 +559,8 @@ void dccl::Codec::load(const google::protobuf::Descriptor* desc)
         if(!desc->options().GetExtension(dccl::msg).has_codec_version())
             dlog.is(WARN) && dlog << "** NOTE: No (dccl.msg).codec_version set for DCCL Message '" << desc->full_name() <<  "'. Unless you need backwards compatibility with Goby 2.0 (DCCL2), we highly recommend setting 'option (dccl.msg).codec_version = 3' in the message definition for " << desc->full_name() << " to use the default DCCL3 codecs. If you need compatibility with Goby 2.0, ignore this warning, or set 'option (dccl.msg).codec_version = 2' to remove this warning. **" << std::endl;
         
-        boost::shared_ptr<FieldCodecBase> codec = FieldCodecManager::find(desc);
+        FieldCodecManager::ScopedSnapshot snapshot;
+        FieldCodecBase* codec = FieldCodecManager::find(desc);
 
         unsigned dccl_id = id(desc);
         unsigned head_size_bits, body_size_bits;
@@ -346,10 +579,7 @@ void dccl::Codec::load(const google::protobuf::Descriptor* desc)
         codec->base_validate(desc, HEAD);
         codec->base_validate(desc, BODY);
 
-        if(id2desc_.count(dccl_id) && desc != id2desc_.find(dccl_id)->second)
-            throw(Exception("`dccl id` " + boost::lexical_cast<std::string>(dccl_id) + " is already in use by Message " + id2desc_.find(dccl_id)->second->full_name() + ": " + boost::lexical_cast<std::string>(id2desc_.find(dccl_id)->second)));
-        else
-            id2desc_.insert(std::make_pair(id(desc), desc));
+        add_loaded(desc, dccl_id, head_size_bits + body_size_bits);
 
         dlog.is(DEBUG1) && dlog << "Successfully validated message of type: " << desc->full_name() << std::endl;
 
@@ -372,12 +602,35 @@ void dccl::Codec::load(const google::protobuf::Descriptor* desc)
 }
 
 
+void dccl::Codec::add_loaded(const google::protobuf::Descriptor* desc, unsigned dccl_id, unsigned max_bits)
+{
+    if(id2desc_.count(dccl_id) && desc != id2desc_.find(dccl_id)->second)
+        throw(Exception("`dccl id` " + boost::lexical_cast<std::string>(dccl_id) + " is already in use by Message " + id2desc_.find(dccl_id)->second->full_name() + ": " + boost::lexical_cast<std::string>(id2desc_.find(dccl_id)->second)));
+
+    // loading a message again only refreshes its resolved codecs
+    const bool reloaded = id2desc_.count(dccl_id);
+    id2desc_.insert(std::make_pair(dccl_id, desc));
+    add_counters(desc, dccl_id, max_bits);
+    FieldCodecManager::resolve(desc, !reloaded);
+    
+    // checked once here rather than on every encode and decode
+    if(has_builtin_field_codecs(desc))
+        builtin_codec_descs_.insert(desc);
+    else
+        builtin_codec_descs_.erase(desc);
+}
+
 void dccl::Codec::unload(const google::protobuf::Descriptor* desc)
 {
     unsigned dccl_id = id(desc);
     if(id2desc_.count(dccl_id)) 
     {
         id2desc_.erase(dccl_id);
+        counters_.erase(dccl_id);
+        builtin_codec_descs_.erase(desc);
+        FieldCodecManager::release(desc);
+        // the descriptor may be destroyed (and its address reused) once unloaded
+        FieldCodecBase::invalidate_caches();
     }
     else
     {
@@ -387,11 +640,196 @@ void dccl::Codec::unload(const google::protobuf::Descriptor* desc)
     
 }
 
+namespace
+{
+    // the fields of an embedded message are only encoded by their own codecs (and so recorded in the schema image) if the message uses a default message codec
+    bool schema_image_has_nested(const FieldCodecBase* codec)
+    {
+        return dynamic_cast<const v3::DefaultMessageCodec*>(codec) ||
+            dynamic_cast<const v2::DefaultMessageCodec*>(codec);
+    }
+
+    // the record for field_desc, without its codec name or nested fields
+    internal::SchemaImageField make_schema_image_field(const FieldDescriptor* field_desc)
+    {
+        const DCCLFieldOptions& options = field_desc->options().GetExtension(dccl::field);
+        
+        internal::SchemaImageField field;
+        std::memset(&field, 0, sizeof(field));
+        field.number = field_desc->number();
+        field.max_repeat = options.max_repeat();
+        field.min = options.min();
+        field.max = options.max();
+        field.precision = options.precision();
+        if(options.has_min()) field.flags |= internal::SchemaImageField::HAS_MIN;
+        if(options.has_max()) field.flags |= internal::SchemaImageField::HAS_MAX;
+        if(options.has_precision()) field.flags |= internal::SchemaImageField::HAS_PRECISION;
+        if(options.in_head()) field.flags |= internal::SchemaImageField::IN_HEAD;
+        return field;
+    }
+    
+    void add_schema_image_fields(internal::SchemaImageWriter* writer,
+                                 const Descriptor* desc,
+                                 bool has_codec_group,
+                                 const std::string& codec_group)
+    {
+        for(int i = 0, n = desc->field_count(); i < n; ++i)
+        {
+            const FieldDescriptor* field_desc = desc->field(i);
+            const FieldCodecBase* field_codec = FieldCodecManager::find(field_desc, has_codec_group, codec_group);
+
+            internal::SchemaImageField field = make_schema_image_field(field_desc);
+            field.codec = writer->add_string(field_codec->name());
+            const uint32 index = writer->num_fields();
+            writer->add_field(field);
+
+            if(field_desc->message_type() && schema_image_has_nested(field_codec))
+            {
+                add_schema_image_fields(writer, field_desc->message_type(), has_codec_group, codec_group);
+                writer->field(index).num_nested = writer->num_fields() - index - 1;
+            }
+        }
+    }
+
+    // true if the records [begin, end) still describe the fields of desc: same bounds, and the same codecs resolved in this process
+    bool check_schema_image_fields(const internal::SchemaImageReader& image,
+                                   uint32 begin, uint32 end,
+                                   const Descriptor* desc,
+                                   bool has_codec_group,
+                                   const std::string& codec_group)
+    {
+        int num_fields = 0;
+        for(uint32 j = begin; j < end; j += 1 + image.field(j).num_nested, ++num_fields)
+        {
+            const internal::SchemaImageField& field = image.field(j);
+            const FieldDescriptor* field_desc = desc->FindFieldByNumber(field.number);
+            if(!field_desc)
+                return false;
+
+            const internal::SchemaImageField expected = make_schema_image_field(field_desc);
+            if(field.max_repeat != expected.max_repeat || field.flags != expected.flags ||
+               field.min != expected.min || field.max != expected.max || field.precision != expected.precision)
+                return false;
+            
+            const FieldCodecBase* field_codec = FieldCodecManager::find(field_desc, has_codec_group, codec_group);
+            if(field_codec->name() != image.string(field.codec))
+                return false;
+
+            if(field_desc->message_type() && schema_image_has_nested(field_codec))
+            {
+                if(!check_schema_image_fields(image, j + 1, j + 1 + field.num_nested, field_desc->message_type(), has_codec_group, codec_group))
+                    return false;
+            }
+            else if(field.num_nested != 0)
+            {
+                return false;
+            }
+        }
+        return num_fields == desc->field_count();
+    }
+}
+
+void dccl::Codec::write_schema_image(const std::string& path) const
+{
+    internal::SchemaImageWriter writer;
+    
+    for(std::map<int32, const google::protobuf::Descriptor*>::const_iterator it = id2desc_.begin(), end = id2desc_.end(); it != end; ++it)
+    {
+        const Descriptor* desc = it->second;
+        FieldCodecManager::ScopedSnapshot snapshot;
+        FieldCodecBase* codec = FieldCodecManager::find(desc);
+
+        internal::SchemaImageMessage message;
+        std::memset(&message, 0, sizeof(message));
+        message.fingerprint = internal::schema_fingerprint(desc);
+        message.dccl_id = it->first;
+        message.name = writer.add_string(desc->full_name());
+        message.codec = writer.add_string(codec->name());
+        message.max_bytes = desc->options().GetExtension(dccl::msg).max_bytes();
+
+        // as sized by load()
+        unsigned id_bits = 0;
+        id_codec()->field_size(&id_bits, message.dccl_id, 0);
+        codec->base_max_size(&message.head_max_bits, desc, HEAD);
+        codec->base_max_size(&message.body_max_bits, desc, BODY);
+        codec->base_min_size(&message.head_min_bits, desc, HEAD);
+        codec->base_min_size(&message.body_min_bits, desc, BODY);
+        message.head_max_bits += id_bits;
+        message.head_min_bits += id_bits;
+
+        const bool has_codec_group = desc->options().GetExtension(dccl::msg).has_codec_group() ||
+            desc->options().GetExtension(dccl::msg).has_codec_version();
+        
+        message.first_field = writer.num_fields();
+        add_schema_image_fields(&writer, desc, has_codec_group, FieldCodecBase::codec_group(desc));
+        message.num_fields = writer.num_fields() - message.first_field;
+        writer.add_message(message);
+    }
+
+    writer.write(path, id_codec_);
+    dlog.is(DEBUG1) && dlog << "Wrote schema image of " << id2desc_.size() << " message(s) to " << path << std::endl;
+}
+
+unsigned dccl::Codec::load_schema_image(const std::string& path)
+{
+    internal::MappedFile file(path);
+    internal::SchemaImageReader image(file.data(), file.size());
+
+    // a different identifier codec changes every message's header
+    const bool same_id_codec = (id_codec_ == image.string(image.header().id_codec));
+
+    FieldCodecManager::ScopedSnapshot snapshot;
+    unsigned num_trusted = 0;
+    for(uint32 i = 0, n = image.header().num_messages; i < n; ++i)
+    {
+        const internal::SchemaImageMessage& message = image.message(i);
+        const Descriptor* desc = DynamicProtobufManager::find_descriptor(image.string(message.name));
+        if(!desc)
+            throw(Exception(std::string("Message ") + image.string(message.name) + " in schema image " + path + " cannot be found. Load the .proto file or library containing it before calling load_schema_image()."));
+
+        const DCCLMessageOptions& options = desc->options().GetExtension(dccl::msg);
+        bool trusted = same_id_codec &&
+            message.dccl_id == id(desc) &&
+            message.max_bytes == options.max_bytes() &&
+            ceil_bits2bytes(message.head_max_bits) + ceil_bits2bytes(message.body_max_bits) <= message.max_bytes &&
+            message.fingerprint == internal::schema_fingerprint(desc);
+
+        try
+        {
+            // the codecs registered in this process must resolve to the same ones, for the embedded messages too
+            if(trusted)
+                trusted = (FieldCodecManager::find(desc)->name() == image.string(message.codec));
+            if(trusted)
+                trusted = check_schema_image_fields(image, message.first_field, message.first_field + message.num_fields, desc,
+                                                    options.has_codec_group() || options.has_codec_version(),
+                                                    FieldCodecBase::codec_group(desc));
+        }
+        catch(Exception& e)
+        {
+            trusted = false;
+        }
+
+        if(!trusted)
+        {
+            dlog.is(DEBUG1) && dlog << "Schema image entry for " << desc->full_name() << " is stale; revalidating." << std::endl;
+            load(desc);
+            continue;
+        }
+        
+        add_loaded(desc, message.dccl_id, message.head_max_bits + message.body_max_bits);
+        ++num_trusted;
+        dlog.is(DEBUG1) && dlog << "Loaded message of type: " << desc->full_name() << " from schema image" << std::endl;
+    }
+
+    return num_trusted;
+}
+
 unsigned dccl::Codec::size(const google::protobuf::Message& msg)
 {
     const Descriptor* desc = msg.GetDescriptor();
 
-    boost::shared_ptr<FieldCodecBase> codec = FieldCodecManager::find(desc);
+    FieldCodecManager::ScopedSnapshot snapshot;
+    FieldCodecBase* codec = FieldCodecManager::find(desc);
     
     unsigned dccl_id = id(desc);
     unsigned head_size_bits;
@@ -411,7 +849,8 @@ unsigned dccl::Codec::size(const google::protobuf::Message& msg)
 
 unsigned dccl::Codec::max_size(const google::protobuf::Descriptor* desc) const
 {
-    boost::shared_ptr<FieldCodecBase> codec = FieldCodecManager::find(desc);
+    FieldCodecManager::ScopedSnapshot snapshot;
+    FieldCodecBase* codec = FieldCodecManager::find(desc);
 
     unsigned head_size_bits;
     codec->base_max_size(&head_size_bits, desc, HEAD);
@@ -430,7 +869,8 @@ unsigned dccl::Codec::max_size(const google::protobuf::Descriptor* desc) const
 
 unsigned dccl::Codec::min_size(const google::protobuf::Descriptor* desc) const
 {
-    boost::shared_ptr<FieldCodecBase> codec = FieldCodecManager::find(desc);
+    FieldCodecManager::ScopedSnapshot snapshot;
+    FieldCodecBase* codec = FieldCodecManager::find(desc);
 
     unsigned head_size_bits;
     codec->base_min_size(&head_size_bits, desc, HEAD);
@@ -457,7 +897,8 @@ void dccl::Codec::info(const google::protobuf::Descriptor* desc, std::ostream* p
     {
         try
         {   
-            boost::shared_ptr<FieldCodecBase> codec = FieldCodecManager::find(desc);
+            FieldCodecManager::ScopedSnapshot snapshot;
+            FieldCodecBase* codec = FieldCodecManager::find(desc);
 
             unsigned config_head_bit_size, body_bit_size;
             codec->base_max_size(&config_head_bit_size, desc, HEAD);
@@ -582,7 +1023,10 @@ void dccl::Codec::load_library(void* dl_handle)
     void (*dccl_load_ptr)(dccl::Codec*);
     dccl_load_ptr = (void (*)(dccl::Codec*)) dlsym(dl_handle, "dccl3_load");
     if(dccl_load_ptr)
+    {
+        FieldCodecManager::ScopedBatch batch;
         (*dccl_load_ptr)(this);
+    }
 }
 
 void dccl::Codec::unload_library(void* dl_handle)
@@ -594,7 +1038,10 @@ void dccl::Codec::unload_library(void* dl_handle)
     void (*dccl_unload_ptr)(dccl::Codec*);
     dccl_unload_ptr = (void (*)(dccl::Codec*)) dlsym(dl_handle, "dccl3_unload");
     if(dccl_unload_ptr)
+    {
+        FieldCodecManager::ScopedBatch batch;
         (*dccl_unload_ptr)(this);
+    }
 }
 
 
@@ -618,6 +1065,77 @@ void dccl::Codec::set_crypto_passphrase(const std::string& passphrase, const std
     skip_crypto_ids_ = do_not_encrypt_ids_;
 }
 
+void dccl::Codec::trace_dump(const TraceBuffer& trace, std::ostream* os) const
+{
+    *os << trace.recorded() << " events recorded, showing the last " << trace.size() << " (oldest first)\n";
+    *os << "Offsets and widths are in bits; offsets are from the start of the message part (head or body), not counting the identifier.\n";
+    *os << std::left
+        << std::setw(8) << "id" << std::setw(8) << "op" << std::setw(6) << "part"
+        << std::setw(8) << "offset" << std::setw(8) << "width" << std::setw(12) << "cycles"
+        << std::setw(24) << "codec" << "field" << std::endl;
+
+    // message type at each depth of the current message (events are in the order fields are started)
+    std::vector<const Descriptor*> desc_stack;
+    for(std::size_t i = 0, n = trace.size(); i < n; ++i)
+    {
+        const TraceEvent& event = trace[i];
+
+        std::string name;
+        const FieldDescriptor* field = 0;
+        if(event.depth == 0)
+        {
+            std::map<int32, const Descriptor*>::const_iterator it = id2desc_.find(event.dccl_id);
+            desc_stack.assign(1, it != id2desc_.end() ? it->second : 0);
+            name = desc_stack[0] ? desc_stack[0]->full_name() : "(message not loaded)";
+        }
+        else
+        {
+            const Descriptor* parent = (event.depth <= desc_stack.size()) ? desc_stack[event.depth - 1] : 0;
+            field = parent ? parent->FindFieldByNumber(event.field_number) : 0;
+            desc_stack.resize(event.depth);
+            desc_stack.push_back((field && field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) ? field->message_type() : 0);
+            name = std::string(event.depth, '|') + (field ? field->name() : "#" + boost::lexical_cast<std::string>(event.field_number));
+            if(event.flags & TraceEvent::REPEATED)
+                name += "[]";
+        }
+
+        const FieldCodecBase* codec = FieldCodecManager::find_by_handle(event.codec_handle);
+        std::string codec_name = codec ? codec->name() : "#" + boost::lexical_cast<std::string>(event.codec_handle);
+        
+        *os << std::setw(8) << event.dccl_id
+            << std::setw(8) << ((event.flags & TraceEvent::DECODE) ? "decode" : "encode")
+            << std::setw(6) << ((event.flags & TraceEvent::HEAD) ? "head" : "body")
+            << std::setw(8) << event.bit_offset;
+        if(event.flags & TraceEvent::INCOMPLETE)
+            *os << std::setw(20) << "(failed)";
+        else
+            *os << std::setw(8) << event.bit_width << std::setw(12) << event.cycles;
+        *os << std::setw(24) << codec_name << name << "\n";
+    }
+    *os << std::right << std::flush;
+}
+
+void dccl::Codec::add_counters(const google::protobuf::Descriptor* desc, unsigned dccl_id, unsigned fixed_bits)
+{
+    // reloading a type keeps its counters
+    if(!counters_.count(dccl_id))
+        counters_.insert(std::make_pair(dccl_id, boost::shared_ptr<internal::MessageCounters>(new internal::MessageCounters(desc->full_name(), fixed_bits))));
+}
+
+std::map<dccl::int32, dccl::MessageStats> dccl::Codec::stats() const
+{
+    std::map<int32, MessageStats> stats;
+    for(std::map<int32, boost::shared_ptr<internal::MessageCounters> >::const_iterator it = counters_.begin(), end = counters_.end(); it != end; ++it)
+        stats.insert(std::make_pair(it->first, it->second->snapshot()));
+    return stats;
+}
+
+void dccl::Codec::reset_stats()
+{
+    for(std::map<int32, boost::shared_ptr<internal::MessageCounters> >::iterator it = counters_.begin(), end = counters_.end(); it != end; ++it)
+        it->second->reset();
+}
+
 void dccl::Codec::info_all(std::ostream* param_os /*= 0 */) const
 {
     std::ostream* os = (param_os) ? param_os : &dlog;
@@ -26,15 +26,21 @@
 #include <set>
 #include <map>
 #include <ostream>
+#include <iterator>
 #include <stdexcept>
 #include <vector>
 
 #include <google/protobuf/descriptor.h>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include "binary.h"
 #include "dynamic_protobuf_manager.h"
+#include "message_pool.h"
+#include "generated_codec.h"
+#include "trace.h"
+#include "codec_stats.h"
 #include "logger.h"
 #include "exception.h"
 #include "field_codec.h"
@@ -50,6 +56,7 @@
 namespace dccl
 {
     class FieldCodec;
+    class StreamDecoder;
   
     /// \brief The Dynamic CCL enCODer/DECoder. This is the main class you will use to load, encode and decode DCCL messages. Many users will not need any other DCCL classes than this one.
     /// \ingroup dccl_api
@@ -116,6 +123,21 @@ namespace dccl
         /// \throw dccl::Exception if message is invalid.
         void unload(const google::protobuf::Descriptor* desc);
 
+        /// \brief Writes a compact binary "schema image" of all the loaded (validated) messages to disk.
+        ///
+        /// The image holds the id table, the resolved codec names, the sizes and the field bounds of each loaded message (including the fields of its embedded messages), along with a fingerprint of the message's descriptor and of the message and enum types it uses. Short-lived processes can pass it to load_schema_image() to avoid revalidating the same messages at every start.
+        /// \param path File to write the image to. The image is written to `path`.tmp and then renamed over `path`, so an existing image is replaced whole (processes that have it mapped keep reading the old one)
+        /// \throw Exception if the image cannot be written
+        void write_schema_image(const std::string& path) const;
+
+        /// \brief Loads all the messages in a schema image previously written by write_schema_image().
+        ///
+        /// The image is memory-mapped and each message descriptor is located by name using DynamicProtobufManager::find_descriptor. Messages whose fingerprint, codecs (including those of embedded message fields), bounds and sizes still match the image are loaded without revalidation; all others are loaded (and validated) using load(). The codecs of the trusted messages are resolved (and their per-field values computed, see FieldCodecBase::make_field_data()) as for load().
+        /// \param path File containing the image
+        /// \return Number of messages loaded without revalidation
+        /// \throw Exception if the image is corrupt, a message cannot be found, or a message fails validation.
+        unsigned load_schema_image(const std::string& path);
+        
         /// \brief Set a passphrase to be used when encoded messages to encrypt them and to decrypt messages after decoding them.
         ///
         /// Encryption is performed using AES via the opertional Crypto++ library. If this library is not compiled in, no encryption will be performed.
@@ -123,6 +145,26 @@ namespace dccl
         /// \param do_not_encrypt_ids_ Optional set of DCCL ids for which to skip encrypting or decrypting
         void set_crypto_passphrase(const std::string& passphrase,
                                    const std::set<unsigned>& do_not_encrypt_ids_ = std::set<unsigned>());
+
+        /// \brief Enable (the default) or disable the use of encoders and decoders generated by protoc-gen-dccl (see GeneratedCodecs).
+        ///
+        /// When enabled, messages that have a generated codec are encoded and decoded without reflection, unless this Codec uses a non-default identifier codec, encryption is enabled for the message, or only the header is requested. The generated codec is also not used for a message if, when it was loaded, any of its fields did not resolve to the built-in DCCL v3 codec that the generated code assumes (e.g. "dccl.default3" was replaced, or a field sets (dccl.field).codec); load() the message again after changing its codecs. The encoded bytes are identical either way.
+        void set_use_generated_codecs(bool use)
+        { use_generated_codecs_ = use; }
+
+        /// \brief Record a compact binary TraceEvent for every field encoded or decoded by this Codec (see trace()).
+        ///
+        /// The events are written into a preallocated ring buffer that keeps the most recent `capacity` events, so tracing can be left on and the trace pulled (e.g. with TraceBuffer::write()) when an anomaly is seen. While tracing, messages are always encoded and decoded by reflection (not by generated codecs).
+        void enable_trace(std::size_t capacity = 4096)
+        { trace_.reset(new TraceBuffer(capacity)); }
+
+        /// \brief Stop tracing and discard the trace
+        void disable_trace()
+        { trace_.reset(); }
+
+        /// \brief The events recorded since enable_trace(), or null if tracing is disabled
+        const TraceBuffer* trace() const
+        { return trace_.get(); }
             
         //@}
             
@@ -148,6 +190,21 @@ namespace dccl
         ///
         /// \param os Pointer to a stream to write this information (if 0, writes to dccl::dlog)        
         void info_all(std::ostream* os = 0) const;
+
+        /// \brief Counters for each loaded DCCL type, keyed by `dccl.id`: encodes and decodes (with the bytes and padding bits produced), failures by reason, and latency histograms.
+        ///
+        /// The counters are always kept (as relaxed atomics), so this snapshot may be taken at any time, even while messages are being encoded and decoded. Counters for a type start when it is loaded and are discarded when it is unloaded.
+        std::map<int32, MessageStats> stats() const;
+
+        /// \brief Set all the counters returned by stats() back to zero
+        void reset_stats();
+
+        /// \brief Writes a human readable table of the events in a trace (as shown by `dccl --trace-dump`)
+        ///
+        /// Message, field and codec names are given for the messages loaded into this Codec (and the codecs currently in the FieldCodecManager).
+        /// \param trace Trace recorded by this (or another) Codec (see enable_trace())
+        /// \param os Pointer to a stream to write this information
+        void trace_dump(const TraceBuffer& trace, std::ostream* os) const;
             
         /// \brief Gives the DCCL id (defined by the custom message option extension "(dccl.msg).id" in the .proto file). This ID is used on the wire to unique identify incoming message types.
         ///
@@ -221,10 +278,12 @@ namespace dccl
         /// \param end Iterator pointing to the past-the-end character of the message.
         /// \param msg Pointer to any Google Protobuf Message generated by protoc (i.e. subclass of google::protobuf::Message). The decoded message will be written here.
         /// \param header_only If true, only decode the header (do not try to decrypt (if applicable) and decode the message body)
+        /// \param partial If true, [begin, end) may hold only the first part of the message (e.g. the bytes of a stream received so far): running out of bytes is then not counted as a decode failure in stats()
+        /// \throw NotEnoughBitsException if the bytes end before the message does
         /// \throw Exception if message cannot be decoded.
         /// \return Actual end of decoding, allowing the next message to be decoded starting at this location
         template <typename CharIterator>
-            CharIterator decode(CharIterator begin, CharIterator end, google::protobuf::Message* msg, bool header_only = false);
+            CharIterator decode(CharIterator begin, CharIterator end, google::protobuf::Message* msg, bool header_only = false, bool partial = false);
 
         /// \brief Decode a DCCL message when the type is known at compile time.
         ///
@@ -232,36 +291,82 @@ namespace dccl
         /// \param msg Pointer to any Google Protobuf Message generated by protoc (i.e. subclass of google::protobuf::Message). The decoded message will be written here.
         /// \param header_only If true, only decode the header (do not try to decrypt (if applicable) and decode the message body)
         /// \throw Exception if message cannot be decoded.
-        void decode(const std::string& bytes, google::protobuf::Message* msg, bool header_only = false);
+        /// \return Number of bytes of `bytes` consumed by this message
+        size_t decode(const std::string& bytes, google::protobuf::Message* msg, bool header_only = false);
 
         /// \brief Decode a DCCL message when the type is known at compile time.
         ///
         /// \param bytes encoded message to decode (must already have been validated) which will have the used bytes stripped from the front of the encoded message
         /// \param msg Pointer to any Google Protobuf Message generated by protoc (i.e. subclass of google::protobuf::Message). The decoded message will be written here.
         /// \throw Exception if message cannot be decoded.
-        void decode(std::string* bytes, google::protobuf::Message* msg);
+        /// \return Number of bytes consumed (and stripped from `bytes`)
+        size_t decode(std::string* bytes, google::protobuf::Message* msg);
 
         /// \brief An alterative form for decoding messages for message types <i>not</i> known at compile-time ("dynamic").
         ///
         /// \tparam GoogleProtobufMessagePointer anything that acts like a pointer (has operator*) to a google::protobuf::Message (smart pointers like boost::shared_ptr included)
         /// \param bytes the byte string returned by encode
         /// \param header_only If true, only decode the header (do not try to decrypt (if applicable) and decode the message body)
+        /// \param consumed If not null, set to the number of bytes of `bytes` consumed by this message
         /// \throw Exception if message cannot be decoded
         /// \return pointer to decoded message (a google::protobuf::Message). You are responsible for deleting the memory used by this pointer, so we recommend using a smart pointer here (e.g. boost::shared_ptr or the C++11 equivalent). This message can be examined using the Google Reflection/Descriptor API.
         template<typename GoogleProtobufMessagePointer>
-            GoogleProtobufMessagePointer decode(const std::string& bytes, bool header_only = false);
+            GoogleProtobufMessagePointer decode(const std::string& bytes, bool header_only = false, size_t* consumed = 0);
         
         /// \brief An alterative form for decoding messages for message types <i>not</i> known at compile-time ("dynamic"), where the bytes used are stripped from the front of the encoded message.
         ///
         /// \tparam GoogleProtobufMessagePointer anything that acts like a pointer (has operator*) to a google::protobuf::Message (smart pointers like boost::shared_ptr included)
         /// \param bytes encoded message to decode (must already have been validated) which will have the used bytes stripped from the front of the encoded message
+        /// \param consumed If not null, set to the number of bytes stripped from `bytes`
         /// \throw Exception if message cannot be decoded
         /// \return pointer to decoded message (a google::protobuf::Message). You are responsible for deleting the memory used by this pointer, so we recommend using a smart pointer here (e.g. boost::shared_ptr or the C++11 equivalent). This message can be examined using the Google Reflection/Descriptor API.
         template<typename GoogleProtobufMessagePointer>
-            GoogleProtobufMessagePointer decode(std::string* bytes);
+            GoogleProtobufMessagePointer decode(std::string* bytes, size_t* consumed = 0);
+
+        /// \brief An alterative form for decoding messages for message types <i>not</i> known at compile-time ("dynamic"), where the decoded message is taken from a MessagePool and returned to it when no longer used.
+        ///
+        /// \param bytes the byte string returned by encode
+        /// \param pool Pool to get the message to decode into from (must not be null)
+        /// \param header_only If true, only decode the header (do not try to decrypt (if applicable) and decode the message body)
+        /// \param consumed If not null, set to the number of bytes of `bytes` consumed by this message
+        /// \throw Exception if message cannot be decoded or `pool` is null
+        /// \return pointer to decoded message, which goes back to `pool` when the last copy of the pointer is destroyed
+        boost::shared_ptr<google::protobuf::Message> decode_from_pool(const std::string& bytes, MessagePool* pool, bool header_only = false, size_t* consumed = 0);
+
+        /// \brief An alterative form for decoding messages for message types <i>not</i> known at compile-time ("dynamic") into a message from a MessagePool, where the bytes used are stripped from the front of the encoded message.
+        ///
+        /// \param bytes encoded message to decode (must already have been validated) which will have the used bytes stripped from the front of the encoded message
+        /// \param pool Pool to get the message to decode into from (must not be null)
+        /// \param consumed If not null, set to the number of bytes stripped from `bytes`
+        /// \throw Exception if message cannot be decoded or `pool` is null
+        /// \return pointer to decoded message, which goes back to `pool` when the last copy of the pointer is destroyed
+        boost::shared_ptr<google::protobuf::Message> decode_from_pool(std::string* bytes, MessagePool* pool, size_t* consumed = 0);
+
+#if DCCL_HAS_PROTOBUF_ARENA
+        /// \brief An alterative form for decoding messages for message types <i>not</i> known at compile-time ("dynamic"), where the decoded message and all of its sub-messages and strings are allocated on a google::protobuf::Arena. Use this to decode a batch of messages that are then freed together with the Arena.
+        ///
+        /// \param bytes the byte string returned by encode
+        /// \param arena Arena to allocate the decoded message on. If null, the message is allocated on the heap and deleting it is up to the caller.
+        /// \param header_only If true, only decode the header (do not try to decrypt (if applicable) and decode the message body)
+        /// \param consumed If not null, set to the number of bytes of `bytes` consumed by this message
+        /// \throw Exception if message cannot be decoded
+        /// \return pointer to decoded message, owned by `arena` (do not delete it)
+        google::protobuf::Message* decode_to_arena(const std::string& bytes, google::protobuf::Arena* arena, bool header_only = false, size_t* consumed = 0);
+
+        /// \brief An alterative form for decoding messages for message types <i>not</i> known at compile-time ("dynamic") onto a google::protobuf::Arena, where the bytes used are stripped from the front of the encoded message.
+        ///
+        /// \param bytes encoded message to decode (must already have been validated) which will have the used bytes stripped from the front of the encoded message
+        /// \param arena Arena to allocate the decoded message on. If null, the message is allocated on the heap and deleting it is up to the caller.
+        /// \param consumed If not null, set to the number of bytes stripped from `bytes`
+        /// \throw Exception if message cannot be decoded
+        /// \return pointer to decoded message, owned by `arena` (do not delete it)
+        google::protobuf::Message* decode_to_arena(std::string* bytes, google::protobuf::Arena* arena, size_t* consumed = 0);
+#endif
 
         /// \brief Provides the encoded size (in bytes) of msg. This is useful if you need to know the size of a message before encoding it (encoding it is generally much more expensive than calling this method)
         ///
+        /// Note: to find the number of bytes a decode() used, use the byte count it returns rather than calling size() on the decoded message (which recomputes the size).
+        ///
         /// \param msg Google Protobuf message with DCCL extensions for which the encoded size is requested
         /// \return Encoded (using DCCL) size in bytes
         unsigned size(const google::protobuf::Message& msg);
@@ -311,17 +416,35 @@ namespace dccl
         
       private:
         friend class v2::DefaultMessageCodec;
+        // for id_codec()
+        friend class StreamDecoder;
         Codec(const Codec&);
         Codec& operator= (const Codec&);
 
-        void encode_internal(const google::protobuf::Message& msg, bool header_only, Bitset& header_bits, Bitset& body_bits);
+        // returns the number of bits used (before padding the head and body to whole bytes)
+        unsigned encode_internal(const google::protobuf::Message& msg, bool header_only, Bitset& header_bits, Bitset& body_bits);
 
         void encrypt(std::string* s, const std::string& nonce);
         void decrypt(std::string* s, const std::string& nonce);
 
         void set_default_codecs();
 
-        boost::shared_ptr<FieldCodecBase> id_codec() const
+        // generated codec to use for desc, or null to use reflection
+        const GeneratedCodecs::Entry* generated_codec(const google::protobuf::Descriptor* desc) const;
+        // returns bytes consumed, or 0 if there is no generated codec for msg
+        size_t decode_generated(const std::string& bytes, google::protobuf::Message* msg);
+
+        // counters for a loaded `dccl.id`, or null
+        internal::MessageCounters* counters(unsigned dccl_id) const
+        {
+            std::map<int32, boost::shared_ptr<internal::MessageCounters> >::const_iterator it = counters_.find(dccl_id);
+            return it == counters_.end() ? 0 : it->second.get();
+        }
+        void add_counters(const google::protobuf::Descriptor* desc, unsigned dccl_id, unsigned fixed_bits);
+        // records a validated (or trusted, see load_schema_image()) message as loaded: `max_bits` is its maximum size including the identifier
+        void add_loaded(const google::protobuf::Descriptor* desc, unsigned dccl_id, unsigned max_bits);
+
+        FieldCodecBase* id_codec() const
         {
             return FieldCodecManager::find(google::protobuf::FieldDescriptor::TYPE_UINT32,
                                            id_codec_);
@@ -339,7 +462,16 @@ namespace dccl
         std::string id_codec_;
 
         std::vector<void *> dl_handles_;
-        
+
+        bool use_generated_codecs_;
+        // loaded messages whose fields all used the built-in codecs when loaded (see generated_codec())
+        std::set<const google::protobuf::Descriptor*> builtin_codec_descs_;
+
+        // null unless tracing (enable_trace())
+        boost::scoped_ptr<TraceBuffer> trace_;
+
+        // counters for each loaded `dccl.id` (see stats())
+        std::map<int32, boost::shared_ptr<internal::MessageCounters> > counters_;
     };
 
     inline std::ostream& operator<<(std::ostream& os, const Codec& codec)
@@ -350,7 +482,7 @@ namespace dccl
 }
 
 template<typename GoogleProtobufMessagePointer>
-GoogleProtobufMessagePointer dccl::Codec::decode(const std::string& bytes, bool header_only /* = false */)
+GoogleProtobufMessagePointer dccl::Codec::decode(const std::string& bytes, bool header_only /* = false */, size_t* consumed /* = 0 */)
 {
     unsigned this_id = id(bytes);
 
@@ -360,12 +492,14 @@ GoogleProtobufMessagePointer dccl::Codec::decode(const std::string& bytes, bool
     // ownership of this object goes to the caller of decode()
     GoogleProtobufMessagePointer msg =
         dccl::DynamicProtobufManager::new_protobuf_message<GoogleProtobufMessagePointer>(id2desc_.find(this_id)->second);
-    decode(bytes, &(*msg), header_only);
+    size_t this_consumed = decode(bytes, &(*msg), header_only);
+    if(consumed)
+        *consumed = this_consumed;
     return msg;
 }
 
 template<typename GoogleProtobufMessagePointer>
-GoogleProtobufMessagePointer dccl::Codec::decode(std::string* bytes)
+GoogleProtobufMessagePointer dccl::Codec::decode(std::string* bytes, size_t* consumed /* = 0 */)
 {
     unsigned this_id = id(*bytes);
 
@@ -374,8 +508,9 @@ GoogleProtobufMessagePointer dccl::Codec::decode(std::string* bytes)
                     
     GoogleProtobufMessagePointer msg =
         dccl::DynamicProtobufManager::new_protobuf_message<GoogleProtobufMessagePointer>(id2desc_.find(this_id)->second);
-    std::string::iterator new_begin = decode(bytes->begin(), bytes->end(), &(*msg));
-    bytes->erase(bytes->begin(), new_begin);
+    size_t this_consumed = decode(bytes, &(*msg));
+    if(consumed)
+        *consumed = this_consumed;
     return msg;
 }
 
@@ -402,8 +537,10 @@ unsigned dccl::Codec::id(CharIterator begin, CharIterator end)
 }
 
 template <typename CharIterator>
-CharIterator dccl::Codec::decode(CharIterator begin, CharIterator end, google::protobuf::Message* msg, bool header_only /*= false*/)
+CharIterator dccl::Codec::decode(CharIterator begin, CharIterator end, google::protobuf::Message* msg, bool header_only /*= false*/, bool partial /*= false*/)
 {
+    const uint64 start = internal::MessageCounters::now();
+    internal::MessageCounters* counters = 0;
     try
     {
         unsigned this_id = id(begin, end);
@@ -412,12 +549,15 @@ CharIterator dccl::Codec::decode(CharIterator begin, CharIterator end, google::p
         
         if(!id2desc_.count(this_id))
             throw(Exception("Message id " + boost::lexical_cast<std::string>(this_id) + " has not been loaded. Call load() before decoding this type."));
+        counters = this->counters(this_id);
 
         const google::protobuf::Descriptor* desc = msg->GetDescriptor();
 
         dlog.is(logger::DEBUG1, logger::DECODE) && dlog  << "Type name: " << desc->full_name() << std::endl;
 
-        boost::shared_ptr<FieldCodecBase> codec = FieldCodecManager::find(desc);
+        FieldCodecManager::ScopedSnapshot snapshot;
+        FieldCodecBase::ScopedTrace trace(trace_.get(), this_id);
+        FieldCodecBase* codec = FieldCodecManager::find(desc);
         boost::shared_ptr<internal::FromProtoCppTypeBase> helper = internal::TypeHelper::find(desc);
 
         CharIterator actual_end = end;
@@ -434,6 +574,10 @@ CharIterator dccl::Codec::decode(CharIterator begin, CharIterator end, google::p
             unsigned head_size_bytes = ceil_bits2bytes(head_size_bits);
             unsigned body_size_bytes = ceil_bits2bytes(body_size_bits);
 
+            if(std::distance(begin, end) < static_cast<std::ptrdiff_t>(head_size_bytes))
+                throw(NotEnoughBitsException("Message is shorter than its header (" + boost::lexical_cast<std::string>(head_size_bytes) + " bytes)",
+                                             static_cast<unsigned>(BITS_IN_BYTE*(head_size_bytes - std::distance(begin, end)))));
+
             dlog.is(logger::DEBUG2, logger::DECODE) && dlog  << "Head bytes (bits): " << head_size_bytes << "(" << head_size_bits
                                     << "), max body bytes (bits): " << body_size_bytes << "(" << body_size_bits << ")" <<  std::endl;
 
@@ -494,16 +638,25 @@ CharIterator dccl::Codec::decode(CharIterator begin, CharIterator end, google::p
         }
 
         dlog.is(logger::DEBUG1, logger::DECODE) && dlog  << "Successfully decoded message of type: " << desc->full_name() << std::endl;
+        if(counters)
+            counters->decoded(std::distance(begin, actual_end), internal::MessageCounters::now() - start);
         return actual_end;
     }
     catch(std::exception& e)
     {
+        const NotEnoughBitsException* not_enough_bits = dynamic_cast<NotEnoughBitsException*>(&e);
+        if(counters && !(partial && not_enough_bits))
+            counters->decode_failed(not_enough_bits ? FAILURE_TRUNCATED : FAILURE_OTHER);
+
         std::stringstream ss;
 
         ss << "Message " << hex_encode(begin, end) <<  " failed to decode. Reason: " << e.what() << std::endl;
 
         dlog.is(logger::DEBUG1, logger::DECODE) && dlog << ss.str() << std::endl;
-        throw(Exception(ss.str()));
+        if(not_enough_bits)
+            throw(NotEnoughBitsException(ss.str(), not_enough_bits->bits_short()));
+        else
+            throw(Exception(ss.str()));
     }
 }
 
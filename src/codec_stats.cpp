@@ -0,0 +1,199 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <iomanip>
+#include <sstream>
+
+#if __cplusplus >= 201103L
+#include <chrono>
+#else
+#include <time.h>
+#endif
+
+#include "dccl/codec_stats.h"
+
+namespace
+{
+    void load(const boost::atomic<dccl::uint64>* counters, int n, dccl::uint64* values)
+    {
+        for(int i = 0; i < n; ++i)
+            values[i] = counters[i].load(boost::memory_order_relaxed);
+    }
+    
+    void zero(boost::atomic<dccl::uint64>* counters, int n)
+    {
+        for(int i = 0; i < n; ++i)
+            counters[i].store(0, boost::memory_order_relaxed);
+    }
+
+    // e.g. "1.5 ms"
+    std::string format_nanoseconds(dccl::uint64 ns)
+    {
+        std::stringstream ss;
+        ss << std::setprecision(3);
+        if(ns < 1000)
+            ss << ns << " ns";
+        else if(ns < 1000000)
+            ss << ns / 1.0e3 << " us";
+        else if(ns < 1000000000)
+            ss << ns / 1.0e6 << " ms";
+        else
+            ss << ns / 1.0e9 << " s";
+        return ss.str();
+    }
+
+    void write_failures(std::ostream& os, const dccl::uint64* failures)
+    {
+        bool any = false;
+        for(int i = 0; i < dccl::NUM_STATS_FAILURES; ++i)
+        {
+            if(failures[i])
+            {
+                os << (any ? ", " : " (") << dccl::stats_failure_name(static_cast<dccl::StatsFailure>(i)) << ": " << failures[i];
+                any = true;
+            }
+        }
+        if(any)
+            os << ")";
+    }
+
+    void write_latency(std::ostream& os, const dccl::LatencyHistogram& latency)
+    {
+        if(!latency.count())
+            return;
+        os << "    latency: median <= " << format_nanoseconds(latency.quantile(0.5))
+           << ", 99% <= " << format_nanoseconds(latency.quantile(0.99))
+           << ", max <= " << format_nanoseconds(latency.quantile(1)) << "\n";
+    }
+}
+
+const char* dccl::stats_failure_name(StatsFailure failure)
+{
+    switch(failure)
+    {
+        case FAILURE_UNINITIALIZED: return "uninitialized";
+        case FAILURE_BUFFER_TOO_SMALL: return "buffer too small";
+        case FAILURE_TRUNCATED: return "truncated";
+        default:
+        case FAILURE_OTHER: return "other";
+    }
+}
+
+dccl::uint64 dccl::LatencyHistogram::count() const
+{
+    uint64 total = 0;
+    for(int i = 0; i < NUM_BUCKETS; ++i)
+        total += buckets[i];
+    return total;
+}
+
+dccl::uint64 dccl::LatencyHistogram::quantile(double q) const
+{
+    const uint64 total = count();
+    if(!total)
+        return 0;
+    
+    uint64 seen = 0;
+    for(int i = 0; i < NUM_BUCKETS; ++i)
+    {
+        seen += buckets[i];
+        if(seen >= q * total)
+            return (static_cast<uint64>(1) << (i + 1)) - 1;
+    }
+    return (static_cast<uint64>(1) << NUM_BUCKETS) - 1;
+}
+
+std::ostream& dccl::operator<<(std::ostream& os, const MessageStats& stats)
+{
+    uint64 encode_failures = 0, decode_failures = 0;
+    for(int i = 0; i < NUM_STATS_FAILURES; ++i)
+    {
+        encode_failures += stats.encode_failures[i];
+        decode_failures += stats.decode_failures[i];
+    }
+
+    os << stats.name << "\n";
+    os << "  encoded: " << stats.encode_count << " messages, " << stats.encode_bytes << " bytes";
+    if(stats.encode_count)
+        os << " (" << std::setprecision(4) << static_cast<double>(stats.encode_bytes) / stats.encode_count << " bytes/message)";
+    os << ", " << stats.encode_padding_bits << " padding bits";
+    if(stats.encode_bytes)
+        os << " (" << std::setprecision(3) << 100.0 * stats.encode_padding_bits / (8 * stats.encode_bytes) << "%)";
+    os << "; " << encode_failures << " failed";
+    write_failures(os, stats.encode_failures);
+    os << "\n";
+    write_latency(os, stats.encode_latency);
+    
+    os << "  decoded: " << stats.decode_count << " messages, " << stats.decode_bytes << " bytes; " << decode_failures << " failed";
+    write_failures(os, stats.decode_failures);
+    os << "\n";
+    write_latency(os, stats.decode_latency);
+    return os;
+}
+
+dccl::internal::MessageCounters::MessageCounters(const std::string& name, unsigned fixed_bits)
+    : name_(name),
+      fixed_bits_(fixed_bits)
+{
+    reset();
+}
+
+dccl::uint64 dccl::internal::MessageCounters::now()
+{
+#if __cplusplus >= 201103L
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return static_cast<uint64>(t.tv_sec) * 1000000000 + t.tv_nsec;
+#endif
+}
+
+dccl::MessageStats dccl::internal::MessageCounters::snapshot() const
+{
+    MessageStats stats;
+    stats.name = name_;
+    stats.encode_count = encode_count_.load(boost::memory_order_relaxed);
+    stats.encode_bytes = encode_bytes_.load(boost::memory_order_relaxed);
+    stats.encode_bits = encode_bits_.load(boost::memory_order_relaxed);
+    // each counter is read separately, so clamp in case of an encode in between
+    stats.encode_padding_bits = (8 * stats.encode_bytes > stats.encode_bits) ? 8 * stats.encode_bytes - stats.encode_bits : 0;
+    load(encode_failures_, NUM_STATS_FAILURES, stats.encode_failures);
+    load(encode_latency_, LatencyHistogram::NUM_BUCKETS, stats.encode_latency.buckets);
+    stats.decode_count = decode_count_.load(boost::memory_order_relaxed);
+    stats.decode_bytes = decode_bytes_.load(boost::memory_order_relaxed);
+    load(decode_failures_, NUM_STATS_FAILURES, stats.decode_failures);
+    load(decode_latency_, LatencyHistogram::NUM_BUCKETS, stats.decode_latency.buckets);
+    return stats;
+}
+
+void dccl::internal::MessageCounters::reset()
+{
+    encode_count_.store(0, boost::memory_order_relaxed);
+    encode_bytes_.store(0, boost::memory_order_relaxed);
+    encode_bits_.store(0, boost::memory_order_relaxed);
+    zero(encode_failures_, NUM_STATS_FAILURES);
+    zero(encode_latency_, LatencyHistogram::NUM_BUCKETS);
+    decode_count_.store(0, boost::memory_order_relaxed);
+    decode_bytes_.store(0, boost::memory_order_relaxed);
+    zero(decode_failures_, NUM_STATS_FAILURES);
+    zero(decode_latency_, LatencyHistogram::NUM_BUCKETS);
+}
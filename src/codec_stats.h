@@ -0,0 +1,177 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLCODECSTATS20171030H
+#define DCCLCODECSTATS20171030H
+
+#include <algorithm>
+#include <ostream>
+#include <string>
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "dccl/common.h"
+
+namespace dccl
+{
+    /// \brief Reasons that an encode or decode failed, as counted in MessageStats
+    enum StatsFailure
+    {
+        /// (encode) required fields are not set
+        FAILURE_UNINITIALIZED,
+        /// (encode) the buffer passed is too small for the message
+        FAILURE_BUFFER_TOO_SMALL,
+        /// (decode) the bytes end before the message does
+        FAILURE_TRUNCATED,
+        /// any other error (e.g. an invalid value, or a field codec error)
+        FAILURE_OTHER,
+        NUM_STATS_FAILURES
+    };
+
+    /// \brief Name of a StatsFailure (e.g. "truncated")
+    const char* stats_failure_name(StatsFailure failure);
+    
+    /// \brief Histogram of latencies with logarithmic (power of two) buckets: bucket i counts latencies of [2^i, 2^(i+1)) nanoseconds (bucket 0 also counts 0 ns)
+    struct LatencyHistogram
+    {
+        enum { NUM_BUCKETS = 40 };
+        
+        LatencyHistogram()
+        { std::fill(buckets, buckets + NUM_BUCKETS, 0); }
+
+        /// \brief Bucket for a latency
+        static int bucket(uint64 nanoseconds)
+        {
+            int b = 0;
+            while(nanoseconds >>= 1)
+                ++b;
+            return b < NUM_BUCKETS ? b : NUM_BUCKETS - 1;
+        }
+        
+        /// \brief Total number of latencies recorded
+        uint64 count() const;
+
+        /// \brief Upper bound (in nanoseconds) of the bucket containing the given quantile (e.g. 0.5 for the median), or 0 if empty
+        uint64 quantile(double q) const;
+        
+        uint64 buckets[NUM_BUCKETS];
+    };
+
+    /// \brief Counters for one DCCL message type (see Codec::stats())
+    struct MessageStats
+    {
+        MessageStats()
+            : encode_count(0),
+              encode_bytes(0),
+              encode_bits(0),
+              encode_padding_bits(0),
+              decode_count(0),
+              decode_bytes(0)
+        {
+            std::fill(encode_failures, encode_failures + NUM_STATS_FAILURES, 0);
+            std::fill(decode_failures, decode_failures + NUM_STATS_FAILURES, 0);
+        }
+
+        /// full name of the message type
+        std::string name;
+        
+        /// successful encodes
+        uint64 encode_count;
+        /// bytes produced by encode
+        uint64 encode_bytes;
+        /// bits used by the encoded fields (including the identifier)
+        uint64 encode_bits;
+        /// bits of zeros added to reach whole bytes (after the header and after the body): encode_bytes * 8 - encode_bits
+        uint64 encode_padding_bits;
+        /// failed encodes, by StatsFailure
+        uint64 encode_failures[NUM_STATS_FAILURES];
+        LatencyHistogram encode_latency;
+
+        /// successful decodes
+        uint64 decode_count;
+        /// bytes consumed by decode
+        uint64 decode_bytes;
+        /// failed decodes, by StatsFailure
+        uint64 decode_failures[NUM_STATS_FAILURES];
+        LatencyHistogram decode_latency;
+    };
+
+    /// \brief Writes a human readable summary of the counters for a message type
+    std::ostream& operator<<(std::ostream& os, const MessageStats& stats);
+    
+    namespace internal
+    {
+        /// \brief Live counters behind MessageStats. Updated with relaxed atomics, so they may be read (snapshot()) while messages are being encoded and decoded.
+        class MessageCounters : boost::noncopyable
+        {
+          public:
+            /// \param name full name of the message type
+            /// \param fixed_bits bits used by every message of this type if it is fixed size (see encoded() for the generated codecs, which do not count bits)
+            MessageCounters(const std::string& name, unsigned fixed_bits);
+            
+            unsigned fixed_bits() const { return fixed_bits_; }
+            
+            void encoded(std::size_t bytes, unsigned bits, uint64 nanoseconds)
+            {
+                add(encode_count_, 1);
+                add(encode_bytes_, bytes);
+                add(encode_bits_, bits);
+                add(encode_latency_[LatencyHistogram::bucket(nanoseconds)], 1);
+            }
+            void encode_failed(StatsFailure failure)
+            { add(encode_failures_[failure], 1); }
+
+            void decoded(std::size_t bytes, uint64 nanoseconds)
+            {
+                add(decode_count_, 1);
+                add(decode_bytes_, bytes);
+                add(decode_latency_[LatencyHistogram::bucket(nanoseconds)], 1);
+            }
+            void decode_failed(StatsFailure failure)
+            { add(decode_failures_[failure], 1); }
+            
+            MessageStats snapshot() const;
+            void reset();
+
+            /// \brief Monotonic clock (in nanoseconds) used for the latencies
+            static uint64 now();
+            
+          private:
+            static void add(boost::atomic<uint64>& counter, uint64 value)
+            { counter.fetch_add(value, boost::memory_order_relaxed); }
+            
+            std::string name_;
+            unsigned fixed_bits_;
+            boost::atomic<uint64> encode_count_;
+            boost::atomic<uint64> encode_bytes_;
+            boost::atomic<uint64> encode_bits_;
+            boost::atomic<uint64> encode_failures_[NUM_STATS_FAILURES];
+            boost::atomic<uint64> encode_latency_[LatencyHistogram::NUM_BUCKETS];
+            boost::atomic<uint64> decode_count_;
+            boost::atomic<uint64> decode_bytes_;
+            boost::atomic<uint64> decode_failures_[NUM_STATS_FAILURES];
+            boost::atomic<uint64> decode_latency_[LatencyHistogram::NUM_BUCKETS];
+        };
+    }
+}
+
+#endif
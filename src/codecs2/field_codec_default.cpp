@@ -93,19 +93,12 @@ dccl::Bitset dccl::v2::DefaultStringCodec::encode(const std::string& wire_value)
     }
         
             
-    Bitset value_bits;
-    value_bits.from_byte_string(s);
-    
     Bitset length_bits(min_size(), s.length());
 
-    dccl::dlog.is(DEBUG2) && dccl::dlog << "DefaultStringCodec value_bits: " << value_bits << std::endl;    
-
-    
     dccl::dlog.is(DEBUG2) && dccl::dlog << "DefaultStringCodec length_bits: " << length_bits << std::endl;    
     
     // adds to MSBs
-    for(int i = 0, n = value_bits.size(); i < n; ++i)
-        length_bits.push_back(value_bits[i]);
+    length_bits.append_byte_string(s);
 
     dccl::dlog.is(DEBUG2) && dccl::dlog << "DefaultStringCodec created: " << length_bits << std::endl;
     
@@ -131,11 +124,7 @@ std::string dccl::v2::DefaultStringCodec::decode(Bitset* bits)
 
         
         dccl::dlog.is(DEBUG2) && dccl::dlog << "bits after get_more_bits " << *bits << std::endl;    
-        Bitset string_body_bits = *bits;
-        string_body_bits >>= header_length;
-        string_body_bits.resize(bits->size() - header_length);
-    
-        return string_body_bits.to_byte_string();
+        return bits->to_byte_string(header_length);
     }
     else
     {
@@ -186,14 +175,11 @@ dccl::Bitset dccl::v2::DefaultBytesCodec::encode()
 dccl::Bitset dccl::v2::DefaultBytesCodec::encode(const std::string& wire_value)
 {
     Bitset bits;
-    bits.from_byte_string(wire_value);
-    bits.resize(max_size());
-    
     if(!use_required())
-    {
-        bits <<= 1;
-        bits.set(0, true); // presence bit
-    }
+        bits.push_back(true); // presence bit
+
+    bits.append_byte_string(wire_value);
+    bits.resize(max_size());
     
     return bits;
 }
@@ -219,11 +205,7 @@ std::string dccl::v2::DefaultBytesCodec::decode(Bitset* bits)
             // grabs more bits to add to the MSBs of `bits`
             bits->get_more_bits(max_size()- min_size());
             
-            Bitset bytes_body_bits = *bits;
-            bytes_body_bits >>= min_size();
-            bytes_body_bits.resize(bits->size() - min_size());
-        
-            return bytes_body_bits.to_byte_string();
+            return bits->to_byte_string(min_size());
         }
         else
         {
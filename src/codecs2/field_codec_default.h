@@ -25,6 +25,8 @@
 #define DCCLFIELDCODECDEFAULT20110322H
 
 #include <sys/time.h>
+#include <vector>
+#include <limits>
 
 #include <boost/utility.hpp>
 #include <boost/type_traits.hpp>
@@ -32,6 +34,7 @@
 #include <boost/numeric/conversion/bounds.hpp>
 #include <boost/numeric/conversion/cast.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/mpl/if.hpp>
 
 #include <google/protobuf/descriptor.h>
 
@@ -50,9 +53,101 @@ namespace dccl
         /// \brief Provides a basic bounded arbitrary length numeric (double, float, uint32, uint64, int32, int64) encoder.
         ///
         /// Takes ceil(log2((max-min)*10^precision)+1) bits for required fields, ceil(log2((max-min)*10^precision)+2) for optional fields.
-        template<typename WireType, typename FieldType = WireType>
-            class DefaultNumericFieldCodec : public TypedFixedFieldCodec<WireType, FieldType>
+        ///
+        /// \tparam Derived If set, the most derived (DCCL_FINAL) class that overrides max(), min() or precision(), allowing these to be bound at compile time (see StaticDispatchFieldCodec). Leave as void to derive from this codec in the usual (virtual) way.
+        template<typename WireType, typename FieldType = WireType, typename Derived = void>
+            class DefaultNumericFieldCodec :
+        public StaticDispatchFieldCodec<typename boost::mpl::if_<boost::is_void<Derived>,
+            DefaultNumericFieldCodec<WireType, FieldType, Derived>, Derived>::type,
+            TypedFixedFieldCodec<WireType, FieldType> >
             {
+              typedef typename boost::mpl::if_<boost::is_void<Derived>,
+                  DefaultNumericFieldCodec<WireType, FieldType, Derived>, Derived>::type derived_type;
+              friend class StaticDispatchFieldCodec<derived_type, TypedFixedFieldCodec<WireType, FieldType> >;
+
+              public:
+              /// \brief Constants for quantizing the values of a field, computed once from min(), max() and precision()
+              struct Quantization
+              {
+                  double min, max, precision;
+                  /// dccl::round_scaling() for precision
+                  WireType rounding;
+                  /// min rounded to precision
+                  WireType rounded_min;
+                  /// 10^|precision|
+                  WireType scale;
+                  /// size() indexed by use_required()
+                  unsigned size[2];
+              };
+
+              /// \brief Computes the Quantization constants for the given bounds
+              static Quantization make_quantization(double min, double max, double precision)
+              {
+                  Quantization q;
+                  q.precision = precision;
+                  q.min = min;
+                  q.max = max;
+                  q.rounding = dccl::round_scaling<WireType>(q.precision);
+                  q.rounded_min = dccl::round_scaled((WireType)q.min, q.rounding);
+                  q.scale = (WireType)std::pow(10.0, q.precision < 0 ? -q.precision : q.precision);
+
+                  // if not required field, leave one value for unspecified (always encoded as 0)
+                  const double num_values = (q.max - q.min) * std::pow(10.0, q.precision) + 1;
+                  q.size[false] = dccl::ceil_log2(num_values + 1);
+                  q.size[true] = dccl::ceil_log2(num_values);
+                  return q;
+              }
+
+              /// \brief Returns the unsigned value sent on the wire (0 for out-of-bounds values)
+              static dccl::uint64 quantize(WireType value, const Quantization& q, bool required)
+              {
+                  // round first, before checking bounds
+                  WireType wire_value = dccl::round_scaled(value, q.rounding);
+
+                  // check bounds, if out-of-bounds, send as zeros
+                  if(wire_value < q.min || wire_value > q.max)
+                      return 0;
+          
+                  wire_value -= q.rounded_min;
+
+                  if (q.precision < 0) {
+                      wire_value /= q.scale;
+                  } else if (q.precision > 0) {
+                      wire_value *= q.scale;
+                  }
+
+                  dccl::uint64 uint_value = boost::numeric_cast<dccl::uint64>(dccl::round_scaled(wire_value, static_cast<WireType>(1)));
+
+                  // "presence" value (0)
+                  if(!required)
+                      uint_value += 1;
+
+                  return uint_value;
+              }
+
+              /// \brief Inverse of quantize(); returns false for the "presence" (null) value
+              static bool dequantize(dccl::uint64 uint_value, const Quantization& q, bool required, WireType* value)
+              {
+                  if(!required)
+                  {
+                      if(!uint_value) return false;
+                      --uint_value;
+                  }
+	  
+                  WireType wire_value = (WireType)uint_value;
+
+                  if (q.precision < 0) {
+                      wire_value *= q.scale;
+                  } else if (q.precision > 0) {
+                      wire_value /= q.scale;
+                  }
+
+                  // round values again to properly handle cases where double precision
+                  // leads to slightly off values (e.g. 2.099999999 instead of 2.1)
+                  *value = dccl::round_scaled(static_cast<WireType>(wire_value + q.rounded_min), q.rounding);
+                  return true;
+              }
+                
               protected:
 
               virtual double max()
@@ -78,51 +173,28 @@ namespace dccl
               {
 
                   // ensure given max and min fit within WireType ranges
-                  FieldCodecBase::require(min() >= boost::numeric::bounds<WireType>::lowest(),
+                  FieldCodecBase::require(derived().min() >= boost::numeric::bounds<WireType>::lowest(),
                                           "(dccl.field).min must be >= minimum of this field type.");
-                  FieldCodecBase::require(max() <= boost::numeric::bounds<WireType>::highest(),
+                  FieldCodecBase::require(derived().max() <= boost::numeric::bounds<WireType>::highest(),
                                           "(dccl.field).max must be <= maximum of this field type.");
 
           
                   // ensure value fits into double
-                  FieldCodecBase::require((precision() + std::ceil(std::log10(max() - min()))) <= std::numeric_limits<double>::digits10,
+                  FieldCodecBase::require((derived().precision() + std::ceil(std::log10(derived().max() - derived().min()))) <= std::numeric_limits<double>::digits10,
                                           "[(dccl.field).max-(dccl.field).min]*10^(dccl.field).precision must fit in a double-precision floating point value. Please increase min, decrease max, or decrease precision.");
-          
               }
       
       
               Bitset encode()
               {
-                  return Bitset(size());
+                  return Bitset(derived().size());
               }
           
           
               virtual Bitset encode(const WireType& value)
               {
-                  // round first, before checking bounds
-                  WireType wire_value = dccl::round(value, precision());
-
-                  // check bounds, if out-of-bounds, send as zeros
-                  if(wire_value < min() || wire_value > max())
-                      return Bitset(size());
-          
-                  wire_value -= dccl::round((WireType)min(), precision());
-
-                  if (precision() < 0) {
-                      wire_value /= (WireType)std::pow(10.0, -precision());
-                  } else if (precision() > 0) {
-                      wire_value *= (WireType)std::pow(10.0, precision());
-                  }
-
-                  dccl::uint64 uint_value = boost::numeric_cast<dccl::uint64>(dccl::round(wire_value, 0));
-
-                  // "presence" value (0)
-                  if(!FieldCodecBase::use_required())
-                      uint_value += 1;
-	  
-
                   Bitset encoded;
-                  encoded.from(uint_value, size());
+                  encoded.from(quantize(value, quantization(), FieldCodecBase::use_required()), derived().size());
                   return encoded;
               }
           
@@ -134,43 +206,199 @@ namespace dccl
                   // See, e.g., http://gcc.gnu.org/bugzilla/show_bug.cgi?id=10959
                   dccl::uint64 uint_value = (bits->template to<dccl::uint64>)();
 
-                  if(!FieldCodecBase::use_required())
-                  {
-                      if(!uint_value) throw NullValueException();
-                      --uint_value;
-                  }
-	  
-                  WireType wire_value = (WireType)uint_value;
+                  WireType wire_value;
+                  if(!dequantize(uint_value, quantization(), FieldCodecBase::use_required(), &wire_value))
+                      throw NullValueException();
+                  return wire_value;
+              }
 
-                  if (precision() < 0) {
-                      wire_value *= (WireType)std::pow(10.0, -precision());
-                  } else if (precision() > 0) {
-                      wire_value /= (WireType)std::pow(10.0, precision());
-                  }
+              unsigned size()
+              { return quantization().size[FieldCodecBase::use_required()]; }
 
-                  // round values again to properly handle cases where double precision
-                  // leads to slightly off values (e.g. 2.099999999 instead of 2.1)
-                  wire_value = dccl::round(wire_value + dccl::round((WireType)min(), precision()),
-                                           precision());
 
-                  return wire_value;
+              /// \brief Quantization constants for the current field: those computed when the message was loaded (see make_field_data()), or else computed now. So that they can be computed in advance, min(), max() and precision() must depend only on the field.
+              Quantization quantization()
+              {
+                  if(const QuantizationData* data = FieldCodecBase::field_data<QuantizationData>())
+                      return data->quantization;
+                  return compute_quantization();
               }
 
-              unsigned size()
+              boost::shared_ptr<const FieldCodecBase::FieldData> make_field_data()
               {
-                  // if not required field, leave one value for unspecified (always encoded as 0)
-                  unsigned NULL_VALUE = FieldCodecBase::use_required() ? 0 : 1;
+                  boost::shared_ptr<QuantizationData> data(new QuantizationData);
+                  data->quantization = compute_quantization();
+                  return data;
+              }
+
+              public:
+              /// \brief Encode a repeated field by quantizing the whole array, packing the values at the fixed width size() into 64-bit words with shifts, and appending the words to the Bitset in one sweep.
+              ///
+              /// Used when the bounds are bound at compile time (Derived is set) and no type conversion is needed (WireType == FieldType); otherwise the values are encoded one at a time by TypedFieldCodec. Gives the same bits as the per-value path.
+              Bitset encode_repeated(internal::Span<const FieldType> field_values)
+              { return encode_repeated(field_values, has_array_kernel()); }
+
+              /// \brief Decode a repeated field by copying its bits out as 64-bit words, unpacking the values with shifts and then dequantizing them (see encode_repeated()).
+              unsigned decode_repeated(Bitset* bits, internal::Span<FieldType> field_values)
+              { return decode_repeated(bits, field_values, has_array_kernel()); }
+
+              /// \brief Size of a repeated field (with the array kernel, every value takes size() bits).
+              unsigned size_repeated(internal::Span<const FieldType> field_values)
+              { return size_repeated(field_values, has_array_kernel()); }
+              
+              private:
+              typedef boost::integral_constant<bool, !boost::is_void<Derived>::value &&
+                  boost::is_same<WireType, FieldType>::value> has_array_kernel;
+              
+              struct QuantizationData : public FieldCodecBase::FieldData
+              {
+                  Quantization quantization;
+              };
+              
+              Quantization compute_quantization()
+              { return make_quantization(derived().min(), derived().max(), derived().precision()); }
+
+              Bitset encode_repeated(internal::Span<const FieldType> field_values, boost::false_type)
+              { return TypedFixedFieldCodec<WireType, FieldType>::encode_repeated(field_values); }
+
+              unsigned decode_repeated(Bitset* bits, internal::Span<FieldType> field_values, boost::false_type)
+              { return TypedFixedFieldCodec<WireType, FieldType>::decode_repeated(bits, field_values); }
               
-                  return dccl::ceil_log2((max()-min())*std::pow(10.0, precision())+1 + NULL_VALUE);
+              unsigned size_repeated(internal::Span<const FieldType> field_values, boost::false_type)
+              { return TypedFixedFieldCodec<WireType, FieldType>::size_repeated(field_values); }
+
+              unsigned size_repeated(internal::Span<const FieldType> field_values, boost::true_type)
+              {
+                  const unsigned max_repeat = this->dccl_field_options().max_repeat();
+                  if(FieldCodecBase::codec_version() > 2)
+                      return this->repeated_vector_field_size(max_repeat) +
+                          std::min(max_repeat, static_cast<unsigned>(field_values.size())) * derived().size();
+                  else
+                      return max_repeat * derived().size();
               }
-            
+              
+              enum { word_bits = std::numeric_limits<dccl::uint64>::digits };
+
+              // fixed width of each packed value; wire values are dccl::uint64 so wider fields cannot be packed
+              unsigned packed_width()
+              {
+                  const unsigned width = derived().size();
+                  if(width > word_bits)
+                      throw(Exception("Numeric field is too wide to pack (size() > 64 bits)"));
+                  return width;
+              }
+
+              static std::size_t packed_words(unsigned num_values, unsigned width)
+              { return (static_cast<std::size_t>(num_values) * width + word_bits - 1) / word_bits; }
+
+              Bitset encode_repeated(internal::Span<const FieldType> field_values, boost::true_type)
+              {
+                  const unsigned max_repeat = this->dccl_field_options().max_repeat();
+                  unsigned wire_vector_size = max_repeat;
+
+                  Bitset bits;
+                  if(FieldCodecBase::codec_version() > 2)
+                  {
+                      wire_vector_size = std::min(max_repeat, static_cast<unsigned>(field_values.size()));
+                      bits.append(Bitset(this->repeated_vector_field_size(max_repeat), field_values.size()));
+                  }
+
+                  // quantize: padding values (DCCL2) are encoded as zeros, like encode()
+                  const Quantization q = quantization();
+                  const bool required = this->use_required();
+                  const unsigned n = std::min(wire_vector_size, static_cast<unsigned>(field_values.size()));
+                  std::vector<dccl::uint64> wire_values(wire_vector_size, 0);
+                  for(unsigned i = 0; i < n; ++i)
+                      wire_values[i] = quantize(field_values[i], q, required);
+
+                  // pack into 64-bit words, then append them to the Bitset in one sweep
+                  const unsigned width = packed_width();
+                  std::vector<dccl::uint64> words(packed_words(wire_vector_size, width), 0);
+                  for(unsigned i = 0; i < wire_vector_size && width; ++i)
+                  {
+                      const unsigned pos = i * width, word = pos / word_bits, bit = pos % word_bits;
+                      words[word] |= wire_values[i] << bit;
+                      if(bit && bit + width > word_bits)
+                          words[word + 1] |= wire_values[i] >> (word_bits - bit);
+                  }
+                  if(!words.empty())
+                      bits.append_words(&words[0], wire_vector_size * width);
+                  return bits;
+              }
+
+              unsigned decode_repeated(Bitset* bits, internal::Span<FieldType> field_values, boost::true_type)
+              {
+                  unsigned wire_vector_size = this->dccl_field_options().max_repeat();
+                  if(FieldCodecBase::codec_version() > 2)
+                  {
+                      Bitset size_bits(bits);
+                      size_bits.get_more_bits(this->repeated_vector_field_size(wire_vector_size));
+                      wire_vector_size = size_bits.to_ulong();
+                  }
+
+                  if(wire_vector_size > field_values.size())
+                      throw(Exception("Decoded repeated field size (" + boost::lexical_cast<std::string>(wire_vector_size) + ") is larger than (dccl.field).max_repeat"));
+
+                  // copy out as 64-bit words in one sweep, then unpack them
+                  const unsigned width = packed_width();
+                  Bitset packed(bits);
+                  packed.get_more_bits(wire_vector_size * width);
+                  std::vector<dccl::uint64> words(packed_words(wire_vector_size, width), 0);
+                  if(!words.empty())
+                      packed.to_words(&words[0]);
+
+                  const dccl::uint64 mask = (width < word_bits) ? ((static_cast<dccl::uint64>(1) << width) - 1) : ~static_cast<dccl::uint64>(0);
+                  std::vector<dccl::uint64> wire_values(wire_vector_size, 0);
+                  for(unsigned i = 0; i < wire_vector_size && width; ++i)
+                  {
+                      const unsigned pos = i * width, word = pos / word_bits, bit = pos % word_bits;
+                      dccl::uint64 value = words[word] >> bit;
+                      if(bit && bit + width > word_bits)
+                          value |= words[word + 1] << (word_bits - bit);
+                      wire_values[i] = value & mask;
+                  }
+
+                  // dequantize, skipping null values
+                  const Quantization q = quantization();
+                  const bool required = this->use_required();
+                  unsigned n = 0;
+                  for(unsigned i = 0; i < wire_vector_size; ++i)
+                  {
+                      if(dequantize(wire_values[i], q, required, &field_values[n]))
+                          ++n;
+                  }
+                  return n;
+              }
+
+              private:
+              derived_type& derived() { return static_cast<derived_type&>(*this); }
             };
 
+        /// \brief The DefaultNumericFieldCodec registered for the built-in numeric types. As this class is DCCL_FINAL, its bounds and quantization are bound at compile time; derive from DefaultNumericFieldCodec to customize.
+        template<typename WireType>
+            class BuiltinNumericFieldCodec DCCL_FINAL
+            : public DefaultNumericFieldCodec<WireType, WireType, BuiltinNumericFieldCodec<WireType> >
+        {
+            // repeated values use the default format, so the number present can be read from the size prefix
+            unsigned any_peek_repeated_size(Bitset* repeated_bits)
+            { return this->peek_repeated_size_prefix(repeated_bits); }
+            
+            // final, so nothing can override any_encode_repeated() or any_decode_repeated() and the message's repeated field storage can be used directly
+            bool supports_bulk_repeated()
+            { return this->bulk_repeated_supported(); }
+        };
+
+        class BuiltinBoolCodec;
+        class BuiltinStringCodec;
+        class BuiltinBytesCodec;
+        class BuiltinEnumCodec;
+        
         /// \brief Provides a bool encoder. Uses 1 bit if field is `required`, 2 bits if `optional`
         ///
         /// [presence bit (0 bits if required, 1 bit if optional)][value (1 bit)]
         class DefaultBoolCodec : public TypedFixedFieldCodec<bool>
         {
+            friend class StaticDispatchFieldCodec<BuiltinBoolCodec, DefaultBoolCodec>;
           private:
             Bitset encode(const bool& wire_value);
             Bitset encode();
@@ -184,6 +412,7 @@ namespace dccl
         /// [length of following string (1 byte)][string (0-255 bytes)]
         class DefaultStringCodec : public TypedFieldCodec<std::string>
         {
+            friend class StaticDispatchFieldCodec<BuiltinStringCodec, DefaultStringCodec>;
           private:
             Bitset encode();
             Bitset encode(const std::string& wire_value);
@@ -202,6 +431,7 @@ namespace dccl
         /// \brief Provides an fixed length byte string encoder.        
         class DefaultBytesCodec : public TypedFieldCodec<std::string>
         {
+            friend class StaticDispatchFieldCodec<BuiltinBytesCodec, DefaultBytesCodec>;
           private:
             Bitset encode();
             Bitset encode(const std::string& wire_value);
@@ -217,6 +447,7 @@ namespace dccl
         class DefaultEnumCodec
             : public DefaultNumericFieldCodec<int32, const google::protobuf::EnumValueDescriptor*>
         {
+            friend class StaticDispatchFieldCodec<BuiltinEnumCodec, DefaultEnumCodec>;
           public:
             int32 pre_encode(const google::protobuf::EnumValueDescriptor* const& field_value);
             const google::protobuf::EnumValueDescriptor* post_decode(const int32& wire_value);
@@ -232,6 +463,32 @@ namespace dccl
             double min()
             { return 0; }
         };
+
+        /// \brief The DefaultBoolCodec registered for bool fields. As this class is DCCL_FINAL, calls into it are bound at compile time; derive from DefaultBoolCodec to customize.
+        class BuiltinBoolCodec DCCL_FINAL
+            : public StaticDispatchFieldCodec<BuiltinBoolCodec, DefaultBoolCodec>
+        {
+            // see BuiltinNumericFieldCodec
+            unsigned any_peek_repeated_size(Bitset* repeated_bits)
+            { return peek_repeated_size_prefix(repeated_bits); }
+            bool supports_bulk_repeated()
+            { return bulk_repeated_supported(); }
+        };
+
+        /// \brief The DefaultStringCodec registered for string fields (see BuiltinBoolCodec)
+        class BuiltinStringCodec DCCL_FINAL
+            : public StaticDispatchFieldCodec<BuiltinStringCodec, DefaultStringCodec>
+        { };
+
+        /// \brief The DefaultBytesCodec registered for bytes fields (see BuiltinBoolCodec)
+        class BuiltinBytesCodec DCCL_FINAL
+            : public StaticDispatchFieldCodec<BuiltinBytesCodec, DefaultBytesCodec>
+        { };
+
+        /// \brief The DefaultEnumCodec registered for enum fields (see BuiltinBoolCodec)
+        class BuiltinEnumCodec DCCL_FINAL
+            : public StaticDispatchFieldCodec<BuiltinEnumCodec, DefaultEnumCodec>
+        { };
         
         
         /// \brief Encodes time of day (default: second precision, but can be set with (dccl.field).precision extension) 
@@ -244,13 +501,15 @@ namespace dccl
         {
           public:
             time_wire_type pre_encode(const TimeType& time_of_day) {
-                time_wire_type max_secs = max();
+                time_wire_type max_secs = this->quantization().max;
                 return std::fmod(time_of_day / static_cast<time_wire_type>(conversion_factor), max_secs);
             }
 
             TimeType post_decode(const time_wire_type& encoded_time) {
 
-                int64 max_secs = (int64)max();
+                const typename DefaultNumericFieldCodec<time_wire_type, TimeType>::Quantization& q =
+                    this->quantization();
+                int64 max_secs = (int64)q.max;
                 timeval t;
                 gettimeofday(&t, 0);
                 int64 now = t.tv_sec;
@@ -265,7 +524,7 @@ namespace dccl
                 }
 
                 return dccl::round((TimeType)(conversion_factor * (daystart + encoded_time)),
-                                   precision() - std::log10((double)conversion_factor));
+                                   q.precision - std::log10((double)conversion_factor));
             }
 
           private:
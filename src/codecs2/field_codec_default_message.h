@@ -42,8 +42,12 @@ namespace dccl
             unsigned min_size();
             unsigned any_size(const boost::any& wire_value);
 
+            // repeated messages use the default repeated field format
+            unsigned any_peek_repeated_size(Bitset* repeated_bits)
+            { return peek_repeated_size_prefix(repeated_bits); }
 
-            boost::shared_ptr<FieldCodecBase> find(const google::protobuf::FieldDescriptor* field_desc)
+
+            FieldCodecBase* find(const google::protobuf::FieldDescriptor* field_desc)
             {
                 return FieldCodecManager::find(field_desc, has_codec_group(), codec_group());
             }
@@ -55,17 +59,27 @@ namespace dccl
 
             struct Size
             {
-                static void repeated(boost::shared_ptr<FieldCodecBase> codec,
+                template<typename Value>
+                static void repeated(FieldCodecBase* codec,
                                      unsigned* return_value,
-                                     const std::vector<boost::any>& field_values,
+                                     const std::vector<Value>& field_values,
                                      const google::protobuf::FieldDescriptor* field_desc)
                     {
                         codec->field_size_repeated(return_value, field_values, field_desc);
                     }
+
+                static void repeated(FieldCodecBase* codec,
+                                     unsigned* return_value,
+                                     const google::protobuf::Message& msg,
+                                     const google::protobuf::FieldDescriptor* field_desc)
+                    {
+                        codec->field_size_repeated(return_value, msg, field_desc);
+                    }
                 
-                static void single(boost::shared_ptr<FieldCodecBase> codec,
+                template<typename Value>
+                static void single(FieldCodecBase* codec,
                                    unsigned* return_value,
-                                   const boost::any& field_value,
+                                   const Value& field_value,
                                    const google::protobuf::FieldDescriptor* field_desc)
                     {
                         codec->field_size(return_value, field_value, field_desc);
@@ -75,17 +89,27 @@ namespace dccl
             
             struct Encoder
             {
-                static void repeated(boost::shared_ptr<FieldCodecBase> codec,
+                template<typename Value>
+                static void repeated(FieldCodecBase* codec,
                                      Bitset* return_value,
-                                     const std::vector<boost::any>& field_values,
+                                     const std::vector<Value>& field_values,
                                      const google::protobuf::FieldDescriptor* field_desc)
                     {
                         codec->field_encode_repeated(return_value, field_values, field_desc);
                     }
+
+                static void repeated(FieldCodecBase* codec,
+                                     Bitset* return_value,
+                                     const google::protobuf::Message& msg,
+                                     const google::protobuf::FieldDescriptor* field_desc)
+                    {
+                        codec->field_encode_repeated(return_value, msg, field_desc);
+                    }
                 
-                static void single(boost::shared_ptr<FieldCodecBase> codec,
+                template<typename Value>
+                static void single(FieldCodecBase* codec,
                                    Bitset* return_value,
-                                   const boost::any& field_value,
+                                   const Value& field_value,
                                    const google::protobuf::FieldDescriptor* field_desc)
                     {
                         codec->field_encode(return_value, field_value, field_desc);
@@ -94,7 +118,7 @@ namespace dccl
 
             struct MaxSize
             {
-                static void field(boost::shared_ptr<FieldCodecBase> codec,
+                static void field(FieldCodecBase* codec,
                                   unsigned* return_value,
                                   const google::protobuf::FieldDescriptor* field_desc)
                     {
@@ -104,7 +128,7 @@ namespace dccl
 
             struct MinSize
             {
-                static void field(boost::shared_ptr<FieldCodecBase> codec,
+                static void field(FieldCodecBase* codec,
                                   unsigned* return_value,
                                   const google::protobuf::FieldDescriptor* field_desc)
                     {
@@ -115,7 +139,7 @@ namespace dccl
             
             struct Validate
             {
-                static void field(boost::shared_ptr<FieldCodecBase> codec,
+                static void field(FieldCodecBase* codec,
                                   bool* return_value,
                                   const google::protobuf::FieldDescriptor* field_desc)
                     {
@@ -125,7 +149,7 @@ namespace dccl
 
             struct Info
             {
-                static void field(boost::shared_ptr<FieldCodecBase> codec,
+                static void field(FieldCodecBase* codec,
                                   std::stringstream* return_value,
                                   const google::protobuf::FieldDescriptor* field_desc)
                     {
@@ -168,22 +192,36 @@ namespace dccl
                         if(!check_field(field_desc))
                             continue;
            
-                        boost::shared_ptr<FieldCodecBase> codec = find(field_desc);
-                        boost::shared_ptr<internal::FromProtoCppTypeBase> helper =
-                            internal::TypeHelper::find(field_desc);
-            
-            
-                        if(field_desc->is_repeated())
+                        FieldCodecBase* codec = find(field_desc);
+
+                        if(field_desc->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE)
+                        {
+                            // embedded messages go through boost::any so that custom message codecs can use their derived type
+                            boost::shared_ptr<internal::FromProtoCppTypeBase> helper =
+                                internal::TypeHelper::find(field_desc);
+                            
+                            if(field_desc->is_repeated())
+                            {
+                                std::vector<boost::any> field_values;
+                                for(int j = 0, m = refl->FieldSize(*msg, field_desc); j < m; ++j)
+                                    field_values.push_back(helper->get_repeated_value(field_desc, *msg, j));
+                                
+                                Action::repeated(codec, &return_value, field_values, field_desc);
+                            }
+                            else
+                            {
+                                Action::single(codec, &return_value, helper->get_value(field_desc, *msg), field_desc);
+                            }
+                        }
+                        else if(field_desc->is_repeated())
                         {
-                            std::vector<boost::any> field_values;
-                            for(int j = 0, m = refl->FieldSize(*msg, field_desc); j < m; ++j)
-                                field_values.push_back(helper->get_repeated_value(field_desc, *msg, j));
-                   
-                            Action::repeated(codec, &return_value, field_values, field_desc);
+                            Action::repeated(codec, &return_value, *msg, field_desc);
                         }
                         else
                         {
-                            Action::single(codec, &return_value, helper->get_value(field_desc, *msg), field_desc);
+                            internal::TaggedValue field_value;
+                            internal::get_field_value(field_desc, *msg, &field_value);
+                            Action::single(codec, &return_value, field_value, field_desc);
                         }
                     }
                     return return_value;
@@ -42,19 +42,12 @@ dccl::Bitset dccl::v3::DefaultStringCodec::encode(const std::string& wire_value)
     }
         
             
-    Bitset value_bits;
-    value_bits.from_byte_string(s);
-    
     Bitset length_bits(min_size(), s.length());
 
-    dccl::dlog.is(DEBUG2) && dccl::dlog << "DefaultStringCodec value_bits: " << value_bits << std::endl;    
-
-    
     dccl::dlog.is(DEBUG2) && dccl::dlog << "DefaultStringCodec length_bits: " << length_bits << std::endl;    
     
     // adds to MSBs
-    for(int i = 0, n = value_bits.size(); i < n; ++i)
-        length_bits.push_back(value_bits[i]);
+    length_bits.append_byte_string(s);
 
     dccl::dlog.is(DEBUG2) && dccl::dlog << "DefaultStringCodec created: " << length_bits << std::endl;
     
@@ -80,11 +73,7 @@ std::string dccl::v3::DefaultStringCodec::decode(Bitset* bits)
 
         
         dccl::dlog.is(DEBUG2) && dccl::dlog << "bits after get_more_bits " << *bits << std::endl;    
-        Bitset string_body_bits = *bits;
-        string_body_bits >>= header_length;
-        string_body_bits.resize(bits->size() - header_length);
-    
-        return string_body_bits.to_byte_string();
+        return bits->to_byte_string(header_length);
     }
     else
     {
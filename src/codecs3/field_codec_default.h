@@ -35,10 +35,25 @@ namespace dccl
         template<typename WireType, typename FieldType = WireType>
             class DefaultNumericFieldCodec : public v2::DefaultNumericFieldCodec<WireType, FieldType> { };
 
+        template<typename WireType>
+            class BuiltinNumericFieldCodec DCCL_FINAL
+            : public v2::DefaultNumericFieldCodec<WireType, WireType, BuiltinNumericFieldCodec<WireType> >
+        {
+            // see v2::BuiltinNumericFieldCodec
+            unsigned any_peek_repeated_size(Bitset* repeated_bits)
+            { return this->peek_repeated_size_prefix(repeated_bits); }
+            bool supports_bulk_repeated()
+            { return this->bulk_repeated_supported(); }
+        };
+        
 	typedef v2::DefaultBoolCodec DefaultBoolCodec;
 	typedef v2::DefaultBytesCodec DefaultBytesCodec;
         typedef v2::DefaultEnumCodec DefaultEnumCodec;
 
+	typedef v2::BuiltinBoolCodec BuiltinBoolCodec;
+	typedef v2::BuiltinBytesCodec BuiltinBytesCodec;
+        typedef v2::BuiltinEnumCodec BuiltinEnumCodec;
+
         
         template<typename TimeType>
             class TimeCodec : public v2::TimeCodecBase<TimeType, 0>
@@ -53,11 +68,14 @@ namespace dccl
         { };
 
 
+        class BuiltinStringCodec;
+        
         /// \brief Provides an variable length ASCII string encoder.
         ///
         /// [length of following string size: ceil(log2(max_length))][string]
         class DefaultStringCodec : public TypedFieldCodec<std::string>
         {
+            friend class StaticDispatchFieldCodec<BuiltinStringCodec, DefaultStringCodec>;
           private:
             Bitset encode();
             Bitset encode(const std::string& wire_value);
@@ -69,6 +87,11 @@ namespace dccl
             void validate();
         };
 
+        /// \brief The DefaultStringCodec registered for string fields. As this class is DCCL_FINAL, calls into it are bound at compile time; derive from DefaultStringCodec to customize.
+        class BuiltinStringCodec DCCL_FINAL
+            : public StaticDispatchFieldCodec<BuiltinStringCodec, DefaultStringCodec>
+        { };
+
     }
 }
 
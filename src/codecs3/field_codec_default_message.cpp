@@ -88,7 +88,8 @@ void dccl::v3::DefaultMessageCodec::any_decode(Bitset* bits, boost::any* wire_va
         
         const google::protobuf::Descriptor* desc = msg->GetDescriptor();
         const google::protobuf::Reflection* refl = msg->GetReflection();
-        
+
+        bool decoded_field = false;
         for(int i = 0, n = desc->field_count(); i < n; ++i)
         {
         
@@ -98,23 +99,22 @@ void dccl::v3::DefaultMessageCodec::any_decode(Bitset* bits, boost::any* wire_va
                 continue;
 
             
-            boost::shared_ptr<FieldCodecBase> codec = find(field_desc);            
-            boost::shared_ptr<internal::FromProtoCppTypeBase> helper =
-                internal::TypeHelper::find(field_desc);
+            FieldCodecBase* codec = find(field_desc);            
 
             if(field_desc->is_repeated())
             {   
                 std::vector<boost::any> field_values;
                 if(field_desc->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE)
                 {
-                    unsigned max_repeat = field_desc->options().GetExtension(dccl::field).max_repeat();
-                    for(unsigned j = 0, m = max_repeat; j < m; ++j)
+                    // allocate only as many messages as are present
+                    unsigned repeated_size = codec->field_peek_repeated_size(bits, field_desc);
+                    for(unsigned j = 0, m = repeated_size; j < m; ++j)
                         field_values.push_back(refl->AddMessage(msg, field_desc));
 
                     codec->field_decode_repeated(bits, &field_values, field_desc);
 
-                    // remove the unused messages
-                    for(int j = field_values.size(), m = max_repeat; j < m; ++j)
+                    // remove the unused (empty) messages
+                    for(int j = field_values.size(), m = repeated_size; j < m; ++j)
                     {
                         refl->RemoveLast(msg, field_desc);
                     }
@@ -122,9 +122,7 @@ void dccl::v3::DefaultMessageCodec::any_decode(Bitset* bits, boost::any* wire_va
                 else
                 {
                     // for primitive types
-                    codec->field_decode_repeated(bits, &field_values, field_desc);
-                    for(int j = 0, m = field_values.size(); j < m; ++j)
-                        helper->add_value(field_desc, msg, field_values[j]);
+                    codec->field_decode_repeated(bits, msg, field_desc);
                 }
             }
             else
@@ -140,15 +138,26 @@ void dccl::v3::DefaultMessageCodec::any_decode(Bitset* bits, boost::any* wire_va
                 else
                 {
                     // for primitive types
-                    codec->field_decode(bits, &field_value, field_desc);
-                    helper->set_value(field_desc, msg, field_value);
+                    internal::TaggedValue value;
+                    codec->field_decode(bits, &value, field_desc);
+                    internal::set_field_value(field_desc, msg, value);
                 }
             } 
+
+            if(!decoded_field)
+                decoded_field = field_desc->is_repeated() ? refl->FieldSize(*msg, field_desc) > 0 : refl->HasField(*msg, field_desc);
+        }
+
+        // only list the fields if none were decoded (msg may have been set before decoding)
+        bool empty = !decoded_field;
+        if(empty && this_field())
+        {
+            std::vector< const google::protobuf::FieldDescriptor* > set_fields;
+            refl->ListFields(*msg, &set_fields);
+            empty = set_fields.empty();
         }
 
-        std::vector< const google::protobuf::FieldDescriptor* > set_fields;
-        refl->ListFields(*msg, &set_fields);
-        if(set_fields.empty() && this_field()) *wire_value = boost::any();
+        if(empty && this_field()) *wire_value = boost::any();
         else *wire_value = msg;
     }
     catch(boost::bad_any_cast& e)
@@ -20,9 +20,6 @@ dccl::Bitset dccl::v3::VarBytesCodec::encode(const std::string& wire_value)
         s.resize(dccl_field_options().max_length()); 
     }
             
-    dccl::Bitset value_bits;
-    value_bits.from_byte_string(s);
-    
     dccl::Bitset length_bits(presence_size() + prefix_size(), s.length());
 
     if(!use_required()) // set the presence bit
@@ -31,14 +28,10 @@ dccl::Bitset dccl::v3::VarBytesCodec::encode(const std::string& wire_value)
         length_bits.set(0);
     }
     
-    dccl::dlog.is(DEBUG2) && dccl::dlog << "dccl::v3::VarBytesCodec value_bits: " << value_bits << std::endl;    
-
-    
     dccl::dlog.is(DEBUG2) && dccl::dlog << "dccl::v3::VarBytesCodec length_bits: " << length_bits << std::endl;    
     
     // adds to MSBs
-    for(int i = 0, n = value_bits.size(); i < n; ++i)
-        length_bits.push_back(value_bits[i]);
+    length_bits.append_byte_string(s);
 
     dccl::dlog.is(DEBUG2) && dccl::dlog << "dccl::v3::VarBytesCodec created: " << length_bits << std::endl;
     
@@ -72,14 +65,7 @@ std::string dccl::v3::VarBytesCodec::decode(dccl::Bitset* bits)
     bits->get_more_bits(value_length*dccl::BITS_IN_BYTE);
         
     dccl::dlog.is(DEBUG2) && dccl::dlog << "bits after get_more_bits " << *bits << std::endl;    
-    dccl::Bitset string_body_bits = *bits;
-    string_body_bits >>= header_length;
-    string_body_bits.resize(bits->size() - header_length);
-
-    dccl::dlog.is(DEBUG2) && dccl::dlog << "string_body_bits " << string_body_bits << std::endl;    
-
-    
-    return string_body_bits.to_byte_string();
+    return bits->to_byte_string(header_length);
 }
 
 unsigned dccl::v3::VarBytesCodec::size()
@@ -29,12 +29,15 @@ namespace dccl
 {
     namespace v3
     {
+        class BuiltinVarBytesCodec;
+        
         // Size (in bits) for "required/optional/repeated bytes foo":
         // if optional: [1 bit - has_foo()?][N bits - prefix with length of byte string][string bytes]
         // if required: [N bits - prefix with length of string][string bytes]
         // if repeated: [M bits - prefix with the number of repeated values][same as "required" for value with index 0][same as "required" for index = 1]...[same as required for last index]
         class VarBytesCodec : public dccl::TypedFieldCodec<std::string>
         {
+            friend class dccl::StaticDispatchFieldCodec<BuiltinVarBytesCodec, VarBytesCodec>;
         private:
             dccl::Bitset encode();
             dccl::Bitset encode(const std::string& wire_value);
@@ -52,6 +55,11 @@ namespace dccl
             { return use_required() ? 0 : 1; }
         
         };
+
+        // the VarBytesCodec registered as "dccl.var_bytes" (DCCL_FINAL, so calls into it are bound at compile time)
+        class BuiltinVarBytesCodec DCCL_FINAL
+            : public dccl::StaticDispatchFieldCodec<BuiltinVarBytesCodec, VarBytesCodec>
+        { };
     }
 }
 
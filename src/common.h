@@ -35,6 +35,20 @@
 
 #include "dccl/bitset.h"
 
+/// Marks a class `final` where the compiler supports it (C++11 and newer), allowing calls through a pointer or reference to that class to be bound at compile time
+#if __cplusplus >= 201103L
+#define DCCL_FINAL final
+#else
+#define DCCL_FINAL
+#endif
+
+/// Marks a variable as having one instance per thread: C++11 `thread_local`, or the GCC/Clang `__thread` extension for older standards (which only allows plain data, such as pointers)
+#if __cplusplus >= 201103L
+#define DCCL_THREAD_LOCAL thread_local
+#else
+#define DCCL_THREAD_LOCAL __thread
+#endif
+
 
 namespace dccl
 {
@@ -74,36 +88,46 @@ namespace dccl
         Float round(Float d)
     { return std::floor(d + 0.5); }
     
+    /// \brief scaling used to round values of type Float to 'precision' number of decimal places (see round_scaled())
+    template<typename Float>
+        typename boost::enable_if<boost::is_floating_point<Float>, Float>::type round_scaling(int precision)
+    { return std::pow(10.0, precision); }
+
+    /// round 'value' using a 'scaling' precomputed by round_scaling(), for rounding many values to the same precision
+    template<typename Float>
+        typename boost::enable_if<boost::is_floating_point<Float>, Float>::type round_scaled(Float value, Float scaling)
+    { return round(value*scaling)/scaling; }
+    
     /// round 'value' to 'precision' number of decimal places
     /// \param r value to round
     /// \param dec number of places past the decimal to round (e.g. dec=1 rounds to tenths)
     /// \return r rounded
     template<typename Float>
         typename boost::enable_if<boost::is_floating_point<Float>, Float>::type round(Float value, int precision)
-    {
-        Float scaling = std::pow(10.0, precision);
-        return round(value*scaling)/scaling;        
-    }
+    { return round_scaled(value, round_scaling<Float>(precision)); }
     
     // C++98 has no long long overload for abs
     template<typename Int>
       Int abs(Int i) { return (i < 0) ? -i : i; }
 
-    /// round 'value' to 'precision' number of decimal places
-    /// \param r value to round
-    /// \param dec number of places past the decimal to round (e.g. dec=1 rounds to tenths)
-    /// \return r rounded
+    /// \brief scaling used to round values of type Int to 'precision' number of decimal places (see round_scaled())
     template<typename Int>
-        typename boost::enable_if<boost::is_integral<Int>, Int>::type round(Int value, int precision)
+        typename boost::enable_if<boost::is_integral<Int>, Int>::type round_scaling(int precision)
     {
-        if(precision >= 0)
+        // doesn't mean anything to round an integer to positive precision
+        return (precision >= 0) ? 1 : (Int)std::pow(10.0, -precision);
+    }
+
+    /// round 'value' using a 'scaling' precomputed by round_scaling(), for rounding many values to the same precision
+    template<typename Int>
+        typename boost::enable_if<boost::is_integral<Int>, Int>::type round_scaled(Int value, Int scaling)
+    {
+        if(scaling == 1)
         {
-            // doesn't mean anything to round an integer to positive precision
             return value;
         }
         else
         {
-            Int scaling = (Int)std::pow(10.0, -precision);
             Int remainder = value % scaling;
 
             value -= remainder;
@@ -114,6 +138,14 @@ namespace dccl
         }
     }
     
+    /// round 'value' to 'precision' number of decimal places
+    /// \param r value to round
+    /// \param dec number of places past the decimal to round (e.g. dec=1 rounds to tenths)
+    /// \return r rounded
+    template<typename Int>
+        typename boost::enable_if<boost::is_integral<Int>, Int>::type round(Int value, int precision)
+    { return round_scaled(value, round_scaling<Int>(precision)); }
+    
     
 }
 #endif
@@ -22,7 +22,7 @@
 #include <sstream>
 
 #include "dynamic_protobuf_manager.h"
-#include "logger.h"
+#include "dccl/logger.h"
 #include "exception.h"
 
 boost::shared_ptr<dccl::DynamicProtobufManager> dccl::DynamicProtobufManager::inst_;
@@ -34,6 +34,14 @@
 #include <google/protobuf/descriptor_database.h>
 #include <google/protobuf/compiler/importer.h>
 
+/// Whether google::protobuf::Arena is available (Google Protobuf 3.0 and newer)
+#if GOOGLE_PROTOBUF_VERSION >= 3000000
+#define DCCL_HAS_PROTOBUF_ARENA 1
+#include <google/protobuf/arena.h>
+#else
+#define DCCL_HAS_PROTOBUF_ARENA 0
+#endif
+
 #include <boost/shared_ptr.hpp>
 
 namespace dccl
@@ -107,6 +115,17 @@ namespace dccl
         static boost::shared_ptr<google::protobuf::Message> new_protobuf_message(
             const std::string& protobuf_type_name)
         { return new_protobuf_message<boost::shared_ptr<google::protobuf::Message> >(protobuf_type_name); }
+
+#if DCCL_HAS_PROTOBUF_ARENA
+        /// \brief Create a new (empty) Google Protobuf message of a given type by Descriptor on a google::protobuf::Arena. Sub-messages and strings later added to it are allocated on the same Arena.
+        ///
+        /// \param desc The Google Protobuf Descriptor of the message to create.
+        /// \param arena Arena to allocate the message on. The message is freed with the Arena and must not be deleted. If null, the message is allocated on the heap and deleting it is up to the caller.
+        /// \return A pointer to the newly created object.
+        static google::protobuf::Message* new_protobuf_message(
+            const google::protobuf::Descriptor* desc, google::protobuf::Arena* arena)
+        { return msg_factory().GetPrototype(desc)->New(arena); }
+#endif
             
             
         /// \brief Add a Google Protobuf DescriptorDatabase to the set of databases searched for Message Descriptors.
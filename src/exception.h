@@ -43,6 +43,22 @@ namespace dccl
           : Exception("NULL Value")
         { }    
     };
+
+    /// \brief Exception thrown when the bytes being decoded end before the message does (e.g. a truncated message).
+    class NotEnoughBitsException : public Exception
+    {
+      public:
+      NotEnoughBitsException(const std::string& s, unsigned bits_short = 0)
+          : Exception(s),
+            bits_short_(bits_short)
+        { }
+
+        /// \brief Number of bits missing for the read that failed (the message needs at least this many more), or 0 if unknown
+        unsigned bits_short() const { return bits_short_; }
+        
+      private:
+        unsigned bits_short_;
+    };
         
 }
 
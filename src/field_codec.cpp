@@ -30,6 +30,11 @@ dccl::MessagePart dccl::FieldCodecBase::part_ =
 
 const google::protobuf::Message* dccl::FieldCodecBase::root_message_ = 0;
 const google::protobuf::Descriptor* dccl::FieldCodecBase::root_descriptor_ = 0;
+dccl::TraceBuffer* dccl::FieldCodecBase::trace_ = 0;
+dccl::uint32 dccl::FieldCodecBase::trace_id_ = 0;
+std::vector<const dccl::Bitset*> dccl::FieldCodecBase::trace_bits_;
+unsigned dccl::FieldCodecBase::trace_part_bits_ = 0;
+boost::atomic<unsigned> dccl::FieldCodecBase::cache_generation_(0);
 
 using dccl::dlog;
 using namespace dccl::logger;
@@ -37,7 +42,7 @@ using namespace dccl::logger;
 //
 // FieldCodecBase public
 //
-dccl::FieldCodecBase::FieldCodecBase() { }
+dccl::FieldCodecBase::FieldCodecBase() : handle_(-1) { }
             
 void dccl::FieldCodecBase::base_encode(Bitset* bits,
                                        const google::protobuf::Message& field_value,
@@ -53,39 +58,282 @@ void dccl::FieldCodecBase::base_encode(Bitset* bits,
 
 }
 
-void dccl::FieldCodecBase::field_encode(Bitset* bits,
-                                        const boost::any& field_value,
-                                        const google::protobuf::FieldDescriptor* field)
+//
+// FieldCodecBase field_* paths: each public field_encode() / field_size() / field_decode() overload (boost::any, TaggedValue or bulk RepeatedField) supplies the value-specific steps (a "path") to the shared field_*_core()
+//
+
+// boost::any value
+struct dccl::FieldCodecBase::AnyPath
+{
+    AnyPath(const boost::any* in, boost::any* out) : in_(in), out_(out) { }
+
+    int encode(FieldCodecBase* codec, Bitset* bits)
+    {
+        boost::any wire_value;
+        codec->field_pre_encode(&wire_value, *in_);
+        codec->any_encode(bits, wire_value);
+        return -1;
+    }
+
+    unsigned size(FieldCodecBase* codec)
+    {
+        boost::any wire_value;
+        codec->field_pre_encode(&wire_value, *in_);
+        return codec->any_size(wire_value);
+    }
+
+    void decode(FieldCodecBase* codec, Bitset* bits)
+    {
+        wire_value_ = *out_;
+        codec->any_decode(bits, &wire_value_);
+    }
+
+    void post_decode(FieldCodecBase* codec)
+    { codec->field_post_decode(wire_value_, out_); }
+    
+    const boost::any* in_;
+    boost::any* out_;
+    boost::any wire_value_;
+};
+
+// repeated boost::any values
+struct dccl::FieldCodecBase::AnyRepeatedPath
+{
+    AnyRepeatedPath(const std::vector<boost::any>* in, std::vector<boost::any>* out) : in_(in), out_(out) { }
+
+    int encode(FieldCodecBase* codec, Bitset* bits)
+    {
+        std::vector<boost::any> wire_values;
+        codec->field_pre_encode_repeated(&wire_values, *in_);
+        codec->any_encode_repeated(bits, wire_values);
+        return wire_values.size();
+    }
+
+    unsigned size(FieldCodecBase* codec)
+    {
+        std::vector<boost::any> wire_values;
+        codec->field_pre_encode_repeated(&wire_values, *in_);
+        return codec->any_size_repeated(wire_values);
+    }
+
+    void decode(FieldCodecBase* codec, Bitset* bits)
+    {
+        wire_values_ = *out_;
+        codec->any_decode_repeated(bits, &wire_values_);
+    }
+
+    void post_decode(FieldCodecBase* codec)
+    {
+        out_->clear();
+        codec->field_post_decode_repeated(wire_values_, out_);
+    }
+    
+    const std::vector<boost::any>* in_;
+    std::vector<boost::any>* out_;
+    std::vector<boost::any> wire_values_;
+};
+
+// internal::TaggedValue value (codec supports_tagged_value())
+struct dccl::FieldCodecBase::TaggedPath
+{
+    TaggedPath(const internal::TaggedValue* in, internal::TaggedValue* out) : in_(in), out_(out) { }
+
+    int encode(FieldCodecBase* codec, Bitset* bits)
+    {
+        internal::TaggedValue wire_value;
+        codec->tagged_pre_encode(&wire_value, *in_);
+        codec->tagged_encode(bits, wire_value);
+        return -1;
+    }
+
+    unsigned size(FieldCodecBase* codec)
+    {
+        internal::TaggedValue wire_value;
+        codec->tagged_pre_encode(&wire_value, *in_);
+        return codec->tagged_size(wire_value);
+    }
+
+    void decode(FieldCodecBase* codec, Bitset* bits)
+    { codec->tagged_decode(bits, &wire_value_); }
+
+    void post_decode(FieldCodecBase* codec)
+    {
+        out_->clear();
+        if(!wire_value_.empty())
+            codec->tagged_post_decode(wire_value_, out_);
+    }
+    
+    const internal::TaggedValue* in_;
+    internal::TaggedValue* out_;
+    internal::TaggedValue wire_value_;
+};
+
+// repeated internal::TaggedValue values (codec supports_tagged_value())
+struct dccl::FieldCodecBase::TaggedRepeatedPath
+{
+    TaggedRepeatedPath(const std::vector<internal::TaggedValue>* in, std::vector<internal::TaggedValue>* out) : in_(in), out_(out) { }
+
+    int encode(FieldCodecBase* codec, Bitset* bits)
+    {
+        std::vector<internal::TaggedValue> wire_values;
+        codec->tagged_pre_encode_repeated(&wire_values, *in_);
+        codec->tagged_encode_repeated(bits, wire_values);
+        return wire_values.size();
+    }
+
+    unsigned size(FieldCodecBase* codec)
+    {
+        std::vector<internal::TaggedValue> wire_values;
+        codec->tagged_pre_encode_repeated(&wire_values, *in_);
+        return codec->tagged_size_repeated(wire_values);
+    }
+
+    void decode(FieldCodecBase* codec, Bitset* bits)
+    { codec->tagged_decode_repeated(bits, &wire_values_); }
+
+    void post_decode(FieldCodecBase* codec)
+    {
+        out_->clear();
+        codec->tagged_post_decode_repeated(wire_values_, out_);
+    }
+    
+    const std::vector<internal::TaggedValue>* in_;
+    std::vector<internal::TaggedValue>* out_;
+    std::vector<internal::TaggedValue> wire_values_;
+};
+
+// repeated scalar field accessed directly in the message's RepeatedField (codec supports_bulk_repeated())
+struct dccl::FieldCodecBase::BulkRepeatedPath
+{
+    BulkRepeatedPath(const google::protobuf::Message* in, google::protobuf::Message* out,
+                     const google::protobuf::FieldDescriptor* field) : in_(in), out_(out), field_(field) { }
+
+    int encode(FieldCodecBase* codec, Bitset* bits)
+    {
+        codec->bulk_encode_repeated(bits, *in_);
+        return in_->GetReflection()->FieldSize(*in_, field_);
+    }
+
+    unsigned size(FieldCodecBase* codec)
+    { return codec->bulk_size_repeated(*in_); }
+
+    void decode(FieldCodecBase* codec, Bitset* bits)
+    { codec->bulk_decode_repeated(bits, out_); }
+
+    void post_decode(FieldCodecBase* codec)
+    { }
+    
+    const google::protobuf::Message* in_;
+    google::protobuf::Message* out_;
+    const google::protobuf::FieldDescriptor* field_;
+};
+
+template<typename Path>
+void dccl::FieldCodecBase::field_encode_core(Bitset* bits,
+                                             Path& path,
+                                             const google::protobuf::FieldDescriptor* field,
+                                             bool repeated)
 {
     internal::MessageStack msg_handler(field);
 
     if(field)
-        dlog.is(DEBUG2, ENCODE) && dlog << "Starting encode for field: " << field->DebugString() << std::flush;
+        dlog.is(DEBUG2, ENCODE) && dlog << "Starting " << (repeated ? "repeated " : "") << "encode for field: " << field->DebugString() << std::flush;
+
+    TraceRAII trace(this, field, msg_handler.field_.size(), repeated ? TraceEvent::REPEATED : 0);
 
-    boost::any wire_value;
-    field_pre_encode(&wire_value, field_value);
-    
     Bitset new_bits;
-    any_encode(&new_bits, wire_value);
-    disp_size(field, new_bits, msg_handler.field_.size());
+    int vector_size = path.encode(this, &new_bits);
+    disp_size(field, new_bits, msg_handler.field_.size(), vector_size);
+    trace.encoded(new_bits.size());
     bits->append(new_bits);
 }
 
+template<typename Path>
+void dccl::FieldCodecBase::field_size_core(unsigned* bit_size,
+                                           Path& path,
+                                           const google::protobuf::FieldDescriptor* field)
+{
+    internal::MessageStack msg_handler(field);
+    *bit_size += path.size(this);
+}
+
+template<typename Path>
+void dccl::FieldCodecBase::field_decode_core(Bitset* bits,
+                                             Path& path,
+                                             const google::protobuf::FieldDescriptor* field,
+                                             bool repeated)
+{
+    internal::MessageStack msg_handler(field);
+
+    if(!bits)
+        throw(Exception("Decode called with NULL Bitset"));    
+    
+    if(field)
+        dlog.is(DEBUG2, DECODE) && dlog << "Starting " << (repeated ? "repeated " : "") << "decode for field: " << field->DebugString() << std::flush;
+    
+    if(root_message())
+        dlog.is(DEBUG3, DECODE) && dlog <<  "Message thus far is: " << root_message()->DebugString() << std::flush;
+    
+    TraceRAII trace(this, field, msg_handler.field_.size(), TraceEvent::DECODE | (repeated ? TraceEvent::REPEATED : 0));
+    
+    Bitset these_bits(bits);
+    trace.decoding(bits, &these_bits);
+
+    unsigned bits_to_transfer = 0;
+    field_min_size(&bits_to_transfer, field);
+    these_bits.get_more_bits(bits_to_transfer);    
+    
+    dlog.is(DEBUG2, DECODE) && dlog  << "... using these " << these_bits.size() << " bits: " << these_bits << std::endl;
+
+    path.decode(this, &these_bits);
+    trace.decoded();
+    
+    path.post_decode(this);
+}
+
+void dccl::FieldCodecBase::field_encode(Bitset* bits,
+                                        const boost::any& field_value,
+                                        const google::protobuf::FieldDescriptor* field)
+{
+    AnyPath path(&field_value, 0);
+    field_encode_core(bits, path, field, false);
+}
+
 void dccl::FieldCodecBase::field_encode_repeated(Bitset* bits,
                                                  const std::vector<boost::any>& field_values,
                                                  const google::protobuf::FieldDescriptor* field)
 {
-    internal::MessageStack msg_handler(field);
+    AnyRepeatedPath path(&field_values, 0);
+    field_encode_core(bits, path, field, true);
+}
 
-    std::vector<boost::any> wire_values;
-    field_pre_encode_repeated(&wire_values, field_values);
-    
-    Bitset new_bits;
-    any_encode_repeated(&new_bits, wire_values);
-    disp_size(field, new_bits, msg_handler.field_.size(), wire_values.size());
-    bits->append(new_bits);
+
+void dccl::FieldCodecBase::field_encode(Bitset* bits,
+                                        const internal::TaggedValue& field_value,
+                                        const google::protobuf::FieldDescriptor* field)
+{
+    if(!supports_tagged_value())
+        return field_encode(bits, field_value.to_any(), field);
+
+    TaggedPath path(&field_value, 0);
+    field_encode_core(bits, path, field, false);
 }
 
+void dccl::FieldCodecBase::field_encode_repeated(Bitset* bits,
+                                                 const std::vector<internal::TaggedValue>& field_values,
+                                                 const google::protobuf::FieldDescriptor* field)
+{
+    if(!supports_tagged_value())
+    {
+        std::vector<boost::any> any_values(field_values.size());
+        for(int i = 0, n = field_values.size(); i < n; ++i)
+            any_values[i] = field_values[i].to_any();
+        return field_encode_repeated(bits, any_values, field);
+    }
+
+    TaggedRepeatedPath path(&field_values, 0);
+    field_encode_core(bits, path, field, true);
+}
             
 void dccl::FieldCodecBase::base_size(unsigned* bit_size,
                                      const google::protobuf::Message& msg,
@@ -103,24 +351,44 @@ void dccl::FieldCodecBase::field_size(unsigned* bit_size,
                                       const boost::any& field_value,
                                       const google::protobuf::FieldDescriptor* field)
 {
-    internal::MessageStack msg_handler(field);
-
-    boost::any wire_value;
-    field_pre_encode(&wire_value, field_value);
-
-    *bit_size += any_size(wire_value);
+    AnyPath path(&field_value, 0);
+    field_size_core(bit_size, path, field);
 }
 
 void dccl::FieldCodecBase::field_size_repeated(unsigned* bit_size,
                                                const std::vector<boost::any>& field_values,
                                                const google::protobuf::FieldDescriptor* field)
 {
-    internal::MessageStack msg_handler(field);
+    AnyRepeatedPath path(&field_values, 0);
+    field_size_core(bit_size, path, field);
+}
+
 
-    std::vector<boost::any> wire_values;
-    field_pre_encode_repeated(&wire_values, field_values);
+void dccl::FieldCodecBase::field_size(unsigned* bit_size,
+                                      const internal::TaggedValue& field_value,
+                                      const google::protobuf::FieldDescriptor* field)
+{
+    if(!supports_tagged_value())
+        return field_size(bit_size, field_value.to_any(), field);
 
-    *bit_size += any_size_repeated(wire_values);
+    TaggedPath path(&field_value, 0);
+    field_size_core(bit_size, path, field);
+}
+
+void dccl::FieldCodecBase::field_size_repeated(unsigned* bit_size,
+                                               const std::vector<internal::TaggedValue>& field_values,
+                                               const google::protobuf::FieldDescriptor* field)
+{
+    if(!supports_tagged_value())
+    {
+        std::vector<boost::any> any_values(field_values.size());
+        for(int i = 0, n = field_values.size(); i < n; ++i)
+            any_values[i] = field_values[i].to_any();
+        return field_size_repeated(bit_size, any_values, field);
+    }
+
+    TaggedRepeatedPath path(&field_values, 0);
+    field_size_core(bit_size, path, field);
 }
 
 
@@ -140,62 +408,125 @@ void dccl::FieldCodecBase::field_decode(Bitset* bits,
                                         boost::any* field_value,
                                         const google::protobuf::FieldDescriptor* field)
 {
-    internal::MessageStack msg_handler(field);
-    
     if(!field_value)
         throw(Exception("Decode called with NULL boost::any"));
-    else if(!bits)
-        throw(Exception("Decode called with NULL Bitset"));    
-    
-    if(field)
-        dlog.is(DEBUG2, DECODE) && dlog << "Starting decode for field: " << field->DebugString() << std::flush;
-    
-    if(root_message())
-        dlog.is(DEBUG3, DECODE) && dlog <<  "Message thus far is: " << root_message()->DebugString() << std::flush;
-    
-    Bitset these_bits(bits);
-
-    unsigned bits_to_transfer = 0;
-    field_min_size(&bits_to_transfer, field);
-    these_bits.get_more_bits(bits_to_transfer);    
-    
-    dlog.is(DEBUG2, DECODE) && dlog  << "... using these bits: " << these_bits << std::endl;
 
-    boost::any wire_value = *field_value;
-    
-    any_decode(&these_bits, &wire_value);
-    
-    field_post_decode(wire_value, field_value);  
+    AnyPath path(field_value, field_value);
+    field_decode_core(bits, path, field, false);
 }
 
 void dccl::FieldCodecBase::field_decode_repeated(Bitset* bits,
                                                  std::vector<boost::any>* field_values,
                                                  const google::protobuf::FieldDescriptor* field)
 {
-    internal::MessageStack msg_handler(field);
-    
     if(!field_values)
         throw(Exception("Decode called with NULL field_values"));
-    else if(!bits)
-        throw(Exception("Decode called with NULL Bitset"));    
-    
-    if(field)
-        dlog.is(DEBUG2, DECODE) && dlog  << "Starting repeated decode for field: " << field->DebugString();
-    
-    Bitset these_bits(bits);
-    
-    unsigned bits_to_transfer = 0;
-    field_min_size(&bits_to_transfer, field);
-    these_bits.get_more_bits(bits_to_transfer);
+
+    AnyRepeatedPath path(field_values, field_values);
+    field_decode_core(bits, path, field, true);
+}
+
+
+void dccl::FieldCodecBase::field_decode(Bitset* bits,
+                                        internal::TaggedValue* field_value,
+                                        const google::protobuf::FieldDescriptor* field)
+{
+    if(!field_value)
+        throw(Exception("Decode called with NULL TaggedValue"));
     
-    dlog.is(DEBUG2, DECODE) && dlog  << "using these " <<
-        these_bits.size() << " bits: " << these_bits << std::endl;
+    if(!supports_tagged_value())
+    {
+        boost::any value = field_value->to_any();
+        field_decode(bits, &value, field);
+        field_value->from_any(value, field->cpp_type());
+        return;
+    }
+
+    TaggedPath path(field_value, field_value);
+    field_decode_core(bits, path, field, false);
+}
+
+void dccl::FieldCodecBase::field_decode_repeated(Bitset* bits,
+                                                 std::vector<internal::TaggedValue>* field_values,
+                                                 const google::protobuf::FieldDescriptor* field)
+{
+    if(!field_values)
+        throw(Exception("Decode called with NULL field_values"));
+
+    if(!supports_tagged_value())
+    {
+        std::vector<boost::any> values;
+        field_decode_repeated(bits, &values, field);
+        field_values->resize(values.size());
+        for(int i = 0, n = values.size(); i < n; ++i)
+            (*field_values)[i].from_any(values[i], field->cpp_type());
+        return;
+    }
+
+    TaggedRepeatedPath path(field_values, field_values);
+    field_decode_core(bits, path, field, true);
+}
+
+
+void dccl::FieldCodecBase::field_encode_repeated(Bitset* bits,
+                                                 const google::protobuf::Message& msg,
+                                                 const google::protobuf::FieldDescriptor* field)
+{
+    if(!supports_bulk_repeated())
+    {
+        std::vector<internal::TaggedValue> field_values(msg.GetReflection()->FieldSize(msg, field));
+        for(int j = 0, m = field_values.size(); j < m; ++j)
+            internal::get_repeated_field_value(field, msg, j, &field_values[j]);
+        return field_encode_repeated(bits, field_values, field);
+    }
+
+    BulkRepeatedPath path(&msg, 0, field);
+    field_encode_core(bits, path, field, true);
+}
+
+void dccl::FieldCodecBase::field_size_repeated(unsigned* bit_size,
+                                               const google::protobuf::Message& msg,
+                                               const google::protobuf::FieldDescriptor* field)
+{
+    if(!supports_bulk_repeated())
+    {
+        std::vector<internal::TaggedValue> field_values(msg.GetReflection()->FieldSize(msg, field));
+        for(int j = 0, m = field_values.size(); j < m; ++j)
+            internal::get_repeated_field_value(field, msg, j, &field_values[j]);
+        return field_size_repeated(bit_size, field_values, field);
+    }
+
+    BulkRepeatedPath path(&msg, 0, field);
+    field_size_core(bit_size, path, field);
+}
 
-    std::vector<boost::any> wire_values = *field_values;
-    any_decode_repeated(&these_bits, &wire_values);
+void dccl::FieldCodecBase::field_decode_repeated(Bitset* bits,
+                                                 google::protobuf::Message* msg,
+                                                 const google::protobuf::FieldDescriptor* field)
+{
+    if(!supports_bulk_repeated())
+    {
+        std::vector<internal::TaggedValue> values;
+        field_decode_repeated(bits, &values, field);
+        for(int j = 0, m = values.size(); j < m; ++j)
+            internal::add_field_value(field, msg, values[j]);
+        return;
+    }
 
-    field_values->clear();
-    field_post_decode_repeated(wire_values, field_values);
+    BulkRepeatedPath path(msg, msg, field);
+    field_decode_core(bits, path, field, true);
+}
+
+
+unsigned dccl::FieldCodecBase::field_peek_repeated_size(Bitset* bits,
+                                                         const google::protobuf::FieldDescriptor* field)
+{
+    internal::MessageStack msg_handler(field);
+
+    if(!bits)
+        throw(Exception("Decode called with NULL Bitset"));    
+
+    return any_peek_repeated_size(bits);
 }
 
 
@@ -284,6 +615,12 @@ void dccl::FieldCodecBase::field_validate(bool* b,
     
     validate();
 }
+
+const dccl::FieldCodecBase::FieldData* dccl::FieldCodecBase::any_field_data() const
+{
+    const google::protobuf::FieldDescriptor* field = this_field();
+    return field ? FieldCodecManager::__field_data(this, field) : 0;
+}
             
 void dccl::FieldCodecBase::base_info(std::ostream* os, const google::protobuf::Descriptor* desc, MessagePart part)
 {
@@ -429,6 +766,30 @@ void dccl::FieldCodecBase::any_decode_repeated(Bitset* repeated_bits, std::vecto
     }
 }
 
+unsigned dccl::FieldCodecBase::any_peek_repeated_size(Bitset* repeated_bits)
+{
+    // the repeated field format of derived codecs is unknown, so assume the worst
+    return dccl_field_options().max_repeat();
+}
+
+unsigned dccl::FieldCodecBase::peek_repeated_size_prefix(Bitset* repeated_bits)
+{
+    if(codec_version() > 2)
+    {
+        Bitset size_bits(repeated_bits);        
+        size_bits.get_more_bits(repeated_vector_field_size(dccl_field_options().max_repeat()));
+        unsigned wire_vector_size = size_bits.to_ulong();
+
+        // give the bits back
+        repeated_bits->prepend(size_bits);
+        return wire_vector_size;
+    }
+    else
+    {
+        return dccl_field_options().max_repeat();
+    }
+}
+
 unsigned dccl::FieldCodecBase::any_size_repeated(const std::vector<boost::any>& wire_values)
 {
     unsigned out = 0;
@@ -494,10 +855,188 @@ void dccl::FieldCodecBase::any_post_decode_repeated(
 }
 
 
+void dccl::FieldCodecBase::tagged_encode_repeated(Bitset* bits, const std::vector<internal::TaggedValue>& wire_values)
+{
+    unsigned wire_vector_size = dccl_field_options().max_repeat();
+
+    if(codec_version() > 2)
+    {
+        wire_vector_size = std::min((int)dccl_field_options().max_repeat(), (int)wire_values.size());    
+        Bitset size_bits(repeated_vector_field_size(dccl_field_options().max_repeat()), wire_values.size());
+        bits->append(size_bits);
+    }    
+
+    for(unsigned i = 0, n = wire_vector_size; i < n; ++i)
+    {
+        Bitset new_bits;
+        if(i < wire_values.size())
+            tagged_encode(&new_bits, wire_values[i]);
+        else
+            tagged_encode(&new_bits, internal::TaggedValue());
+        bits->append(new_bits);
+    }
+}
+
+void dccl::FieldCodecBase::tagged_decode_repeated(Bitset* repeated_bits, std::vector<internal::TaggedValue>* wire_values)
+{
+    unsigned wire_vector_size = dccl_field_options().max_repeat();    
+    if(codec_version() > 2)
+    {
+        Bitset size_bits(repeated_bits);        
+        size_bits.get_more_bits(repeated_vector_field_size(dccl_field_options().max_repeat()));
+
+        wire_vector_size = size_bits.to_ulong();
+    }
+
+    wire_values->resize(wire_vector_size);
+    
+    for(unsigned i = 0, n = wire_vector_size; i < n; ++i)
+    {
+        Bitset these_bits(repeated_bits);        
+        these_bits.get_more_bits(min_size());        
+        tagged_decode(&these_bits, &(*wire_values)[i]);
+    }
+}
+
+unsigned dccl::FieldCodecBase::tagged_size_repeated(const std::vector<internal::TaggedValue>& wire_values)
+{
+    unsigned out = 0;
+    unsigned wire_vector_size = dccl_field_options().max_repeat();
+
+    if(codec_version() > 2)
+    {
+        wire_vector_size = std::min((int)dccl_field_options().max_repeat(), (int)wire_values.size());    
+        out += repeated_vector_field_size(dccl_field_options().max_repeat());
+    }    
+
+    for(unsigned i = 0, n = wire_vector_size; i < n; ++i)
+    {
+        if(i < wire_values.size())
+            out += tagged_size(wire_values[i]);
+        else
+            out += tagged_size(internal::TaggedValue());
+    }    
+    return out;
+}
+
+void dccl::FieldCodecBase::tagged_pre_encode_repeated(std::vector<internal::TaggedValue>* wire_values,
+                                                      const std::vector<internal::TaggedValue>& field_values)
+{
+    wire_values->reserve(field_values.size());
+    for(std::vector<internal::TaggedValue>::const_iterator it = field_values.begin(),
+            end = field_values.end(); it != end; ++it)
+    {
+        wire_values->push_back(internal::TaggedValue());
+        tagged_pre_encode(&wire_values->back(), *it);
+    }
+}
+
+void dccl::FieldCodecBase::tagged_post_decode_repeated(const std::vector<internal::TaggedValue>& wire_values,
+                                                       std::vector<internal::TaggedValue>* field_values)
+{
+    field_values->reserve(wire_values.size());
+    for(std::vector<internal::TaggedValue>::const_iterator it = wire_values.begin(),
+            end = wire_values.end(); it != end; ++it)
+    {
+        field_values->push_back(internal::TaggedValue());
+        tagged_post_decode(*it, &field_values->back());
+    }
+}
+
+
 //
 // FieldCodecBase private
 //
 
+void dccl::FieldCodecBase::TraceRAII::begin(const FieldCodecBase* codec, const google::protobuf::FieldDescriptor* field, int depth, int flags)
+{
+    event_ = FieldCodecBase::trace_->next();
+    event_index_ = FieldCodecBase::trace_->recorded() - 1;
+    event_->dccl_id = FieldCodecBase::trace_id_;
+    event_->field_number = field ? field->number() : 0;
+    event_->bit_offset = 0;
+    event_->bit_width = 0;
+    event_->codec_handle = codec->handle();
+    event_->depth = depth;
+    event_->flags = flags | TraceEvent::INCOMPLETE | (FieldCodecBase::part_ == HEAD ? TraceEvent::HEAD : 0);
+    event_->cycles = 0;
+    start_ = TraceBuffer::now();
+}
+
+void dccl::FieldCodecBase::TraceRAII::begin_decode(const Bitset* bits, const Bitset* these_bits)
+{
+    if(event_->depth == 0)
+    {
+        trace_bits_.assign(1, bits);
+        trace_part_bits_ = bits->size();
+    }
+    bits_index_ = trace_bits_.size();
+    trace_bits_.push_back(these_bits);
+    available_ = available();
+    event_->bit_offset = trace_part_bits_ - available_;
+}
+
+unsigned dccl::FieldCodecBase::TraceRAII::available() const
+{
+    unsigned bits = 0;
+    for(int i = 0; i < bits_index_; ++i)
+        bits += trace_bits_[i]->size();
+    return bits;
+}
+
+namespace
+{
+    // sets the offsets of the encode events of one message part (starting with its root message at `first`).
+    // Fields are encoded (and so their events completed) before the enclosing message codec adds any bits of its own (e.g. presence), so this is done once the whole part is known: the fields of a message are placed at the end of that message, after any such bits
+    void set_encode_offsets(dccl::TraceBuffer* trace, dccl::uint64 first)
+    {
+        const dccl::uint64 last = trace->recorded();
+        if(last - first > trace->capacity())
+            return;
+
+        // bits of the (direct) fields of each message event, then the offset of its next field
+        static std::vector<unsigned> fields_bits;
+        static std::vector<dccl::uint64> parents;
+        fields_bits.assign(last - first, 0);
+        
+        parents.clear();
+        for(dccl::uint64 i = first; i < last; ++i)
+        {
+            const dccl::TraceEvent& event = trace->recorded_event(i);
+            parents.resize(event.depth);
+            if(!parents.empty())
+                fields_bits[parents.back() - first] += event.bit_width;
+            parents.push_back(i);
+        }
+
+        parents.clear();
+        for(dccl::uint64 i = first; i < last; ++i)
+        {
+            dccl::TraceEvent& event = trace->recorded_event(i);
+            parents.resize(event.depth);
+            if(!parents.empty())
+            {
+                unsigned& next_offset = fields_bits[parents.back() - first];
+                event.bit_offset = next_offset;
+                next_offset += event.bit_width;
+            }
+            parents.push_back(i);
+            // now the offset of its first field
+            fields_bits[i - first] = event.bit_offset + event.bit_width - fields_bits[i - first];
+        }
+    }
+}
+
+void dccl::FieldCodecBase::TraceRAII::end(unsigned width)
+{
+    event_->cycles = TraceBuffer::now() - start_;
+    event_->bit_width = width;
+    event_->flags &= ~TraceEvent::INCOMPLETE;
+
+    if(event_->depth == 0 && !(event_->flags & TraceEvent::DECODE))
+        set_encode_offsets(FieldCodecBase::trace_, event_index_);
+}
+
 void dccl::FieldCodecBase::disp_size(const google::protobuf::FieldDescriptor* field, const Bitset& new_bits, int depth, int vector_size /* = -1 */)
 {
     if(!root_descriptor_)
@@ -26,7 +26,9 @@
 #include <string>
 
 #include <boost/any.hpp>
+#include <boost/atomic.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <google/protobuf/message.h>
 #include <google/protobuf/descriptor.pb.h>
@@ -37,7 +39,9 @@
 #include "dccl/option_extensions.pb.h"
 #include "internal/type_helper.h"
 #include "internal/field_codec_message_stack.h"
+#include "internal/tagged_value.h"
 #include "dccl/binary.h"
+#include "dccl/trace.h"
 
 namespace dccl
 {
@@ -68,6 +72,9 @@ namespace dccl
         /// \return the C++ type used to encode and decode. See http://code.google.com/apis/protocolbuffers/docs/reference/cpp/google.protobuf.descriptor.html#FieldDescriptor.CppType.details
         google::protobuf::FieldDescriptor::CppType wire_type() const  { return wire_type_; }
 
+        /// \brief the index of this codec in the FieldCodecManager (see FieldCodecManager::find_by_handle()), or -1 if it has not been added
+        int handle() const { return handle_; }
+
 
         /// \brief Returns the FieldDescriptor (field schema  meta-data) for this field
         ///
@@ -116,6 +123,18 @@ namespace dccl
             
         /// \brief the part of the message currently being encoded (head or body).
         static MessagePart part() { return part_; }
+
+        /// \brief Changes whenever values that codecs cache per field (keyed by FieldDescriptor) may have become stale: when codecs are added or removed (FieldCodecManager) and when messages are unloaded (Codec::unload()). Codecs holding such caches must discard them when this changes.
+        static unsigned cache_generation() { return cache_generation_.load(boost::memory_order_relaxed); }
+
+        /// \brief Invalidates the per-field values cached by every codec (see cache_generation())
+        static void invalidate_caches() { cache_generation_.fetch_add(1, boost::memory_order_relaxed); }
+
+        /// \brief Values that a codec computes once per field, when the message is loaded (see make_field_data()). Derive from this to hold them.
+        struct FieldData
+        {
+            virtual ~FieldData() { }
+        };
             
         //@}
 
@@ -266,6 +285,61 @@ namespace dccl
                                    std::vector<boost::any>* field_values,
                                    const google::protobuf::FieldDescriptor* field);
 
+        /// \brief Encode a non-repeated field given as an internal::TaggedValue. Used by the default message codecs to avoid boost::any for the common (primitive) field types; codecs that do not support TaggedValue are transparently called using boost::any.
+        void field_encode(Bitset* bits,
+                          const internal::TaggedValue& field_value,
+                          const google::protobuf::FieldDescriptor* field);
+
+        /// \brief Encode a repeated field given as internal::TaggedValue%s.
+        void field_encode_repeated(Bitset* bits,
+                                   const std::vector<internal::TaggedValue>& field_values,
+                                   const google::protobuf::FieldDescriptor* field);
+
+        /// \brief Calculate the size of a non-repeated field given as an internal::TaggedValue.
+        void field_size(unsigned* bit_size, const internal::TaggedValue& field_value,
+                        const google::protobuf::FieldDescriptor* field);
+
+        /// \brief Calculate the size of a repeated field given as internal::TaggedValue%s.
+        void field_size_repeated(unsigned* bit_size, const std::vector<internal::TaggedValue>& field_values,
+                                 const google::protobuf::FieldDescriptor* field);
+
+        /// \brief Decode a non-repeated field into an internal::TaggedValue (left empty if the field was not set).
+        void field_decode(Bitset* bits,
+                          internal::TaggedValue* field_value,
+                          const google::protobuf::FieldDescriptor* field);
+
+        /// \brief Decode a repeated field into internal::TaggedValue%s.
+        void field_decode_repeated(Bitset* bits,
+                                   std::vector<internal::TaggedValue>* field_values,
+                                   const google::protobuf::FieldDescriptor* field);
+
+        /// \brief Encode a repeated scalar field by reading its values directly from the message. Codecs that support it (see TypedFieldCodec::encode_repeated(internal::Span<const FieldType>)) access the RepeatedField storage in bulk; otherwise the values are read one at a time.
+        ///
+        /// \param bits Pointer to bitset to store encoded bits. Bits are added to the most significant end of `bits`
+        /// \param msg Message containing the field
+        /// \param field Protobuf descriptor to the repeated field
+        void field_encode_repeated(Bitset* bits,
+                                   const google::protobuf::Message& msg,
+                                   const google::protobuf::FieldDescriptor* field);
+
+        /// \brief Calculate the size of a repeated scalar field by reading its values directly from the message.
+        void field_size_repeated(unsigned* bit_size,
+                                 const google::protobuf::Message& msg,
+                                 const google::protobuf::FieldDescriptor* field);
+
+        /// \brief Decode a repeated scalar field, adding the values directly to the message.
+        void field_decode_repeated(Bitset* bits,
+                                   google::protobuf::Message* msg,
+                                   const google::protobuf::FieldDescriptor* field);
+
+        /// \brief Upper bound on the number of values that the next field_decode_repeated() call will decode from `bits`, without consuming any bits. Used to allocate only as many sub-messages as are present.
+        ///
+        /// \param bits Bits to decode (as passed to field_decode_repeated()). The bits are left unchanged.
+        /// \param field Protobuf descriptor to the repeated field
+        /// \return the number of values, or (dccl.field).max_repeat if the codec cannot tell (see any_peek_repeated_size())
+        unsigned field_peek_repeated_size(Bitset* bits,
+                                          const google::protobuf::FieldDescriptor* field);
+
         /// \brief Post-decodes a non-repeated (i.e. optional or required) field by converting the WireType (the type used in the encoded DCCL message) representation into the FieldType representation (the Google Protobuf representation). This allows for type-converting codecs.
         ///
         /// \param wire_value Should be set to the desired value to translate
@@ -340,6 +414,14 @@ namespace dccl
                 
         }
 
+        /// \brief The values this codec computed for the current field (this_field()) when the message was loaded (see make_field_data()).
+        ///
+        /// \tparam Data The type returned by make_field_data()
+        /// \return the values, or null if there are none (e.g. the message has not been loaded, or this codec is used by another codec rather than being the codec registered for this field). Valid until the FieldCodecManager snapshot is released, i.e. for the rest of the encode, decode or size call.
+        template<typename Data>
+            const Data* field_data() const
+        { return dynamic_cast<const Data*>(any_field_data()); }
+
         /// \brief Whether to use the required or optional encoding
         bool use_required()
         {
@@ -396,6 +478,10 @@ namespace dccl
         /// \brief Validate a field. Use require() inside your overloaded validate() to assert requirements or throw Exceptions directly as needed.
         virtual void validate() { }
 
+        /// \brief Compute values that depend only on the current field (this_field()), such as constants derived from its options, so that they need not be recomputed on every encode, decode or size call. Called when the message is loaded (Codec::load()); the result is kept with the field in the FieldCodecManager snapshot (which is immutable, so it may be read from any thread) and returned by field_data().
+        virtual boost::shared_ptr<const FieldData> make_field_data()
+        { return boost::shared_ptr<const FieldData>(); }
+
         /// \brief Write field specific information (in addition to general information such as sizes that are automatically written by this class for all fields.
         ///
         /// \return string containing information to display.
@@ -414,6 +500,12 @@ namespace dccl
         virtual void any_encode_repeated(Bitset* bits, const std::vector<boost::any>& wire_values);
         virtual void any_decode_repeated(Bitset* repeated_bits, std::vector<boost::any>* field_values);
 
+        /// \brief Upper bound on the number of values any_decode_repeated() will decode from the front of `repeated_bits`, which must be left unchanged. The default returns (dccl.field).max_repeat; codecs that know their repeated field format can override this to report the exact count (codecs using the default format of FieldCodecBase::any_decode_repeated() can return peek_repeated_size_prefix()).
+        virtual unsigned any_peek_repeated_size(Bitset* repeated_bits);
+
+        /// \brief Read the DCCL3 size prefix written by the default FieldCodecBase::any_encode_repeated() without consuming it ((dccl.field).max_repeat for DCCL2)
+        unsigned peek_repeated_size_prefix(Bitset* repeated_bits);
+
         virtual void any_pre_encode_repeated(std::vector<boost::any>* wire_values,
                                              const std::vector<boost::any>& field_values);
             
@@ -421,10 +513,87 @@ namespace dccl
                                               std::vector<boost::any>* field_values);
             
         virtual unsigned any_size_repeated(const std::vector<boost::any>& wire_values);
+
+        // contain internal::TaggedValue
+        /// \brief Whether this codec implements the tagged_* methods. If false (the default), the TaggedValue field functions convert to and from boost::any and call the any_* methods instead.
+        virtual bool supports_tagged_value() { return false; }
+
+        /// \brief Equivalent of any_encode() for TaggedValue
+        virtual void tagged_encode(Bitset* bits, const internal::TaggedValue& wire_value)
+        { any_encode(bits, wire_value.to_any()); }
+
+        /// \brief Equivalent of any_decode() for TaggedValue
+        virtual void tagged_decode(Bitset* bits, internal::TaggedValue* wire_value)
+        {
+            boost::any value = wire_value->to_any();
+            any_decode(bits, &value);
+            wire_value->from_any(value, wire_type());
+        }
+
+        /// \brief Equivalent of any_size() for TaggedValue
+        virtual unsigned tagged_size(const internal::TaggedValue& wire_value)
+        { return any_size(wire_value.to_any()); }
+
+        /// \brief Equivalent of any_pre_encode() for TaggedValue. The default copies field_value to wire_value.
+        virtual void tagged_pre_encode(internal::TaggedValue* wire_value,
+                                       const internal::TaggedValue& field_value)
+        { *wire_value = field_value; }
+
+        /// \brief Equivalent of any_post_decode() for TaggedValue. The default copies wire_value to field_value.
+        virtual void tagged_post_decode(const internal::TaggedValue& wire_value,
+                                        internal::TaggedValue* field_value)
+        { *field_value = wire_value; }
+        
+        virtual void tagged_encode_repeated(Bitset* bits, const std::vector<internal::TaggedValue>& wire_values);
+        virtual void tagged_decode_repeated(Bitset* repeated_bits, std::vector<internal::TaggedValue>* wire_values);
+        virtual unsigned tagged_size_repeated(const std::vector<internal::TaggedValue>& wire_values);
+        
+        /// \brief Whether this codec implements the bulk_* methods for the current (repeated) field
+        virtual bool supports_bulk_repeated() { return false; }
+
+        /// \brief Encode all the values of the current repeated field of msg
+        virtual void bulk_encode_repeated(Bitset* bits, const google::protobuf::Message& msg)
+        { throw(Exception("Bulk repeated encoding not supported by this codec")); }
+
+        /// \brief Decode the current repeated field, adding the values to msg
+        virtual void bulk_decode_repeated(Bitset* bits, google::protobuf::Message* msg)
+        { throw(Exception("Bulk repeated decoding not supported by this codec")); }
+
+        /// \brief Size of all the values of the current repeated field of msg
+        virtual unsigned bulk_size_repeated(const google::protobuf::Message& msg)
+        { throw(Exception("Bulk repeated sizing not supported by this codec")); }
+        
         virtual unsigned max_size_repeated();
         virtual unsigned min_size_repeated();
             
+        /// \brief Size (in bits) of the DCCL3 prefix giving the number of values in a repeated field
+        int repeated_vector_field_size(int max_repeat)
+        { return dccl::ceil_log2(max_repeat+1); }
+            
         friend class FieldCodecManager;
+
+      public:
+        /// \brief Records a TraceEvent in `buffer` for each field encoded or decoded while this object exists (used by Codec, see Codec::enable_trace()). A null `buffer` disables tracing for this scope.
+        class ScopedTrace
+        {
+          public:
+            ScopedTrace(TraceBuffer* buffer, uint32 dccl_id)
+                : previous_trace_(FieldCodecBase::trace_),
+                  previous_id_(FieldCodecBase::trace_id_)
+            {
+                FieldCodecBase::trace_ = buffer;
+                FieldCodecBase::trace_id_ = dccl_id;
+            }
+            ~ScopedTrace()
+            {
+                FieldCodecBase::trace_ = previous_trace_;
+                FieldCodecBase::trace_id_ = previous_id_;
+            }
+          private:
+            TraceBuffer* previous_trace_;
+            uint32 previous_id_;
+        };
+        
       private:
         // codec information
         void set_name(const std::string& name)
@@ -434,6 +603,9 @@ namespace dccl
         void set_wire_type(google::protobuf::FieldDescriptor::CppType type)
         { wire_type_ = type; }
 
+        // FieldData made by this codec for this_field() (see FieldCodecManager::resolve())
+        const FieldData* any_field_data() const;
+
         bool variable_size()
         {
             if(this_field() && this_field()->is_repeated())
@@ -442,10 +614,28 @@ namespace dccl
                 return max_size() != min_size();
         }            
 
-        int repeated_vector_field_size(int max_repeat)
-        { return dccl::ceil_log2(max_repeat+1); }
+        void tagged_pre_encode_repeated(std::vector<internal::TaggedValue>* wire_values,
+                                        const std::vector<internal::TaggedValue>& field_values);
+        void tagged_post_decode_repeated(const std::vector<internal::TaggedValue>& wire_values,
+                                         std::vector<internal::TaggedValue>* field_values);
+
 
         void disp_size(const google::protobuf::FieldDescriptor* field, const Bitset& new_bits, int depth, int vector_size = -1);
+
+        // value-specific steps of the field_encode(), field_size() and field_decode() overloads (defined in field_codec.cpp)
+        struct AnyPath;
+        struct AnyRepeatedPath;
+        struct TaggedPath;
+        struct TaggedRepeatedPath;
+        struct BulkRepeatedPath;
+
+        // shared implementation of the field_encode(), field_size() and field_decode() overloads (message stack, logging, tracing and Bitset handling) for a given Path
+        template<typename Path>
+            void field_encode_core(Bitset* bits, Path& path, const google::protobuf::FieldDescriptor* field, bool repeated);
+        template<typename Path>
+            void field_size_core(unsigned* bit_size, Path& path, const google::protobuf::FieldDescriptor* field);
+        template<typename Path>
+            void field_decode_core(Bitset* bits, Path& path, const google::protobuf::FieldDescriptor* field, bool repeated);
         
         
       private:
@@ -466,7 +656,7 @@ namespace dccl
                 {
                     FieldCodecBase::part_ = part;
                     FieldCodecBase::root_message_ = root_message;
-                    FieldCodecBase::root_descriptor_ = root_message->GetDescriptor();                    
+                    FieldCodecBase::root_descriptor_ = root_message->GetDescriptor();
                 }
             ~BaseRAII()
                 {
@@ -477,10 +667,68 @@ namespace dccl
         };
         
         
+        // records a TraceEvent for one field_encode() / field_decode() call, if tracing
+        class TraceRAII
+        {
+          public:
+            TraceRAII(const FieldCodecBase* codec, const google::protobuf::FieldDescriptor* field, int depth, int flags)
+                : event_(0),
+                  bits_index_(-1)
+            {
+                // skips the identifier (encoded outside of base_encode())
+                if(FieldCodecBase::trace_ && FieldCodecBase::part_ != UNKNOWN)
+                    begin(codec, field, depth, flags);
+            }
+            ~TraceRAII()
+            {
+                if(bits_index_ >= 0)
+                    FieldCodecBase::trace_bits_.resize(bits_index_);
+            }
+            
+            /// \param bits number of bits encoded for this field
+            void encoded(unsigned bits)
+            { if(event_) end(bits); }
+
+            /// \brief Call before decoding
+            /// \param bits Bitset passed to field_decode() (the root Bitset for the root message)
+            /// \param these_bits (empty) Bitset for the bits of this field, with `bits` as its parent
+            void decoding(const Bitset* bits, const Bitset* these_bits)
+            { if(event_) begin_decode(bits, these_bits); }
+            
+            /// \brief Call after decoding
+            void decoded()
+            { if(event_) end(available_ - available()); }
+            
+          private:
+            void begin(const FieldCodecBase* codec, const google::protobuf::FieldDescriptor* field, int depth, int flags);
+            void begin_decode(const Bitset* bits, const Bitset* these_bits);
+            void end(unsigned width);
+            // bits held by the Bitsets this field can take bits from
+            unsigned available() const;
+
+            TraceEvent* event_;
+            // TraceBuffer::recorded() index of event_
+            uint64 event_index_;
+            uint64 start_;
+            // position of these_bits in trace_bits_
+            int bits_index_;
+            unsigned available_;
+        };
+        
         static MessagePart part_;
         static const google::protobuf::Message* root_message_;
         static const google::protobuf::Descriptor* root_descriptor_;
+
+        static TraceBuffer* trace_;
+        static uint32 trace_id_;
+        // decode: the chain of Bitsets of the fields being decoded, from the Bitset of the message part (bits only flow down this chain, so the bits taken by a field are the decrease in the bits held by the Bitsets above it)
+        static std::vector<const Bitset*> trace_bits_;
+        static unsigned trace_part_bits_;
+
+        static boost::atomic<unsigned> cache_generation_;
         
+        int handle_;
+
         std::string name_;
         google::protobuf::FieldDescriptor::Type field_type_;
         google::protobuf::FieldDescriptor::CppType wire_type_;
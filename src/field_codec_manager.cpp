@@ -21,33 +21,380 @@
 // along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
 #include "field_codec_manager.h"
 
-std::map<google::protobuf::FieldDescriptor::Type, dccl::FieldCodecManager::InsideMap> dccl::FieldCodecManager::codecs_;
+boost::shared_ptr<const dccl::FieldCodecManager::Registry> dccl::FieldCodecManager::registry_;
+DCCL_THREAD_LOCAL const dccl::FieldCodecManager::Registry* dccl::FieldCodecManager::pinned_ = 0;
+DCCL_THREAD_LOCAL std::vector<dccl::FieldCodecManager::Change>* dccl::FieldCodecManager::batch_ = 0;
 
+const dccl::FieldCodecManager::Registry& dccl::FieldCodecManager::pinned()
+{
+    // nothing has been added yet
+    static const Registry empty;
+    return pinned_ ? *pinned_ : empty;
+}
 
-boost::shared_ptr<dccl::FieldCodecBase>
-dccl::FieldCodecManager::__find(google::protobuf::FieldDescriptor::Type type,
-                                                 const std::string& codec_name,
-                                                 const std::string& type_name /* = "" */)
+dccl::FieldCodecBase* dccl::FieldCodecManager::find(const google::protobuf::FieldDescriptor* field,
+                                                    bool has_codec_group,
+                                                    const std::string& codec_group)
+{
+    ScopedSnapshot snapshot;
+    const Registry& registry = pinned();
+
+    // resolved in advance for the message being encoded or decoded
+    if(const ResolvedMessage* resolved = registry.resolved_message(FieldCodecBase::root_descriptor_))
+    {
+        std::map<const google::protobuf::FieldDescriptor*, Resolution>::const_iterator it = resolved->fields.find(field);
+        if(it != resolved->fields.end() &&
+           resolved->has_codec_group == has_codec_group &&
+           (!has_codec_group || resolved->codec_group == codec_group))
+            return registry.codec(it->second.handle);
+    }
+    
+    return registry.codec(__resolve_field(registry, field, has_codec_group, codec_group).handle);
+}
+
+dccl::FieldCodecBase* dccl::FieldCodecManager::find(const google::protobuf::Descriptor* desc,
+                                                    const std::string& name /* = "" */)
 {
-    typedef InsideMap::const_iterator InsideIterator;
-    typedef std::map<google::protobuf::FieldDescriptor::Type, InsideMap>::const_iterator Iterator;
+    ScopedSnapshot snapshot;
+    const Registry& registry = pinned();
     
-    Iterator it = codecs_.find(type);
-    if(it != codecs_.end())
-    {
-        InsideIterator inside_it = it->second.end();
-        // try specific type codec
-        inside_it = it->second.find(__mangle_name(codec_name, type_name));
-        if(inside_it != it->second.end())
-            return inside_it->second;
+    if(!name.empty())
+        return registry.codec(registry.find(google::protobuf::FieldDescriptor::TYPE_MESSAGE, name, desc->full_name()));
+
+    // this was called on the root message
+    if(const ResolvedMessage* resolved = registry.resolved_message(desc))
+        return registry.codec(resolved->message.handle);
+    
+    return registry.codec(__resolve_message(registry, desc).handle);
+}
+
+void dccl::FieldCodecManager::resolve(const google::protobuf::Descriptor* desc, bool add_reference /* = true */)
+{
+    ScopedSnapshot snapshot;
+    const Registry& registry = pinned();
+
+    boost::shared_ptr<ResolvedMessage> resolved(new ResolvedMessage);
+    const dccl::DCCLMessageOptions& options = desc->options().GetExtension(dccl::msg);
+    resolved->has_codec_group = options.has_codec_group() || options.has_codec_version();
+    resolved->codec_group = FieldCodecBase::codec_group(desc);
+    resolved->message = __resolve_message(registry, desc);
+    {
+        // as in FieldCodecBase::base_validate(), so that the codecs see the same message stack (this_field(), etc.) and root message
+        FieldCodecBase::BaseRAII scoped_globals(UNKNOWN, desc);
+        internal::MessageStack msg_handler;
+        msg_handler.push(desc);
+        __resolve_fields(registry, desc, resolved.get());
+    }
+
+    boost::shared_ptr<const Registry> current = boost::atomic_load(&registry_);
+    for(;;)
+    {
+        boost::shared_ptr<Registry> next = __copy_codecs(current.get());
+        // codecs were added or removed since `registry` was pinned
+        boost::shared_ptr<ResolvedMessage> published = (current.get() == &registry) ?
+            boost::shared_ptr<ResolvedMessage>(new ResolvedMessage(*resolved)) : __rebind(*next, *resolved);
+        if(!published)
+            return;
+
+        const ResolvedMessage* previous = next->resolved_message(desc);
+        published->references = previous ? previous->references : 0;
+        if(add_reference || !published->references)
+            ++published->references;
+        next->resolved[desc] = published;
+        
+        if(boost::atomic_compare_exchange(&registry_, &current, boost::shared_ptr<const Registry>(next)))
+            break;
+    }
+}
+
+void dccl::FieldCodecManager::release(const google::protobuf::Descriptor* desc)
+{
+    boost::shared_ptr<const Registry> current = boost::atomic_load(&registry_);
+    for(;;)
+    {
+        const ResolvedMessage* previous = current ? current->resolved_message(desc) : 0;
+        if(!previous)
+            return;
         
-        // try general 
-        inside_it = it->second.find(codec_name);
-        if(inside_it != it->second.end())
-            return inside_it->second;
+        boost::shared_ptr<Registry> next = __copy_codecs(current.get());
+        if(previous->references > 1)
+        {
+            boost::shared_ptr<ResolvedMessage> released(new ResolvedMessage(*previous));
+            --released->references;
+            next->resolved[desc] = released;
+        }
+        else
+        {
+            next->resolved.erase(desc);
+        }
+        
+        if(boost::atomic_compare_exchange(&registry_, &current, boost::shared_ptr<const Registry>(next)))
+            break;
+    }
+}
+
+dccl::FieldCodecManager::Resolution
+dccl::FieldCodecManager::__resolve_field(const Registry& registry,
+                                         const google::protobuf::FieldDescriptor* field,
+                                         bool has_codec_group,
+                                         const std::string& codec_group)
+{
+    Resolution resolution;
+    resolution.name = __find_codec(field, has_codec_group, codec_group);
+    if(field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE)
+        resolution.type_name = field->message_type()->full_name();
+    else
+        resolution.type = field->type();
+    resolution.handle = registry.find(resolution.type, resolution.name, resolution.type_name);
+    return resolution;
+}
+
+dccl::FieldCodecManager::Resolution
+dccl::FieldCodecManager::__resolve_message(const Registry& registry, const google::protobuf::Descriptor* desc)
+{
+    // explicitly declared codec takes precedence over group
+    Resolution resolution;
+    resolution.name = desc->options().GetExtension(dccl::msg).has_codec() ?
+        desc->options().GetExtension(dccl::msg).codec() :
+        FieldCodecBase::codec_group(desc);
+    resolution.type_name = desc->full_name();
+    resolution.handle = registry.find(resolution.type, resolution.name, resolution.type_name);
+    return resolution;
+}
+
+void dccl::FieldCodecManager::__resolve_fields(const Registry& registry,
+                                               const google::protobuf::Descriptor* desc,
+                                               ResolvedMessage* resolved)
+{
+    for(int i = 0, n = desc->field_count(); i < n; ++i)
+    {
+        const google::protobuf::FieldDescriptor* field = desc->field(i);
+        if(field->options().GetExtension(dccl::field).omit() || resolved->fields.count(field))
+            continue;
+
+        Resolution resolution;
+        try
+        {
+            resolution = __resolve_field(registry, field, resolved->has_codec_group, resolved->codec_group);
+        }
+        catch(Exception& e)
+        {
+            // a custom message codec need not use all of its fields; find() reports the error if this one is used
+            continue;
+        }
+
+        internal::MessageStack msg_handler(field);
+        resolution.data = registry.codec(resolution.handle)->make_field_data();
+        resolved->fields[field] = resolution;
+
+        if(field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE)
+            __resolve_fields(registry, field->message_type(), resolved);
+    }
+}
+
+boost::shared_ptr<dccl::FieldCodecManager::ResolvedMessage>
+dccl::FieldCodecManager::__rebind(const Registry& registry, const ResolvedMessage& resolved)
+{
+    boost::shared_ptr<ResolvedMessage> rebound(new ResolvedMessage(resolved));
+    if(!__rebind(registry, &rebound->message))
+        return boost::shared_ptr<ResolvedMessage>();
+
+    for(std::map<const google::protobuf::FieldDescriptor*, Resolution>::iterator it = rebound->fields.begin(); it != rebound->fields.end(); )
+    {
+        if(__rebind(registry, &it->second))
+            ++it;
+        else
+            rebound->fields.erase(it++);
+    }
+    return rebound;
+}
+
+bool dccl::FieldCodecManager::__rebind(const Registry& registry, Resolution* resolution)
+{
+    Handle handle = registry.try_find(resolution->type, resolution->name, resolution->type_name);
+    if(handle < 0)
+        return false;
+
+    // the FieldData belongs to the codec that made it
+    if(handle != resolution->handle)
+    {
+        resolution->handle = handle;
+        resolution->data.reset();
+    }
+    return true;
+}
+
+const dccl::FieldCodecBase::FieldData*
+dccl::FieldCodecManager::__field_data(const FieldCodecBase* codec, const google::protobuf::FieldDescriptor* field)
+{
+    ScopedSnapshot snapshot;
+    const Registry& registry = pinned();
+    
+    if(const ResolvedMessage* resolved = registry.resolved_message(FieldCodecBase::root_descriptor_))
+    {
+        std::map<const google::protobuf::FieldDescriptor*, Resolution>::const_iterator it = resolved->fields.find(field);
+        if(it != resolved->fields.end() && it->second.handle == codec->handle())
+            return it->second.data.get();
+    }
+    return 0;
+}
+
+dccl::FieldCodecManager::Handle
+dccl::FieldCodecManager::Registry::try_find(google::protobuf::FieldDescriptor::Type type,
+                                            const std::string& codec_name,
+                                            const std::string& type_name /* = "" */) const
+{
+    // try specific type codec
+    if(!type_name.empty())
+    {
+        Handle handle = lookup(type, __mangle_name(codec_name, type_name));
+        if(handle >= 0)
+            return handle;
     }
     
+    // try general 
+    return lookup(type, codec_name);
+}
+
+dccl::FieldCodecManager::Handle
+dccl::FieldCodecManager::Registry::find(google::protobuf::FieldDescriptor::Type type,
+                                        const std::string& codec_name,
+                                        const std::string& type_name /* = "" */) const
+{
+    Handle handle = try_find(type, codec_name, type_name);
+    if(handle >= 0)
+        return handle;
+    
     throw(Exception("No codec by the name `" + codec_name + "` found for type: " + internal::TypeHelper::find(type)->as_str()));
 }
 
+dccl::FieldCodecManager::Handle
+dccl::FieldCodecManager::Registry::lookup(google::protobuf::FieldDescriptor::Type type,
+                                          const std::string& name) const
+{
+    std::map<std::string, int>::const_iterator it = name_ids.find(name);
+    if(it == name_ids.end())
+        return -1;
+
+    const std::vector<Handle>& type_handles = handles[type];
+    return (it->second < static_cast<int>(type_handles.size())) ? type_handles[it->second] : -1;
+}
+
+boost::shared_ptr<dccl::internal::FromProtoCppTypeBase>
+dccl::FieldCodecManager::__find_type_helper(const std::string& type_name)
+{
+    ScopedSnapshot snapshot;
+    const Registry& registry = pinned();
+
+    std::map<std::string, boost::shared_ptr<internal::FromProtoCppTypeBase> >::const_iterator it =
+        registry.custom_message_helpers.find(type_name);
+    return it != registry.custom_message_helpers.end() ? it->second : boost::shared_ptr<internal::FromProtoCppTypeBase>();
+}
+
+boost::shared_ptr<dccl::FieldCodecManager::Registry>
+dccl::FieldCodecManager::__copy_codecs(const Registry* registry)
+{
+    boost::shared_ptr<Registry> copy(new Registry);
+    if(registry)
+    {
+        copy->codec_table = registry->codec_table;
+        copy->name_ids = registry->name_ids;
+        for(int i = 0, n = google::protobuf::FieldDescriptor::MAX_TYPE; i <= n; ++i)
+            copy->handles[i] = registry->handles[i];
+        copy->custom_message_helpers = registry->custom_message_helpers;
+        copy->resolved = registry->resolved;
+    }
+    return copy;
+}
 
+void dccl::FieldCodecManager::__change(const Change& change)
+{
+    if(batch_)
+        batch_->push_back(change);
+    else
+        __publish(std::vector<Change>(1, change));
+}
+
+void dccl::FieldCodecManager::__publish(const std::vector<Change>& changes)
+{
+    if(changes.empty())
+        return;
+    
+    std::vector<boost::shared_ptr<FieldCodecBase> > results(changes.size());
+    boost::shared_ptr<const Registry> current = boost::atomic_load(&registry_);
+    for(;;)
+    {
+        boost::shared_ptr<Registry> next = __copy_codecs(current.get());
+        for(std::vector<Change>::size_type i = 0, n = changes.size(); i < n; ++i)
+            results[i] = __apply(next.get(), changes[i]);
+        
+        for(std::map<const google::protobuf::Descriptor*, boost::shared_ptr<const ResolvedMessage> >::iterator it = next->resolved.begin(); it != next->resolved.end(); )
+        {
+            boost::shared_ptr<const ResolvedMessage> rebound = __rebind(*next, *it->second);
+            if(rebound)
+                (it++)->second = rebound;
+            else
+                next->resolved.erase(it++);
+        }
+
+        // on failure, `current` is updated to the registry published in the meantime, so try again from there
+        if(boost::atomic_compare_exchange(&registry_, &current, boost::shared_ptr<const Registry>(next)))
+            break;
+    }
+    FieldCodecBase::invalidate_caches();
+
+    for(std::vector<Change>::size_type i = 0, n = changes.size(); i < n; ++i)
+    {
+        const Change& change = changes[i];
+        const boost::shared_ptr<FieldCodecBase>& result = results[i];
+        if(change.add && !result)
+            dlog.is(logger::DEBUG1) && dlog << "Adding codec " << *change.codec << std::endl;
+        else if(change.add)
+            dlog.is(logger::DEBUG1) && dlog << "Trying to add: " << *change.codec
+                                            << ", but already have duplicate codec (For `name`/`field type` pair) "
+                                            << *result << std::endl;
+        else if(result)
+            dlog.is(logger::DEBUG1) && dlog << "Removing codec " << *result << std::endl;
+        else
+            dlog.is(logger::DEBUG1) && dlog << "Trying to remove: " << *change.codec
+                                            << ", but no such codec exists" << std::endl;
+    }
+}
+
+boost::shared_ptr<dccl::FieldCodecBase>
+dccl::FieldCodecManager::__apply(Registry* registry, const Change& change)
+{
+    if(!change.helper_name.empty())
+    {
+        if(change.add)
+            registry->custom_message_helpers.insert(std::make_pair(change.helper_name, change.helper));
+        else
+            registry->custom_message_helpers.erase(change.helper_name);
+    }
+
+    Handle existing = registry->lookup(change.type, change.name);
+    if(change.add)
+    {
+        if(existing >= 0)
+            return registry->codec_table[existing];
+
+        int id = registry->name_ids.insert(std::make_pair(change.name, static_cast<int>(registry->name_ids.size()))).first->second;
+        std::vector<Handle>& type_handles = registry->handles[change.type];
+        if(id >= static_cast<int>(type_handles.size()))
+            type_handles.resize(id + 1, -1);
+        type_handles[id] = registry->codec_table.size();
+        change.codec->handle_ = type_handles[id];
+        registry->codec_table.push_back(change.codec);
+        return boost::shared_ptr<FieldCodecBase>();
+    }
+    else
+    {
+        if(existing < 0)
+            return boost::shared_ptr<FieldCodecBase>();
+        
+        registry->handles[change.type][registry->name_ids[change.name]] = -1;
+        boost::shared_ptr<FieldCodecBase> removed;
+        removed.swap(registry->codec_table[existing]);
+        return removed;
+    }
+}
@@ -22,6 +22,10 @@
 #ifndef FieldCodecManager20110405H
 #define FieldCodecManager20110405H
 
+#include <map>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
 #include <boost/utility/enable_if.hpp>
 #include <boost/type_traits.hpp>
 #include <boost/mpl/and.hpp>
@@ -118,53 +122,56 @@ namespace dccl
 
         
         /// \brief Find the codec for a given field. For embedded messages, prefers (dccl.field).codec (inside field) over (dccl.msg).codec (inside embedded message).
-        static boost::shared_ptr<FieldCodecBase> find(
+        ///
+        /// For the fields of a message loaded by a Codec (while it is being encoded or decoded), the codec was resolved in advance by resolve(), so this is a lookup in the (immutable) current snapshot; otherwise the codec is resolved by name. The returned codec is owned by the FieldCodecManager and remains valid until it is removed (or, within a ScopedSnapshot, until the snapshot is released).
+        static FieldCodecBase* find(
             const google::protobuf::FieldDescriptor* field,
             bool has_codec_group,
-            const std::string& codec_group)
-        {
-            std::string name = __find_codec(field, has_codec_group, codec_group);            
-            
-            if(field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE)
-                return find(field->message_type(), name);
-            else
-                return __find(field->type(), name);
-        }                
+            const std::string& codec_group);
 
         /// \brief Find the codec for a given base (or embedded) message.
         ///
         /// \param desc Message descriptor to find codec for
         /// \param name Codec name (used for embedded messages to prefer the codec listed as a field option). Omit for finding the codec of a base message (one that is not embedded).
-        static boost::shared_ptr<FieldCodecBase> find(
+        static FieldCodecBase* find(
             const google::protobuf::Descriptor* desc,
-            std::string name = "")
+            const std::string& name = "");
+
+        static FieldCodecBase* find(
+            google::protobuf::FieldDescriptor::Type type,
+            const std::string& name)
         {
-            // this was called on the root message
-            if(name.empty())
-            {
-                // explicitly declared codec takes precedence over group
-                if(desc->options().GetExtension(dccl::msg).has_codec())
-                    name = desc->options().GetExtension(dccl::msg).codec();
-                else
-                    name = FieldCodecBase::codec_group(desc);
-            }
-            
-            return __find(google::protobuf::FieldDescriptor::TYPE_MESSAGE,
-                          name, desc->full_name());
+            ScopedSnapshot snapshot;
+            const Registry& registry = pinned();
+            return registry.codec(registry.find(type, name));
         }
 
-        static boost::shared_ptr<FieldCodecBase> find(
-            google::protobuf::FieldDescriptor::Type type,
-            std::string name)
+        /// \brief Find the codec with the given handle (see FieldCodecBase::handle())
+        ///
+        /// \return the codec, or null if there is no such codec (or it has since been removed)
+        static FieldCodecBase* find_by_handle(int handle)
         {
-            return __find(type, name);
+            ScopedSnapshot snapshot;
+            const Registry& registry = pinned();
+            return (handle >= 0 && handle < static_cast<int>(registry.codec_table.size())) ? registry.codec(handle) : 0;
         }
 
+        /// \brief Resolve the codecs of a message and of all the fields it contains (including those of embedded messages) in advance, and have each of these codecs compute its FieldCodecBase::FieldData for the field (see FieldCodecBase::make_field_data()). The result is published with the current snapshot, so that find() and FieldCodecBase::field_data() are only lookups in immutable data while the message is encoded or decoded. Called by Codec when it loads a message.
+        ///
+        /// When codecs are added or removed later, the fields are resolved again by name; fields whose codec changed then have no FieldData until the message is resolved again.
+        /// \param desc Descriptor of the (root) message
+        /// \param add_reference Take a reference to the result, to be dropped by release(). Otherwise, only refresh it.
+        static void resolve(const google::protobuf::Descriptor* desc, bool add_reference = true);
+
+        /// \brief Drop a reference taken by resolve(). The resolved codecs are discarded when no references remain. Called by Codec when it unloads a message (after which the Descriptor may be destroyed).
+        static void release(const google::protobuf::Descriptor* desc);
+
         static void clear()
         {
             internal::TypeHelper::reset();
-            codecs_.clear();
+            boost::atomic_store(&registry_, boost::shared_ptr<const Registry>());
         }
+
         
         
       private:
@@ -175,10 +182,134 @@ namespace dccl
 
                 
             
-        static boost::shared_ptr<FieldCodecBase> __find(
-            google::protobuf::FieldDescriptor::Type type,
-            const std::string& codec_name,
-            const std::string& type_name = "");
+        /// index into Registry::codec_table
+        typedef int Handle;
+
+        /// \brief A codec resolved by name for a field (or message), and the FieldData it computed for that field
+        struct Resolution
+        {
+            Resolution() : type(google::protobuf::FieldDescriptor::TYPE_MESSAGE), handle(-1) { }
+            // the Registry::find() arguments, kept so that the codec can be resolved again without the descriptor (see __rebind())
+            google::protobuf::FieldDescriptor::Type type;
+            std::string name;
+            std::string type_name;
+            Handle handle;
+            boost::shared_ptr<const FieldCodecBase::FieldData> data;
+        };
+
+        /// \brief The codecs of a loaded message (and of all the fields it contains), resolved by resolve()
+        struct ResolvedMessage
+        {
+            ResolvedMessage() : has_codec_group(false), references(0) { }
+            // the codec group the fields were resolved with
+            bool has_codec_group;
+            std::string codec_group;
+            Resolution message;
+            std::map<const google::protobuf::FieldDescriptor*, Resolution> fields;
+            // resolve() calls not yet matched by release()
+            unsigned references;
+        };
+
+        /// \brief One snapshot of the available codecs. Once published, a Registry is never modified.
+        struct Registry
+        {
+            // all codecs, indexed by Handle; removed codecs leave an empty slot
+            std::vector<boost::shared_ptr<FieldCodecBase> > codec_table;
+            // codec names (including the mangled names of message type specific codecs), interned to integer ids
+            std::map<std::string, int> name_ids;
+            // Handle (or -1) for each name id, per field type
+            std::vector<Handle> handles[google::protobuf::FieldDescriptor::MAX_TYPE + 1];
+            // type helpers for the statically generated message types that have their own codecs (see internal::TypeHelper)
+            std::map<std::string, boost::shared_ptr<internal::FromProtoCppTypeBase> > custom_message_helpers;
+
+            // codecs resolved in advance for the loaded messages, by the Descriptor of the root message (see resolve()). Descriptors are only compared here, as they may since have been destroyed.
+            std::map<const google::protobuf::Descriptor*, boost::shared_ptr<const ResolvedMessage> > resolved;
+
+            // returns -1 if no codec by this name has been added for this type
+            Handle lookup(google::protobuf::FieldDescriptor::Type type,
+                          const std::string& name) const;
+            // prefers the codec specific to type_name (if given); returns -1 if not found
+            Handle try_find(google::protobuf::FieldDescriptor::Type type,
+                            const std::string& codec_name,
+                            const std::string& type_name = "") const;
+            // throws if not found
+            Handle find(google::protobuf::FieldDescriptor::Type type,
+                        const std::string& codec_name,
+                        const std::string& type_name = "") const;
+            // null if desc has not been resolved
+            const ResolvedMessage* resolved_message(const google::protobuf::Descriptor* desc) const
+            {
+                std::map<const google::protobuf::Descriptor*, boost::shared_ptr<const ResolvedMessage> >::const_iterator it = resolved.find(desc);
+                return it != resolved.end() ? it->second.get() : 0;
+            }
+            FieldCodecBase* codec(Handle handle) const
+            { return codec_table[handle].get(); }
+        };
+
+        /// \brief One add() or remove() of a codec, applied to the registry by __publish()
+        struct Change
+        {
+            bool add; // false: remove
+            google::protobuf::FieldDescriptor::Type type;
+            std::string name;
+            // the codec to add (for remove, a codec of the same type, used only for logging)
+            boost::shared_ptr<FieldCodecBase> codec;
+            // for codecs specific to a statically generated message type: that type's name and helper
+            std::string helper_name;
+            boost::shared_ptr<internal::FromProtoCppTypeBase> helper;
+        };
+
+        // registry pinned by this thread's outermost ScopedSnapshot
+        static const Registry& pinned();
+
+        // type helper for a message type with its own codec (used by internal::TypeHelper::find()); null if there is none
+        static boost::shared_ptr<internal::FromProtoCppTypeBase> __find_type_helper(const std::string& type_name);
+        friend class internal::TypeHelper;
+
+        static boost::shared_ptr<Registry> __copy_codecs(const Registry* registry);
+
+        // resolve the codec of a field, or of a root message, by name (throws if there is none)
+        static Resolution __resolve_field(const Registry& registry,
+                                          const google::protobuf::FieldDescriptor* field,
+                                          bool has_codec_group,
+                                          const std::string& codec_group);
+        static Resolution __resolve_message(const Registry& registry, const google::protobuf::Descriptor* desc);
+        // adds the fields of desc (and of its embedded messages) to resolved, with their FieldData
+        static void __resolve_fields(const Registry& registry,
+                                     const google::protobuf::Descriptor* desc,
+                                     ResolvedMessage* resolved);
+        // resolved, with its codecs resolved again (by the names kept in each Resolution) in registry. Fields without a codec are dropped, as is the FieldData of fields whose codec changed. Null if the message codec is gone.
+        static boost::shared_ptr<ResolvedMessage> __rebind(const Registry& registry, const ResolvedMessage& resolved);
+        static bool __rebind(const Registry& registry, Resolution* resolution);
+
+        // FieldData made by codec for field of the message being encoded or decoded (see FieldCodecBase::field_data())
+        static const FieldCodecBase::FieldData* __field_data(const FieldCodecBase* codec,
+                                                             const google::protobuf::FieldDescriptor* field);
+        friend class FieldCodecBase;
+
+        // queues the change on this thread's ScopedBatch, or publishes it right away if there is none
+        static void __change(const Change& change);
+        // copy-on-write update of the published registry with all the changes at once
+        static void __publish(const std::vector<Change>& changes);
+        // applies one change to a registry that has not been published yet. Returns the codec that prevented the change (the existing codec for an add) or was removed
+        static boost::shared_ptr<FieldCodecBase> __apply(Registry* registry, const Change& change);
+
+        template<class Codec>
+            static Change __make_change(bool add,
+                                        const std::string& name,
+                                        google::protobuf::FieldDescriptor::Type field_type,
+                                        google::protobuf::FieldDescriptor::CppType wire_type)
+        {
+            Change change;
+            change.add = add;
+            change.type = field_type;
+            change.name = name;
+            change.codec.reset(new Codec());
+            change.codec->set_name(name);
+            change.codec->set_field_type(field_type);
+            change.codec->set_wire_type(wire_type);
+            return change;
+        }
             
         static std::string __mangle_name(const std::string& codec_name,
                                          const std::string& type_name) 
@@ -222,8 +353,80 @@ namespace dccl
         }
 
       private:
-        typedef std::map<std::string, boost::shared_ptr<FieldCodecBase> > InsideMap;
-        static std::map<google::protobuf::FieldDescriptor::Type, InsideMap> codecs_;
+        // the current registry, only accessed through boost::atomic_load/atomic_store/atomic_compare_exchange
+        static boost::shared_ptr<const Registry> registry_;
+        // registry pinned by this thread's outermost ScopedSnapshot (owned by that ScopedSnapshot)
+        static DCCL_THREAD_LOCAL const Registry* pinned_;
+        // changes queued by this thread's outermost ScopedBatch (owned by that ScopedBatch)
+        static DCCL_THREAD_LOCAL std::vector<Change>* batch_;
+
+      public:
+        /// \brief Pins the current set of codecs for the lifetime of this object.
+        ///
+        /// Adding or removing codecs (e.g. by Codec::load_library() or Codec::unload_library()) never modifies the set of codecs in place; rather it publishes a new copy. Codec pins a snapshot for the duration of each encode, decode or size call, so that the call sees a consistent set of codecs even if another thread loads or unloads codecs meanwhile. The snapshot is held by this object (on the calling thread's stack) and pinned for the calling thread only. Snapshots nest: only the outermost one on each thread takes effect.
+        class ScopedSnapshot
+        {
+          public:
+            ScopedSnapshot()
+            {
+                if(!pinned_)
+                {
+                    // this thread's own changes must be visible to it
+                    if(batch_ && !batch_->empty())
+                    {
+                        __publish(*batch_);
+                        batch_->clear();
+                    }
+                    snapshot_ = boost::atomic_load(&registry_);
+                    // nothing has been added yet
+                    if(!snapshot_)
+                        snapshot_.reset(new Registry);
+                    pinned_ = snapshot_.get();
+                }
+            }
+            ~ScopedSnapshot()
+            {
+                if(snapshot_)
+                    pinned_ = 0;
+            }
+          private:
+            ScopedSnapshot(const ScopedSnapshot&);
+            ScopedSnapshot& operator=(const ScopedSnapshot&);
+            boost::shared_ptr<const FieldCodecManager::Registry> snapshot_;
+        };
+
+        /// \brief Collects the codecs added and removed (by this thread) for the lifetime of this object, and publishes them as a single new snapshot when it is destroyed.
+        ///
+        /// Each add() or remove() outside of a batch copies the whole set of codecs, so use a batch when adding many codecs at once (as Codec does for its default codecs and for load_library()). The changes are published when the batch ends, or earlier if this thread looks up codecs (i.e. takes a ScopedSnapshot) in the meantime. Batches nest: only the outermost one on each thread takes effect.
+        class ScopedBatch
+        {
+          public:
+            ScopedBatch()
+            {
+                if(!batch_)
+                {
+                    owned_ = true;
+                    batch_ = &changes_;
+                }
+                else
+                {
+                    owned_ = false;
+                }
+            }
+            ~ScopedBatch()
+            {
+                if(owned_)
+                {
+                    batch_ = 0;
+                    __publish(changes_);
+                }
+            }
+          private:
+            ScopedBatch(const ScopedBatch&);
+            ScopedBatch& operator=(const ScopedBatch&);
+            bool owned_;
+            std::vector<Change> changes_;
+        };
     };
 }
 
@@ -236,10 +439,13 @@ boost::mpl::not_<boost::is_same<google::protobuf::Message, typename Codec::wire_
 void>::type 
     dccl::FieldCodecManager::add(const std::string& name, compiler::dummy_fcm<0> dummy_fcm)
 {
-    internal::TypeHelper::add<typename Codec::wire_type>();
-    add_single_type<Codec>(__mangle_name(name, Codec::wire_type::descriptor()->full_name()),
-                           google::protobuf::FieldDescriptor::TYPE_MESSAGE,
-                           google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE);
+    typedef typename Codec::wire_type ProtobufMessage;
+    Change change = __make_change<Codec>(true, __mangle_name(name, ProtobufMessage::descriptor()->full_name()),
+                                         google::protobuf::FieldDescriptor::TYPE_MESSAGE,
+                                         google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE);
+    change.helper_name = ProtobufMessage::descriptor()->full_name();
+    change.helper.reset(new internal::FromProtoCustomMessage<ProtobufMessage>);
+    __change(change);
 }
 
 template<class Codec>
@@ -283,29 +489,7 @@ void dccl::FieldCodecManager::add_single_type(const std::string& name,
                                               google::protobuf::FieldDescriptor::Type field_type,
                                               google::protobuf::FieldDescriptor::CppType wire_type)
 {
-    using google::protobuf::FieldDescriptor;
-    if(!codecs_[field_type].count(name))
-    {
-        boost::shared_ptr<FieldCodecBase> new_field_codec(new Codec());
-        new_field_codec->set_name(name);
-        new_field_codec->set_field_type(field_type);
-        new_field_codec->set_wire_type(wire_type);
-        
-        codecs_[field_type][name] = new_field_codec;
-        dccl::dlog.is(dccl::logger::DEBUG1) && dccl::dlog << "Adding codec " << *new_field_codec << std::endl;
-    }            
-    else
-    {
-        boost::shared_ptr<FieldCodecBase> new_field_codec(new Codec());
-        new_field_codec->set_name(name);
-        new_field_codec->set_field_type(field_type);
-        new_field_codec->set_wire_type(wire_type);
-        
-        dccl::dlog.is(dccl::logger::DEBUG1) && dccl::dlog << "Trying to add: " << *new_field_codec
-                                                            << ", but already have duplicate codec (For `name`/`field type` pair) "
-                                                            << *(codecs_[field_type].find(name)->second)
-                                                            << std::endl;
-    }
+    __change(__make_change<Codec>(true, name, field_type, wire_type));
 }
 
 
@@ -319,10 +503,12 @@ boost::mpl::not_<boost::is_same<google::protobuf::Message, typename Codec::wire_
 void>::type 
     dccl::FieldCodecManager::remove(const std::string& name, compiler::dummy_fcm<0> dummy_fcm)
 {
-    internal::TypeHelper::remove<typename Codec::wire_type>();
-    remove_single_type<Codec>(__mangle_name(name, Codec::wire_type::descriptor()->full_name()),
-                              google::protobuf::FieldDescriptor::TYPE_MESSAGE,
-                              google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE);
+    typedef typename Codec::wire_type ProtobufMessage;
+    Change change = __make_change<Codec>(false, __mangle_name(name, ProtobufMessage::descriptor()->full_name()),
+                                         google::protobuf::FieldDescriptor::TYPE_MESSAGE,
+                                         google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE);
+    change.helper_name = ProtobufMessage::descriptor()->full_name();
+    __change(change);
 }
 
 template<class Codec>
@@ -366,23 +552,7 @@ void dccl::FieldCodecManager::remove_single_type(const std::string& name,
                                               google::protobuf::FieldDescriptor::Type field_type,
                                               google::protobuf::FieldDescriptor::CppType wire_type)
 {
-    using google::protobuf::FieldDescriptor;
-    if(codecs_[field_type].count(name))
-    {       
-        dccl::dlog.is(dccl::logger::DEBUG1) && dccl::dlog << "Removing codec " << *codecs_[field_type][name]  << std::endl;
-        codecs_[field_type].erase(name);
-    }            
-    else
-    {
-        boost::shared_ptr<FieldCodecBase> new_field_codec(new Codec());
-        new_field_codec->set_name(name);
-        new_field_codec->set_field_type(field_type);
-        new_field_codec->set_wire_type(wire_type);
-        
-        dccl::dlog.is(dccl::logger::DEBUG1) && dccl::dlog << "Trying to remove: " << *new_field_codec
-                                                            << ", but no such codec exists"
-                                                            << std::endl;
-    }
+    __change(__make_change<Codec>(false, name, field_type, wire_type));
 }
 
 
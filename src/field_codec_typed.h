@@ -23,6 +23,8 @@
 #define DCCLFIELDCODECTYPED20120312H
 
 
+#include <algorithm>
+
 #include <boost/type_traits.hpp>
 
 #include "field_codec.h"
@@ -114,7 +116,29 @@ typedef WireType wire_type;
       /// \param wire_value Value to use when calculating the size of the field. If calculating the size requires encoding the field completely, cache the encoded value for a likely future call to encode() for the same wire_value.
       /// \return the size (in bits) of the field.
       virtual unsigned size(const WireType& wire_value) = 0;
+
+      /// \brief Encode all the values of a repeated field directly from the message's contiguous storage. Only called for scalar field types stored in a google::protobuf::RepeatedField (see internal::RepeatedFieldTraits).
+      ///
+      /// The default implementation pre_encode()s and encode()s each value in turn (adding the DCCL3 size prefix) and gives the same result as the per-value path. Override this to process the whole array at once.
+      /// \param field_values Values to encode (FieldType)
+      /// \return Bits representing the encoded field.
+      virtual Bitset encode_repeated(internal::Span<const FieldType> field_values);
+
+      /// \brief Decode all the values of a repeated field directly into the message's contiguous storage.
+      ///
+      /// \param bits Bits to use for decoding (call get_more_bits() if more are needed).
+      /// \param field_values Storage for up to (dccl.field).max_repeat decoded values.
+      /// \return Number of values decoded into the front of field_values.
+      virtual unsigned decode_repeated(Bitset* bits, internal::Span<FieldType> field_values);
+
+      /// \brief Calculate the size (in bits) of all the values of a repeated field
+      virtual unsigned size_repeated(internal::Span<const FieldType> field_values);
           
+      protected:
+      /// \brief Whether the bulk_* methods below can be used for FieldType. The bulk path bypasses any_encode_repeated() and any_decode_repeated(), which subclasses may override, so supports_bulk_repeated() stays false unless a (DCCL_FINAL) subclass returns this from it, as the built-in codecs do.
+      bool bulk_repeated_supported() const
+      { return internal::RepeatedFieldTraits<FieldType>::supported; }
+
       private:
       unsigned any_size(const boost::any& wire_value)
       {
@@ -215,10 +239,162 @@ typedef WireType wire_type;
           catch(NullValueException&)
           { *wire_value = boost::any(); }              
       }
+
+      bool supports_tagged_value()
+      {
+          return internal::TaggedValueTraits<WireType>::supported &&
+              internal::TaggedValueTraits<FieldType>::supported;
+      }
+
+      void bulk_encode_repeated(Bitset* bits, const google::protobuf::Message& msg)
+      { *bits = encode_repeated(internal::repeated_field_span<FieldType>(msg, FieldCodecBase::this_field())); }
+
+      unsigned bulk_size_repeated(const google::protobuf::Message& msg)
+      { return size_repeated(internal::repeated_field_span<FieldType>(msg, FieldCodecBase::this_field())); }
+      
+      void bulk_decode_repeated(Bitset* bits, google::protobuf::Message* msg)
+      {
+          const google::protobuf::FieldDescriptor* field = FieldCodecBase::this_field();
+          int old_size = msg->GetReflection()->FieldSize(*msg, field);
+          // grow by the number of values on the wire if the codec can tell (see any_peek_repeated_size()); only null values are then truncated
+          unsigned max_repeat = FieldCodecBase::dccl_field_options().max_repeat();
+          internal::Span<FieldType> field_values =
+              internal::append_repeated_field<FieldType>(msg, field, std::min(this->any_peek_repeated_size(bits), max_repeat));
+          unsigned n = decode_repeated(bits, field_values);
+          if(n < field_values.size())
+              internal::truncate_repeated_field<FieldType>(msg, field, old_size + n);
+      }
+      
+      Bitset encode_one(const FieldType& field_value)
+      {
+          try
+          { return encode(this->pre_encode(field_value)); }
+          catch(NullValueException&)
+          { return encode(); }
+      }
+
+      unsigned size_one(const FieldType& field_value)
+      {
+          try
+          { return size(this->pre_encode(field_value)); }
+          catch(NullValueException&)
+          { return size(); }
+      }
+      
+      unsigned tagged_size(const internal::TaggedValue& wire_value)
+      { return wire_value.empty() ? size() : size(internal::tagged_cast<WireType>(wire_value)); }
+
+      void tagged_encode(Bitset* bits, const internal::TaggedValue& wire_value)
+      { *bits = wire_value.empty() ? encode() : encode(internal::tagged_cast<WireType>(wire_value)); }
+
+      void tagged_decode(Bitset* bits, internal::TaggedValue* wire_value)
+      {
+          try
+          { wire_value->set<WireType>(decode(bits)); }
+          catch(NullValueException&)
+          { wire_value->clear(); }
+      }
+
+      void tagged_pre_encode(internal::TaggedValue* wire_value,
+                             const internal::TaggedValue& field_value)
+      {
+          try
+          {
+              if(!field_value.empty())
+                  wire_value->set<WireType>(this->pre_encode(internal::tagged_cast<FieldType>(field_value)));
+          }
+          catch(NullValueException&)
+          {
+              wire_value->clear();
+          }
+      }
+
+      void tagged_post_decode(const internal::TaggedValue& wire_value,
+                              internal::TaggedValue* field_value)
+      {
+          try
+          {
+              if(!wire_value.empty())
+                  field_value->set<FieldType>(this->post_decode(internal::tagged_cast<WireType>(wire_value)));
+          }
+          catch(NullValueException&)
+          {
+              field_value->clear();
+          }
+      }
     
     };
 
 
+    template<typename WireType, typename FieldType>
+        Bitset TypedFieldCodec<WireType, FieldType>::encode_repeated(internal::Span<const FieldType> field_values)
+    {
+        const unsigned max_repeat = this->dccl_field_options().max_repeat();
+        unsigned wire_vector_size = max_repeat;
+
+        Bitset bits;
+        // for DCCL3 and beyond, add a prefix numeric field giving the vector size (rather than always going to max_repeat
+        if(FieldCodecBase::codec_version() > 2)
+        {
+            wire_vector_size = std::min(max_repeat, static_cast<unsigned>(field_values.size()));
+            bits.append(Bitset(this->repeated_vector_field_size(max_repeat), field_values.size()));
+        }
+
+        for(unsigned i = 0; i < wire_vector_size; ++i)
+            bits.append(i < field_values.size() ? encode_one(field_values[i]) : encode());
+        return bits;
+    }
+    
+    template<typename WireType, typename FieldType>
+        unsigned TypedFieldCodec<WireType, FieldType>::decode_repeated(Bitset* bits, internal::Span<FieldType> field_values)
+    {
+        unsigned wire_vector_size = this->dccl_field_options().max_repeat();
+        if(FieldCodecBase::codec_version() > 2)
+        {
+            Bitset size_bits(bits);
+            size_bits.get_more_bits(this->repeated_vector_field_size(wire_vector_size));
+            wire_vector_size = size_bits.to_ulong();
+        }
+
+        if(wire_vector_size > field_values.size())
+            throw(Exception("Decoded repeated field size (" + boost::lexical_cast<std::string>(wire_vector_size) + ") is larger than (dccl.field).max_repeat"));
+
+        const unsigned element_min_size = this->min_size();
+        unsigned n = 0;
+        for(unsigned i = 0; i < wire_vector_size; ++i)
+        {
+            Bitset these_bits(bits);
+            these_bits.get_more_bits(element_min_size);
+            try
+            {
+                field_values[n] = this->post_decode(decode(&these_bits));
+                ++n;
+            }
+            catch(NullValueException&)
+            { }
+        }
+        return n;
+    }
+    
+    template<typename WireType, typename FieldType>
+        unsigned TypedFieldCodec<WireType, FieldType>::size_repeated(internal::Span<const FieldType> field_values)
+    {
+        const unsigned max_repeat = this->dccl_field_options().max_repeat();
+        unsigned wire_vector_size = max_repeat;
+
+        unsigned out = 0;
+        if(FieldCodecBase::codec_version() > 2)
+        {
+            wire_vector_size = std::min(max_repeat, static_cast<unsigned>(field_values.size()));
+            out += this->repeated_vector_field_size(max_repeat);
+        }
+
+        for(unsigned i = 0; i < wire_vector_size; ++i)
+            out += i < field_values.size() ? size_one(field_values[i]) : size();
+        return out;
+    }
+    
+
     /// \brief Base class for "repeated" (multiple value) static-typed (no boost::any) field encoders/decoders. Use TypedFixedFieldCodec if your codec is fixed length (always uses the same number of bits on the wire). Use TypedFieldCodec if your fields are always singular ("optional" or "required"). Singular fields are default implemented in this codec by calls to the equivalent repeated function with an empty or single valued vector.
     ///
     /// \ingroup dccl_field_api
@@ -294,8 +470,46 @@ typedef WireType wire_type;
       virtual unsigned min_size()
       { return min_size_repeated(); }
 
+      /// \brief Encode a repeated field from contiguous storage by converting the values (pre_encode()) and calling encode_repeated(const std::vector<WireType>&)
+      virtual Bitset encode_repeated(internal::Span<const FieldType> field_values)
+      { return encode_repeated(pre_encode_all(field_values)); }
+
+      /// \brief Decode a repeated field into contiguous storage by calling decode_repeated(Bitset*) and converting the values (post_decode())
+      virtual unsigned decode_repeated(dccl::Bitset* bits, internal::Span<FieldType> field_values)
+      {
+          std::vector<WireType> decoded = decode_repeated(bits);
+          if(decoded.size() > field_values.size())
+              throw(Exception("Decoded repeated field size (" + boost::lexical_cast<std::string>(decoded.size()) + ") is larger than (dccl.field).max_repeat"));
+
+          unsigned n = 0;
+          for(int i = 0, end = decoded.size(); i < end; ++i)
+          {
+              try
+              {
+                  field_values[n] = this->post_decode(decoded[i]);
+                  ++n;
+              }
+              catch(NullValueException&)
+              { }
+          }
+          return n;
+      }
+
+      /// \brief Give the size of a repeated field in contiguous storage by converting the values (pre_encode()) and calling size_repeated(const std::vector<WireType>&)
+      virtual unsigned size_repeated(internal::Span<const FieldType> field_values)
+      { return size_repeated(pre_encode_all(field_values)); }
+
           
       private:
+      std::vector<WireType> pre_encode_all(internal::Span<const FieldType> field_values)
+      {
+          std::vector<WireType> wire_values;
+          wire_values.reserve(field_values.size());
+          for(std::size_t i = 0, n = field_values.size(); i < n; ++i)
+              wire_values.push_back(this->pre_encode(field_values[i]));
+          return wire_values;
+      }
+      
       void any_encode_repeated(Bitset* bits, const std::vector<boost::any>& wire_values)
       {
           try
@@ -363,6 +577,19 @@ typedef WireType wire_type;
       
       void any_post_decode(const boost::any& wire_value,
                            boost::any* field_value)
+      {
+          any_post_decode_specific<WireType>(wire_value, field_value);
+      }
+
+      // as for TypedFieldCodec, Message values are decoded in place (see any_decode_repeated_specific())
+      template<typename T>
+      typename boost::enable_if<boost::is_base_of<google::protobuf::Message, T>, void>::type
+      any_post_decode_specific(const boost::any& wire_value, boost::any* field_value, compiler::dummy<0> dummy = 0)
+      {  *field_value = wire_value; }
+
+      template<typename T>
+      typename boost::disable_if<boost::is_base_of<google::protobuf::Message, T>, void>::type
+      any_post_decode_specific(const boost::any& wire_value, boost::any* field_value, compiler::dummy<1> dummy = 0)
       {
           try
           {
@@ -400,10 +627,107 @@ typedef WireType wire_type;
           catch(boost::bad_any_cast&)
           { throw(type_error("size_repeated", typeid(WireType), wire_values.at(0).type())); }
       }
+
+      void tagged_encode_repeated(Bitset* bits, const std::vector<internal::TaggedValue>& wire_values)
+      {
+          std::vector<WireType> in;
+          in.reserve(wire_values.size());
+          for (std::vector<internal::TaggedValue>::const_iterator it = wire_values.begin(); it != wire_values.end(); ++it)
+              in.push_back(internal::tagged_cast<WireType>(*it));
+          
+          *bits = encode_repeated(in);
+      }
+
+      void tagged_decode_repeated(Bitset* repeated_bits, std::vector<internal::TaggedValue>* wire_values)
+      {
+          std::vector<WireType> decoded = decode_repeated(repeated_bits);
+          wire_values->resize(decoded.size());
+          for(int i = 0, n = decoded.size(); i < n; ++i)
+              (*wire_values)[i].set<WireType>(decoded[i]);
+      }
+
+      unsigned tagged_size_repeated(const std::vector<internal::TaggedValue>& wire_values)
+      {
+          std::vector<WireType> in;
+          in.reserve(wire_values.size());
+          for (std::vector<internal::TaggedValue>::const_iterator it = wire_values.begin(); it != wire_values.end(); ++it)
+              in.push_back(internal::tagged_cast<WireType>(*it));
+          
+          return size_repeated(in);
+      }
           
           
     };
 
+
+    template<typename WireType, typename FieldType> class TypedFixedFieldCodec;
+
+    /// \brief CRTP layer that binds the internal::TaggedValue entry points of TypedFieldCodec directly to Derived's encode(), decode(), size(), pre_encode() and post_decode().
+    ///
+    /// When Derived is declared DCCL_FINAL (as the built-in codecs are), these calls are resolved at compile time and can be inlined, so encoding a field costs a single virtual call into the codec. Derived must be a friend of this class if it declares these methods private.
+    /// \tparam Derived The most derived codec class
+    /// \tparam Base TypedFieldCodec or one of its children (e.g. TypedFixedFieldCodec) that Derived would otherwise inherit from
+    template<typename Derived, typename Base>
+        class StaticDispatchFieldCodec : public Base
+    {
+      private:
+      typedef typename Base::wire_type WireType;
+      typedef typename Base::field_type FieldType;
+
+      Derived& derived() { return static_cast<Derived&>(*this); }
+      
+      unsigned tagged_size(const internal::TaggedValue& wire_value)
+      {
+          return wire_value.empty() ? derived().size() :
+              size_of(internal::tagged_cast<WireType>(wire_value),
+                      boost::is_base_of<TypedFixedFieldCodec<WireType, FieldType>, Base>());
+      }
+
+      void tagged_encode(Bitset* bits, const internal::TaggedValue& wire_value)
+      { *bits = wire_value.empty() ? derived().encode() : derived().encode(internal::tagged_cast<WireType>(wire_value)); }
+
+      void tagged_decode(Bitset* bits, internal::TaggedValue* wire_value)
+      {
+          try
+          { wire_value->set<WireType>(derived().decode(bits)); }
+          catch(NullValueException&)
+          { wire_value->clear(); }
+      }
+
+      void tagged_pre_encode(internal::TaggedValue* wire_value,
+                             const internal::TaggedValue& field_value)
+      {
+          try
+          {
+              if(!field_value.empty())
+                  wire_value->set<WireType>(derived().pre_encode(internal::tagged_cast<FieldType>(field_value)));
+          }
+          catch(NullValueException&)
+          {
+              wire_value->clear();
+          }
+      }
+
+      void tagged_post_decode(const internal::TaggedValue& wire_value,
+                              internal::TaggedValue* field_value)
+      {
+          try
+          {
+              if(!wire_value.empty())
+                  field_value->set<FieldType>(derived().post_decode(internal::tagged_cast<WireType>(wire_value)));
+          }
+          catch(NullValueException&)
+          {
+              field_value->clear();
+          }
+      }
+
+      // fixed codecs hide size(const WireType&) as it is always equal to size()
+      unsigned size_of(const WireType& wire_value, boost::true_type /*is_fixed*/)
+      { return derived().size(); }
+      unsigned size_of(const WireType& wire_value, boost::false_type /*is_fixed*/)
+      { return derived().size(wire_value); }
+    };
         
 }
 
@@ -0,0 +1,206 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLGENERATEDCODEC20171026H
+#define DCCLGENERATEDCODEC20171026H
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+#include <google/protobuf/message.h>
+
+#include "dccl/common.h"
+#include "dccl/exception.h"
+
+namespace dccl
+{
+    /// \brief Encoder generated by protoc-gen-dccl for one message type. Writes the entire DCCL message (header and body) to `bytes` and returns the number of bytes written, or 0 if `msg` is not of the generated type (and so must be encoded by reflection).
+    typedef size_t (*GeneratedEncoder)(const google::protobuf::Message& msg, char* bytes, size_t max_len);
+
+    /// \brief Decoder generated by protoc-gen-dccl for one message type. Reads one DCCL message from `bytes` into `msg` and returns the number of bytes consumed, or 0 if `msg` is not of the generated type.
+    typedef size_t (*GeneratedDecoder)(const char* bytes, size_t len, google::protobuf::Message* msg);
+
+    /// \brief Registry of encoders and decoders generated by protoc-gen-dccl (run with the `dccl_codecs` parameter).
+    ///
+    /// The generated code is specialized at compile time to the DCCL options of a message whose fields all use the default (DCCL v3) numeric, enumeration and boolean codecs, and so always encodes to the same number of bytes. Each generated message type adds itself here during static initialization (with add<GeneratedMessage>()). Codec then uses the generated encoder and decoder instead of traversing the message by reflection whenever they are registered for a loaded message's Descriptor and, when that message was loaded, all of its fields resolved to the built-in codecs the generated code assumes (see Codec::set_use_generated_codecs()).
+    class GeneratedCodecs
+    {
+      public:
+        struct Entry
+        {
+            /// (dccl.msg).id
+            unsigned dccl_id;
+            GeneratedEncoder encoder;
+            GeneratedDecoder decoder;
+            /// encoded size (in bytes) of every message of this type
+            size_t size;
+        };
+        
+        /// \brief Register the generated codec for a message type. Returns true so that it can be used to initialize a static variable.
+        static bool add(const google::protobuf::Descriptor* desc, unsigned dccl_id, GeneratedEncoder encoder, GeneratedDecoder decoder, size_t size)
+        {
+            Entry entry = { dccl_id, encoder, decoder, size };
+            entries()[desc] = entry;
+            return true;
+        }
+
+        /// \brief Register the codec generated inside a message class (or any class with the same members): the typedef DCCLGeneratedMessage, the constants DCCL_GENERATED_ID and DCCL_GENERATED_SIZE, and the static functions dccl_encode(const DCCLGeneratedMessage&, char*, size_t) and dccl_decode(const char*, size_t, DCCLGeneratedMessage*).
+        template<typename GeneratedCodec>
+            static bool add();
+
+        /// \brief Unregister the generated codec for a message type (it will be encoded by reflection).
+        static void remove(const google::protobuf::Descriptor* desc)
+        { entries().erase(desc); }
+
+        /// \brief Find the generated codec for a message type, or null if none was registered.
+        static const Entry* find(const google::protobuf::Descriptor* desc)
+        {
+            std::map<const google::protobuf::Descriptor*, Entry>::const_iterator it = entries().find(desc);
+            return it == entries().end() ? 0 : &it->second;
+        }
+
+      private:
+        // function local so that it is initialized before the first (static initialization time) add()
+        static std::map<const google::protobuf::Descriptor*, Entry>& entries()
+        {
+            static std::map<const google::protobuf::Descriptor*, Entry> entries_;
+            return entries_;
+        }
+    };
+    
+    /// Support for the code generated by protoc-gen-dccl
+    namespace generated
+    {
+        /// \brief Writes fixed width values into a byte buffer, least significant bit first, in the same bit order as Bitset::to_byte_string()
+        class BitWriter
+        {
+          public:
+            BitWriter(char* bytes, size_t max_len)
+                : bytes_(reinterpret_cast<unsigned char*>(bytes)), max_len_(max_len), pos_(0)
+            { }
+
+            void write(dccl::uint64 value, unsigned width)
+            {
+                if(pos_ + width > max_len_ * BITS_IN_BYTE)
+                    throw std::length_error("max_len must be >= the encoded size of the message");
+                
+                // one byte (or the part of one byte) at a time
+                for(unsigned i = 0; i < width;)
+                {
+                    unsigned bit = pos_ % BITS_IN_BYTE;
+                    unsigned n = std::min(width - i, BITS_IN_BYTE - bit);
+                    unsigned char mask = (1 << n) - 1;
+                    unsigned char& byte = bytes_[pos_ / BITS_IN_BYTE];
+                    if(bit == 0) byte = 0;
+                    if(i < 64) byte |= ((value >> i) & mask) << bit;
+                    i += n;
+                    pos_ += n;
+                }
+            }
+
+            /// \brief Zero pad to the next byte boundary (as the DCCL header is)
+            void pad_to_byte()
+            {
+                unsigned pad = (BITS_IN_BYTE - pos_ % BITS_IN_BYTE) % BITS_IN_BYTE;
+                write(0, pad);
+            }
+
+            size_t byte_size() const { return ceil_bits2bytes(pos_); }
+            
+          private:
+            unsigned char* bytes_;
+            size_t max_len_;
+            size_t pos_;
+        };
+
+        /// \brief Reads values written by BitWriter
+        class BitReader
+        {
+          public:
+            BitReader(const char* bytes, size_t len)
+                : bytes_(reinterpret_cast<const unsigned char*>(bytes)), len_(len), pos_(0)
+            { }
+
+            dccl::uint64 read(unsigned width)
+            {
+                if(pos_ + width > len_ * BITS_IN_BYTE)
+                    throw(NotEnoughBitsException("Not enough bytes to decode message"));
+
+                dccl::uint64 value = 0;
+                for(unsigned i = 0; i < width;)
+                {
+                    unsigned bit = pos_ % BITS_IN_BYTE;
+                    unsigned n = std::min(width - i, BITS_IN_BYTE - bit);
+                    unsigned char mask = (1 << n) - 1;
+                    if(i < 64)
+                        value |= static_cast<dccl::uint64>((bytes_[pos_ / BITS_IN_BYTE] >> bit) & mask) << i;
+                    i += n;
+                    pos_ += n;
+                }
+                return value;
+            }
+
+            void pad_to_byte()
+            { pos_ = ceil_bits2bytes(pos_) * BITS_IN_BYTE; }
+
+            size_t byte_size() const { return ceil_bits2bytes(pos_); }
+            
+          private:
+            const unsigned char* bytes_;
+            size_t len_;
+            size_t pos_;
+        };
+
+        /// \brief Sets an enumeration field from its numeric value, deducing the enumeration type from the generated setter.
+        template<typename ProtobufMessage, typename Enum>
+            void set_enum(ProtobufMessage* msg, void (ProtobufMessage::*setter)(Enum), int number)
+        { (msg->*setter)(static_cast<Enum>(number)); }
+
+        /// \brief GeneratedEncoder registered by GeneratedCodecs::add<GeneratedCodec>(): the one cast to the generated message type
+        template<typename GeneratedCodec>
+            size_t encode(const google::protobuf::Message& msg, char* bytes, size_t max_len)
+        {
+            const typename GeneratedCodec::DCCLGeneratedMessage* typed_msg =
+                dynamic_cast<const typename GeneratedCodec::DCCLGeneratedMessage*>(&msg);
+            return typed_msg ? GeneratedCodec::dccl_encode(*typed_msg, bytes, max_len) : 0;
+        }
+
+        /// \brief GeneratedDecoder registered by GeneratedCodecs::add<GeneratedCodec>()
+        template<typename GeneratedCodec>
+            size_t decode(const char* bytes, size_t len, google::protobuf::Message* msg)
+        {
+            typename GeneratedCodec::DCCLGeneratedMessage* typed_msg =
+                dynamic_cast<typename GeneratedCodec::DCCLGeneratedMessage*>(msg);
+            return typed_msg ? GeneratedCodec::dccl_decode(bytes, len, typed_msg) : 0;
+        }
+    }
+}
+
+template<typename GeneratedCodec>
+    bool dccl::GeneratedCodecs::add()
+{
+    return add(GeneratedCodec::DCCLGeneratedMessage::descriptor(), GeneratedCodec::DCCL_GENERATED_ID,
+               &generated::encode<GeneratedCodec>, &generated::decode<GeneratedCodec>,
+               GeneratedCodec::DCCL_GENERATED_SIZE);
+}
+
+#endif
@@ -0,0 +1,243 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <set>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <google/protobuf/descriptor.pb.h>
+
+#include "schema_image.h"
+#include "dccl/exception.h"
+
+namespace
+{
+    const dccl::uint64 FNV_OFFSET_BASIS = 14695981039346656037ULL;
+    const dccl::uint64 FNV_PRIME = 1099511628211ULL;
+
+    void fnv1a(dccl::uint64* hash, const std::string& s)
+    {
+        for(std::string::const_iterator it = s.begin(), end = s.end(); it != end; ++it)
+        {
+            *hash ^= static_cast<unsigned char>(*it);
+            *hash *= FNV_PRIME;
+        }
+    }
+
+    void fingerprint_message(dccl::uint64* hash,
+                             const google::protobuf::Descriptor* desc,
+                             std::set<const void*>* visited)
+    {
+        if(!visited->insert(desc).second)
+            return;
+
+        google::protobuf::DescriptorProto desc_proto;
+        desc->CopyTo(&desc_proto);
+        fnv1a(hash, desc->full_name());
+        fnv1a(hash, desc_proto.SerializeAsString());
+
+        for(int i = 0, n = desc->field_count(); i < n; ++i)
+        {
+            const google::protobuf::FieldDescriptor* field = desc->field(i);
+            if(field->message_type())
+            {
+                fingerprint_message(hash, field->message_type(), visited);
+            }
+            else if(field->enum_type() && visited->insert(field->enum_type()).second)
+            {
+                google::protobuf::EnumDescriptorProto enum_proto;
+                field->enum_type()->CopyTo(&enum_proto);
+                fnv1a(hash, field->enum_type()->full_name());
+                fnv1a(hash, enum_proto.SerializeAsString());
+            }
+        }
+    }
+}
+
+dccl::uint64 dccl::internal::schema_fingerprint(const google::protobuf::Descriptor* desc)
+{
+    uint64 hash = FNV_OFFSET_BASIS;
+    std::set<const void*> visited;
+    fingerprint_message(&hash, desc, &visited);
+    return hash;
+}
+
+//
+// MappedFile
+//
+
+dccl::internal::MappedFile::MappedFile(const std::string& path)
+    : data_(0),
+      size_(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw(Exception("Failed to open schema image: " + path));
+
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        throw(Exception("Failed to stat schema image: " + path));
+    }
+
+    size_ = st.st_size;
+    if(size_ > 0)
+    {
+        void* addr = mmap(0, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(addr == MAP_FAILED)
+        {
+            close(fd);
+            throw(Exception("Failed to mmap schema image: " + path));
+        }
+        data_ = static_cast<const char*>(addr);
+    }
+    // the mapping remains valid after the descriptor is closed
+    close(fd);
+}
+
+dccl::internal::MappedFile::~MappedFile()
+{
+    if(data_)
+        munmap(const_cast<char*>(data_), size_);
+}
+
+//
+// SchemaImageWriter
+//
+
+dccl::internal::SchemaImageWriter::SchemaImageWriter()
+    : strings_(1, '\0') // offset 0 is the empty string
+{ }
+
+dccl::uint32 dccl::internal::SchemaImageWriter::add_string(const std::string& s)
+{
+    if(s.empty())
+        return 0;
+    
+    uint32 offset = strings_.size();
+    strings_.append(s.c_str(), s.size() + 1);
+    return offset;
+}
+
+void dccl::internal::SchemaImageWriter::write(const std::string& path, const std::string& id_codec)
+{
+    SchemaImageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SCHEMA_IMAGE_MAGIC, sizeof(header.magic));
+    header.format_version = SCHEMA_IMAGE_FORMAT_VERSION;
+    header.byte_order = SCHEMA_IMAGE_BYTE_ORDER;
+    header.id_codec = add_string(id_codec);
+    header.num_messages = messages_.size();
+    header.num_fields = fields_.size();
+    header.strings_size = strings_.size();
+
+    // written next to `path` and then renamed over it, so that processes that have the old image mapped (see MappedFile) keep reading it, and a failed write never leaves a partial image at `path`
+    const std::string tmp_path = path + ".tmp";
+    std::ofstream fout(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+    if(!fout.is_open())
+        throw(Exception("Failed to open schema image for writing: " + tmp_path));
+    
+    fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if(!messages_.empty())
+        fout.write(reinterpret_cast<const char*>(&messages_[0]), messages_.size()*sizeof(SchemaImageMessage));
+    if(!fields_.empty())
+        fout.write(reinterpret_cast<const char*>(&fields_[0]), fields_.size()*sizeof(SchemaImageField));
+    fout.write(strings_.data(), strings_.size());
+    fout.flush();
+    fout.close();
+
+    if(!fout.good())
+    {
+        std::remove(tmp_path.c_str());
+        throw(Exception("Failed to write schema image: " + tmp_path));
+    }
+
+    if(std::rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp_path.c_str());
+        throw(Exception("Failed to replace schema image: " + path));
+    }
+}
+
+//
+// SchemaImageReader
+//
+
+dccl::internal::SchemaImageReader::SchemaImageReader(const char* data, size_t size)
+    : header_(reinterpret_cast<const SchemaImageHeader*>(data)),
+      messages_(0),
+      fields_(0),
+      strings_(0)
+{
+    if(size < sizeof(SchemaImageHeader) ||
+       std::memcmp(header_->magic, SCHEMA_IMAGE_MAGIC, sizeof(SCHEMA_IMAGE_MAGIC)) != 0)
+        throw(Exception("Not a DCCL schema image"));
+
+    if(header_->format_version != SCHEMA_IMAGE_FORMAT_VERSION)
+        throw(Exception("Unsupported DCCL schema image version"));
+
+    if(header_->byte_order != SCHEMA_IMAGE_BYTE_ORDER)
+        throw(Exception("DCCL schema image was written on a host with a different byte order"));
+    
+    const uint64 expected_size = sizeof(SchemaImageHeader)
+        + static_cast<uint64>(header_->num_messages)*sizeof(SchemaImageMessage)
+        + static_cast<uint64>(header_->num_fields)*sizeof(SchemaImageField)
+        + header_->strings_size;
+
+    if(expected_size != size || header_->strings_size == 0)
+        throw(Exception("Truncated or corrupt DCCL schema image"));
+
+    messages_ = reinterpret_cast<const SchemaImageMessage*>(data + sizeof(SchemaImageHeader));
+    fields_ = reinterpret_cast<const SchemaImageField*>(messages_ + header_->num_messages);
+    strings_ = reinterpret_cast<const char*>(fields_ + header_->num_fields);
+
+    // string table must be terminated so that every offset yields a valid C string
+    if(strings_[header_->strings_size-1] != '\0' || header_->id_codec >= header_->strings_size)
+        throw(Exception("Corrupt string table in DCCL schema image"));
+
+    for(uint32 i = 0, n = header_->num_messages; i < n; ++i)
+    {
+        const SchemaImageMessage& m = messages_[i];
+        if(m.name >= header_->strings_size || m.codec >= header_->strings_size ||
+           static_cast<uint64>(m.first_field) + m.num_fields > header_->num_fields)
+            throw(Exception("Corrupt message table in DCCL schema image"));
+
+        // nested records may not run past the end of their message
+        for(uint32 j = m.first_field, end = m.first_field + m.num_fields; j < end; ++j)
+        {
+            if(static_cast<uint64>(j) + 1 + fields_[j].num_nested > end)
+                throw(Exception("Corrupt field table in DCCL schema image"));
+        }
+    }
+
+    for(uint32 i = 0, n = header_->num_fields; i < n; ++i)
+    {
+        if(fields_[i].codec >= header_->strings_size)
+            throw(Exception("Corrupt field table in DCCL schema image"));
+    }
+}
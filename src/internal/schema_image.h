@@ -0,0 +1,148 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLSCHEMAIMAGE20171012H
+#define DCCLSCHEMAIMAGE20171012H
+
+#include <string>
+#include <vector>
+
+#include "dccl/common.h"
+
+namespace dccl
+{
+    namespace internal
+    {
+        /// \brief On-disk layout of the schema image written by Codec::write_schema_image().
+        ///
+        /// The file is SchemaImageHeader, then num_messages SchemaImageMessage records, then num_fields SchemaImageField records, then a table of NUL terminated strings (names are stored as offsets into this table). All records are naturally aligned so the file can be used in place after mmap().
+        ///
+        /// The fields of a message are stored depth first: a field of an embedded message type encoded by the default message codec is followed by the num_nested records of that message's fields (and their own embedded fields).
+        struct SchemaImageHeader
+        {
+            char magic[8];
+            uint32 format_version;
+            uint32 byte_order; // SCHEMA_IMAGE_BYTE_ORDER as written by the host
+            uint32 num_messages;
+            uint32 num_fields;
+            uint32 strings_size;
+            uint32 id_codec; // offset into string table
+        };
+
+        struct SchemaImageMessage
+        {
+            uint64 fingerprint;
+            uint32 dccl_id;
+            uint32 name;
+            uint32 codec;
+            uint32 max_bytes;
+            uint32 head_max_bits; // includes the identifier (as sized for dccl_id)
+            uint32 body_max_bits;
+            uint32 head_min_bits; // includes the identifier
+            uint32 body_min_bits;
+            uint32 first_field;
+            uint32 num_fields;
+        };
+
+        struct SchemaImageField
+        {
+            enum { HAS_MIN = 1 << 0, HAS_MAX = 1 << 1, HAS_PRECISION = 1 << 2, IN_HEAD = 1 << 3 };
+
+            double min;
+            double max;
+            double precision;
+            int32 number;
+            uint32 codec;
+            uint32 max_repeat;
+            uint32 flags;
+            uint32 num_nested; // records that follow for the fields of this field's message type
+            uint32 reserved;
+        };
+
+        const char SCHEMA_IMAGE_MAGIC[8] = { 'D', 'C', 'C', 'L', 'S', 'C', 'H', '\0' };
+        const uint32 SCHEMA_IMAGE_FORMAT_VERSION = 2;
+        const uint32 SCHEMA_IMAGE_BYTE_ORDER = 0x01020304;
+
+        /// \brief Fingerprint (64-bit FNV-1a) of the serialized DescriptorProto of desc and of every message and enum type used by its fields (recursively), including their options.
+        uint64 schema_fingerprint(const google::protobuf::Descriptor* desc);
+
+        /// \brief Read-only memory mapping of an entire file, unmapped on destruction.
+        class MappedFile
+        {
+          public:
+            /// \throw Exception if the file cannot be opened or mapped
+            MappedFile(const std::string& path);
+            ~MappedFile();
+
+            const char* data() const { return data_; }
+            size_t size() const { return size_; }
+            
+          private:
+            MappedFile(const MappedFile&);
+            MappedFile& operator= (const MappedFile&);
+
+            const char* data_;
+            size_t size_;
+        };
+        
+        /// \brief Accumulates a schema image in memory before it is written to disk.
+        class SchemaImageWriter
+        {
+          public:
+            SchemaImageWriter();
+
+            uint32 add_string(const std::string& s);
+            void add_message(const SchemaImageMessage& message) { messages_.push_back(message); }
+            void add_field(const SchemaImageField& field) { fields_.push_back(field); }
+            SchemaImageField& field(uint32 i) { return fields_[i]; }
+            uint32 num_fields() const { return fields_.size(); }
+
+            /// \throw Exception if the file cannot be written
+            void write(const std::string& path, const std::string& id_codec);
+            
+          private:
+            std::vector<SchemaImageMessage> messages_;
+            std::vector<SchemaImageField> fields_;
+            std::string strings_;
+        };
+
+        /// \brief Checked view onto a mapped schema image.
+        class SchemaImageReader
+        {
+          public:
+            /// \throw Exception if data is not a well-formed schema image
+            SchemaImageReader(const char* data, size_t size);
+
+            const SchemaImageHeader& header() const { return *header_; }
+            const SchemaImageMessage& message(uint32 i) const { return messages_[i]; }
+            const SchemaImageField& field(uint32 i) const { return fields_[i]; }
+            const char* string(uint32 offset) const { return strings_ + offset; }
+
+          private:
+            const SchemaImageHeader* header_;
+            const SchemaImageMessage* messages_;
+            const SchemaImageField* fields_;
+            const char* strings_;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,58 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLSPAN20171016H
+#define DCCLSPAN20171016H
+
+#include <cstddef>
+
+namespace dccl
+{
+    namespace internal
+    {
+        /// \brief Non-owning view of a contiguous array of T (e.g. the storage of a google::protobuf::RepeatedField<T>)
+        template<typename T>
+            class Span
+        {
+          public:
+            typedef T value_type;
+            typedef T* iterator;
+
+            Span() : data_(0), size_(0) { }
+            Span(T* data, std::size_t size) : data_(data), size_(size) { }
+
+            T* data() const { return data_; }
+            std::size_t size() const { return size_; }
+            bool empty() const { return size_ == 0; }
+
+            T& operator[](std::size_t i) const { return data_[i]; }
+
+            T* begin() const { return data_; }
+            T* end() const { return data_ + size_; }
+            
+          private:
+            T* data_;
+            std::size_t size_;
+        };
+    }
+}
+
+#endif
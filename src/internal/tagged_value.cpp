@@ -0,0 +1,255 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include "tagged_value.h"
+
+using namespace google::protobuf;
+
+boost::any dccl::internal::TaggedValue::to_any() const
+{
+    switch(tag_)
+    {
+        default:
+        case EMPTY: return boost::any();
+        case DOUBLE: return u_.d;
+        case FLOAT: return u_.f;
+        case INT32: return u_.i32;
+        case INT64: return u_.i64;
+        case UINT32: return u_.u32;
+        case UINT64: return u_.u64;
+        case BOOL: return u_.b;
+        case ENUM: return u_.e;
+        case STRING: return *str_;
+        case MESSAGE: return u_.m;
+    }
+}
+
+void dccl::internal::TaggedValue::from_any(const boost::any& value, FieldDescriptor::CppType cpp_type)
+{
+    if(value.empty())
+    {
+        clear();
+        return;
+    }
+    
+    try
+    {
+        switch(cpp_type)
+        {
+            case FieldDescriptor::CPPTYPE_DOUBLE: set(boost::any_cast<double>(value)); break;
+            case FieldDescriptor::CPPTYPE_FLOAT: set(boost::any_cast<float>(value)); break;
+            case FieldDescriptor::CPPTYPE_INT32: set(boost::any_cast<int32>(value)); break;
+            case FieldDescriptor::CPPTYPE_INT64: set(boost::any_cast<int64>(value)); break;
+            case FieldDescriptor::CPPTYPE_UINT32: set(boost::any_cast<uint32>(value)); break;
+            case FieldDescriptor::CPPTYPE_UINT64: set(boost::any_cast<uint64>(value)); break;
+            case FieldDescriptor::CPPTYPE_BOOL: set(boost::any_cast<bool>(value)); break;
+            case FieldDescriptor::CPPTYPE_ENUM: set(boost::any_cast<const EnumValueDescriptor*>(value)); break;
+            case FieldDescriptor::CPPTYPE_STRING: set(boost::any_cast<std::string>(value)); break;
+            case FieldDescriptor::CPPTYPE_MESSAGE:
+                if(value.type() == typeid(Message*))
+                    set<const Message*>(boost::any_cast<Message*>(value));
+                else
+                    set(boost::any_cast<const Message*>(value));
+                break;
+        }
+    }
+    catch(boost::bad_any_cast&)
+    {
+        throw(Exception(std::string("Bad type given to TaggedValue::from_any, expected value of C++ type ") + FieldDescriptor::CppTypeName(cpp_type) + ", got " + value.type().name()));
+    }
+}
+
+std::string dccl::internal::TaggedValue::tag_name(Tag tag)
+{
+    switch(tag)
+    {
+        default:
+        case EMPTY: return "empty";
+        case DOUBLE: return "double";
+        case FLOAT: return "float";
+        case INT32: return "int32";
+        case INT64: return "int64";
+        case UINT32: return "uint32";
+        case UINT64: return "uint64";
+        case BOOL: return "bool";
+        case ENUM: return "enum";
+        case STRING: return "string";
+        case MESSAGE: return "message";
+    }
+}
+
+void dccl::internal::get_field_value(const FieldDescriptor* field,
+                                     const Message& msg,
+                                     TaggedValue* value)
+{
+    const Reflection* refl = msg.GetReflection();
+    if(!refl->HasField(msg, field))
+    {
+        value->clear();
+        return;
+    }
+    
+    switch(field->cpp_type())
+    {
+        case FieldDescriptor::CPPTYPE_DOUBLE: value->set(refl->GetDouble(msg, field)); break;
+        case FieldDescriptor::CPPTYPE_FLOAT: value->set(refl->GetFloat(msg, field)); break;
+        case FieldDescriptor::CPPTYPE_INT32: value->set(refl->GetInt32(msg, field)); break;
+        case FieldDescriptor::CPPTYPE_INT64: value->set(refl->GetInt64(msg, field)); break;
+        case FieldDescriptor::CPPTYPE_UINT32: value->set(refl->GetUInt32(msg, field)); break;
+        case FieldDescriptor::CPPTYPE_UINT64: value->set(refl->GetUInt64(msg, field)); break;
+        case FieldDescriptor::CPPTYPE_BOOL: value->set(refl->GetBool(msg, field)); break;
+        case FieldDescriptor::CPPTYPE_ENUM: value->set(refl->GetEnum(msg, field)); break;
+        case FieldDescriptor::CPPTYPE_STRING:
+        {
+            // GetStringReference only uses the scratch space if the string is not stored as std::string
+            std::string scratch;
+            const std::string& s = refl->GetStringReference(msg, field, &scratch);
+            if(&s == &scratch)
+                value->set(scratch);
+            else
+                value->set_string_view(&s);
+            break;
+        }
+        case FieldDescriptor::CPPTYPE_MESSAGE: value->set(&refl->GetMessage(msg, field)); break;
+    }
+}
+
+void dccl::internal::get_repeated_field_value(const FieldDescriptor* field,
+                                              const Message& msg,
+                                              int index,
+                                              TaggedValue* value)
+{
+    const Reflection* refl = msg.GetReflection();
+    switch(field->cpp_type())
+    {
+        case FieldDescriptor::CPPTYPE_DOUBLE: value->set(refl->GetRepeatedDouble(msg, field, index)); break;
+        case FieldDescriptor::CPPTYPE_FLOAT: value->set(refl->GetRepeatedFloat(msg, field, index)); break;
+        case FieldDescriptor::CPPTYPE_INT32: value->set(refl->GetRepeatedInt32(msg, field, index)); break;
+        case FieldDescriptor::CPPTYPE_INT64: value->set(refl->GetRepeatedInt64(msg, field, index)); break;
+        case FieldDescriptor::CPPTYPE_UINT32: value->set(refl->GetRepeatedUInt32(msg, field, index)); break;
+        case FieldDescriptor::CPPTYPE_UINT64: value->set(refl->GetRepeatedUInt64(msg, field, index)); break;
+        case FieldDescriptor::CPPTYPE_BOOL: value->set(refl->GetRepeatedBool(msg, field, index)); break;
+        case FieldDescriptor::CPPTYPE_ENUM: value->set(refl->GetRepeatedEnum(msg, field, index)); break;
+        case FieldDescriptor::CPPTYPE_STRING:
+        {
+            std::string scratch;
+            const std::string& s = refl->GetRepeatedStringReference(msg, field, index, &scratch);
+            if(&s == &scratch)
+                value->set(scratch);
+            else
+                value->set_string_view(&s);
+            break;
+        }
+        case FieldDescriptor::CPPTYPE_MESSAGE: value->set(&refl->GetRepeatedMessage(msg, field, index)); break;
+    }
+}
+
+static void check_tag(const FieldDescriptor* field, const dccl::internal::TaggedValue& value, dccl::internal::TaggedValue::Tag expected)
+{
+    using dccl::internal::TaggedValue;
+    if(value.tag() != expected)
+        throw(dccl::Exception("Value of type " + TaggedValue::tag_name(value.tag()) + " cannot be stored in field " + field->full_name() + " (expected " + TaggedValue::tag_name(expected) + ")"));
+}
+
+void dccl::internal::set_field_value(const FieldDescriptor* field,
+                                     Message* msg,
+                                     const TaggedValue& value)
+{
+    if(value.empty())
+        return;
+
+    const Reflection* refl = msg->GetReflection();
+    switch(field->cpp_type())
+    {
+        case FieldDescriptor::CPPTYPE_DOUBLE: check_tag(field, value, TaggedValue::DOUBLE); refl->SetDouble(msg, field, value.get<double>()); break;
+        case FieldDescriptor::CPPTYPE_FLOAT: check_tag(field, value, TaggedValue::FLOAT); refl->SetFloat(msg, field, value.get<float>()); break;
+        case FieldDescriptor::CPPTYPE_INT32: check_tag(field, value, TaggedValue::INT32); refl->SetInt32(msg, field, value.get<int32>()); break;
+        case FieldDescriptor::CPPTYPE_INT64: check_tag(field, value, TaggedValue::INT64); refl->SetInt64(msg, field, value.get<int64>()); break;
+        case FieldDescriptor::CPPTYPE_UINT32: check_tag(field, value, TaggedValue::UINT32); refl->SetUInt32(msg, field, value.get<uint32>()); break;
+        case FieldDescriptor::CPPTYPE_UINT64: check_tag(field, value, TaggedValue::UINT64); refl->SetUInt64(msg, field, value.get<uint64>()); break;
+        case FieldDescriptor::CPPTYPE_BOOL: check_tag(field, value, TaggedValue::BOOL); refl->SetBool(msg, field, value.get<bool>()); break;
+        case FieldDescriptor::CPPTYPE_ENUM: check_tag(field, value, TaggedValue::ENUM); refl->SetEnum(msg, field, value.get<const EnumValueDescriptor*>()); break;
+        case FieldDescriptor::CPPTYPE_STRING: check_tag(field, value, TaggedValue::STRING); refl->SetString(msg, field, value.get<std::string>()); break;
+        case FieldDescriptor::CPPTYPE_MESSAGE: check_tag(field, value, TaggedValue::MESSAGE); refl->MutableMessage(msg, field)->CopyFrom(*value.get<const Message*>()); break;
+    }
+}
+
+void dccl::internal::add_field_value(const FieldDescriptor* field,
+                                     Message* msg,
+                                     const TaggedValue& value)
+{
+    if(value.empty())
+        return;
+
+    const Reflection* refl = msg->GetReflection();
+    switch(field->cpp_type())
+    {
+        case FieldDescriptor::CPPTYPE_DOUBLE: check_tag(field, value, TaggedValue::DOUBLE); refl->AddDouble(msg, field, value.get<double>()); break;
+        case FieldDescriptor::CPPTYPE_FLOAT: check_tag(field, value, TaggedValue::FLOAT); refl->AddFloat(msg, field, value.get<float>()); break;
+        case FieldDescriptor::CPPTYPE_INT32: check_tag(field, value, TaggedValue::INT32); refl->AddInt32(msg, field, value.get<int32>()); break;
+        case FieldDescriptor::CPPTYPE_INT64: check_tag(field, value, TaggedValue::INT64); refl->AddInt64(msg, field, value.get<int64>()); break;
+        case FieldDescriptor::CPPTYPE_UINT32: check_tag(field, value, TaggedValue::UINT32); refl->AddUInt32(msg, field, value.get<uint32>()); break;
+        case FieldDescriptor::CPPTYPE_UINT64: check_tag(field, value, TaggedValue::UINT64); refl->AddUInt64(msg, field, value.get<uint64>()); break;
+        case FieldDescriptor::CPPTYPE_BOOL: check_tag(field, value, TaggedValue::BOOL); refl->AddBool(msg, field, value.get<bool>()); break;
+        case FieldDescriptor::CPPTYPE_ENUM: check_tag(field, value, TaggedValue::ENUM); refl->AddEnum(msg, field, value.get<const EnumValueDescriptor*>()); break;
+        case FieldDescriptor::CPPTYPE_STRING: check_tag(field, value, TaggedValue::STRING); refl->AddString(msg, field, value.get<std::string>()); break;
+        case FieldDescriptor::CPPTYPE_MESSAGE: check_tag(field, value, TaggedValue::MESSAGE); refl->AddMessage(msg, field)->CopyFrom(*value.get<const Message*>()); break;
+    }
+}
+
+// Get/MutableRepeatedField are deprecated in newer versions of Protobuf in favor of
+// RepeatedFieldRef, which does not expose the contiguous storage we are after
+#if defined(__GNUC__)
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+
+namespace dccl
+{
+    namespace internal
+    {
+#define DCCL_DEFINE_REPEATED_FIELD_ACCESS(T)                            \
+        template<> Span<const T> repeated_field_span<T>(const Message& msg, const FieldDescriptor* field) \
+        {                                                               \
+            const RepeatedField<T>& values = msg.GetReflection()->GetRepeatedField<T>(msg, field); \
+            return Span<const T>(values.data(), values.size());         \
+        }                                                               \
+        template<> Span<T> append_repeated_field<T>(Message* msg, const FieldDescriptor* field, int n) \
+        {                                                               \
+            RepeatedField<T>* values = msg->GetReflection()->MutableRepeatedField<T>(msg, field); \
+            int old_size = values->size();                              \
+            values->Resize(old_size + n, T());                          \
+            return Span<T>(values->mutable_data() + old_size, n);       \
+        }                                                               \
+        template<> void truncate_repeated_field<T>(Message* msg, const FieldDescriptor* field, int size) \
+        {                                                               \
+            msg->GetReflection()->MutableRepeatedField<T>(msg, field)->Truncate(size); \
+        }
+        
+        DCCL_DEFINE_REPEATED_FIELD_ACCESS(double)
+        DCCL_DEFINE_REPEATED_FIELD_ACCESS(float)
+        DCCL_DEFINE_REPEATED_FIELD_ACCESS(int32)
+        DCCL_DEFINE_REPEATED_FIELD_ACCESS(int64)
+        DCCL_DEFINE_REPEATED_FIELD_ACCESS(uint32)
+        DCCL_DEFINE_REPEATED_FIELD_ACCESS(uint64)
+        DCCL_DEFINE_REPEATED_FIELD_ACCESS(bool)
+#undef DCCL_DEFINE_REPEATED_FIELD_ACCESS
+    }
+}
@@ -0,0 +1,313 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLTAGGEDVALUE20171014H
+#define DCCLTAGGEDVALUE20171014H
+
+#include <string>
+
+#include <boost/any.hpp>
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+
+#include "dccl/common.h"
+#include "dccl/exception.h"
+#include "dccl/internal/span.h"
+
+namespace dccl
+{
+    namespace internal
+    {
+        template<typename T> struct TaggedValueTraits;
+        
+        /// \brief Tagged value holding any of the Protobuf C++ field types, used internally to pass field values between the message codecs and field codecs without the heap allocations and RTTI checks of boost::any.
+        ///
+        /// Numeric, enum and message values are stored inline. Strings are held either as a view of a string owned elsewhere (typically, inside the Protobuf message being encoded), which does not allocate, or, when a new value is created (e.g. by decoding), in a std::string member, which allocates like any other std::string.
+        class TaggedValue
+        {
+          public:
+            enum Tag { EMPTY, DOUBLE, FLOAT, INT32, INT64, UINT32, UINT64, BOOL, ENUM, STRING, MESSAGE };
+
+            TaggedValue() : tag_(EMPTY), str_(0) { u_.u64 = 0; }
+            TaggedValue(const TaggedValue& other) { copy(other); }
+            TaggedValue& operator=(const TaggedValue& other)
+            {
+                if(this != &other)
+                    copy(other);
+                return *this;
+            }
+            
+            Tag tag() const { return tag_; }
+            bool empty() const { return tag_ == EMPTY; }
+            void clear() { tag_ = EMPTY; str_ = 0; }
+
+            /// \brief Set the value from a supported type (see TaggedValueTraits)
+            template<typename T>
+                void set(const T& value)
+            { TaggedValueTraits<T>::set(this, value); }
+
+            /// \brief Get the value as a supported type. The caller must check tag() first.
+            template<typename T>
+                typename TaggedValueTraits<T>::get_type get() const
+            { return TaggedValueTraits<T>::get(*this); }
+            
+            /// \brief Refer to a string owned elsewhere, which must outlive this value (or until it is next set)
+            void set_string_view(const std::string* s)
+            {
+                tag_ = STRING;
+                str_ = s;
+            }
+            
+            /// \brief Convert to the equivalent boost::any (used as a compatibility shim for codecs that do not support TaggedValue)
+            boost::any to_any() const;
+
+            /// \brief Set from the boost::any representation of a value of a given CppType
+            void from_any(const boost::any& value, google::protobuf::FieldDescriptor::CppType cpp_type);
+
+            static std::string tag_name(Tag tag);
+
+            template<typename T> friend struct TaggedValueTraits;
+          private:
+            void copy(const TaggedValue& other)
+            {
+                tag_ = other.tag_;
+                u_ = other.u_;
+                if(other.str_ == &other.owned_str_)
+                {
+                    owned_str_ = other.owned_str_;
+                    str_ = &owned_str_;
+                }
+                else
+                {
+                    str_ = other.str_;
+                }
+            }
+            
+          private:
+            Tag tag_;
+            union
+            {
+                double d;
+                float f;
+                int32 i32;
+                int64 i64;
+                uint32 u32;
+                uint64 u64;
+                bool b;
+                const google::protobuf::EnumValueDescriptor* e;
+                const google::protobuf::Message* m;
+            } u_;
+            const std::string* str_;
+            std::string owned_str_;
+        };
+
+        /// \brief Maps a C++ type onto its TaggedValue representation. Types without a specialization are not supported (`supported` is false) and their values must be passed using boost::any.
+        template<typename T> struct TaggedValueTraits
+        {
+            enum { supported = false };
+            static const TaggedValue::Tag tag = TaggedValue::EMPTY;
+            typedef T get_type;
+            static T get(const TaggedValue& v)
+            { throw(Exception("Type not supported by TaggedValue")); }
+            static void set(TaggedValue* v, const T& value)
+            { throw(Exception("Type not supported by TaggedValue")); }
+        };
+
+        template<> struct TaggedValueTraits<double>
+        {
+            enum { supported = true };
+            static const TaggedValue::Tag tag = TaggedValue::DOUBLE;
+            typedef double get_type;
+            static get_type get(const TaggedValue& v) { return v.u_.d; }
+            static void set(TaggedValue* v, const double& value) { v->tag_ = tag; v->u_.d = value; }
+        };
+        
+        template<> struct TaggedValueTraits<float>
+        {
+            enum { supported = true };
+            static const TaggedValue::Tag tag = TaggedValue::FLOAT;
+            typedef float get_type;
+            static get_type get(const TaggedValue& v) { return v.u_.f; }
+            static void set(TaggedValue* v, const float& value) { v->tag_ = tag; v->u_.f = value; }
+        };
+        
+        template<> struct TaggedValueTraits<int32>
+        {
+            enum { supported = true };
+            static const TaggedValue::Tag tag = TaggedValue::INT32;
+            typedef int32 get_type;
+            static get_type get(const TaggedValue& v) { return v.u_.i32; }
+            static void set(TaggedValue* v, const int32& value) { v->tag_ = tag; v->u_.i32 = value; }
+        };
+
+        template<> struct TaggedValueTraits<int64>
+        {
+            enum { supported = true };
+            static const TaggedValue::Tag tag = TaggedValue::INT64;
+            typedef int64 get_type;
+            static get_type get(const TaggedValue& v) { return v.u_.i64; }
+            static void set(TaggedValue* v, const int64& value) { v->tag_ = tag; v->u_.i64 = value; }
+        };
+
+        template<> struct TaggedValueTraits<uint32>
+        {
+            enum { supported = true };
+            static const TaggedValue::Tag tag = TaggedValue::UINT32;
+            typedef uint32 get_type;
+            static get_type get(const TaggedValue& v) { return v.u_.u32; }
+            static void set(TaggedValue* v, const uint32& value) { v->tag_ = tag; v->u_.u32 = value; }
+        };
+
+        template<> struct TaggedValueTraits<uint64>
+        {
+            enum { supported = true };
+            static const TaggedValue::Tag tag = TaggedValue::UINT64;
+            typedef uint64 get_type;
+            static get_type get(const TaggedValue& v) { return v.u_.u64; }
+            static void set(TaggedValue* v, const uint64& value) { v->tag_ = tag; v->u_.u64 = value; }
+        };
+
+        template<> struct TaggedValueTraits<bool>
+        {
+            enum { supported = true };
+            static const TaggedValue::Tag tag = TaggedValue::BOOL;
+            typedef bool get_type;
+            static get_type get(const TaggedValue& v) { return v.u_.b; }
+            static void set(TaggedValue* v, const bool& value) { v->tag_ = tag; v->u_.b = value; }
+        };
+
+        template<> struct TaggedValueTraits<const google::protobuf::EnumValueDescriptor*>
+        {
+            enum { supported = true };
+            static const TaggedValue::Tag tag = TaggedValue::ENUM;
+            typedef const google::protobuf::EnumValueDescriptor* get_type;
+            static get_type get(const TaggedValue& v) { return v.u_.e; }
+            static void set(TaggedValue* v, const google::protobuf::EnumValueDescriptor* const& value) { v->tag_ = tag; v->u_.e = value; }
+        };
+
+        template<> struct TaggedValueTraits<std::string>
+        {
+            enum { supported = true };
+            static const TaggedValue::Tag tag = TaggedValue::STRING;
+            typedef const std::string& get_type;
+            static get_type get(const TaggedValue& v) { return *v.str_; }
+            static void set(TaggedValue* v, const std::string& value)
+            {
+                v->tag_ = tag;
+                v->owned_str_ = value;
+                v->str_ = &v->owned_str_;
+            }
+        };
+
+        template<> struct TaggedValueTraits<const google::protobuf::Message*>
+        {
+            enum { supported = true };
+            static const TaggedValue::Tag tag = TaggedValue::MESSAGE;
+            typedef const google::protobuf::Message* get_type;
+            static get_type get(const TaggedValue& v) { return v.u_.m; }
+            static void set(TaggedValue* v, const google::protobuf::Message* const& value) { v->tag_ = tag; v->u_.m = value; }
+        };
+
+        /// \brief Checked access to the value held by a TaggedValue, analogous to boost::any_cast
+        ///
+        /// \throw Exception if the value does not hold a T
+        template<typename T>
+            typename TaggedValueTraits<T>::get_type tagged_cast(const TaggedValue& value)
+        {
+            if(value.tag() != TaggedValueTraits<T>::tag)
+                throw(Exception("Bad TaggedValue cast, expected: " + TaggedValue::tag_name(TaggedValueTraits<T>::tag) + ", got " + TaggedValue::tag_name(value.tag())));
+            return value.get<T>();
+        }
+
+        /// \brief Get a non-repeated, non-message field's value (empty if the field is not set). Strings are viewed in place where possible.
+        void get_field_value(const google::protobuf::FieldDescriptor* field,
+                             const google::protobuf::Message& msg,
+                             TaggedValue* value);
+
+        /// \brief Get one element of a repeated, non-message field.
+        void get_repeated_field_value(const google::protobuf::FieldDescriptor* field,
+                                      const google::protobuf::Message& msg,
+                                      int index,
+                                      TaggedValue* value);
+
+        /// \brief Set a non-repeated, non-message field (no-op if value is empty).
+        void set_field_value(const google::protobuf::FieldDescriptor* field,
+                             google::protobuf::Message* msg,
+                             const TaggedValue& value);
+        
+        /// \brief Add an element to a repeated, non-message field (no-op if value is empty).
+        void add_field_value(const google::protobuf::FieldDescriptor* field,
+                             google::protobuf::Message* msg,
+                             const TaggedValue& value);
+
+        /// \brief Whether values of type T are stored contiguously in a google::protobuf::RepeatedField<T> (true for all the scalar types except enumerations and strings) and so can be accessed in bulk using repeated_field_span() and friends.
+        template<typename T> struct RepeatedFieldTraits { enum { supported = false }; };
+        template<> struct RepeatedFieldTraits<double> { enum { supported = true }; };
+        template<> struct RepeatedFieldTraits<float> { enum { supported = true }; };
+        template<> struct RepeatedFieldTraits<int32> { enum { supported = true }; };
+        template<> struct RepeatedFieldTraits<int64> { enum { supported = true }; };
+        template<> struct RepeatedFieldTraits<uint32> { enum { supported = true }; };
+        template<> struct RepeatedFieldTraits<uint64> { enum { supported = true }; };
+        template<> struct RepeatedFieldTraits<bool> { enum { supported = true }; };
+
+        /// \brief View of all the values of a repeated scalar field
+        template<typename T>
+            Span<const T> repeated_field_span(const google::protobuf::Message& msg,
+                                              const google::protobuf::FieldDescriptor* field)
+        { throw(Exception("Field " + field->full_name() + " is not stored as a RepeatedField of this type")); }
+        
+        /// \brief Append `n` default values to a repeated scalar field, returning a view of the new values
+        template<typename T>
+            Span<T> append_repeated_field(google::protobuf::Message* msg,
+                                          const google::protobuf::FieldDescriptor* field,
+                                          int n)
+        { throw(Exception("Field " + field->full_name() + " is not stored as a RepeatedField of this type")); }
+
+        /// \brief Remove values from the end of a repeated scalar field until it has `size` values
+        template<typename T>
+            void truncate_repeated_field(google::protobuf::Message* msg,
+                                         const google::protobuf::FieldDescriptor* field,
+                                         int size)
+        { throw(Exception("Field " + field->full_name() + " is not stored as a RepeatedField of this type")); }
+
+#define DCCL_DECLARE_REPEATED_FIELD_ACCESS(T)                           \
+        template<> Span<const T> repeated_field_span<T>(const google::protobuf::Message& msg, \
+                                                        const google::protobuf::FieldDescriptor* field); \
+        template<> Span<T> append_repeated_field<T>(google::protobuf::Message* msg, \
+                                                    const google::protobuf::FieldDescriptor* field, \
+                                                    int n);             \
+        template<> void truncate_repeated_field<T>(google::protobuf::Message* msg, \
+                                                   const google::protobuf::FieldDescriptor* field, \
+                                                   int size);
+        
+        DCCL_DECLARE_REPEATED_FIELD_ACCESS(double)
+        DCCL_DECLARE_REPEATED_FIELD_ACCESS(float)
+        DCCL_DECLARE_REPEATED_FIELD_ACCESS(int32)
+        DCCL_DECLARE_REPEATED_FIELD_ACCESS(int64)
+        DCCL_DECLARE_REPEATED_FIELD_ACCESS(uint32)
+        DCCL_DECLARE_REPEATED_FIELD_ACCESS(uint64)
+        DCCL_DECLARE_REPEATED_FIELD_ACCESS(bool)
+#undef DCCL_DECLARE_REPEATED_FIELD_ACCESS
+    }
+}
+
+#endif
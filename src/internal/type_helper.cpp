@@ -20,10 +20,10 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
 #include "type_helper.h"
+#include "dccl/field_codec_manager.h"
 
 dccl::internal::TypeHelper::TypeMap dccl::internal::TypeHelper::type_map_;
 dccl::internal::TypeHelper::CppTypeMap dccl::internal::TypeHelper::cpptype_map_;
-dccl::internal::TypeHelper::CustomMessageMap dccl::internal::TypeHelper::custom_message_map_;
 
 // used to construct, initialize, and delete a copy of this object
 boost::shared_ptr<dccl::internal::TypeHelper> dccl::internal::TypeHelper::inst_(new dccl::internal::TypeHelper);
@@ -88,9 +88,9 @@ boost::shared_ptr<dccl::internal::FromProtoCppTypeBase> dccl::internal::TypeHelp
 {
     if(!type_name.empty())
     {
-        CustomMessageMap::iterator it = custom_message_map_.find(type_name);
-        if(it != custom_message_map_.end())
-            return it->second;
+        boost::shared_ptr<FromProtoCppTypeBase> helper = FieldCodecManager::__find_type_helper(type_name);
+        if(helper)
+            return helper;
     }
     
     CppTypeMap::iterator it = cpptype_map_.find(cpptype);
@@ -36,6 +36,8 @@ namespace dccl
     {
         
         /// \brief Provides FromProtoTypeBase and FromProtoCppTypeBase type identification helper classes for various representations of the underlying field.
+        ///
+        /// The helpers for statically generated message types with their own codecs are kept by the FieldCodecManager, in the same snapshot as their codecs.
         class TypeHelper
         {
           public:
@@ -58,17 +60,6 @@ namespace dccl
             
           private:
             friend class ::dccl::FieldCodecManager;
-            template<typename ProtobufMessage>
-                static void add()
-            {
-                custom_message_map_.insert(std::make_pair(ProtobufMessage::descriptor()->full_name(),
-                                                          boost::shared_ptr<FromProtoCppTypeBase>(new FromProtoCustomMessage<ProtobufMessage>)));
-            }
-            template<typename ProtobufMessage>
-                static void remove()
-            {
-                custom_message_map_.erase(ProtobufMessage::descriptor()->full_name());
-            }
             static void reset()
             {
                 inst_.reset();
@@ -80,7 +71,6 @@ namespace dccl
             {
                 type_map_.clear();
                 cpptype_map_.clear();
-                custom_message_map_.clear();
             }
             TypeHelper(const TypeHelper&);
             TypeHelper& operator= (const TypeHelper&);
@@ -99,10 +89,6 @@ namespace dccl
             typedef std::map<google::protobuf::FieldDescriptor::CppType,
                 boost::shared_ptr<FromProtoCppTypeBase> > CppTypeMap;
             static CppTypeMap cpptype_map_;
-
-            typedef std::map<std::string,
-                boost::shared_ptr<FromProtoCppTypeBase> > CustomMessageMap;
-            static CustomMessageMap custom_message_map_;
         };
     }
 }
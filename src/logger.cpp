@@ -19,6 +19,7 @@
 //
 // You should have received a copy of the GNU Lesser General Public License
 // along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
 #include <ctime>
 
 #include "dccl/logger.h"
@@ -44,9 +45,31 @@ int dccl::internal::LogBuffer::overflow(int c) {
     return c;
 }
 
+std::streamsize dccl::internal::LogBuffer::xsputn(const char* s, std::streamsize n) {
+    const char* end = s + n;
+    for(const char* begin = s; begin != end; )
+    {
+        const char* newline = std::find(begin, end, '\n');
+        buffer_.back().append(begin, newline);
+        if(newline == end)
+            break;
+        buffer_.push_back(std::string());
+        begin = newline + 1;
+    }
+    return n;
+}
+
 void dccl::to_ostream(const std::string& msg, dccl::logger::Verbosity vrb,
                       dccl::logger::Group grp, std::ostream* os,
                       bool add_timestamp)
+{
+    to_ostream(msg, vrb, grp, os, add_timestamp, std::time(0));
+    *os << std::flush;
+}
+
+void dccl::to_ostream(const std::string& msg, dccl::logger::Verbosity vrb,
+                      dccl::logger::Group grp, std::ostream* os,
+                      bool add_timestamp, std::time_t now)
 {
     std::string grp_str;
     switch(grp)
@@ -58,11 +81,10 @@ void dccl::to_ostream(const std::string& msg, dccl::logger::Verbosity vrb,
         case logger::SIZE: grp_str = "{size}: "; break;
     }
     
-    std::time_t now = std::time(0);
-    std::tm* t = std::gmtime(&now);
-
     if(add_timestamp)
     {
+        std::tm t_buf;
+        std::tm* t = gmtime_r(&now, &t_buf);
         *os << "[ " << (t->tm_year+1900) << "-"
             << std::setw(2) << std::setfill('0') << (t->tm_mon+1) << "-"
             << std::setw(2) << t->tm_mday
@@ -73,6 +95,6 @@ void dccl::to_ostream(const std::string& msg, dccl::logger::Verbosity vrb,
             << std::setfill(' ');
     }
     
-    *os << grp_str << msg << std::endl;
+    *os << grp_str << msg << '\n';
     
 }
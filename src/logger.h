@@ -28,6 +28,12 @@
 #include <iomanip>
 #include <boost/signals2.hpp>
 #include <cstdio>
+#include <ctime>
+
+/// Highest verbosity (as a logger::Verbosity value) compiled into DCCL, set by the CMake log_max_verbosity option. Logger::is() always returns false above this level, which allows the compiler to remove these log statements entirely.
+#ifndef DCCL_LOG_MAX_VERBOSITY
+#define DCCL_LOG_MAX_VERBOSITY @DCCL_LOG_MAX_VERBOSITY@
+#endif
 
 namespace dccl {
     namespace logger {
@@ -54,6 +60,10 @@ namespace dccl {
 
     void to_ostream(const std::string& msg, dccl::logger::Verbosity vrb,
                     dccl::logger::Group grp, std::ostream* os, bool add_timestamp);
+
+    /// \brief Writes one log line as to_ostream() above, but with the given timestamp and without flushing `os`
+    void to_ostream(const std::string& msg, dccl::logger::Verbosity vrb,
+                    dccl::logger::Group grp, std::ostream* os, bool add_timestamp, std::time_t time);
     
     namespace internal
     {
@@ -103,6 +113,9 @@ namespace dccl {
             /// virtual inherited from std::streambuf. Called when something is inserted into the stream
             /// Called when std::endl or std::flush is inserted into the stream
             int overflow(int c = EOF);
+
+            /// virtual inherited from std::streambuf. Called when a string of characters is inserted into the stream (appends them at once rather than one overflow() per character)
+            std::streamsize xsputn(const char* s, std::streamsize n);
      
 
             void display(const std::string& s) {
@@ -142,8 +155,9 @@ namespace dccl {
         /// \endcode
         /// \param verbosity The verbosity level to tag the following message with. These levels are used to direct the output of dlog to different logs or omit them completely.
         /// \param group The group that this message belongs to.
+        /// \return false if the verbosity is greater than DCCL_LOG_MAX_VERBOSITY (known at compile time for constant verbosities) or not connected to any slot.
         bool is(logger::Verbosity verbosity, logger::Group group = logger::GENERAL) {
-            if (!buf_.contains(verbosity)) {
+            if (verbosity > DCCL_LOG_MAX_VERBOSITY || !buf_.contains(verbosity)) {
                 return false;
             } else {
                 buf_.set_verbosity(verbosity);
@@ -0,0 +1,110 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <boost/weak_ptr.hpp>
+
+#include "message_pool.h"
+#include "dynamic_protobuf_manager.h"
+
+// deleter for the messages handed out by the pool
+class dccl::MessagePool::Release
+{
+  public:
+    Release(const boost::shared_ptr<FreeMessages>& free) : free_(free) { }
+    
+    void operator()(google::protobuf::Message* msg) const
+    {
+        boost::shared_ptr<FreeMessages> free = free_.lock();
+        if(free)
+            free->release(msg);
+        else
+            delete msg;
+    }
+
+  private:
+    boost::weak_ptr<FreeMessages> free_;
+};
+
+
+dccl::MessagePool::MessagePool(std::size_t max_free_per_type /* = 16 */)
+    : free_(new FreeMessages(max_free_per_type))
+{ }
+
+boost::shared_ptr<google::protobuf::Message> dccl::MessagePool::get(const google::protobuf::Descriptor* desc)
+{
+    google::protobuf::Message* msg = 0;
+    
+    std::map<const google::protobuf::Descriptor*, std::vector<google::protobuf::Message*> >::iterator it =
+        free_->messages.find(desc);
+    if(it != free_->messages.end() && !it->second.empty())
+    {
+        msg = it->second.back();
+        it->second.pop_back();
+    }
+    else
+    {
+        msg = DynamicProtobufManager::new_protobuf_message<google::protobuf::Message*>(desc);
+    }
+
+    return boost::shared_ptr<google::protobuf::Message>(msg, Release(free_));
+}
+
+std::size_t dccl::MessagePool::num_free(const google::protobuf::Descriptor* desc) const
+{
+    std::map<const google::protobuf::Descriptor*, std::vector<google::protobuf::Message*> >::const_iterator it =
+        free_->messages.find(desc);
+    return it == free_->messages.end() ? 0 : it->second.size();
+}
+
+void dccl::MessagePool::clear()
+{
+    free_->clear();
+}
+
+dccl::MessagePool::FreeMessages::~FreeMessages()
+{
+    clear();
+}
+
+void dccl::MessagePool::FreeMessages::release(google::protobuf::Message* msg)
+{
+    std::vector<google::protobuf::Message*>& free = messages[msg->GetDescriptor()];
+    if(free.size() < max_per_type)
+    {
+        // Clear() keeps the memory allocated for strings and repeated fields
+        msg->Clear();
+        free.push_back(msg);
+    }
+    else
+    {
+        delete msg;
+    }
+}
+
+void dccl::MessagePool::FreeMessages::clear()
+{
+    for(std::map<const google::protobuf::Descriptor*, std::vector<google::protobuf::Message*> >::iterator it = messages.begin(), end = messages.end(); it != end; ++it)
+    {
+        for(std::vector<google::protobuf::Message*>::iterator msg_it = it->second.begin(), msg_end = it->second.end(); msg_it != msg_end; ++msg_it)
+            delete *msg_it;
+    }
+    messages.clear();
+}
@@ -0,0 +1,86 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLMESSAGEPOOL20171020H
+#define DCCLMESSAGEPOOL20171020H
+
+#include <map>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <google/protobuf/message.h>
+
+namespace dccl
+{
+    /// \brief Pool of reusable Google Protobuf messages, kept separately for each message type (Descriptor).
+    ///
+    /// get() hands out a cleared message that was used before (or a new one if there are none free) through a boost::shared_ptr whose deleter returns the message to the pool. Reusing messages keeps the memory already allocated for their strings and repeated fields, which avoids most of the allocations when decoding a stream of messages:
+    /// \code
+    /// dccl::MessagePool pool;
+    /// boost::shared_ptr<google::protobuf::Message> msg = codec.decode_from_pool(bytes, &pool);
+    /// \endcode
+    /// The pool is not thread-safe. It may be destroyed before the messages it handed out, which are then deleted as usual.
+    /// \ingroup dccl_api
+    class MessagePool
+    {
+      public:
+        /// \brief Create a MessagePool
+        ///
+        /// \param max_free_per_type Maximum number of unused messages kept for each message type. Messages released when this many are already kept are deleted.
+        explicit MessagePool(std::size_t max_free_per_type = 16);
+
+        /// \brief Get an empty message of a given type
+        ///
+        /// \param desc The Google Protobuf Descriptor of the message to get.
+        /// \return A cleared message, which is returned to the pool when the last copy of the pointer is destroyed.
+        boost::shared_ptr<google::protobuf::Message> get(const google::protobuf::Descriptor* desc);
+
+        /// \brief Number of unused messages of a given type held by the pool.
+        std::size_t num_free(const google::protobuf::Descriptor* desc) const;
+
+        /// \brief Delete all the unused messages held by the pool.
+        void clear();
+        
+      private:
+        MessagePool(const MessagePool&);
+        MessagePool& operator= (const MessagePool&);
+
+        // shared with the deleters of the messages handed out, so that they can outlive the pool
+        struct FreeMessages
+        {
+            FreeMessages(std::size_t max) : max_per_type(max) { }
+            ~FreeMessages();
+            void release(google::protobuf::Message* msg);
+            void clear();
+            
+            std::size_t max_per_type;
+            std::map<const google::protobuf::Descriptor*, std::vector<google::protobuf::Message*> > messages;
+        };
+
+        class Release;
+        
+      private:
+        boost::shared_ptr<FreeMessages> free_;
+    };
+}
+
+#endif
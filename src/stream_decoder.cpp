@@ -0,0 +1,207 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+
+#include "stream_decoder.h"
+
+using namespace dccl::logger;
+
+dccl::StreamDecoder::StreamDecoder(Codec* codec, MessagePool* pool /* = 0 */)
+    : codec_(codec),
+      pool_(pool),
+      pos_(0),
+      wait_bytes_(0)
+{ }
+
+unsigned dccl::StreamDecoder::push(const char* data, size_t len)
+{
+    buffer_.append(data, len);
+    return decode_available(false);
+}
+
+unsigned dccl::StreamDecoder::flush()
+{
+    return decode_available(true);
+}
+
+boost::shared_ptr<google::protobuf::Message> dccl::StreamDecoder::pop()
+{
+    if(messages_.empty())
+        throw(Exception("StreamDecoder::pop() called with no decoded messages available"));
+
+    boost::shared_ptr<google::protobuf::Message> msg = messages_.front();
+    messages_.pop_front();
+    return msg;
+}
+
+void dccl::StreamDecoder::clear()
+{
+    buffer_.clear();
+    pos_ = 0;
+    wait_bytes_ = 0;
+    messages_.clear();
+}
+
+unsigned dccl::StreamDecoder::decode_available(bool end_of_stream)
+{
+    unsigned id_max_bits = 0;
+    codec_->id_codec()->field_max_size(&id_max_bits, 0);
+    const size_t id_max_bytes = ceil_bits2bytes(id_max_bits);
+    
+    unsigned num_decoded = 0;
+    while(pos_ < buffer_.size())
+    {
+        const char* begin = buffer_.data() + pos_;
+        const size_t available = buffer_.size() - pos_;
+        
+        if(available < id_max_bytes && !end_of_stream)
+            break;
+
+        // identifier codecs may read up to their maximum size, so pad a short final frame
+        std::string id_bytes(begin, std::min(available, id_max_bytes));
+        id_bytes.resize(id_max_bytes, '\0');
+
+        unsigned dccl_id = 0;
+        try
+        {
+            dccl_id = codec_->id(id_bytes);
+        }
+        catch(Exception& e)
+        {
+            discard_and_throw(e.what());
+        }
+        
+        const Frame& f = frame(dccl_id);
+        if((available < f.min_bytes || available < wait_bytes_) && !end_of_stream)
+            break;
+
+        boost::shared_ptr<google::protobuf::Message> msg = pool_ ? pool_->get(f.desc) :
+            DynamicProtobufManager::new_protobuf_message(f.desc);
+        size_t consumed = 0;
+
+        if(available >= f.max_bytes)
+        {
+            // the whole frame is present, so any failure is a genuine error
+            try
+            {
+                consumed = codec_->decode(begin, begin + available, msg.get()) - begin;
+            }
+            catch(Exception& e)
+            {
+                discard_and_throw(e.what());
+            }
+        }
+        else if(end_of_stream)
+        {
+            std::string padded(begin, available);
+            padded.resize(f.max_bytes, '\0');
+            try
+            {
+                consumed = codec_->decode(padded.begin(), padded.end(), msg.get()) - padded.begin();
+            }
+            catch(Exception& e)
+            {
+                discard_and_throw(e.what());
+            }
+            
+            if(consumed > available)
+                discard_and_throw("stream ended partway through a message of type " + f.desc->full_name());
+        }
+        else
+        {
+            // the message may be shorter than its maximum size, so try it now; decoding
+            // fails without reading past the end if more bytes are needed
+            try
+            {
+                consumed = codec_->decode(begin, begin + available, msg.get(), false, true) - begin;
+            }
+            catch(NotEnoughBitsException& e)
+            {
+                // the frame is at least this long, so don't decode it again before then
+                wait_bytes_ = std::min<size_t>(f.max_bytes, available + std::max(1u, ceil_bits2bytes(e.bits_short())));
+                dlog.is(DEBUG2, DECODE) && dlog << "StreamDecoder: waiting for " << wait_bytes_ - available << " or more bytes of message of type " << f.desc->full_name() << std::endl;
+                break;
+            }
+            catch(Exception& e)
+            {
+                discard_and_throw(e.what());
+            }
+        }
+
+        pos_ += consumed;
+        wait_bytes_ = 0;
+        messages_.push_back(msg);
+        ++num_decoded;
+    }
+
+    if(pos_ == buffer_.size())
+    {
+        buffer_.clear();
+        pos_ = 0;
+    }
+    else if(pos_ > buffer_.size() / 2)
+    {
+        buffer_.erase(0, pos_);
+        pos_ = 0;
+    }
+    
+    return num_decoded;
+}
+
+const dccl::StreamDecoder::Frame& dccl::StreamDecoder::frame(unsigned dccl_id)
+{
+    std::map<int32, const google::protobuf::Descriptor*>::const_iterator loaded_it = codec_->loaded().find(dccl_id);
+    if(loaded_it == codec_->loaded().end())
+        discard_and_throw("Message id " + boost::lexical_cast<std::string>(dccl_id) + " has not been loaded. Call load() before decoding this type.");
+
+    const google::protobuf::Descriptor* desc = loaded_it->second;
+    std::map<unsigned, Frame>::iterator it = frames_.find(dccl_id);
+    if(it != frames_.end() && it->second.desc == desc)
+        return it->second;
+
+    FieldCodecManager::ScopedSnapshot snapshot;
+    FieldCodecBase* codec = FieldCodecManager::find(desc);
+    unsigned head_bits, body_max_bits, body_min_bits;
+    codec->base_max_size(&head_bits, desc, HEAD);
+    codec->base_max_size(&body_max_bits, desc, BODY);
+    codec->base_min_size(&body_min_bits, desc, BODY);
+
+    unsigned id_bits = 0;
+    codec_->id_codec()->field_size(&id_bits, dccl_id, 0);
+    
+    Frame f;
+    f.desc = desc;
+    f.head_bytes = ceil_bits2bytes(head_bits + id_bits);
+    f.min_bytes = f.head_bytes + ceil_bits2bytes(body_min_bits);
+    f.max_bytes = f.head_bytes + ceil_bits2bytes(body_max_bits);
+
+    return frames_[dccl_id] = f;
+}
+
+void dccl::StreamDecoder::discard_and_throw(const std::string& reason)
+{
+    dlog.is(DEBUG1, DECODE) && dlog << "StreamDecoder: discarding " << buffered_bytes() << " buffered byte(s)" << std::endl;
+    buffer_.clear();
+    pos_ = 0;
+    wait_bytes_ = 0;
+    throw(Exception("StreamDecoder: " + reason));
+}
@@ -0,0 +1,125 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLSTREAMDECODER20171013H
+#define DCCLSTREAMDECODER20171013H
+
+#include <string>
+#include <deque>
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+
+#include "dccl/codec.h"
+
+namespace dccl
+{
+    /// \brief Incrementally decodes a stream of concatenated DCCL messages that arrives in arbitrarily sized chunks (e.g. from a serial port, socket or pipe).
+    ///
+    /// Partial frames are buffered between calls to push(), and each message is decoded as soon as enough bytes of it have arrived. The identifier codec and the minimum and maximum sizes of each loaded type are used to decide when a frame may be complete: a fixed size frame is decoded once all of its bytes are present. A variable size frame is tried early, and if it runs out of bytes it is not tried again until at least as many more bytes as it was short have arrived, so it is decoded a bounded number of times however small the chunks are. For example:
+    /// \code
+    /// dccl::StreamDecoder decoder(&codec);
+    /// while(read(fd, buf, sizeof(buf)) > 0)
+    /// {
+    ///     decoder.push(buf, n);
+    ///     while(!decoder.empty())
+    ///         handle(decoder.pop());
+    /// }
+    /// decoder.flush();
+    /// \endcode
+    /// \ingroup dccl_api
+    class StreamDecoder
+    {
+      public:
+        /// \brief Create a StreamDecoder
+        ///
+        /// \param codec Codec to decode with. All message types expected on the stream must be loaded into this Codec, which must outlive the StreamDecoder.
+        /// \param pool If not null, decode into messages from this pool (which must outlive the StreamDecoder), so that messages released after pop() are reused.
+        StreamDecoder(Codec* codec, MessagePool* pool = 0);
+
+        /// \brief Add a chunk of bytes to the stream and decode any messages it completes.
+        ///
+        /// \param data Pointer to the start of the chunk
+        /// \param len Length of the chunk in bytes
+        /// \throw Exception if a complete frame cannot be decoded (e.g. unknown id or corrupt data). The buffered bytes are discarded, since DCCL frames cannot be resynchronized.
+        /// \return Number of messages decoded from this chunk
+        unsigned push(const char* data, size_t len);
+
+        /// \brief Add a chunk of bytes to the stream and decode any messages it completes.
+        unsigned push(const std::string& chunk)
+        { return push(chunk.data(), chunk.size()); }
+
+        /// \brief Decode any messages remaining at the end of the stream, allowing a final frame that is shorter than its maximum size.
+        ///
+        /// \throw Exception if bytes remain that do not form a complete message. The buffered bytes are discarded.
+        /// \return Number of messages decoded
+        unsigned flush();
+
+        /// \brief Returns true if no decoded messages are waiting to be popped.
+        bool empty() const { return messages_.empty(); }
+
+        /// \brief Number of decoded messages waiting to be popped.
+        size_t size() const { return messages_.size(); }
+
+        /// \brief Remove and return the oldest decoded message.
+        ///
+        /// \throw Exception if there are no decoded messages.
+        boost::shared_ptr<google::protobuf::Message> pop();
+        
+        /// \brief Number of bytes received but not yet consumed by a decoded message.
+        size_t buffered_bytes() const { return buffer_.size() - pos_; }
+
+        /// \brief Discard all buffered bytes and decoded messages.
+        void clear();
+        
+      private:
+        StreamDecoder(const StreamDecoder&);
+        StreamDecoder& operator= (const StreamDecoder&);
+
+        // sizes of a given loaded message type, in bytes
+        struct Frame
+        {
+            const google::protobuf::Descriptor* desc;
+            unsigned head_bytes; // includes the identifier
+            unsigned min_bytes;
+            unsigned max_bytes;
+        };
+
+        unsigned decode_available(bool end_of_stream);
+        const Frame& frame(unsigned dccl_id);
+        void discard_and_throw(const std::string& reason);
+        
+      private:
+        Codec* codec_;
+        MessagePool* pool_;
+        
+        std::string buffer_;
+        // offset into buffer_ of the first byte not yet consumed
+        size_t pos_;
+        // number of bytes (from pos_) that must be buffered before the frame at pos_ is tried again
+        size_t wait_bytes_;
+        
+        std::deque<boost::shared_ptr<google::protobuf::Message> > messages_;
+        std::map<unsigned, Frame> frames_;
+    };
+}
+
+#endif
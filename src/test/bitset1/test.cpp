@@ -82,6 +82,20 @@ int main()
     std::cout << bits2.size() << ": " << bits2 << std::endl;
     assert(bits2.to_ulong() == 0x02a512);
 
+    // byte strings at unaligned positions
+    {
+        Bitset prefix(3, 0x5);
+        prefix.append_byte_string(dccl::hex_decode("12a502"));
+        std::cout << prefix.size() << ": " << prefix << std::endl;
+        assert(prefix.size() == 27);
+        assert(prefix.to_ulong() == ((0x02a512ul << 3) | 0x5));
+        assert(dccl::hex_encode(prefix.to_byte_string(3)) == "12a502");
+        assert(dccl::hex_encode(prefix.to_byte_string(11)) == "a502");
+        assert(dccl::hex_encode(prefix.to_byte_string(1)) == "4a940a00");
+        assert(prefix.to_byte_string(0) == prefix.to_byte_string());
+        assert(prefix.to_byte_string(27).empty());
+    }
+
     // get_more_bits;
     {
         std::cout << std::endl;
@@ -158,6 +172,33 @@ int main()
         assert(grandparent.to_ulong() == 0xD);
     }
 
+
+    {
+        std::cout << std::endl;
+        // 70 bits spanning two 64-bit words, appended after a 3-bit prefix
+        dccl::uint64 words[2] = { 0x8000000000000001ull, 0x2Aull };
+        Bitset bits(3, 0x5);
+        bits.append_words(words, 70);
+        std::cout << "append_words: " << bits << std::endl;
+
+        assert(bits.size() == 73);
+        assert(bits[0] && !bits[1] && bits[2] && bits[3] && !bits[4]);
+        assert(bits[3 + 63] && bits[3 + 65] && bits[3 + 67] && bits[3 + 69]);
+        assert(!bits[3 + 64] && !bits[3 + 62]);
+
+        // round trip (the prefix stays in the first word)
+        dccl::uint64 out[2] = { 0, 0 };
+        bits.to_words(out);
+        assert(out[0] == ((words[0] << 3) | 0x5));
+        assert(out[1] == ((words[1] << 3) | (words[0] >> 61)));
+
+        Bitset tail;
+        tail.append_words(words, 70);
+        dccl::uint64 tail_out[2] = { 0, 0 };
+        tail.to_words(tail_out);
+        assert(tail_out[0] == words[0] && tail_out[1] == words[1]);
+    }
+
     
     std::cout << "all tests passed" << std::endl;
     
@@ -21,6 +21,10 @@
 // along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
 // tests arithmetic encoder
 
+#if __cplusplus >= 201103L
+#include <thread>
+#endif
+
 #include <google/protobuf/descriptor.pb.h>
 
 #include "dccl/codec.h"
@@ -66,10 +70,15 @@ void run_test(dccl::arith::protobuf::ArithmeticModel& model,
     std::cout << "Message in:\n" << msg_in.DebugString() << std::endl;
 
     
+    // sizing first lets the encode reuse the sized bits (for static models)
+    unsigned size = codec.size(msg_in);
+    
     std::cout << "Try encode..." << std::endl;
     std::string bytes;
     codec.encode(&bytes, msg_in);
     std::cout << "... got bytes (hex): " << dccl::hex_encode(bytes) << std::endl;
+    // the adaptive encode adapts as it goes, which sizing does not
+    assert(bytes.size() == size || model.is_adaptive());
 
     std::cout << "Try decode..." << std::endl;
 
@@ -274,6 +283,104 @@ int main(int argc, char* argv[])
 
     }
 
+    // adaptive models with separate state for each link
+    {
+        dccl::arith::protobuf::ArithmeticModel model;
+        model.set_name("adaptive_state_model");
+        model.set_eof_frequency(1);
+        for(int i = 0; i < 4; ++i)
+        {
+            model.add_value_bound(i);
+            model.add_frequency(1);
+        }
+        model.add_value_bound(4);
+        model.set_is_adaptive(true);
+        dccl::arith::ModelManager::set_model(model);
+        codec.load<ArithmeticAdaptiveStateTestMsg>();
+
+        ArithmeticAdaptiveStateTestMsg msg_a, msg_b;
+        for(int i = 0; i < 20; ++i)
+        {
+            msg_a.add_value(0);
+            msg_b.add_value(3);
+        }
+
+        dccl::arith::AdaptiveModelState encoder_a, encoder_b, decoder_a, decoder_b;
+        std::vector<std::string> bytes_a, bytes_b;
+        for(int i = 0; i < 5; ++i)
+        {
+            // the links are interleaved, but each adapts only to its own values
+            bytes_a.push_back(std::string());
+            bytes_b.push_back(std::string());
+            {
+                dccl::arith::ScopedAdaptiveModelState state(&encoder_a);
+                codec.encode(&bytes_a.back(), msg_a);
+            }
+            {
+                dccl::arith::ScopedAdaptiveModelState state(&encoder_b);
+                codec.encode(&bytes_b.back(), msg_b);
+            }
+            if(i > 0)
+            {
+                assert(bytes_a[i].size() <= bytes_a[i-1].size());
+                assert(bytes_b[i].size() <= bytes_b[i-1].size());
+            }
+        }
+        assert(bytes_a.back().size() < bytes_a.front().size());
+        assert(bytes_a.back().size() == bytes_b.back().size());
+
+        for(int i = 0; i < 5; ++i)
+        {
+            ArithmeticAdaptiveStateTestMsg msg_out;
+            {
+                dccl::arith::ScopedAdaptiveModelState state(&decoder_b);
+                codec.decode(bytes_b[i], &msg_out);
+            }
+            assert(msg_out.SerializeAsString() == msg_b.SerializeAsString());
+            
+            msg_out.Clear();
+            {
+                dccl::arith::ScopedAdaptiveModelState state(&decoder_a);
+                codec.decode(bytes_a[i], &msg_out);
+            }
+            assert(msg_out.SerializeAsString() == msg_a.SerializeAsString());
+        }
+
+        // a snapshot rolls back the state
+        dccl::arith::AdaptiveModelState snapshot(encoder_a);
+        std::string first, second;
+        {
+            dccl::arith::ScopedAdaptiveModelState state(&encoder_a);
+            codec.encode(&first, msg_a);
+            encoder_a = snapshot;
+            codec.encode(&second, msg_a);
+        }
+        assert(first == second);
+        
+        // reset returns to the initial frequencies, and the shared frequencies were never adapted
+        first.clear(); // encode() appends
+        second.clear();
+        encoder_a.reset();
+        {
+            dccl::arith::ScopedAdaptiveModelState state(&encoder_a);
+            codec.encode(&first, msg_a);
+        }
+        codec.encode(&second, msg_a);
+        assert(first == bytes_a.front());
+        assert(second == bytes_a.front());
+        assert(dccl::arith::ModelManager::bound_state() == 0);
+
+#if __cplusplus >= 201103L
+        // the binding is per thread
+        {
+            dccl::arith::ScopedAdaptiveModelState state(&encoder_a);
+            std::thread other([]() { assert(dccl::arith::ModelManager::bound_state() == 0); });
+            other.join();
+            assert(dccl::arith::ModelManager::bound_state() == &encoder_a);
+        }
+#endif
+    }
+
     
     // test case from Arithmetic Coding revealed: A guided tour from theory to praxis Sable Technical Report No. 2007-5 Eric Bodden
 
@@ -0,0 +1,212 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests that codecs added and removed while a snapshot of the codec registry is pinned do not affect the pinned snapshot
+
+#if __cplusplus >= 201103L
+#include <atomic>
+#include <thread>
+#endif
+
+#include "dccl/codec.h"
+#include "dccl/field_codec_fixed.h"
+#include "test.pb.h"
+
+using namespace dccl::test;
+
+class ByteCodec : public dccl::TypedFixedFieldCodec<dccl::int32>
+{
+  private:
+    dccl::Bitset encode(const dccl::int32& wire_value)
+    { return dccl::Bitset(size(), static_cast<unsigned char>(wire_value)); }
+    dccl::Bitset encode()
+    { return encode(0); }
+    dccl::int32 decode(dccl::Bitset* bits)
+    { return bits->to_ulong(); }
+    unsigned size()
+    { return 8; }
+    void validate()
+    { }
+};
+
+// as ByteCodec, but twice the size
+class WordCodec : public dccl::TypedFixedFieldCodec<dccl::int32>
+{
+  private:
+    dccl::Bitset encode(const dccl::int32& wire_value)
+    { return dccl::Bitset(size(), static_cast<unsigned short>(wire_value)); }
+    dccl::Bitset encode()
+    { return encode(0); }
+    dccl::int32 decode(dccl::Bitset* bits)
+    { return bits->to_ulong(); }
+    unsigned size()
+    { return 16; }
+    void validate()
+    { }
+};
+
+bool encode_throws(dccl::Codec& codec, const TestMsg& msg)
+{
+    try
+    {
+        std::string bytes;
+        codec.encode(&bytes, msg);
+    }
+    catch(dccl::Exception& e)
+    {
+        std::cout << "Caught (as expected): " << e.what() << std::endl;
+        return true;
+    }
+    return false;
+}
+
+void check_round_trip(dccl::Codec& codec, const TestMsg& msg)
+{
+    std::string bytes;
+    codec.encode(&bytes, msg);
+    TestMsg msg_out;
+    codec.decode(bytes, &msg_out);
+    assert(msg.SerializeAsString() == msg_out.SerializeAsString());
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::ALL, &std::cerr);
+
+    dccl::FieldCodecManager::add<ByteCodec>("test.byte");
+
+    dccl::Codec codec;
+    codec.load<TestMsg>();
+
+    TestMsg msg;
+    msg.set_value(42);
+    msg.set_plain(7);
+    check_round_trip(codec, msg);
+
+    {
+        dccl::FieldCodecManager::ScopedSnapshot snapshot;
+        // only modifies the published registry, not the pinned one
+        dccl::FieldCodecManager::remove<ByteCodec>("test.byte");
+        check_round_trip(codec, msg);
+        assert(dccl::FieldCodecManager::find(google::protobuf::FieldDescriptor::TYPE_INT32, "test.byte"));
+    }
+
+    // now the removal is visible
+    assert(encode_throws(codec, msg));
+
+    dccl::FieldCodecManager::add<ByteCodec>("test.byte");
+    check_round_trip(codec, msg);
+
+    {
+        dccl::FieldCodecManager::ScopedSnapshot snapshot;
+        dccl::FieldCodecManager::remove<ByteCodec>("test.byte");
+        // nested snapshots share the outermost one
+        dccl::FieldCodecManager::ScopedSnapshot nested;
+        check_round_trip(codec, msg);
+    }
+    assert(encode_throws(codec, msg));
+
+    {
+        dccl::FieldCodecManager::ScopedBatch batch;
+        dccl::FieldCodecManager::add<ByteCodec>("test.byte");
+        dccl::FieldCodecManager::add<ByteCodec>("test.other");
+        // nested batches join the outermost one
+        dccl::FieldCodecManager::ScopedBatch nested;
+        dccl::FieldCodecManager::remove<ByteCodec>("test.other");
+    }
+    check_round_trip(codec, msg);
+    assert(dccl::FieldCodecManager::find(google::protobuf::FieldDescriptor::TYPE_INT32, "test.byte"));
+
+    {
+        dccl::FieldCodecManager::ScopedBatch batch;
+        dccl::FieldCodecManager::remove<ByteCodec>("test.byte");
+        // a thread sees its own pending changes
+        assert(encode_throws(codec, msg));
+        dccl::FieldCodecManager::add<ByteCodec>("test.byte");
+    }
+    check_round_trip(codec, msg);
+    
+    // per-field caches are dropped when codecs or messages are unloaded
+    {
+        unsigned generation = dccl::FieldCodecBase::cache_generation();
+        codec.unload<TestMsg>();
+        assert(dccl::FieldCodecBase::cache_generation() != generation);
+
+        generation = dccl::FieldCodecBase::cache_generation();
+        dccl::FieldCodecManager::add<ByteCodec>("test.other");
+        assert(dccl::FieldCodecBase::cache_generation() != generation);
+
+        codec.load<TestMsg>();
+        check_round_trip(codec, msg);
+    }
+    
+    // the codecs resolved when the message was loaded follow codecs replaced by name, and are shared by Codecs loading the same message
+    {
+        const unsigned byte_size = codec.size(msg);
+        {
+            dccl::FieldCodecManager::ScopedBatch batch;
+            dccl::FieldCodecManager::remove<ByteCodec>("test.byte");
+            dccl::FieldCodecManager::add<WordCodec>("test.byte");
+        }
+        assert(codec.size(msg) == byte_size + 1);
+        check_round_trip(codec, msg);
+
+        {
+            dccl::Codec other;
+            other.load<TestMsg>();
+            check_round_trip(other, msg);
+        }
+        // still resolved for `codec`
+        check_round_trip(codec, msg);
+        
+        {
+            dccl::FieldCodecManager::ScopedBatch batch;
+            dccl::FieldCodecManager::remove<WordCodec>("test.byte");
+            dccl::FieldCodecManager::add<ByteCodec>("test.byte");
+        }
+        assert(codec.size(msg) == byte_size);
+        check_round_trip(codec, msg);
+    }
+    
+#if __cplusplus >= 201103L
+    // codecs changing on another thread never invalidate the snapshot of an in-flight call
+    {
+        // dlog itself is not thread-safe
+        dccl::dlog.disconnect(dccl::logger::ALL);
+        
+        std::atomic<bool> done(false);
+        std::thread loader([&done]()
+                           {
+                               while(!done)
+                               {
+                                   dccl::FieldCodecManager::add<ByteCodec>("test.other");
+                                   dccl::FieldCodecManager::remove<ByteCodec>("test.other");
+                               }
+                           });
+        for(int i = 0; i < 2000; ++i)
+            check_round_trip(codec, msg);
+        done = true;
+        loader.join();
+    }
+#endif
+    
+    std::cout << "all tests passed" << std::endl;
+}
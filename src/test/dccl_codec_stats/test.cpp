@@ -0,0 +1,177 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests the per-type counters and latency histograms (Codec::stats())
+
+#include <sstream>
+
+#include "dccl/codec.h"
+#include "dccl/stream_decoder.h"
+#include "test.pb.h"
+
+using namespace dccl::test;
+
+const int STATS_ID = 4;
+
+dccl::MessageStats stats(const dccl::Codec& codec)
+{
+    std::map<dccl::int32, dccl::MessageStats> all = codec.stats();
+    assert(all.count(STATS_ID));
+    return all[STATS_ID];
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::ALL, &std::cerr);
+
+    // histogram buckets are powers of two of nanoseconds
+    assert(dccl::LatencyHistogram::bucket(0) == 0);
+    assert(dccl::LatencyHistogram::bucket(1) == 0);
+    assert(dccl::LatencyHistogram::bucket(2) == 1);
+    assert(dccl::LatencyHistogram::bucket(1000) == 9);
+    assert(dccl::LatencyHistogram::bucket(~dccl::uint64(0)) == dccl::LatencyHistogram::NUM_BUCKETS - 1);
+    {
+        dccl::LatencyHistogram latency;
+        assert(latency.quantile(0.5) == 0);
+        latency.buckets[3] = 9;
+        latency.buckets[10] = 1;
+        assert(latency.count() == 10);
+        assert(latency.quantile(0.5) == 15);
+        assert(latency.quantile(0.9) == 15);
+        assert(latency.quantile(1) == 2047);
+    }
+    
+    dccl::Codec codec;
+    assert(codec.stats().empty());
+    codec.load<StatsMsg>();
+    assert(codec.stats().size() == 1);
+    assert(stats(codec).name == "dccl.test.StatsMsg");
+    assert(stats(codec).encode_count == 0);
+
+    // encode
+    std::vector<std::string> encoded;
+    std::size_t total_bytes = 0;
+    for(int i = 0; i < 3; ++i)
+    {
+        StatsMsg msg;
+        msg.set_vehicle(i);
+        msg.set_active(i % 2);
+        msg.set_note(std::string(i * 5, 'x'));
+        std::string bytes;
+        codec.encode(&bytes, msg);
+        encoded.push_back(bytes);
+        total_bytes += bytes.size();
+    }
+
+    dccl::MessageStats s = stats(codec);
+    std::cout << s;
+    assert(s.encode_count == 3);
+    assert(s.encode_bytes == total_bytes);
+    assert(s.encode_bits + s.encode_padding_bits == 8 * total_bytes);
+    // at most 7 bits pad each of the head and the body
+    assert(s.encode_padding_bits <= 3 * 14);
+    assert(s.encode_latency.count() == 3);
+    assert(s.decode_count == 0);
+
+    // encode failures
+    {
+        StatsMsg msg;
+        try { codec.encode(&encoded.back(), msg); assert(false); }
+        catch(dccl::Exception& e) { }
+        
+        msg.set_vehicle(1);
+        msg.set_active(true);
+        msg.set_note("too long for this buffer");
+        char small[2];
+        try { codec.encode(small, sizeof(small), msg); assert(false); }
+        catch(std::length_error& e) { }
+        
+        s = stats(codec);
+        assert(s.encode_count == 3);
+        assert(s.encode_failures[dccl::FAILURE_UNINITIALIZED] == 1);
+        assert(s.encode_failures[dccl::FAILURE_BUFFER_TOO_SMALL] == 1);
+        assert(s.encode_failures[dccl::FAILURE_TRUNCATED] == 0);
+        assert(s.encode_failures[dccl::FAILURE_OTHER] == 0);
+    }
+    
+    // decode
+    for(int i = 0; i < 3; ++i)
+    {
+        StatsMsg msg;
+        codec.decode(encoded[i], &msg);
+        assert(msg.vehicle() == i);
+    }
+    s = stats(codec);
+    assert(s.decode_count == 3);
+    assert(s.decode_bytes == total_bytes);
+    assert(s.decode_latency.count() == 3);
+    
+    // truncated messages
+    {
+        StatsMsg msg;
+        const std::string& longest = encoded.back();
+        try { codec.decode(longest.substr(0, 1), &msg); assert(false); }
+        catch(dccl::Exception& e) { }
+        try { codec.decode(longest.substr(0, longest.size() - 2), &msg); assert(false); }
+        catch(dccl::Exception& e) { }
+
+        s = stats(codec);
+        assert(s.decode_count == 3);
+        assert(s.decode_failures[dccl::FAILURE_TRUNCATED] == 2);
+        assert(s.decode_failures[dccl::FAILURE_OTHER] == 0);
+    }
+
+    // a stream that delivers the message in pieces does not count the early attempts as failures
+    {
+        dccl::StreamDecoder decoder(&codec);
+        const std::string& longest = encoded.back();
+        std::size_t half = longest.size() / 2;
+        decoder.push(longest.substr(0, half));
+        assert(decoder.empty());
+        decoder.push(longest.substr(half));
+        assert(decoder.size() == 1);
+
+        s = stats(codec);
+        assert(s.decode_count == 4);
+        assert(s.decode_failures[dccl::FAILURE_TRUNCATED] == 2);
+    }
+
+    // a reload keeps the counters
+    codec.load<StatsMsg>();
+    assert(stats(codec).decode_count == 4);
+    
+    std::stringstream ss;
+    ss << stats(codec);
+    assert(ss.str().find("dccl.test.StatsMsg") != std::string::npos);
+    assert(ss.str().find("truncated: 2") != std::string::npos);
+    
+    codec.reset_stats();
+    s = stats(codec);
+    assert(s.encode_count == 0 && s.encode_bytes == 0 && s.encode_padding_bits == 0);
+    assert(s.encode_failures[dccl::FAILURE_UNINITIALIZED] == 0);
+    assert(s.decode_count == 0 && s.decode_latency.count() == 0);
+    assert(s.decode_failures[dccl::FAILURE_TRUNCATED] == 0);
+
+    codec.unload<StatsMsg>();
+    assert(codec.stats().empty());
+    
+    std::cout << "all tests passed" << std::endl;
+}
@@ -22,7 +22,10 @@
 // tests custom message codec
 // tests cryptography
 
+#include <boost/algorithm/string.hpp>
+
 #include "dccl/codec.h"
+#include "dccl/codecs3/field_codec_default.h"
 #include "test.pb.h"
 
 
@@ -169,6 +172,65 @@ namespace dccl
     
         };
 
+        // the default codecs can still be derived from
+        class UpperCaseStringCodec : public dccl::v3::DefaultStringCodec
+        {
+          public:
+            std::string pre_encode(const std::string& field_value)
+            { return boost::to_upper_copy(field_value); }
+        };
+
+        // repeated CustomMsg codec with its own size prefix (the number of unused slots), unlike the DCCL3 default
+        class CustomMsgRepeatedCodec :
+            public dccl::RepeatedTypedFieldCodec<CustomMsg>
+        {
+        private:
+            enum { REPEAT_STORAGE_BITS = 4 };
+            enum { A_SIZE = 8 };
+
+            unsigned max_repeat() { return FieldCodecBase::dccl_field_options().max_repeat(); }
+            
+            Bitset encode_repeated(const std::vector<CustomMsg>& wire_values)
+                {
+                    unsigned repeat_size = std::min<unsigned>(wire_values.size(), max_repeat());
+                    Bitset out(REPEAT_STORAGE_BITS, max_repeat() - repeat_size);
+                    for(unsigned i = 0; i < repeat_size; ++i)
+                        out.append(Bitset(A_SIZE, wire_values[i].a()));
+                    return out;
+                }
+    
+            std::vector<CustomMsg> decode_repeated(Bitset* bits)
+                {
+                    unsigned repeat_size = max_repeat() - bits->to_ulong();
+                    bits->get_more_bits(repeat_size*A_SIZE);
+
+                    Bitset value_bits = *bits;
+                    value_bits >>= REPEAT_STORAGE_BITS;
+
+                    std::vector<CustomMsg> out(repeat_size);
+                    for(unsigned i = 0; i < repeat_size; ++i)
+                    {
+                        out[i].set_a(value_bits.to_ulong() & ((1 << A_SIZE) - 1));
+                        value_bits >>= A_SIZE;
+                    }
+                    return out;
+                }
+    
+            unsigned size_repeated(const std::vector<CustomMsg>& field_values)
+                { return REPEAT_STORAGE_BITS + std::min<unsigned>(field_values.size(), max_repeat())*A_SIZE; }
+
+            unsigned max_size_repeated()
+                { return REPEAT_STORAGE_BITS + max_repeat()*A_SIZE; }
+    
+            unsigned min_size_repeated()
+                { return REPEAT_STORAGE_BITS; }
+
+            void validate()
+                {
+                    FieldCodecBase::require(max_repeat() < (1 << REPEAT_STORAGE_BITS), "(dccl.field).max_repeat too large");
+                }
+        };
+
     }
 }
 
@@ -181,6 +243,8 @@ int main(int argc, char* argv[])
     dccl::Codec codec;
     dccl::FieldCodecManager::add<dccl::test::CustomCodec>("custom_codec");
     dccl::FieldCodecManager::add<dccl::test::Int32RepeatedCodec>("int32_test_codec");
+    dccl::FieldCodecManager::add<dccl::test::CustomMsgRepeatedCodec>("custom_msg_repeated_codec");
+    dccl::FieldCodecManager::add<dccl::test::UpperCaseStringCodec, google::protobuf::FieldDescriptor::TYPE_STRING>("upper_case_string_codec");
     
     codec.set_crypto_passphrase("my_passphrase!");
 
@@ -207,6 +271,7 @@ int main(int argc, char* argv[])
     msg_in2.mutable_msg()->CopyFrom(msg_in1);
     msg_in2.add_c(30);
     msg_in2.add_c(2);
+    msg_in2.set_s("abc");
 
     codec.info(msg_in2.GetDescriptor(), &std::cout);    
     std::cout << "Message in:\n" << msg_in2.DebugString() << std::endl;
@@ -218,7 +283,21 @@ int main(int argc, char* argv[])
     std::cout << "Try decode..." << std::endl;
     codec.decode(bytes2, &msg_out2);
     std::cout << "... got Message out:\n" << msg_out2.DebugString() << std::endl;
+    assert(msg_out2.s() == "ABC");
+    msg_out2.set_s(msg_in2.s());
     assert(msg_in2.SerializeAsString() == msg_out2.SerializeAsString());
+
+    // repeated messages with a custom repeated codec: the DCCL3 size prefix cannot be peeked, so the decoder must not rely on it
+    CustomMsg3 msg_in3, msg_out3;
+    msg_in3.add_msg()->set_a(5);
+    msg_in3.add_msg()->set_a(200);
+
+    codec.load(msg_in3.GetDescriptor());
+    std::string bytes3;
+    codec.encode(&bytes3, msg_in3);
+    codec.decode(bytes3, &msg_out3);
+    std::cout << "... got Message out:\n" << msg_out3.DebugString() << std::endl;
+    assert(msg_in3.SerializeAsString() == msg_out3.SerializeAsString());
     
     std::cout << "all tests passed" << std::endl;
 }
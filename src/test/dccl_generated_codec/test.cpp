@@ -0,0 +1,265 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests that the encoder/decoder written by protoc-gen-dccl (with the dccl_codecs parameter) produces the same bytes as the reflection based codecs
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "dccl/codec.h"
+#include "dccl/generated_codec.h"
+#include "dccl/codecs2/field_codec_default.h"
+#include "dccl/codecs3/field_codec_default.h"
+#include "gen_codec_plugin.h"
+#include "test.pb.h"
+
+using namespace dccl::test;
+using dccl::Bitset;
+
+// the code protoc-gen-dccl inserts into the class_scope of GeneratedMsg (checked against the generator below)
+struct GeneratedMsgCodec
+{
+#include "expected_class_scope.inc"
+};
+
+// counts the calls that Codec makes to the generated functions (registered with GeneratedCodecs::add<>())
+struct CountingGeneratedMsgCodec : public GeneratedMsgCodec
+{
+    static size_t dccl_encode(const GeneratedMsg& msg, char* dccl_bytes, size_t dccl_max_len)
+    {
+        ++encodes;
+        return GeneratedMsgCodec::dccl_encode(msg, dccl_bytes, dccl_max_len);
+    }
+    static size_t dccl_decode(const char* dccl_bytes, size_t dccl_len, GeneratedMsg* msg)
+    {
+        ++decodes;
+        return GeneratedMsgCodec::dccl_decode(dccl_bytes, dccl_len, msg);
+    }
+    static int encodes;
+    static int decodes;
+};
+int CountingGeneratedMsgCodec::encodes = 0;
+int CountingGeneratedMsgCodec::decodes = 0;
+
+// encodes all 32 bits of uint32 fields, so that using the generated codec after "dccl.default3" is replaced would be seen
+class FullWidthUInt32Codec : public dccl::TypedFixedFieldCodec<dccl::uint32>
+{
+    unsigned size() { return 33; }
+    Bitset encode() { return Bitset(size()); }
+    Bitset encode(const dccl::uint32& wire_value)
+    { return Bitset(size(), (static_cast<unsigned long>(wire_value) << 1) | 1); }
+    dccl::uint32 decode(Bitset* bits)
+    {
+        unsigned long value = bits->to_ulong();
+        if(!(value & 1))
+            throw(dccl::NullValueException());
+        return value >> 1;
+    }
+    void validate() { }
+};
+
+std::string read_file(const std::string& path)
+{
+    std::ifstream fin(path.c_str());
+    assert(fin.is_open());
+    std::stringstream ss;
+    ss << fin.rdbuf();
+    return ss.str();
+}
+
+void check(dccl::Codec& codec, const GeneratedMsg& msg)
+{
+    std::cout << msg.ShortDebugString() << std::endl;
+    
+    codec.set_use_generated_codecs(false);
+    const int encodes = CountingGeneratedMsgCodec::encodes;
+    std::string reflection_bytes;
+    codec.encode(&reflection_bytes, msg);
+    GeneratedMsg reflection_msg;
+    codec.decode(reflection_bytes, &reflection_msg);
+    assert(CountingGeneratedMsgCodec::encodes == encodes);
+
+    codec.set_use_generated_codecs(true);
+    std::string generated_bytes;
+    codec.encode(&generated_bytes, msg);
+    assert(CountingGeneratedMsgCodec::encodes == encodes + 1);
+    assert(generated_bytes == reflection_bytes);
+    assert(generated_bytes.size() == GeneratedMsgCodec::DCCL_GENERATED_SIZE);
+
+    char buffer[32];
+    size_t buffer_size = codec.encode(buffer, sizeof(buffer), msg);
+    assert(buffer_size == GeneratedMsgCodec::DCCL_GENERATED_SIZE);
+    assert(std::string(buffer, GeneratedMsgCodec::DCCL_GENERATED_SIZE) == reflection_bytes);
+    
+    GeneratedMsg generated_msg;
+    codec.decode(generated_bytes, &generated_msg);
+    assert(generated_msg.SerializeAsString() == reflection_msg.SerializeAsString());
+
+    std::string stream = generated_bytes + reflection_bytes;
+    GeneratedMsg stream_msg;
+    codec.decode(&stream, &stream_msg);
+    assert(stream.size() == reflection_bytes.size());
+    assert(stream_msg.SerializeAsString() == reflection_msg.SerializeAsString());
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::ALL, &std::cerr);
+
+    // run the generator used by protoc-gen-dccl on GeneratedMsg, and check that it writes the code compiled above
+    assert(argc == 2);
+    const std::string source_dir = argv[1];
+    std::stringstream class_scope, namespace_scope;
+    bool generated = dccl::gen::construct_codec_plugin(GeneratedMsg::descriptor(), class_scope, namespace_scope);
+    assert(generated);
+    if(class_scope.str() != read_file(source_dir + "/expected_class_scope.inc") ||
+       namespace_scope.str() != read_file(source_dir + "/expected_namespace_scope.inc"))
+    {
+        std::cout << "Generated code does not match expected:\n" << class_scope.str() << namespace_scope.str() << std::endl;
+        assert(false);
+    }
+    
+    dccl::GeneratedCodecs::add<CountingGeneratedMsgCodec>();
+    
+    dccl::Codec codec;
+    codec.load<GeneratedMsg>();
+    assert(codec.size(GeneratedMsg()) == GeneratedMsgCodec::DCCL_GENERATED_SIZE);
+    
+    GeneratedMsg msg;
+    msg.set_vehicle(12);
+    msg.set_depth(1234.56);
+    msg.set_mode(RETURN);
+    msg.set_active(true);
+    check(codec, msg);
+
+    msg.set_heading(359.7);
+    msg.set_count(-100);
+    msg.set_battery(100);
+    msg.set_last_mode(SURVEY);
+    msg.set_fault(false);
+    msg.set_speed(-1.234);
+    msg.set_delete_(6);
+    check(codec, msg);
+
+    // out of bounds values are sent as not set
+    msg.set_heading(400);
+    msg.set_count(100001);
+    msg.set_speed(2.01);
+    check(codec, msg);
+
+    srand(1);
+    for(int i = 0; i < 1000; ++i)
+    {
+        GeneratedMsg random_msg;
+        random_msg.set_vehicle(rand() % 31);
+        random_msg.set_depth((rand() % 60001) / 10.0);
+        if(rand() % 2) random_msg.set_heading(rand() % 361);
+        if(rand() % 2) random_msg.set_count(rand() % 100101 - 100);
+        if(rand() % 2) random_msg.set_battery(rand() % 101);
+        random_msg.set_mode(static_cast<Mode>(rand() % 2 ? IDLE : SURVEY));
+        if(rand() % 2) random_msg.set_last_mode(RETURN);
+        random_msg.set_active(rand() % 2);
+        if(rand() % 2) random_msg.set_fault(rand() % 2);
+        if(rand() % 2) random_msg.set_speed((rand() % 401 - 200) / 100.0);
+        if(rand() % 2) random_msg.set_delete_(rand() % 7);
+        check(codec, random_msg);
+    }
+
+    // uninitialized messages fall back to reflection, which reports the error
+    try
+    {
+        std::string bytes;
+        codec.encode(&bytes, GeneratedMsg());
+        assert(false);
+    }
+    catch(dccl::Exception& e)
+    {
+        std::cout << "Caught (as expected): " << e.what() << std::endl;
+    }
+
+    // truncated messages are reported by the generated decoder
+    try
+    {
+        std::string bytes;
+        codec.encode(&bytes, msg);
+        GeneratedMsg msg_out;
+        codec.decode(bytes.substr(0, bytes.size() - 1), &msg_out);
+        assert(false);
+    }
+    catch(dccl::Exception& e)
+    {
+        std::cout << "Caught (as expected): " << e.what() << std::endl;
+    }
+    
+    // messages loaded from a schema image use the generated codec too
+    {
+        const std::string image_path = "dccl_test_generated_codec_image.bin";
+        codec.write_schema_image(image_path);
+
+        dccl::Codec cached_codec;
+        unsigned trusted = cached_codec.load_schema_image(image_path);
+        assert(trusted == 1);
+        
+        const int encodes = CountingGeneratedMsgCodec::encodes, decodes = CountingGeneratedMsgCodec::decodes;
+        std::string bytes;
+        cached_codec.encode(&bytes, msg);
+        assert(CountingGeneratedMsgCodec::encodes == encodes + 1);
+        GeneratedMsg msg_out;
+        cached_codec.decode(bytes, &msg_out);
+        assert(CountingGeneratedMsgCodec::decodes == decodes + 1);
+
+        codec.set_use_generated_codecs(false);
+        std::string reflection_bytes;
+        codec.encode(&reflection_bytes, msg);
+        GeneratedMsg reflection_msg;
+        codec.decode(reflection_bytes, &reflection_msg);
+        codec.set_use_generated_codecs(true);
+        assert(bytes == reflection_bytes);
+        assert(msg_out.SerializeAsString() == reflection_msg.SerializeAsString());
+    }
+    
+    // the generated codec is not used once the codec it assumes for a field is replaced
+    {
+        dccl::FieldCodecManager::remove<dccl::v3::BuiltinNumericFieldCodec<dccl::uint32> >("dccl.default3");
+        dccl::FieldCodecManager::add<FullWidthUInt32Codec>("dccl.default3");
+
+        dccl::Codec replaced_codec;
+        replaced_codec.load<GeneratedMsg>();
+        assert(replaced_codec.size(msg) > GeneratedMsgCodec::DCCL_GENERATED_SIZE);
+
+        const int encodes = CountingGeneratedMsgCodec::encodes;
+        std::string bytes;
+        replaced_codec.encode(&bytes, msg);
+        assert(CountingGeneratedMsgCodec::encodes == encodes);
+        assert(bytes.size() == replaced_codec.size(msg));
+
+        GeneratedMsg msg_out;
+        replaced_codec.decode(bytes, &msg_out);
+        assert(msg_out.battery() == msg.battery());
+        assert(msg_out.delete_() == msg.delete_());
+        
+        dccl::FieldCodecManager::remove<FullWidthUInt32Codec>("dccl.default3");
+        dccl::FieldCodecManager::add<dccl::v3::BuiltinNumericFieldCodec<dccl::uint32> >("dccl.default3");
+    }
+    
+    std::cout << "all tests passed" << std::endl;
+}
@@ -0,0 +1,129 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests reuse of decoded messages through dccl::MessagePool
+
+#include "dccl/codec.h"
+#include "dccl/stream_decoder.h"
+#include "test.pb.h"
+
+using namespace dccl::test;
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::ALL, &std::cerr);
+
+    dccl::Codec codec;
+    codec.load<NavMsg>();
+    codec.load<TextMsg>();
+
+    NavMsg nav;
+    nav.set_x(100.1);
+    nav.set_y(-200.2);
+    for(int i = 0; i < 5; ++i)
+        nav.add_depth(i*100);
+
+    TextMsg text;
+    text.set_text("the quick brown fox");
+
+    std::string nav_bytes, text_bytes;
+    codec.encode(&nav_bytes, nav);
+    codec.encode(&text_bytes, text);
+
+    // messages are reused once released
+    {
+        dccl::MessagePool pool;
+        const google::protobuf::Message* first = 0;
+        {
+            boost::shared_ptr<google::protobuf::Message> msg = codec.decode_from_pool(nav_bytes, &pool);
+            assert(msg->SerializeAsString() == nav.SerializeAsString());
+            assert(pool.num_free(NavMsg::descriptor()) == 0);
+            first = msg.get();
+        }
+        assert(pool.num_free(NavMsg::descriptor()) == 1);
+
+        // mixed types
+        size_t consumed = 0;
+        boost::shared_ptr<google::protobuf::Message> text_out = codec.decode_from_pool(text_bytes, &pool, false, &consumed);
+        assert(consumed == text_bytes.size());
+        assert(text_out->SerializeAsString() == text.SerializeAsString());
+        assert(pool.num_free(NavMsg::descriptor()) == 1);
+
+        // released messages are cleared
+        NavMsg short_nav = nav;
+        short_nav.clear_depth();
+        std::string bytes;
+        codec.encode(&bytes, short_nav);
+        boost::shared_ptr<google::protobuf::Message> msg = codec.decode_from_pool(bytes, &pool);
+        assert(msg.get() == first);
+        assert(msg->SerializeAsString() == short_nav.SerializeAsString());
+
+        // pool destroyed before its messages
+        {
+            dccl::MessagePool short_pool;
+            msg = short_pool.get(NavMsg::descriptor());
+        }
+        msg.reset();
+
+        pool.clear();
+        assert(pool.num_free(NavMsg::descriptor()) == 0);
+    }
+
+    // a pool is required
+    {
+        bool caught = false;
+        try
+        { codec.decode_from_pool(nav_bytes, 0); }
+        catch(dccl::Exception& e)
+        { caught = true; }
+        assert(caught);
+    }
+    
+    // at most max_free_per_type are kept
+    {
+        dccl::MessagePool pool(2);
+        {
+            std::vector<boost::shared_ptr<google::protobuf::Message> > msgs;
+            for(int i = 0; i < 4; ++i)
+                msgs.push_back(pool.get(TextMsg::descriptor()));
+        }
+        assert(pool.num_free(TextMsg::descriptor()) == 2);
+    }
+
+    // streaming decode
+    {
+        dccl::MessagePool pool;
+        dccl::StreamDecoder decoder(&codec, &pool);
+        for(int i = 0; i < 10; ++i)
+        {
+            decoder.push(nav_bytes + text_bytes);
+            assert(decoder.size() == 2);
+            boost::shared_ptr<google::protobuf::Message> nav_out = decoder.pop();
+            assert(nav_out->SerializeAsString() == nav.SerializeAsString());
+            boost::shared_ptr<google::protobuf::Message> text_out = decoder.pop();
+            assert(text_out->SerializeAsString() == text.SerializeAsString());
+        }
+        assert(pool.num_free(NavMsg::descriptor()) == 1);
+        assert(pool.num_free(TextMsg::descriptor()) == 1);
+    }
+    
+    std::cout << "all tests passed" << std::endl;
+}
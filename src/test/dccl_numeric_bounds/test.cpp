@@ -22,11 +22,26 @@
 // tests bounds on DefaultNumericFieldCodec
 
 #include "dccl/codec.h"
+#include "dccl/codecs3/field_codec_default.h"
 #include "test.pb.h"
 using namespace dccl::test;
 
 using dccl::operator<<;
 
+// counts the calls to precision(), made each time the quantization constants are computed
+class CountingNumericCodec : public dccl::v3::DefaultNumericFieldCodec<double>
+{
+  public:
+    static int computed;
+  private:
+    double precision()
+    {
+        ++computed;
+        return dccl::v3::DefaultNumericFieldCodec<double>::precision();
+    }
+};
+int CountingNumericCodec::computed = 0;
+
 int main(int argc, char* argv[])
 {
     dccl::dlog.connect(dccl::logger::ALL, &std::cerr);
@@ -93,6 +108,30 @@ int main(int argc, char* argv[])
         assert(msg_out_neg.b() == test_values[i][3]);
     }    
     
+    // the quantization constants are computed when the message is loaded, not on each encode, decode or size call
+    {
+        dccl::FieldCodecManager::add<CountingNumericCodec>("test.counting");
+        codec.load<CountedNumericMsg>();
+        const int computed = CountingNumericCodec::computed;
+        assert(computed > 0);
+
+        CountedNumericMsg counted_in;
+        counted_in.set_a(-1.25);
+        counted_in.add_b(12.5);
+        counted_in.add_b(99.9);
+        for(int i = 0; i < 10; ++i)
+        {
+            std::string enc;
+            codec.encode(&enc, counted_in);
+            CountedNumericMsg counted_out;
+            codec.decode(enc, &counted_out);
+            assert(counted_in.SerializeAsString() == counted_out.SerializeAsString());
+            unsigned size = codec.size(counted_in);
+            assert(size == enc.size());
+        }
+        assert(CountingNumericCodec::computed == computed);
+    }
+    
     std::cout << "all tests passed" << std::endl;
 }
 
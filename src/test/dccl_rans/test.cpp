@@ -0,0 +1,206 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests the rANS codec (dccl.rans) using arithmetic coder models
+
+#include <dlfcn.h>
+#include <cstdlib>
+
+#include "dccl/codec.h"
+#include "dccl/arithmetic/field_codec_rans.h"
+
+#include "test.pb.h"
+
+#include "dccl/binary.h"
+using namespace dccl::test;
+
+dccl::Codec codec;
+
+void check(const google::protobuf::Message& msg_in, const google::protobuf::Message& msg_expected)
+{
+    codec.load(msg_in.GetDescriptor());
+
+    unsigned size = codec.size(msg_in);
+    std::string bytes;
+    codec.encode(&bytes, msg_in);
+    assert(bytes.size() == size);
+    assert(bytes.size() <= codec.max_size(msg_in.GetDescriptor()));
+    
+    boost::shared_ptr<google::protobuf::Message> msg_out(msg_in.New());
+    codec.decode(bytes, msg_out.get());
+    
+    if(msg_expected.SerializeAsString() != msg_out->SerializeAsString())
+    {
+        std::cout << "Message in:\n" << msg_in.DebugString()
+                  << "Expected:\n" << msg_expected.DebugString()
+                  << "Got:\n" << msg_out->DebugString() << std::endl;
+        assert(false);
+    }
+}
+
+void check(const google::protobuf::Message& msg_in)
+{
+    check(msg_in, msg_in);
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::WARN_PLUS, &std::cerr);
+    
+    void* dl_handle = dlopen(DCCL_ARITHMETIC_NAME, RTLD_LAZY);
+    if(!dl_handle)
+    {
+        std::cerr << "Failed to open " << DCCL_ARITHMETIC_NAME << std::endl;
+        exit(1);
+    }
+    codec.load_library(dl_handle);
+
+    // enumerations, single and repeated
+    {
+        dccl::arith::protobuf::ArithmeticModel model;
+        model.set_name("enum_model");
+        model.set_eof_frequency(2);
+        model.add_frequency(10);
+        model.add_frequency(3);
+        model.add_frequency(1);
+        model.add_value_bound(1);
+        model.add_value_bound(2);
+        model.add_value_bound(3);
+        model.add_value_bound(4);
+        dccl::arith::ModelManager::set_model(model);
+
+        for(int n = 0; n <= 4; ++n)
+        {
+            for(int v = RANS_A; v <= RANS_C; ++v)
+            {
+                RansEnumTestMsg msg_in;
+                msg_in.set_single(static_cast<RansEnum>(v));
+                for(int i = 0; i < n; ++i)
+                    msg_in.add_value(static_cast<RansEnum>((v + i) % 3 + 1));
+                check(msg_in);
+            }
+        }
+    }
+
+    // random models, compared with the arithmetic coder
+    srand(1);
+    unsigned rans_bytes = 0, arithmetic_bytes = 0;
+    for(int test = 0; test < 100; ++test)
+    {
+        dccl::arith::protobuf::ArithmeticModel model;
+        model.set_name("model");
+        
+        int symbols = rand() % 300 + 1;
+        int each_max_freq = (test % 2) ? 10 : 10000;
+        model.set_eof_frequency(rand() % each_max_freq + 1);
+        model.set_out_of_range_frequency(0);
+        model.add_value_bound(-(rand() % 1000));
+        for(int j = 0; j < symbols; ++j)
+        {
+            model.add_frequency(rand() % each_max_freq + 1);
+            model.add_value_bound(model.value_bound(j) + rand() % 100 + 1);
+        }
+        dccl::arith::ModelManager::set_model(model);
+
+        // values drawn from the model, so the sizes are comparable to its entropy
+        int total = 0;
+        for(int j = 0; j < symbols; ++j)
+            total += model.frequency(j);
+        
+        RansDoubleTestMsg msg_in;
+        RansArithmeticTestMsg arith_msg_in;
+        for(int i = 0, n = rand() % 101; i < n; ++i)
+        {
+            int f = rand() % total, j = 0;
+            for(; f >= static_cast<int>(model.frequency(j)); ++j)
+                f -= model.frequency(j);
+            msg_in.add_value(model.value_bound(j));
+            arith_msg_in.add_value(model.value_bound(j));
+        }
+        msg_in.set_after(test);
+        arith_msg_in.set_after(test);
+        check(msg_in);
+
+        codec.load(arith_msg_in.GetDescriptor());
+        rans_bytes += codec.size(msg_in);
+        arithmetic_bytes += codec.size(arith_msg_in);
+    }
+    std::cout << "rANS: " << rans_bytes << " bytes, arithmetic: " << arithmetic_bytes << " bytes" << std::endl;
+    // the flushed state costs a byte or two per field, so the totals should be close
+    assert(rans_bytes < arithmetic_bytes * 1.1);
+    
+    // out of range values (with no frequency) end the field, and no EOF frequency fills the field with the most probable symbol
+    {
+        dccl::arith::protobuf::ArithmeticModel model;
+        model.set_name("model");
+        model.set_eof_frequency(1);
+        model.set_out_of_range_frequency(0);
+        model.add_frequency(1);
+        model.add_frequency(2);
+        model.add_value_bound(0);
+        model.add_value_bound(1);
+        model.add_value_bound(2);
+        dccl::arith::ModelManager::set_model(model);
+
+        RansDoubleTestMsg msg_in, msg_expected;
+        msg_in.add_value(1);
+        msg_in.add_value(5);
+        msg_in.add_value(0);
+        msg_in.set_after(10);
+        msg_expected.add_value(1);
+        msg_expected.set_after(10);
+        check(msg_in, msg_expected);
+
+        model.set_eof_frequency(0);
+        dccl::arith::ModelManager::set_model(model);
+        msg_in.clear_value();
+        msg_in.add_value(0);
+        msg_expected.clear_value();
+        msg_expected.add_value(0);
+        for(int i = 1; i < 100; ++i)
+            msg_expected.add_value(1);
+        check(msg_in, msg_expected);
+    }
+
+    // adaptive models are rejected
+    {
+        dccl::arith::protobuf::ArithmeticModel model;
+        model.set_name("adaptive_model");
+        model.add_frequency(1);
+        model.add_value_bound(0);
+        model.add_value_bound(1);
+        model.set_is_adaptive(true);
+        dccl::arith::ModelManager::set_model(model);
+
+        bool threw = false;
+        try
+        {
+            codec.load<RansAdaptiveTestMsg>();
+        }
+        catch(dccl::Exception& e)
+        {
+            threw = true;
+        }
+        assert(threw);
+    }
+    
+    std::cout << "all tests passed" << std::endl;
+}
@@ -119,6 +119,49 @@ int main(int argc, char* argv[])
     }
 
 
+    // bytes consumed reported by decode
+    {
+        std::string bytes2 = bytes1;
+        size_t offset = 0;
+        for(std::list<const google::protobuf::Message*>::const_iterator it = msgs.begin(),
+                end = msgs.end(); it != end; ++it)
+        {
+            size_t consumed = 0;
+            boost::shared_ptr<google::protobuf::Message> msg_const =
+                codec.decode<boost::shared_ptr<google::protobuf::Message> >(bytes1.substr(offset), false, &consumed);
+            assert(consumed == codec.size(**it));
+            assert((*it)->SerializeAsString() == msg_const->SerializeAsString());
+            offset += consumed;
+
+            boost::shared_ptr<google::protobuf::Message> msg_out =
+                dccl::DynamicProtobufManager::new_protobuf_message((*it)->GetDescriptor());
+            size_t stripped = codec.decode(&bytes2, msg_out.get());
+            assert(stripped == consumed);
+            assert((*it)->SerializeAsString() == msg_out->SerializeAsString());
+        }
+        // only the trailing padding remains
+        assert(bytes2 == std::string(4, '\0'));
+        assert(offset + bytes2.size() == bytes1.size());
+    }
+
+#if DCCL_HAS_PROTOBUF_ARENA
+    // decoded onto an Arena
+    {
+        google::protobuf::Arena arena;
+        std::string bytes2 = bytes1;
+        for(std::list<const google::protobuf::Message*>::const_iterator it = msgs.begin(),
+                end = msgs.end(); it != end; ++it)
+        {
+            size_t consumed = 0;
+            google::protobuf::Message* msg_out = codec.decode_to_arena(&bytes2, &arena, &consumed);
+            assert(msg_out->GetArena() == &arena);
+            assert(consumed == codec.size(**it));
+            assert((*it)->SerializeAsString() == msg_out->SerializeAsString());
+        }
+        assert(bytes2 == std::string(4, '\0'));
+    }
+#endif
+    
     // destructive
     {
         std::list< boost::shared_ptr<google::protobuf::Message> > msgs_out;
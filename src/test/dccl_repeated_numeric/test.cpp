@@ -0,0 +1,124 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests that the array encode/decode of repeated numeric fields gives the same bits as the per-value path
+
+#include <cstdlib>
+
+#include "dccl/codec.h"
+#include "dccl/codecs2/field_codec_default.h"
+#include "test.pb.h"
+
+using namespace dccl::test;
+
+// not DCCL_FINAL, so each value is quantized and packed in turn
+template<typename T>
+class ReferenceNumericCodec : public dccl::v2::DefaultNumericFieldCodec<T>
+{ };
+
+double rand_value(double min, double max)
+{ return min + (max - min) * (std::rand() / static_cast<double>(RAND_MAX)); }
+
+template<typename Msg>
+void fill(Msg* msg, int n)
+{
+    // values extend beyond the bounds so that out-of-range (zero) values are tested
+    for(int i = 0; i < n; ++i)
+    {
+        msg->add_d(rand_value(-110, 110));
+        if(i < 5) msg->add_f(rand_value(-11, 11));
+        if(i < 8) msg->add_i32(static_cast<dccl::int32>(rand_value(-1100, 1100)));
+        if(i < 4) msg->add_i64(static_cast<dccl::int64>(rand_value(-1.1e9, 1.1e9)));
+        if(i < 6) msg->add_u32(static_cast<dccl::uint32>(rand_value(0, 550)));
+        if(i < 3) msg->add_u64(static_cast<dccl::uint64>(rand_value(0, 1.1e12)));
+    }
+}
+
+template<typename Msg, typename ReferenceMsg>
+void check(dccl::Codec& codec, dccl::Codec& reference_codec)
+{
+    for(int n = 0; n <= 10; ++n)
+    {
+        std::srand(n);
+        Msg msg_in;
+        fill(&msg_in, n);
+        std::srand(n);
+        ReferenceMsg reference_in;
+        fill(&reference_in, n);
+
+        std::string bytes, reference_bytes;
+        codec.encode(&bytes, msg_in);
+        reference_codec.encode(&reference_bytes, reference_in);
+        std::cout << "Message " << n << " (hex): " << dccl::hex_encode(bytes) << std::endl;
+        assert(bytes == reference_bytes);
+        assert(codec.size(msg_in) == reference_codec.size(reference_in));
+        
+        Msg msg_out;
+        ReferenceMsg reference_out;
+        codec.decode(bytes, &msg_out);
+        reference_codec.decode(reference_bytes, &reference_out);
+        std::cout << msg_out.ShortDebugString() << std::endl;
+        assert(msg_out.SerializeAsString() == reference_out.SerializeAsString());
+    }
+
+    // in range values round trip 
+    Msg msg_in;
+    msg_in.add_d(-12.345);
+    msg_in.add_d(99.999);
+    msg_in.add_f(1.25);
+    msg_in.add_i32(-990);
+    msg_in.add_i64(123456789);
+    msg_in.add_u32(500);
+    msg_in.add_u64(999999999000ull);
+    std::string bytes;
+    codec.encode(&bytes, msg_in);
+    Msg msg_out;
+    codec.decode(bytes, &msg_out);
+    assert(msg_in.SerializeAsString() == msg_out.SerializeAsString());
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::ALL, &std::cerr);
+
+    dccl::FieldCodecManager::add<ReferenceNumericCodec<double> >("reference");
+    dccl::FieldCodecManager::add<ReferenceNumericCodec<float> >("reference");
+    dccl::FieldCodecManager::add<ReferenceNumericCodec<dccl::int32> >("reference");
+    dccl::FieldCodecManager::add<ReferenceNumericCodec<dccl::int64> >("reference");
+    dccl::FieldCodecManager::add<ReferenceNumericCodec<dccl::uint32> >("reference");
+    dccl::FieldCodecManager::add<ReferenceNumericCodec<dccl::uint64> >("reference");
+
+    {
+        dccl::Codec codec, reference_codec;
+        codec.load<NumericV3>();
+        reference_codec.load<ReferenceV3>();
+        check<NumericV3, ReferenceV3>(codec, reference_codec);
+    }
+
+    {
+        dccl::Codec codec, reference_codec;
+        codec.load<NumericV2>();
+        reference_codec.load<ReferenceV2>();
+        check<NumericV2, ReferenceV2>(codec, reference_codec);
+    }
+
+    std::cout << "all tests passed" << std::endl;
+}
@@ -0,0 +1,186 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests writing and loading the compiled schema image
+
+#include <fstream>
+#include <cstdio>
+
+#include "dccl/codec.h"
+#include "dccl/binary.h"
+#include "dccl/internal/schema_image.h"
+
+#include "test.pb.h"
+using namespace dccl::test;
+
+using dccl::operator<<;
+
+void round_trip(dccl::Codec& encoder, dccl::Codec& decoder, const google::protobuf::Message& msg_in)
+{
+    std::string bytes;
+    encoder.encode(&bytes, msg_in);
+    std::cout << "... got bytes (hex): " << dccl::hex_encode(bytes) << std::endl;
+
+    boost::shared_ptr<google::protobuf::Message> msg_out = decoder.decode<boost::shared_ptr<google::protobuf::Message> >(bytes);
+    std::cout << "... got Message out:\n" << msg_out->DebugString() << std::endl;
+    assert(msg_in.SerializeAsString() == msg_out->SerializeAsString());
+}
+
+std::string read_file(const std::string& path)
+{
+    std::ifstream fin(path.c_str(), std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+}
+
+void write_file(const std::string& path, const std::string& contents)
+{
+    std::ofstream fout(path.c_str(), std::ios::binary | std::ios::trunc);
+    fout << contents;
+}
+
+dccl::internal::SchemaImageMessage* image_messages(std::string* image)
+{ return reinterpret_cast<dccl::internal::SchemaImageMessage*>(&(*image)[sizeof(dccl::internal::SchemaImageHeader)]); }
+
+dccl::internal::SchemaImageField* image_fields(std::string* image)
+{
+    const dccl::internal::SchemaImageHeader* header = reinterpret_cast<const dccl::internal::SchemaImageHeader*>(image->data());
+    return reinterpret_cast<dccl::internal::SchemaImageField*>(image_messages(image) + header->num_messages);
+}
+
+// loads a modified image, and returns the number of messages loaded without revalidation
+unsigned load_modified(const std::string& image_path, const std::string& image)
+{
+    write_file(image_path, image);
+    dccl::Codec cached_codec;
+    unsigned num_trusted = cached_codec.load_schema_image(image_path);
+    assert(cached_codec.loaded().size() == 2);
+    return num_trusted;
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::ALL, &std::cerr);
+
+    const std::string image_path = "dccl_test_schema_image.bin";
+
+    SchemaMsg1 msg_in1;
+    msg_in1.set_vehicle(12);
+    msg_in1.mutable_pos()->set_lat(42.35812);
+    msg_in1.mutable_pos()->set_lon(-71.08766);
+    msg_in1.add_depth(5);
+    msg_in1.add_depth(750);
+
+    SchemaMsg2 msg_in2;
+    msg_in2.set_name("unicorn");
+    msg_in2.set_data("\x01\x02");
+    
+    dccl::Codec codec;
+    codec.load<SchemaMsg1>();
+    codec.load<SchemaMsg2>();
+    codec.write_schema_image(image_path);
+    // written to a temporary file and renamed over image_path
+    assert(!std::ifstream((image_path + ".tmp").c_str()).is_open());
+
+    // fingerprints match, so everything is loaded without revalidation
+    {
+        dccl::Codec cached_codec;
+        unsigned trusted = cached_codec.load_schema_image(image_path);
+        assert(trusted == 2);
+        assert(cached_codec.loaded().size() == 2);
+        assert(cached_codec.max_size<SchemaMsg1>() == codec.max_size<SchemaMsg1>());
+
+        round_trip(codec, cached_codec, msg_in1);
+        round_trip(cached_codec, codec, msg_in2);
+    }
+
+    std::string image = read_file(image_path);
+
+    // the fields of SchemaMsg1 (id 10, so the first message) are stored depth first: vehicle, pos, pos.lat, pos.lon, depth
+    {
+        std::string copy = image;
+        dccl::internal::SchemaImageMessage* messages = image_messages(&copy);
+        dccl::internal::SchemaImageField* fields = image_fields(&copy);
+        assert(messages[0].num_fields == 5);
+        assert(fields[1].number == 2 && fields[1].num_nested == 2);
+        assert(fields[2].number == 1 && fields[2].min == -90);
+
+        // header size as used by load(): the one byte identifier for id 10, plus the 5 bit vehicle field
+        assert(messages[0].head_max_bits == 8 + 5);
+    }
+
+    // a different codec for a field of an embedded message
+    {
+        std::string stale_image = image;
+        image_fields(&stale_image)[2].codec = image_messages(&stale_image)[0].name;
+        unsigned trusted = load_modified(image_path, stale_image);
+        assert(trusted == 1);
+    }
+
+    // different bounds
+    {
+        std::string stale_image = image;
+        image_fields(&stale_image)[2].min = -45;
+        unsigned trusted = load_modified(image_path, stale_image);
+        assert(trusted == 1);
+    }
+
+    // stored sizes that no longer fit max_bytes
+    {
+        std::string stale_image = image;
+        image_messages(&stale_image)[1].body_max_bits = 8*64;
+        unsigned trusted = load_modified(image_path, stale_image);
+        assert(trusted == 1);
+    }
+    
+    // stale fingerprint: message is still loaded, but by revalidating it
+    {
+        std::string stale_image = image;
+        const size_t fingerprint_offset = 32; // first message record, immediately following the header
+        stale_image[fingerprint_offset] ^= 0xFF;
+        write_file(image_path, stale_image);
+        
+        dccl::Codec cached_codec;
+        unsigned trusted = cached_codec.load_schema_image(image_path);
+        assert(trusted == 1);
+        assert(cached_codec.loaded().size() == 2);
+        round_trip(codec, cached_codec, msg_in1);
+    }
+
+    // corrupt images are rejected
+    {
+        write_file(image_path, image.substr(0, image.size() - 1));
+        dccl::Codec cached_codec;
+        try
+        {
+            cached_codec.load_schema_image(image_path);
+            assert(false);
+        }
+        catch(dccl::Exception& e)
+        {
+            std::cout << "Caught (as expected): " << e.what() << std::endl;
+        }
+        assert(cached_codec.loaded().empty());
+    }
+
+    std::remove(image_path.c_str());
+    
+    std::cout << "all tests passed" << std::endl;
+}
@@ -0,0 +1,174 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests incremental decoding of chunked input with StreamDecoder
+
+#include "dccl/codec.h"
+#include "dccl/stream_decoder.h"
+#include "dccl/binary.h"
+
+#include "test.pb.h"
+using namespace dccl::test;
+
+using dccl::operator<<;
+
+std::vector<boost::shared_ptr<google::protobuf::Message> > decode_in_chunks(dccl::Codec& codec, const std::string& bytes, size_t chunk_size)
+{
+    std::cout << "Decoding in chunks of " << chunk_size << " byte(s)" << std::endl;
+    dccl::StreamDecoder decoder(&codec);
+    std::vector<boost::shared_ptr<google::protobuf::Message> > msgs_out;
+    for(size_t i = 0; i < bytes.size(); i += chunk_size)
+    {
+        decoder.push(bytes.substr(i, chunk_size));
+        while(!decoder.empty())
+            msgs_out.push_back(decoder.pop());
+    }
+    decoder.flush();
+    while(!decoder.empty())
+        msgs_out.push_back(decoder.pop());
+    assert(decoder.buffered_bytes() == 0);
+    return msgs_out;
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::ALL, &std::cerr);
+
+    dccl::Codec codec;
+    codec.load<StreamMsg1>();
+    codec.load<StreamMsg2>();
+    codec.load<StreamMsg3>();
+    
+    StreamMsg1 msg_in1;
+    msg_in1.set_int32_val(7);
+    msg_in1.add_depth(10.5);
+    msg_in1.add_depth(5999.9);
+    
+    StreamMsg2 msg_in2;
+    msg_in2.set_string_val("hi");
+    msg_in2.set_bytes_val("\x01\x02\x03");
+
+    StreamMsg2 msg_in3;
+    
+    StreamMsg3 msg_in4;
+    
+    std::vector<const google::protobuf::Message*> msgs_in;
+    msgs_in.push_back(&msg_in1);
+    msgs_in.push_back(&msg_in2);
+    msgs_in.push_back(&msg_in3);
+    msgs_in.push_back(&msg_in1);
+    msgs_in.push_back(&msg_in4);
+    
+    std::string bytes;
+    for(std::vector<const google::protobuf::Message*>::const_iterator it = msgs_in.begin(), end = msgs_in.end(); it != end; ++it)
+        codec.encode(&bytes, **it);
+
+    std::cout << "Encoded stream (hex): " << dccl::hex_encode(bytes) << std::endl;
+    
+    const size_t chunk_sizes[] = { 1, 2, 3, 7, bytes.size() };
+    for(unsigned c = 0; c < sizeof(chunk_sizes) / sizeof(size_t); ++c)
+    {
+        std::vector<boost::shared_ptr<google::protobuf::Message> > msgs_out = decode_in_chunks(codec, bytes, chunk_sizes[c]);
+        assert(msgs_out.size() == msgs_in.size());
+        for(unsigned i = 0, n = msgs_in.size(); i < n; ++i)
+        {
+            std::cout << "... got Message out:\n" << msgs_out[i]->DebugString() << std::endl;
+            assert(msgs_in[i]->SerializeAsString() == msgs_out[i]->SerializeAsString());
+        }
+    }
+
+    // messages are emitted as soon as they are complete, not at the end of the stream
+    {
+        std::string first;
+        codec.encode(&first, msg_in2);
+        dccl::StreamDecoder decoder(&codec);
+        unsigned decoded = decoder.push(first.substr(0, first.size() - 1));
+        assert(decoded == 0);
+        decoded = decoder.push(first.substr(first.size() - 1));
+        assert(decoded == 1);
+        boost::shared_ptr<google::protobuf::Message> msg_out = decoder.pop();
+        assert(msg_out->SerializeAsString() == msg_in2.SerializeAsString());
+        assert(decoder.empty());
+    }
+    
+    // waiting for the rest of a message is not counted as a decode failure, and NotEnoughBitsException reports the shortfall
+    {
+        codec.reset_stats();
+        std::string first;
+        codec.encode(&first, msg_in2);
+        decode_in_chunks(codec, first, 1);
+        const dccl::MessageStats& stats = codec.stats()[200];
+        assert(stats.decode_count == 1);
+        assert(stats.decode_failures[dccl::FAILURE_TRUNCATED] == 0);
+        
+        try
+        {
+            StreamMsg2 msg_out;
+            codec.decode(first.substr(0, first.size() - 1), &msg_out);
+            assert(false);
+        }
+        catch(dccl::NotEnoughBitsException& e)
+        {
+            std::cout << "Caught (as expected): " << e.what() << std::endl;
+            assert(e.bits_short() > 0);
+        }
+        assert(codec.stats()[200].decode_failures[dccl::FAILURE_TRUNCATED] == 1);
+    }
+    
+    // stream truncated partway through a message
+    {
+        dccl::StreamDecoder decoder(&codec);
+        std::string first;
+        codec.encode(&first, msg_in1);
+        decoder.push(first.substr(0, 2));
+        try
+        {
+            decoder.flush();
+            assert(false);
+        }
+        catch(dccl::Exception& e)
+        {
+            std::cout << "Caught (as expected): " << e.what() << std::endl;
+        }
+        assert(decoder.buffered_bytes() == 0);
+    }
+
+    // unknown identifier
+    {
+        dccl::Codec other_codec;
+        other_codec.load<StreamMsg1>();
+        dccl::StreamDecoder decoder(&other_codec);
+        try
+        {
+            std::string unknown;
+            codec.encode(&unknown, msg_in4);
+            decoder.push(unknown);
+            decoder.flush();
+            assert(false);
+        }
+        catch(dccl::Exception& e)
+        {
+            std::cout << "Caught (as expected): " << e.what() << std::endl;
+        }
+    }
+    
+    std::cout << "all tests passed" << std::endl;
+}
@@ -0,0 +1,166 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests the binary trace of encoded and decoded fields (Codec::enable_trace())
+
+#include <sstream>
+
+#include "dccl/codec.h"
+#include "test.pb.h"
+
+using namespace dccl::test;
+
+// checks the event for the field with the given number at the given depth
+const dccl::TraceEvent& find_event(const dccl::TraceBuffer& trace, std::size_t begin, int depth, int field_number)
+{
+    for(std::size_t i = begin, n = trace.size(); i < n; ++i)
+    {
+        if(trace[i].depth == depth && trace[i].field_number == field_number)
+            return trace[i];
+    }
+    assert(false);
+    return trace[0];
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::ALL, &std::cerr);
+
+    dccl::Codec codec;
+    codec.load<TraceMsg>();
+    assert(!codec.trace());
+
+    TraceMsg msg;
+    msg.set_vehicle(12);
+    msg.set_active(true);
+    msg.mutable_position()->set_lat(42.1234);
+    msg.mutable_position()->set_lon(-70.5678);
+    msg.add_depth(10);
+    msg.add_depth(999);
+    msg.set_note("hello");
+    
+    codec.enable_trace(64);
+    const dccl::TraceBuffer& trace = *codec.trace();
+    
+    std::string bytes;
+    codec.encode(&bytes, msg);
+    std::size_t encode_events = trace.size();
+    TraceMsg msg_out;
+    codec.decode(bytes, &msg_out);
+    assert(msg.SerializeAsString() == msg_out.SerializeAsString());
+
+    codec.trace_dump(trace, &std::cout);
+
+    // root message (head and body), 5 fields, 2 sub-message fields
+    assert(encode_events == 9);
+    assert(trace.size() == 2 * encode_events);
+
+    unsigned body_bits = 0;
+    for(int decode = 0; decode < 2; ++decode)
+    {
+        std::size_t begin = decode ? encode_events : 0;
+        for(std::size_t i = begin; i < begin + encode_events; ++i)
+        {
+            assert(trace[i].dccl_id == 3);
+            assert(!(trace[i].flags & dccl::TraceEvent::INCOMPLETE));
+            assert(static_cast<bool>(trace[i].flags & dccl::TraceEvent::DECODE) == static_cast<bool>(decode));
+        }
+        
+        // head: root then vehicle
+        assert(trace[begin].depth == 0 && (trace[begin].flags & dccl::TraceEvent::HEAD));
+        const dccl::TraceEvent& vehicle = trace[begin + 1];
+        assert(vehicle.field_number == 1 && (vehicle.flags & dccl::TraceEvent::HEAD));
+        assert(vehicle.bit_offset == 0 && vehicle.bit_width == 5);
+        assert(vehicle.codec_handle >= 0);
+        assert(dccl::FieldCodecManager::find_by_handle(vehicle.codec_handle)->name() == "dccl.default3");
+        
+        // body: root then the fields, each starting where the previous one ended
+        const dccl::TraceEvent& body = trace[begin + 2];
+        assert(body.depth == 0 && !(body.flags & dccl::TraceEvent::HEAD));
+        const dccl::TraceEvent& active = find_event(trace, begin + 2, 1, 2);
+        const dccl::TraceEvent& position = find_event(trace, begin + 2, 1, 3);
+        const dccl::TraceEvent& lat = find_event(trace, begin + 2, 2, 1);
+        const dccl::TraceEvent& lon = find_event(trace, begin + 2, 2, 2);
+        const dccl::TraceEvent& depth = find_event(trace, begin + 2, 1, 4);
+        const dccl::TraceEvent& note = find_event(trace, begin + 2, 1, 5);
+        assert(active.bit_offset == 0 && active.bit_width == 1);
+        assert(position.bit_offset == 1);
+        // presence bit of the optional message, then lat and lon
+        assert(lat.bit_width == 21 && lon.bit_width == 22);
+        assert(position.bit_width == 1 + 21 + 22);
+        assert(lat.bit_offset == position.bit_offset + 1);
+        assert(lon.bit_offset == lat.bit_offset + lat.bit_width);
+        assert(depth.bit_offset == position.bit_offset + position.bit_width);
+        assert(depth.flags & dccl::TraceEvent::REPEATED);
+        // 3 bit size prefix + 2 * 10 bits
+        assert(depth.bit_width == 3 + 2 * 10);
+        assert(note.bit_offset == depth.bit_offset + depth.bit_width);
+        assert(body.bit_width == note.bit_offset + note.bit_width);
+
+        if(!decode)
+            body_bits = body.bit_width;
+        else
+            assert(body.bit_width == body_bits);
+    }
+
+    // write and read back
+    std::stringstream ss;
+    trace.write(&ss);
+    assert(ss.str().size() == 24 + 32 * trace.size());
+    dccl::TraceBuffer trace_in(1);
+    trace_in.read(&ss);
+    assert(trace_in.size() == trace.size() && trace_in.recorded() == trace.recorded());
+    for(std::size_t i = 0, n = trace.size(); i < n; ++i)
+        assert(trace_in[i].field_number == trace[i].field_number && trace_in[i].bit_offset == trace[i].bit_offset && trace_in[i].cycles == trace[i].cycles);
+
+    // the ring buffer keeps the most recent events
+    for(int i = 0; i < 10; ++i)
+        codec.encode(&bytes, msg);
+    assert(trace.size() == 64 && trace.recorded() == 2 * encode_events + 10 * encode_events);
+    assert(trace[trace.size() - encode_events].depth == 0 && (trace[trace.size() - encode_events].flags & dccl::TraceEvent::HEAD));
+    ss.str("");
+    ss.clear();
+    trace.write(&ss);
+    trace_in.read(&ss);
+    assert(trace_in.size() == 64);
+    for(std::size_t i = 0, n = trace.size(); i < n; ++i)
+        assert(trace_in[i].field_number == trace[i].field_number && trace_in[i].bit_offset == trace[i].bit_offset);
+
+    // failed decodes are marked
+    codec.enable_trace(64);
+    try
+    {
+        codec.decode(bytes.substr(0, 4), &msg_out);
+        assert(false);
+    }
+    catch(dccl::Exception& e)
+    {
+        std::cout << "Caught (as expected): " << e.what() << std::endl;
+    }
+    codec.trace_dump(*codec.trace(), &std::cout);
+    assert(codec.trace()->size() && ((*codec.trace())[codec.trace()->size() - 1].flags & dccl::TraceEvent::INCOMPLETE));
+    
+    codec.disable_trace();
+    codec.encode(&bytes, msg);
+    assert(!codec.trace());
+
+    std::cout << "all tests passed" << std::endl;
+}
@@ -19,7 +19,13 @@
 //
 // You should have received a copy of the GNU Lesser General Public License
 // along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <sstream>
+#if __cplusplus >= 201103L
+#include <thread>
+#endif
+
 #include "dccl/logger.h"
+#include "dccl/async_log_sink.h"
 
 /// asserts false if called - used for testing proper short-circuiting of logger calls
 inline std::ostream& stream_assert(std::ostream & os)
@@ -94,6 +100,54 @@ int main(int argc, char* argv[])
     dlog.is(WARN) && dlog << "warn ok" << std::endl;
     dlog.disconnect(ALL);    
 
+
+#if __cplusplus >= 201103L
+    std::cout << "attaching AsyncLogSink to DEBUG1+" << std::endl;
+    {
+        std::stringstream ss;
+        dccl::AsyncLogSink sink(&ss, false);
+        dlog.connect(DEBUG1_PLUS, &sink, &dccl::AsyncLogSink::push);
+        dlog.is(DEBUG2) && dlog << stream_assert << std::endl;
+        dlog.is(DEBUG1, ENCODE) && dlog << "debug1 " << 1 << " ok" << std::endl;
+        dlog.is(WARN) && dlog << "warn ok\nsecond line ok" << std::endl;
+        dlog.disconnect(ALL);
+        sink.flush();
+        std::cout << ss.str();
+        assert(ss.str() == "{encode}: debug1 1 ok\nwarn ok\nsecond line ok\n");
+        assert(sink.dropped() == 0);
+    }
+
+    std::cout << "AsyncLogSink from several threads" << std::endl;
+    {
+        std::stringstream ss;
+        const int num_threads = 4, lines_per_thread = 10000;
+        int lines = 0;
+        dccl::uint64 dropped = 0;
+        {
+            dccl::AsyncLogSink sink(&ss, true, 64);
+            std::vector<std::thread> threads;
+            for(int i = 0; i < num_threads; ++i)
+                threads.push_back(std::thread([&sink, i]() {
+                            for(int j = 0; j < lines_per_thread; ++j)
+                                sink.push("line", DEBUG1, DECODE);
+                        }));
+            for(int i = 0; i < num_threads; ++i)
+                threads[i].join();
+            dropped = sink.dropped();
+        }
+        // every line was either written or counted as dropped
+        std::string line;
+        while(std::getline(ss, line))
+        {
+            if(line.find("{decode}: line") != std::string::npos)
+                ++lines;
+            else
+                assert(line.find("dropped") != std::string::npos);
+        }
+        std::cout << "wrote " << lines << ", dropped " << dropped << std::endl;
+        assert(lines + dropped == num_threads * lines_per_thread);
+    }
+#endif
     
     std::cout << "All tests passed." << std::endl;
 
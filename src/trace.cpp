@@ -0,0 +1,136 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif __cplusplus >= 201103L
+#include <chrono>
+#else
+#include <time.h>
+#endif
+
+#include "dccl/trace.h"
+#include "dccl/exception.h"
+
+namespace
+{
+    const char TRACE_MAGIC[8] = { 'D', 'C', 'C', 'L', 'T', 'R', 'C', '1' };
+    const int TRACE_EVENT_BYTES = 32;
+    
+    template<typename Int>
+    void put(char*& p, Int value)
+    {
+        for(unsigned i = 0; i < sizeof(Int); ++i)
+            *p++ = static_cast<char>((static_cast<dccl::uint64>(value) >> (8*i)) & 0xFF);
+    }
+
+    template<typename Int>
+    Int get(const char*& p)
+    {
+        dccl::uint64 value = 0;
+        for(unsigned i = 0; i < sizeof(Int); ++i)
+            value |= static_cast<dccl::uint64>(static_cast<unsigned char>(*p++)) << (8*i);
+        return static_cast<Int>(value);
+    }
+}
+
+dccl::TraceBuffer::TraceBuffer(std::size_t capacity)
+    : events_(capacity ? capacity : 1),
+      recorded_(0)
+{ }
+
+void dccl::TraceBuffer::write(std::ostream* os) const
+{
+    char header[sizeof(TRACE_MAGIC) + 16];
+    char* p = header;
+    std::memcpy(p, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    p += sizeof(TRACE_MAGIC);
+    put<uint64>(p, recorded_);
+    put<uint64>(p, size());
+    os->write(header, sizeof(header));
+    
+    for(std::size_t i = 0, n = size(); i < n; ++i)
+    {
+        const TraceEvent& event = (*this)[i];
+        char bytes[TRACE_EVENT_BYTES];
+        p = bytes;
+        put(p, event.dccl_id);
+        put(p, event.field_number);
+        put(p, event.bit_offset);
+        put(p, event.bit_width);
+        put(p, event.codec_handle);
+        put(p, event.depth);
+        put(p, event.flags);
+        put(p, event.cycles);
+        os->write(bytes, sizeof(bytes));
+    }
+}
+
+void dccl::TraceBuffer::read(std::istream* is)
+{
+    char header[sizeof(TRACE_MAGIC) + 16];
+    if(!is->read(header, sizeof(header)) || std::memcmp(header, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0)
+        throw(Exception("Not a DCCL trace (bad header)"));
+    
+    const char* p = header + sizeof(TRACE_MAGIC);
+    uint64 recorded = get<uint64>(p);
+    uint64 size = get<uint64>(p);
+    if(size > recorded)
+        throw(Exception("Not a DCCL trace (bad header)"));
+
+    // stored so that operator[] gives them back in the same order
+    std::vector<TraceEvent> events(size ? size : 1);
+    for(uint64 i = 0; i < size; ++i)
+    {
+        char bytes[TRACE_EVENT_BYTES];
+        if(!is->read(bytes, sizeof(bytes)))
+            throw(Exception("DCCL trace is truncated"));
+        p = bytes;
+        TraceEvent event;
+        event.dccl_id = get<uint32>(p);
+        event.field_number = get<int32>(p);
+        event.bit_offset = get<uint32>(p);
+        event.bit_width = get<uint32>(p);
+        event.codec_handle = get<int32>(p);
+        event.depth = get<boost::uint16_t>(p);
+        event.flags = get<boost::uint16_t>(p);
+        event.cycles = get<uint64>(p);
+        events[(recorded - size + i) % size] = event;
+    }
+
+    events_.swap(events);
+    recorded_ = recorded;
+}
+
+dccl::uint64 dccl::TraceBuffer::now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif __cplusplus >= 201103L
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return static_cast<uint64>(t.tv_sec) * 1000000000 + t.tv_nsec;
+#endif
+}
@@ -0,0 +1,111 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLTRACE20171028H
+#define DCCLTRACE20171028H
+
+#include <iostream>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "dccl/common.h"
+
+namespace dccl
+{
+    /// \brief One field encoded or decoded by a Codec with tracing enabled (see Codec::enable_trace()). Fixed size (32 bytes) so that tracing can be left on.
+    struct TraceEvent
+    {
+        enum Flags
+        {
+            /// event is from a decode (otherwise encode)
+            DECODE = 1 << 0,
+            /// field is repeated (one event for all the values)
+            REPEATED = 1 << 1,
+            /// field is in the header
+            HEAD = 1 << 2,
+            /// the field codec threw an exception (bit_width and cycles are not set)
+            INCOMPLETE = 1 << 3
+        };
+        
+        /// DCCL id of the (root) message
+        uint32 dccl_id;
+        /// field number within the enclosing (sub-)message, or 0 for the root message itself
+        int32 field_number;
+        /// offset of the field from the start of the message part (HEAD or BODY), not counting the identifier
+        uint32 bit_offset;
+        /// number of bits (for messages, including all the sub-message fields)
+        uint32 bit_width;
+        /// FieldCodecManager handle of the field codec (see FieldCodecBase::handle())
+        int32 codec_handle;
+        /// nesting depth: 0 for the root message, 1 for its fields, 2 for the fields of a sub-message, etc. Events are recorded in the order fields are started, so the fields of a sub-message follow the event for the sub-message field
+        boost::uint16_t depth;
+        /// bitwise OR of Flags
+        boost::uint16_t flags;
+        /// time spent encoding or decoding this field (including sub-message fields), in TraceBuffer::now() units (CPU cycles on x86, otherwise nanoseconds)
+        uint64 cycles;
+    };
+
+    /// \brief Preallocated ring buffer of TraceEvents. When full, the oldest events are overwritten so that the most recent history is always available.
+    class TraceBuffer : boost::noncopyable
+    {
+      public:
+        /// \brief Allocates space for `capacity` events
+        explicit TraceBuffer(std::size_t capacity);
+
+        std::size_t capacity() const { return events_.size(); }
+        /// \brief Number of events available (at most capacity())
+        std::size_t size() const
+        { return recorded_ < events_.size() ? recorded_ : events_.size(); }
+        /// \brief Number of events recorded since the last clear(), including those that have been overwritten
+        uint64 recorded() const { return recorded_; }
+        
+        /// \brief Event `i` of size(), oldest first
+        const TraceEvent& operator[](std::size_t i) const
+        { return events_[(recorded_ - size() + i) % events_.size()]; }
+
+        void clear() { recorded_ = 0; }
+
+        /// \brief The `n`th event recorded (only valid for the last capacity() events, i.e. n >= recorded() - size())
+        TraceEvent& recorded_event(uint64 n)
+        { return events_[n % events_.size()]; }
+
+        /// \brief Returns the slot for the next event (overwriting the oldest if full)
+        TraceEvent* next()
+        { return &events_[recorded_++ % events_.size()]; }
+
+        /// \brief Writes the events (oldest first) in a compact little-endian binary format, readable by read() (and `dccl --trace-dump`)
+        void write(std::ostream* os) const;
+        /// \brief Replaces the contents with the events read from `is` (as written by write()). The capacity becomes the number of events read.
+        /// \throw Exception if `is` does not contain a DCCL trace
+        void read(std::istream* is);
+
+        /// \brief Timestamp counter used for TraceEvent::cycles
+        static uint64 now();
+        
+      private:
+        std::vector<TraceEvent> events_;
+        uint64 recorded_;
+    };
+}
+
+#endif